@@ -0,0 +1,227 @@
+#include "breakpoint.hpp"
+
+#include <algorithm>
+
+bool breakpoint_manager::add(std::uint64_t addr) {
+    auto it = m_sites.find(addr);
+    if (it != m_sites.end()) {
+        if (it->second.wanted) {
+            return false;
+        }
+        it->second.wanted = true;   // deleted and set again before the next resume
+        m_dirty.push_back(addr);
+        return true;
+    }
+    m_sites.emplace(addr, site{});
+    m_dirty.push_back(addr);
+    return true;
+}
+
+bool breakpoint_manager::remove(std::uint64_t addr) {
+    auto it = m_sites.find(addr);
+    if (it == m_sites.end() || !it->second.wanted) {
+        return false;
+    }
+    if (it->second.inserted) {
+        it->second.wanted = false;  // the int3 goes away at the next sync()
+        m_dirty.push_back(addr);
+    } else {
+        m_sites.erase(it);
+    }
+    return true;
+}
+
+// what is not in the inferior just goes: the table never holds a site that is neither wanted nor inserted
+void breakpoint_manager::remove_all() {
+    for (auto it = m_sites.begin(); it != m_sites.end(); ) {
+        if (!it->second.inserted) {
+            it = m_sites.erase(it);
+            continue;
+        }
+        if (it->second.wanted) {
+            it->second.wanted = false;
+            m_dirty.push_back(it->first);
+        }
+        ++it;
+    }
+}
+
+std::vector<std::uint64_t> breakpoint_manager::restart(const std::function<std::uint64_t(std::uint64_t)>& move) {
+    std::vector<std::uint64_t> dropped;
+    std::unordered_map<std::uint64_t, site> sites;
+    m_dirty.clear();
+    for (const auto& entry : m_sites) {
+        if (!entry.second.wanted) {
+            continue;
+        }
+        std::uint64_t addr = move(entry.first);
+        if (addr == 0) {
+            dropped.push_back(entry.first);
+        } else {
+            sites.emplace(addr, site{});
+            m_dirty.push_back(addr);
+        }
+    }
+    m_sites.swap(sites);
+    std::sort(dropped.begin(), dropped.end());
+    return dropped;
+}
+
+std::vector<std::uint64_t> breakpoint_manager::addresses() const {
+    std::vector<std::uint64_t> result;
+    result.reserve(m_sites.size());
+    for (const auto& entry : m_sites) {
+        if (entry.second.wanted) {
+            result.push_back(entry.first);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool breakpoint_manager::contains(std::uint64_t addr) const {
+    auto it = m_sites.find(addr);
+    return it != m_sites.end() && it->second.wanted;
+}
+
+bool breakpoint_manager::inserted(std::uint64_t addr) const {
+    auto it = m_sites.find(addr);
+    return it != m_sites.end() && it->second.inserted;
+}
+
+std::vector<std::uint64_t> breakpoint_manager::sync() {
+    std::vector<std::uint64_t> failed;
+    if (m_dirty.empty()) {
+        return failed;
+    }
+    std::sort(m_dirty.begin(), m_dirty.end());
+    m_dirty.erase(std::unique(m_dirty.begin(), m_dirty.end()), m_dirty.end());
+
+    // one entry per aligned word that has at least one site to change
+    struct word {
+        std::uint64_t addr;
+        unsigned char bytes[8];
+    };
+    std::vector<word> words;
+    for (auto addr : m_dirty) {
+        std::uint64_t w = addr & ~std::uint64_t(7);
+        if (words.empty() || words.back().addr != w) {
+            words.push_back(word{w, {}});
+        }
+    }
+    std::vector<memory::request> reads;
+    reads.reserve(words.size());
+    for (auto& w : words) {
+        reads.push_back({w.addr, w.bytes, sizeof(w.bytes), 0});
+    }
+    m_memory.read(reads);
+
+    std::vector<std::uint64_t> retry;
+    for (std::size_t i = 0; i < words.size(); ++i) {
+        word& w = words[i];
+        std::size_t readable = reads[i].done;
+        bool changed = false;
+        for (std::size_t b = 0; b < readable; ++b) {
+            auto it = m_sites.find(w.addr + b);
+            if (it == m_sites.end()) {
+                continue;
+            }
+            site& s = it->second;
+            if (s.wanted && !s.inserted) {
+                s.saved = w.bytes[b];
+                w.bytes[b] = int3;
+                changed = true;
+            } else if (!s.wanted && s.inserted) {
+                w.bytes[b] = s.saved;
+                changed = true;
+            }
+        }
+        bool written = !changed || m_memory.write(w.addr, w.bytes, readable) == readable;
+        for (std::size_t b = 0; b < sizeof(w.bytes); ++b) {
+            auto it = m_sites.find(w.addr + b);
+            if (it == m_sites.end()) {
+                continue;
+            }
+            site& s = it->second;
+            if (s.inserted != s.wanted && b < readable && written) {
+                s.inserted = s.wanted;
+            } else if (s.inserted != s.wanted && s.wanted) {
+                failed.push_back(w.addr + b);
+                s.wanted = false;
+            }
+            // a site lifted to step over it and deleted meanwhile is gone as well
+            if (!s.wanted && !s.inserted) {
+                m_sites.erase(it);
+            } else if (!s.wanted) {
+                retry.push_back(w.addr + b);    // a removal we could not write, try again next time
+            }
+        }
+    }
+
+    m_dirty.swap(retry);
+    return failed;
+}
+
+bool breakpoint_manager::lift(std::uint64_t addr) {
+    auto it = m_sites.find(addr);
+    if (it == m_sites.end() || !it->second.inserted) {
+        return false;
+    }
+    if (m_memory.write(addr, &it->second.saved, 1) != 1) {
+        return false;
+    }
+    it->second.inserted = false;
+    return true;
+}
+
+bool breakpoint_manager::restore(std::uint64_t addr) {
+    auto it = m_sites.find(addr);
+    if (it == m_sites.end() || it->second.inserted || !it->second.wanted) {
+        return false;
+    }
+    unsigned char original = 0, patch = int3;
+    if (m_memory.read(addr, &original, 1) != 1 || m_memory.write(addr, &patch, 1) != 1) {
+        return false;
+    }
+    it->second.saved = original;
+    it->second.inserted = true;
+    return true;
+}
+
+void breakpoint_manager::shadow(std::uint64_t addr, void* buf, std::size_t len) const {
+    auto bytes = static_cast<unsigned char*>(buf);
+    // walk whichever is smaller: the bytes of the range or the breakpoint table
+    if (len <= m_sites.size()) {
+        for (std::size_t i = 0; i < len; ++i) {
+            auto it = m_sites.find(addr + i);
+            if (it != m_sites.end() && it->second.inserted) {
+                bytes[i] = it->second.saved;
+            }
+        }
+    } else {
+        for (const auto& entry : m_sites) {
+            if (entry.second.inserted && entry.first >= addr && entry.first - addr < len) {
+                bytes[entry.first - addr] = entry.second.saved;
+            }
+        }
+    }
+}
+
+void breakpoint_manager::prepare_write(std::uint64_t addr, unsigned char* buf, std::size_t len) {
+    if (len <= m_sites.size()) {
+        for (std::size_t i = 0; i < len; ++i) {
+            auto it = m_sites.find(addr + i);
+            if (it != m_sites.end() && it->second.inserted) {
+                it->second.saved = buf[i];
+                buf[i] = int3;
+            }
+        }
+    } else {
+        for (auto& entry : m_sites) {
+            if (entry.second.inserted && entry.first >= addr && entry.first - addr < len) {
+                entry.second.saved = buf[entry.first - addr];
+                buf[entry.first - addr] = int3;
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef TDB_BREAKPOINT_HPP
+#define TDB_BREAKPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "memory.hpp"
+
+// software breakpoints: an int3 (0xcc) over the first byte of an instruction
+//
+// sites stay inserted across stops, so a resume only has to patch what changed since the last one.
+// add() and remove() just record the wish; sync() applies all pending changes at once, with one
+// read and one write per 8-byte word of text, however many breakpoints share that word
+class breakpoint_manager {
+    public:
+        static const unsigned char int3 = 0xcc;
+
+        explicit breakpoint_manager(memory& mem) : m_memory(mem) {}
+
+        bool add(std::uint64_t addr);       // false if there already is a breakpoint at addr
+        bool remove(std::uint64_t addr);    // false if there is none
+        void remove_all();
+        // the program was started again, without any of our int3s: each breakpoint goes where `move` says
+        // (0 drops it) and in with the next sync(). returns the dropped addresses
+        std::vector<std::uint64_t> restart(const std::function<std::uint64_t(std::uint64_t)>& move);
+        bool contains(std::uint64_t addr) const;
+        std::vector<std::uint64_t> addresses() const;   // sorted
+
+        // is there an int3 in the inferior at addr right now
+        bool inserted(std::uint64_t addr) const;
+
+        // patch the inferior so that exactly the wanted breakpoints are inserted.
+        // returns the addresses that could not be patched (e.g. unmapped), those breakpoints are dropped
+        std::vector<std::uint64_t> sync();
+
+        // put the original byte back at one site / insert it again, used to step over a breakpoint
+        bool lift(std::uint64_t addr);
+        bool restore(std::uint64_t addr);
+
+        // replace the int3s in a buffer just read from [addr, addr + len) with the original bytes
+        void shadow(std::uint64_t addr, void* buf, std::size_t len) const;
+        // the user is about to write buf to [addr, addr + len): remember the new bytes under the sites
+        // we own and keep the int3s in place in buf
+        void prepare_write(std::uint64_t addr, unsigned char* buf, std::size_t len);
+
+    private:
+        struct site {
+            unsigned char saved = 0;    // the byte the int3 replaced, valid while inserted
+            bool inserted = false;
+            bool wanted = true;
+        };
+
+        memory& m_memory;
+        std::unordered_map<std::uint64_t, site> m_sites;
+        std::vector<std::uint64_t> m_dirty;     // sites where inserted != wanted, applied by sync()
+};
+
+#endif
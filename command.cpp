@@ -0,0 +1,64 @@
+#include "command.hpp"
+
+#include <charconv>
+
+bool parse_number(std::string_view s, std::uint64_t& value) {
+    bool negative = !s.empty() && s[0] == '-';
+    if (negative) {
+        s.remove_prefix(1);
+    }
+    int base = 10;
+    if (s.size() > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        base = 16;
+        s.remove_prefix(2);
+    } else if (s.size() > 1 && s[0] == '0') {
+        base = 8;
+        s.remove_prefix(1);
+    }
+    if (s.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(s.data(), s.data() + s.size(), value, base);
+    if (result.ec != std::errc{} || result.ptr != s.data() + s.size()) {
+        return false;
+    }
+    if (negative) {
+        value = -value;
+    }
+    return true;
+}
+
+command_args::command_args(std::string_view line) : m_line(line) {
+    std::size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && (line[i] == ' ' || line[i] == '\t')) {
+            ++i;
+        }
+        std::size_t start = i;
+        while (i < line.size() && line[i] != ' ' && line[i] != '\t') {
+            ++i;
+        }
+        if (i > start) {
+            m_words.push_back(line.substr(start, i - start));
+        }
+    }
+}
+
+std::string_view command_args::rest(std::size_t i) const {
+    if (i >= m_words.size()) {
+        return {};
+    }
+    std::size_t start = m_words[i].data() - m_line.data();
+    std::size_t end = m_words.back().data() + m_words.back().size() - m_line.data();
+    return m_line.substr(start, end - start);
+}
+
+bool command_args::is(std::size_t i, std::string_view full) const {
+    return i < m_words.size() && full.substr(0, m_words[i].size()) == m_words[i];
+}
+
+command_args command_args::from(std::size_t i) const {
+    command_args args {*this};
+    args.m_words.erase(args.m_words.begin(), args.m_words.begin() + std::min(i, m_words.size()));
+    return args;
+}
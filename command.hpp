@@ -0,0 +1,101 @@
+#ifndef TDB_COMMAND_HPP
+#define TDB_COMMAND_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// accepts 0x-prefixed hex, 0-prefixed octal and decimal (and a leading '-', wrapping around), like strtoull
+// with base 0
+bool parse_number(std::string_view s, std::uint64_t& value);
+
+// the words of a command line, as views into the line: nothing is copied. the line has to outlive them
+class command_args {
+    public:
+        explicit command_args(std::string_view line);
+
+        std::size_t size() const { return m_words.size(); }
+        bool empty() const { return m_words.empty(); }
+        // "" past the end
+        std::string_view operator[](std::size_t i) const { return i < m_words.size() ? m_words[i] : std::string_view{}; }
+        // the line from word i on, as typed: the spaces in a condition or an environment value stay
+        std::string_view rest(std::size_t i) const;
+        // word i as a number; false if there is no word i or it is not a number
+        bool number(std::size_t i, std::uint64_t& value) const { return i < m_words.size() && parse_number(m_words[i], value); }
+        // word i is `full` or a prefix of it
+        bool is(std::size_t i, std::string_view full) const;
+        // the words from i on, for a subcommand: its name is word 0
+        command_args from(std::size_t i) const;
+
+    private:
+        std::string_view m_line;
+        std::vector<std::string_view> m_words;
+};
+
+// the table behind a command interpreter: entries sorted by name (see sorted()), found by name, by an alias or
+// by a prefix only one name has. `Command` needs `name` and `alias` (empty for none) members that convert to
+// std::string_view; the rest (handler, usage, ...) is the interpreter's. the entries are a static array the
+// table only points into
+template <typename Command>
+class command_table {
+    public:
+        template <std::size_t N>
+        constexpr explicit command_table(const Command (&commands)[N]) : m_begin(commands), m_end(commands + N) {}
+
+        // for a static_assert where the table is defined: lookups are binary searches
+        constexpr bool sorted() const {
+            for (const Command* c = m_begin + 1; c < m_end; ++c) {
+                if (!(std::string_view(c[-1].name) < std::string_view(c->name))) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // nullptr if nothing matches or the prefix is ambiguous; `candidates` then gets the names it could be
+        const Command* find(std::string_view word, std::vector<std::string_view>* candidates = nullptr) const {
+            if (word.empty()) {
+                return nullptr;
+            }
+            for (const Command& c : *this) {
+                if (std::string_view(c.alias) == word) {
+                    return &c;
+                }
+            }
+            auto first = std::lower_bound(m_begin, m_end, word,
+                                          [](const Command& c, std::string_view w) { return std::string_view(c.name) < w; });
+            auto last = first;
+            while (last != m_end && std::string_view(last->name).substr(0, word.size()) == word) {
+                ++last;
+            }
+            if (first != last && (std::string_view(first->name) == word || last - first == 1)) {
+                return first;
+            }
+            for (auto it = first; candidates != nullptr && it != last; ++it) {
+                candidates->push_back(it->name);
+            }
+            return nullptr;
+        }
+
+        // the names starting with `prefix`, for completion
+        std::vector<std::string_view> complete(std::string_view prefix) const {
+            std::vector<std::string_view> names;
+            for (const Command& c : *this) {
+                if (std::string_view(c.name).substr(0, prefix.size()) == prefix) {
+                    names.push_back(c.name);
+                }
+            }
+            return names;
+        }
+
+        constexpr const Command* begin() const { return m_begin; }
+        constexpr const Command* end() const { return m_end; }
+
+    private:
+        const Command* m_begin;
+        const Command* m_end;
+};
+
+#endif
@@ -0,0 +1,332 @@
+#include "condition.hpp"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include "registers.hpp"
+
+namespace {
+    // one byte each, operands (if any) follow in little endian
+    enum opcode : std::uint8_t {
+        op_const,       // 8-byte immediate
+        op_const8,      // 1-byte immediate, for the small numbers conditions are full of
+        op_reg,         // 1-byte index of a 64-bit slot of user_regs_struct
+        op_load,        // 1-byte width: pops an address, pushes what is there
+        op_neg, op_not, op_bitnot,
+        op_mul, op_div, op_mod, op_add, op_sub, op_shl, op_shr,
+        op_lt, op_le, op_gt, op_ge, op_eq, op_ne,
+        op_and, op_xor, op_or,
+        op_bool,        // 0 or 1
+        op_jz_keep,     // 2-byte forward offset: if the top is 0 jump and keep it, else pop it
+        op_jnz_keep,    // same for non-zero, which becomes 1
+    };
+
+    // the deepest expression a condition may have; the stack lives in evaluate()'s frame
+    const int max_stack = 64;
+
+    struct binary_operator {
+        const char* token;
+        int precedence;
+        opcode op;
+    };
+
+    // longest tokens first, so that "<<" is not taken for "<"
+    const binary_operator binary_operators[] = {
+        {"||", 1, op_or}, {"&&", 2, op_and},
+        {"<<", 9, op_shl}, {">>", 9, op_shr},
+        {"==", 6, op_eq}, {"!=", 6, op_ne}, {"<=", 7, op_le}, {">=", 7, op_ge},
+        {"|", 3, op_or}, {"^", 4, op_xor}, {"&", 5, op_and},
+        {"<", 7, op_lt}, {">", 7, op_gt},
+        {"+", 10, op_add}, {"-", 10, op_sub},
+        {"*", 11, op_mul}, {"/", 11, op_div}, {"%", 11, op_mod},
+    };
+    const int logical_or = 1, logical_and = 2;
+}
+
+// recursive descent over the text, emitting code as it goes
+class condition_compiler {
+    public:
+        condition_compiler(std::string_view text, const condition::symbol_resolver& resolve, condition& out)
+            : m_text{text}, m_resolve{resolve}, m_out{out} {}
+
+        bool compile(std::string& error) {
+            m_out.m_code.clear();
+            bool ok = expression(0);
+            skip_space();
+            if (ok && m_pos != m_text.size()) {
+                ok = fail("unexpected " + std::string(m_text.substr(m_pos)));
+            }
+            if (!ok) {
+                error = m_error;
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        bool fail(const std::string& message) {
+            if (m_error.empty()) {
+                m_error = message;
+            }
+            return false;
+        }
+
+        void skip_space() {
+            while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos]))) {
+                ++m_pos;
+            }
+        }
+
+        bool take(std::string_view token) {
+            skip_space();
+            if (m_text.substr(m_pos, token.size()) != token) {
+                return false;
+            }
+            m_pos += token.size();
+            return true;
+        }
+
+        // effect: how many values op pushes (or pops, negative), to keep track of how deep the stack gets
+        void emit(opcode op, int effect) {
+            m_out.m_code.push_back(op);
+            m_depth += effect;
+        }
+
+        bool emit_const(std::uint64_t value) {
+            if (value < 256) {
+                emit(op_const8, 1);
+                m_out.m_code.push_back(static_cast<std::uint8_t>(value));
+            } else {
+                emit(op_const, 1);
+                for (int i = 0; i < 8; ++i) {
+                    m_out.m_code.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+                }
+            }
+            return m_depth <= max_stack || fail("expression too deep");
+        }
+
+        void emit_load(std::uint64_t width) {
+            emit(op_load, 0);
+            m_out.m_code.push_back(static_cast<std::uint8_t>(width));
+        }
+
+        // binary operators of at least min_precedence, by precedence climbing
+        bool expression(int min_precedence) {
+            if (!unary()) {
+                return false;
+            }
+            for (;;) {
+                skip_space();
+                const binary_operator* found = nullptr;
+                for (const auto& b : binary_operators) {
+                    if (m_text.substr(m_pos, std::strlen(b.token)) == b.token) {
+                        found = &b;
+                        break;
+                    }
+                }
+                if (found == nullptr || found->precedence < min_precedence) {
+                    return true;
+                }
+                m_pos += std::strlen(found->token);
+                if (found->precedence == logical_or || found->precedence == logical_and) {
+                    // a || b: if a is true the answer is 1 without looking at b
+                    std::size_t jump = m_out.m_code.size();
+                    emit(found->precedence == logical_or ? op_jnz_keep : op_jz_keep, -1);
+                    m_out.m_code.push_back(0);
+                    m_out.m_code.push_back(0);
+                    if (!expression(found->precedence + 1)) {
+                        return false;
+                    }
+                    emit(op_bool, 0);
+                    std::size_t offset = m_out.m_code.size() - (jump + 3);
+                    if (offset > 0xffff) {
+                        return fail("expression too long");
+                    }
+                    m_out.m_code[jump + 1] = static_cast<std::uint8_t>(offset);
+                    m_out.m_code[jump + 2] = static_cast<std::uint8_t>(offset >> 8);
+                    continue;
+                }
+                if (!expression(found->precedence + 1)) {
+                    return false;
+                }
+                emit(found->op, -1);
+            }
+        }
+
+        bool unary() {
+            skip_space();
+            if (take("!")) {
+                return unary() && (emit(op_not, 0), true);
+            } else if (take("~")) {
+                return unary() && (emit(op_bitnot, 0), true);
+            } else if (take("-")) {
+                return unary() && (emit(op_neg, 0), true);
+            } else if (take("*")) {
+                return unary() && (emit_load(8), true);
+            }
+            return primary();
+        }
+
+        bool primary() {
+            skip_space();
+            if (take("(")) {
+                return expression(0) && (take(")") || fail("missing )"));
+            }
+            if (m_pos >= m_text.size()) {
+                return fail("expression expected");
+            }
+            char c = m_text[m_pos];
+            if (std::isdigit(static_cast<unsigned char>(c))) {
+                std::string digits;
+                while (m_pos < m_text.size() && std::isalnum(static_cast<unsigned char>(m_text[m_pos]))) {
+                    digits += m_text[m_pos++];
+                }
+                char* end = nullptr;
+                std::uint64_t value = std::strtoull(digits.c_str(), &end, 0);
+                if (*end != '\0') {
+                    return fail("bad number " + digits);
+                }
+                return emit_const(value);
+            }
+            bool dollar = c == '$';
+            std::size_t start = dollar ? ++m_pos : m_pos;
+            while (m_pos < m_text.size() && (std::isalnum(static_cast<unsigned char>(m_text[m_pos])) || m_text[m_pos] == '_'
+                                              || m_text.substr(m_pos, 2) == "::")) {
+                m_pos += m_text[m_pos] == ':' ? 2 : 1;
+            }
+            std::string_view name = m_text.substr(start, m_pos - start);
+            if (name.empty()) {
+                return fail(std::string("unexpected ") + c);
+            }
+            if (!dollar && (name == "u8" || name == "u16" || name == "u32" || name == "u64") && take("[")) {
+                if (!expression(0) || !(take("]") || fail("missing ]"))) {
+                    return false;
+                }
+                emit_load(name == "u8" ? 1 : name == "u16" ? 2 : name == "u32" ? 4 : 8);
+                return true;
+            }
+            if (const register_cache::info* reg = register_cache::find(name)) {
+                emit(op_reg, 1);
+                m_out.m_code.push_back(static_cast<std::uint8_t>(reg->offset / 8));
+                return m_depth <= max_stack || fail("expression too deep");
+            }
+            std::uint64_t addr = 0, size = 0;
+            if (dollar || !m_resolve || !m_resolve(name, addr, size)) {
+                return fail("no register or variable " + std::string(name));
+            }
+            if (size != 1 && size != 2 && size != 4) {
+                size = 8;
+            }
+            if (!emit_const(addr)) {
+                return false;
+            }
+            emit_load(size);
+            return true;
+        }
+
+        std::string_view m_text;
+        std::size_t m_pos = 0;
+        const condition::symbol_resolver& m_resolve;
+        condition& m_out;
+        int m_depth = 0;
+        std::string m_error;
+};
+
+bool condition::compile(std::string_view text, const symbol_resolver& resolve, condition& out, std::string& error) {
+    condition compiled;
+    compiled.m_text = std::string(text);
+    condition_compiler compiler {text, resolve, compiled};
+    if (!compiler.compile(error)) {
+        return false;
+    }
+    out = std::move(compiled);
+    return true;
+}
+
+bool condition::evaluate(const user_regs_struct& regs, const memory_reader& read, std::uint64_t& result) const {
+    std::uint64_t stack[max_stack] = {};
+    std::size_t top = 0;    // stack[top - 1] is the top
+    const std::uint8_t* code = m_code.data();
+    const std::uint8_t* end = code + m_code.size();
+    const std::uint8_t* ip = code;
+    while (ip < end) {
+        std::uint8_t op = *ip++;
+        std::uint64_t b = top > 0 ? stack[top - 1] : 0;
+        std::uint64_t& a = stack[top >= 2 ? top - 2 : 0];
+        std::int64_t sa = static_cast<std::int64_t>(a), sb = static_cast<std::int64_t>(b);
+        switch (op) {
+            case op_const: {
+                std::uint64_t value = 0;
+                for (int i = 0; i < 8; ++i) {
+                    value |= static_cast<std::uint64_t>(ip[i]) << (8 * i);
+                }
+                ip += 8;
+                stack[top++] = value;
+                break;
+            }
+            case op_const8:
+                stack[top++] = *ip++;
+                break;
+            case op_reg: {
+                std::uint64_t value;
+                std::memcpy(&value, reinterpret_cast<const char*>(&regs) + 8 * *ip++, sizeof(value));
+                stack[top++] = value;
+                break;
+            }
+            case op_load: {
+                std::size_t width = *ip++;
+                std::uint64_t value = 0;
+                if (read(b, &value, width) < width) {
+                    return false;
+                }
+                stack[top - 1] = value;
+                break;
+            }
+            case op_neg: stack[top - 1] = -b; break;
+            case op_not: stack[top - 1] = b == 0; break;
+            case op_bitnot: stack[top - 1] = ~b; break;
+            case op_bool: stack[top - 1] = b != 0; break;
+            case op_div:
+            case op_mod:
+                if (b == 0 || (sa == INT64_MIN && sb == -1)) {
+                    return false;
+                }
+                a = op == op_div ? sa / sb : sa % sb;
+                --top;
+                break;
+            case op_mul: a *= b; --top; break;
+            case op_add: a += b; --top; break;
+            case op_sub: a -= b; --top; break;
+            case op_shl: a = b < 64 ? a << b : 0; --top; break;
+            case op_shr: a = static_cast<std::uint64_t>(sa >> (b < 64 ? b : 63)); --top; break;
+            case op_lt: a = sa < sb; --top; break;
+            case op_le: a = sa <= sb; --top; break;
+            case op_gt: a = sa > sb; --top; break;
+            case op_ge: a = sa >= sb; --top; break;
+            case op_eq: a = a == b; --top; break;
+            case op_ne: a = a != b; --top; break;
+            case op_and: a &= b; --top; break;
+            case op_xor: a ^= b; --top; break;
+            case op_or: a |= b; --top; break;
+            case op_jz_keep:
+            case op_jnz_keep: {
+                std::size_t offset = ip[0] | ip[1] << 8;
+                ip += 2;
+                if ((b != 0) == (op == op_jnz_keep)) {
+                    stack[top - 1] = b != 0;
+                    ip += offset;
+                } else {
+                    --top;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    if (top != 1) {
+        return false;
+    }
+    result = stack[0];
+    return true;
+}
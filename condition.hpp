@@ -0,0 +1,43 @@
+#ifndef TDB_CONDITION_HPP
+#define TDB_CONDITION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/user.h>
+
+// the condition of a conditional breakpoint, compiled once when the breakpoint is set into bytecode
+// for a small stack machine, so that a hit costs one pass over a few bytes instead of parsing text.
+//
+// the language is C's integer expressions over 64-bit values: literals, registers ($rax or rax),
+// global variables (read with their own size when it is 1, 2, 4 or 8 bytes), `*expr` (an 8-byte load),
+// `u8[expr]` ... `u64[expr]` (loads of that width), parentheses and the operators
+//     ! ~ - (unary)   * / %   + -   << >>   < <= > >=   == !=   &   ^   |   &&   ||
+// comparisons, division and >> are signed, && and || short-circuit
+class condition {
+    public:
+        // the run-time address and size of a global; false if there is none
+        using symbol_resolver = std::function<bool(std::string_view name, std::uint64_t& addr, std::uint64_t& size)>;
+        // reads inferior memory, same contract as memory::read
+        using memory_reader = std::function<std::size_t(std::uint64_t addr, void* buf, std::size_t len)>;
+
+        // false and a message in `error` if text is not a valid expression
+        static bool compile(std::string_view text, const symbol_resolver& resolve, condition& out, std::string& error);
+
+        // false if the expression cannot be evaluated (unreadable memory, division by zero)
+        bool evaluate(const user_regs_struct& regs, const memory_reader& read, std::uint64_t& result) const;
+
+        const std::string& text() const { return m_text; }
+        std::size_t code_size() const { return m_code.size(); }
+
+    private:
+        friend class condition_compiler;
+
+        std::string m_text;
+        std::vector<std::uint8_t> m_code;
+};
+
+#endif
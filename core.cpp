@@ -0,0 +1,502 @@
+#include "core.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/procfs.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    const std::uint64_t page_size = 4096;
+    const std::size_t chunk_size = 8 << 20;
+
+    static_assert(sizeof(elf_gregset_t) == sizeof(user_regs_struct), "pr_reg is a user_regs_struct");
+    static_assert(sizeof(elf_fpregset_t) == sizeof(user_fpregs_struct), "NT_FPREGSET is a user_fpregs_struct");
+
+    struct mapping {
+        std::uint64_t start, end;
+        int prot;
+        std::uint64_t offset;
+        std::string path;
+    };
+
+    std::vector<mapping> read_maps(pid_t pid) {
+        std::vector<mapping> maps;
+        std::ifstream in {"/proc/" + std::to_string(pid) + "/maps"};
+        for (std::string line; std::getline(in, line); ) {
+            // 7f0c1a2b3000-7f0c1a2d5000 r-xp 00000000 08:01 1234   /usr/lib/libc.so.6
+            std::istringstream fields {line};
+            std::string range, perms, offset, dev, inode;
+            if (!(fields >> range >> perms >> offset >> dev >> inode) || perms.size() < 3) {
+                continue;
+            }
+            mapping m;
+            auto dash = range.find('-');
+            m.start = std::stoull(range.substr(0, dash), nullptr, 16);
+            m.end = std::stoull(range.substr(dash + 1), nullptr, 16);
+            m.prot = (perms[0] == 'r' ? PROT_READ : 0) | (perms[1] == 'w' ? PROT_WRITE : 0)
+                     | (perms[2] == 'x' ? PROT_EXEC : 0);
+            m.offset = std::stoull(offset, nullptr, 16);
+            std::getline(fields >> std::ws, m.path);
+            maps.push_back(m);
+        }
+        return maps;
+    }
+
+    std::string read_file(const std::string& path) {
+        std::ifstream in {path, std::ios::binary};
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    // a note: its header, "CORE" and the descriptor, each padded to 4 bytes
+    void add_note(std::string& notes, std::uint32_t type, const void* desc, std::size_t size) {
+        Elf64_Nhdr header {5, static_cast<Elf64_Word>(size), type};
+        notes.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        notes.append("CORE\0\0\0", 8);
+        notes.append(static_cast<const char*>(desc), size);
+        notes.append((4 - size % 4) % 4, '\0');
+    }
+
+    // state, ppid, pgrp and session from /proc/<pid>/stat, whose second field (the name) may hold anything
+    void read_stat(pid_t pid, prpsinfo_t& info) {
+        std::string stat = read_file("/proc/" + std::to_string(pid) + "/stat");
+        auto paren = stat.rfind(')');
+        if (paren == std::string::npos) {
+            return;
+        }
+        std::istringstream fields {stat.substr(paren + 1)};
+        char state = 0;
+        int ppid = 0, pgrp = 0, sid = 0;
+        fields >> state >> ppid >> pgrp >> sid;
+        static const char states[] = "RSDTZW";
+        const char* s = std::strchr(states, state);
+        info.pr_state = s != nullptr && state != 0 ? s - states : 0;
+        info.pr_sname = state;
+        info.pr_zomb = state == 'Z';
+        info.pr_ppid = ppid;
+        info.pr_pgrp = pgrp;
+        info.pr_sid = sid;
+    }
+
+    std::string build_notes(pid_t pid, const std::vector<core_thread>& threads, const std::vector<mapping>& maps) {
+        std::string notes;
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            const core_thread& t = threads[i];
+            prstatus_t status;
+            std::memset(&status, 0, sizeof(status));
+            status.pr_info.si_signo = t.signal;
+            status.pr_cursig = t.signal;
+            status.pr_pid = t.tid;
+            std::memcpy(&status.pr_reg, &t.regs, sizeof(status.pr_reg));
+            status.pr_fpvalid = t.has_fp_regs;
+            add_note(notes, NT_PRSTATUS, &status, sizeof(status));
+            if (t.has_fp_regs) {
+                add_note(notes, NT_FPREGSET, &t.fp_regs, sizeof(t.fp_regs));
+            }
+            if (i == 0) {
+                // after the first thread, as the kernel has it
+                prpsinfo_t info;
+                std::memset(&info, 0, sizeof(info));
+                info.pr_pid = pid;
+                read_stat(pid, info);
+                std::string comm = read_file("/proc/" + std::to_string(pid) + "/comm");
+                if (!comm.empty() && comm.back() == '\n') {
+                    comm.pop_back();
+                }
+                std::strncpy(info.pr_fname, comm.c_str(), sizeof(info.pr_fname));
+                std::string args = read_file("/proc/" + std::to_string(pid) + "/cmdline");
+                for (auto& c : args) {
+                    c = c == '\0' ? ' ' : c;
+                }
+                std::strncpy(info.pr_psargs, args.c_str(), sizeof(info.pr_psargs) - 1);
+                add_note(notes, NT_PRPSINFO, &info, sizeof(info));
+            }
+        }
+        std::string auxv = read_file("/proc/" + std::to_string(pid) + "/auxv");
+        if (!auxv.empty()) {
+            add_note(notes, NT_AUXV, auxv.data(), auxv.size());
+        }
+        // NT_FILE: the number of files and the page size, their ranges (start, end, offset in pages), their names
+        std::vector<std::uint64_t> ranges;
+        std::string names;
+        for (const auto& m : maps) {
+            if (!m.path.empty() && m.path[0] == '/') {
+                ranges.insert(ranges.end(), {m.start, m.end, m.offset / page_size});
+                names.append(m.path).push_back('\0');
+            }
+        }
+        std::string files;
+        std::uint64_t header[] = {ranges.size() / 3, page_size};
+        files.append(reinterpret_cast<const char*>(header), sizeof(header));
+        files.append(reinterpret_cast<const char*>(ranges.data()), ranges.size() * sizeof(ranges[0]));
+        files += names;
+        add_note(notes, NT_FILE, files.data(), files.size());
+        return notes;
+    }
+
+    bool zero(const char* page) {
+        const std::uint64_t* words = reinterpret_cast<const std::uint64_t*>(page);
+        for (std::size_t i = 0; i < page_size / sizeof(std::uint64_t); ++i) {
+            if (words[i] != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the whole file, read-only; nullptr with the reason in `error`
+    const char* map_file(const std::string& path, std::size_t& size, std::string& error) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            error = std::strerror(errno);
+            return nullptr;
+        }
+        struct stat st;
+        void* data = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        error = data == MAP_FAILED ? (st.st_size == 0 ? "empty file" : std::strerror(errno)) : "";
+        close(fd);
+        size = data == MAP_FAILED ? 0 : st.st_size;
+        return data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+    }
+
+    bool write_all(int fd, const char* buf, std::size_t len, std::uint64_t offset) {
+        while (len > 0) {
+            ssize_t n = pwrite(fd, buf, len, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            buf += n;
+            len -= n;
+            offset += n;
+        }
+        return true;
+    }
+}
+
+bool write_core(const std::string& path, pid_t pid, const std::vector<core_thread>& threads, memory& mem,
+                const std::function<void(std::uint64_t addr, void* buf, std::size_t len)>& shadow,
+                const std::map<std::uint64_t, int>& protections, core_summary& summary, std::string& error) {
+    // pages protected for watchpoints are mappings of their own in /proc/<pid>/maps. they get back the
+    // protection they have for the program, and join up again with the pieces they were split from
+    std::vector<mapping> maps;
+    bool last_ours = false;
+    for (const auto& m : read_maps(pid)) {
+        // the vsyscall page is no part of the process, and vvar can't be read from outside
+        if (m.path == "[vsyscall]" || m.path.compare(0, 5, "[vvar") == 0) {
+            continue;
+        }
+        for (std::uint64_t at = m.start; at < m.end; ) {
+            auto own = protections.lower_bound(at);
+            bool ours = own != protections.end() && own->first == at;
+            mapping piece = m;
+            piece.start = at;
+            piece.end = ours ? at + page_size : own != protections.end() && own->first < m.end ? own->first : m.end;
+            piece.prot = ours ? own->second : m.prot;
+            piece.offset = m.offset + (at - m.start);
+            mapping* last = maps.empty() ? nullptr : &maps.back();
+            if ((ours || last_ours) && last != nullptr && last->end == piece.start && last->prot == piece.prot
+                    && last->path == piece.path && last->offset + (last->end - last->start) == piece.offset) {
+                last->end = piece.end;
+            } else {
+                maps.push_back(piece);
+            }
+            last_ours = ours;
+            at = piece.end;
+        }
+    }
+    std::string notes = build_notes(pid, threads, maps);
+
+    Elf64_Ehdr header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_NONE;
+    header.e_type = ET_CORE;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_phoff = sizeof(header);
+    header.e_ehsize = sizeof(header);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = 1 + maps.size();
+
+    // the notes right after the headers, the memory from the next page on, one segment after the other
+    std::vector<Elf64_Phdr> segments(header.e_phnum);
+    std::memset(segments.data(), 0, segments.size() * sizeof(Elf64_Phdr));
+    segments[0].p_type = PT_NOTE;
+    segments[0].p_offset = sizeof(header) + segments.size() * sizeof(Elf64_Phdr);
+    segments[0].p_filesz = notes.size();
+    std::uint64_t offset = (segments[0].p_offset + notes.size() + page_size - 1) & ~(page_size - 1);
+    for (std::size_t i = 0; i < maps.size(); ++i) {
+        const mapping& m = maps[i];
+        Elf64_Phdr& p = segments[i + 1];
+        p.p_type = PT_LOAD;
+        p.p_flags = (m.prot & PROT_READ ? PF_R : 0) | (m.prot & PROT_WRITE ? PF_W : 0) | (m.prot & PROT_EXEC ? PF_X : 0);
+        p.p_vaddr = m.start;
+        p.p_memsz = m.end - m.start;
+        p.p_filesz = m.prot & PROT_READ ? p.p_memsz : 0;    // what can't be read is only described
+        p.p_offset = offset;
+        p.p_align = page_size;
+        offset += p.p_filesz;
+    }
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    std::string head(reinterpret_cast<const char*>(&header), sizeof(header));
+    head.append(reinterpret_cast<const char*>(segments.data()), segments.size() * sizeof(Elf64_Phdr));
+    head += notes;
+    bool ok = write_all(fd, head.data(), head.size(), 0);
+
+    std::vector<char> chunk(chunk_size);
+    for (std::size_t i = 1; ok && i < segments.size(); ++i) {
+        const Elf64_Phdr& p = segments[i];
+        std::uint64_t done = 0;
+        summary.segments++;
+        while (ok && done < p.p_filesz) {
+            std::size_t want = std::min<std::uint64_t>(chunk.size(), p.p_filesz - done);
+            std::size_t got = mem.read(p.p_vaddr + done, chunk.data(), want) & ~(page_size - 1);
+            shadow(p.p_vaddr + done, chunk.data(), got);
+            // runs of pages that aren't all zero, one pwrite each
+            for (std::size_t page = 0; ok && page < got; ) {
+                if (zero(&chunk[page])) {
+                    summary.holes += page_size;
+                    page += page_size;
+                    continue;
+                }
+                std::size_t end = page + page_size;
+                while (end < got && !zero(&chunk[end])) {
+                    end += page_size;
+                }
+                ok = write_all(fd, &chunk[page], end - page, p.p_offset + done + page);
+                summary.written += end - page;
+                page = end;
+            }
+            if (got < want) {
+                summary.holes += page_size;     // a page the process has mapped but can't be read: zeros
+                got += page_size;
+            }
+            done += got;
+        }
+    }
+    // the holes at the end are part of the file too
+    ok = ok && ftruncate(fd, offset) == 0;
+    if (!ok) {
+        error = std::strerror(errno);
+    }
+    close(fd);
+    return ok;
+}
+
+bool core_file::is_core(const std::string& path) {
+    std::ifstream in {path, std::ios::binary};
+    Elf64_Ehdr header;
+    return in.read(reinterpret_cast<char*>(&header), sizeof(header)) && std::memcmp(header.e_ident, ELFMAG, SELFMAG) == 0
+           && header.e_ident[EI_CLASS] == ELFCLASS64 && header.e_type == ET_CORE;
+}
+
+// the page tables fill in as memory is looked at, so a core of gigabytes opens as fast as a small one
+std::unique_ptr<core_file> core_file::open(const std::string& path) {
+    std::unique_ptr<core_file> core {new core_file};
+    std::string error;
+    core->m_data = map_file(path, core->m_size, error);
+    if (core->m_data == nullptr) {
+        std::cerr << "cannot map " << path << ": " << error << std::endl;
+        return nullptr;
+    }
+    Elf64_Ehdr header;
+    if (core->m_size < sizeof(header)) {
+        std::cerr << path << ": not a core file" << std::endl;
+        return nullptr;
+    }
+    std::memcpy(&header, core->m_data, sizeof(header));
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0 || header.e_ident[EI_CLASS] != ELFCLASS64
+            || header.e_type != ET_CORE || header.e_machine != EM_X86_64) {
+        std::cerr << path << ": not an x86-64 core file" << std::endl;
+        return nullptr;
+    }
+    if (header.e_phentsize != sizeof(Elf64_Phdr) || header.e_phoff + header.e_phnum * sizeof(Elf64_Phdr) > core->m_size) {
+        std::cerr << path << ": truncated program headers" << std::endl;
+        return nullptr;
+    }
+    auto phdrs = reinterpret_cast<const Elf64_Phdr*>(core->m_data + header.e_phoff);
+    for (std::size_t i = 0; i < header.e_phnum; ++i) {
+        const Elf64_Phdr& p = phdrs[i];
+        if (p.p_type == PT_LOAD && p.p_memsz != 0) {
+            // a core cut short (a full disk, a ulimit) still has its first segments
+            std::uint64_t filesz = p.p_offset < core->m_size ? std::min(p.p_filesz, core->m_size - p.p_offset) : 0;
+            core->m_segments.push_back(segment{p.p_vaddr, p.p_memsz, p.p_offset, filesz});
+        } else if (p.p_type == PT_NOTE && p.p_offset < core->m_size) {
+            core->read_notes(std::string_view{core->m_data + p.p_offset, std::min(p.p_filesz, core->m_size - p.p_offset)});
+        }
+    }
+    if (core->m_threads.empty()) {
+        std::cerr << path << ": no threads in the core" << std::endl;
+        return nullptr;
+    }
+    if (core->m_pid == 0) {
+        core->m_pid = core->m_threads.front().tid;
+    }
+    std::sort(core->m_segments.begin(), core->m_segments.end(),
+              [](const segment& a, const segment& b) { return a.vaddr < b.vaddr; });
+    for (auto& f : core->m_files) {
+        for (std::size_t i = 0; i < header.e_phnum; ++i) {
+            const Elf64_Phdr& p = phdrs[i];
+            if (p.p_type == PT_LOAD && f.start >= p.p_vaddr && f.start - p.p_vaddr < p.p_memsz) {
+                f.executable = p.p_flags & PF_X;
+                break;
+            }
+        }
+    }
+    std::sort(core->m_files.begin(), core->m_files.end(),
+              [](const mapped_file& a, const mapped_file& b) { return a.start < b.start; });
+    core->m_backing.resize(core->m_files.size());
+    return core;
+}
+
+core_file::~core_file() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    for (const auto& b : m_backing) {
+        if (b.data != nullptr) {
+            munmap(const_cast<char*>(b.data), b.size);
+        }
+    }
+}
+
+void core_file::read_notes(std::string_view notes) {
+    while (notes.size() >= sizeof(Elf64_Nhdr)) {
+        Elf64_Nhdr header;
+        std::memcpy(&header, notes.data(), sizeof(header));
+        std::size_t name_size = (header.n_namesz + 3) & ~std::size_t{3};
+        std::size_t desc_size = (header.n_descsz + 3) & ~std::size_t{3};
+        if (sizeof(header) + name_size + header.n_descsz > notes.size()) {
+            break;
+        }
+        std::string_view name = notes.substr(sizeof(header), header.n_namesz);
+        std::string_view desc = notes.substr(sizeof(header) + name_size, header.n_descsz);
+        notes.remove_prefix(std::min(notes.size(), sizeof(header) + name_size + desc_size));
+        if (name != std::string_view{"CORE", 5}) {
+            continue;   // "LINUX": the XSAVE area and the like
+        }
+        if (header.n_type == NT_PRSTATUS && desc.size() >= sizeof(prstatus_t)) {
+            prstatus_t status;
+            std::memcpy(&status, desc.data(), sizeof(status));
+            core_thread t;
+            std::memset(&t, 0, sizeof(t));
+            t.tid = status.pr_pid;
+            std::memcpy(&t.regs, &status.pr_reg, sizeof(t.regs));
+            t.signal = status.pr_cursig;
+            m_threads.push_back(t);
+        } else if (header.n_type == NT_FPREGSET && desc.size() >= sizeof(user_fpregs_struct) && !m_threads.empty()) {
+            // right after the NT_PRSTATUS of its thread
+            std::memcpy(&m_threads.back().fp_regs, desc.data(), sizeof(user_fpregs_struct));
+            m_threads.back().has_fp_regs = true;
+        } else if (header.n_type == NT_PRPSINFO && desc.size() >= sizeof(prpsinfo_t)) {
+            prpsinfo_t info;
+            std::memcpy(&info, desc.data(), sizeof(info));
+            m_pid = info.pr_pid;
+            m_command.assign(info.pr_psargs, strnlen(info.pr_psargs, sizeof(info.pr_psargs)));
+            while (!m_command.empty() && m_command.back() == ' ') {
+                m_command.pop_back();
+            }
+        } else if (header.n_type == NT_AUXV) {
+            m_auxv = desc;
+        } else if (header.n_type == NT_FILE && desc.size() >= 2 * sizeof(std::uint64_t)) {
+            // the number of files and the page size, their ranges (start, end, offset in pages), their names
+            std::uint64_t count, page;
+            std::memcpy(&count, desc.data(), sizeof(count));
+            std::memcpy(&page, desc.data() + sizeof(count), sizeof(page));
+            std::size_t ranges = 2 * sizeof(std::uint64_t);
+            if (count > (desc.size() - ranges) / (3 * sizeof(std::uint64_t))) {
+                continue;
+            }
+            std::string_view names = desc.substr(ranges + count * 3 * sizeof(std::uint64_t));
+            for (std::uint64_t i = 0; i < count && !names.empty(); ++i) {
+                std::uint64_t range[3];
+                std::memcpy(range, desc.data() + ranges + i * sizeof(range), sizeof(range));
+                std::string_view path = names.substr(0, names.find('\0'));
+                names.remove_prefix(std::min(names.size(), path.size() + 1));
+                m_files.push_back(mapped_file{range[0], range[1], range[2] * page, std::string{path}, false});
+            }
+        }
+    }
+}
+
+std::uint64_t core_file::aux_value(std::uint64_t type) const {
+    std::uint64_t entry[2];
+    for (std::size_t at = 0; at + sizeof(entry) <= m_auxv.size(); at += sizeof(entry)) {
+        std::memcpy(entry, m_auxv.data() + at, sizeof(entry));
+        if (entry[0] == type) {
+            return entry[1];
+        }
+    }
+    return 0;
+}
+
+std::string_view core_file::view(std::uint64_t addr, std::size_t len) const {
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), addr,
+                               [](std::uint64_t addr, const segment& s) { return addr < s.vaddr; });
+    if (it == m_segments.begin() || addr - std::prev(it)->vaddr >= std::prev(it)->memsz) {
+        return {};
+    }
+    const segment& s = *std::prev(it);
+    std::uint64_t in = addr - s.vaddr;
+    len = std::min<std::uint64_t>(len, s.memsz - in);
+    if (in < s.filesz) {
+        return std::string_view{m_data + s.offset + in, std::min<std::uint64_t>(len, s.filesz - in)};
+    }
+    return file_view(addr, len);
+}
+
+std::size_t core_file::read(std::uint64_t addr, void* buf, std::size_t len) const {
+    std::size_t done = 0;
+    while (done < len) {
+        std::string_view bytes = view(addr + done, len - done);
+        if (bytes.empty()) {
+            break;
+        }
+        std::memcpy(static_cast<char*>(buf) + done, bytes.data(), bytes.size());
+        done += bytes.size();
+    }
+    return done;
+}
+
+// memory that is in no segment's part of the file, from the file mapped there
+std::string_view core_file::file_view(std::uint64_t addr, std::size_t len) const {
+    auto it = std::upper_bound(m_files.begin(), m_files.end(), addr,
+                               [](std::uint64_t addr, const mapped_file& f) { return addr < f.start; });
+    if (it == m_files.begin() || addr >= std::prev(it)->end) {
+        return {};
+    }
+    const mapped_file& f = *std::prev(it);
+    backing& b = m_backing[std::prev(it) - m_files.begin()];
+    if (!b.tried) {
+        b.tried = true;
+        std::string error;
+        b.data = map_file(f.path, b.size, error);
+    }
+    std::uint64_t offset = f.offset + (addr - f.start);
+    if (b.data == nullptr || offset >= b.size) {
+        return {};
+    }
+    return std::string_view{b.data + offset, std::min<std::uint64_t>({len, f.end - addr, b.size - offset})};
+}
@@ -0,0 +1,106 @@
+#ifndef TDB_CORE_HPP
+#define TDB_CORE_HPP
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+#include "memory.hpp"
+
+// ELF core files, the kind the kernel writes and gdb reads: a PT_NOTE segment with the registers of every
+// thread (NT_PRSTATUS, NT_FPREGSET), the process (NT_PRPSINFO), the aux vector (NT_AUXV) and the mapped
+// files (NT_FILE), then a PT_LOAD segment per mapping in /proc/<pid>/maps
+
+// a thread of the process, as it is to be found in the core. the first one is the one the core is about
+struct core_thread {
+    pid_t tid;
+    user_regs_struct regs;
+    user_fpregs_struct fp_regs;
+    bool has_fp_regs;
+    int signal;         // the one it stopped with, 0 for none
+};
+
+struct core_summary {
+    std::size_t segments = 0;
+    std::uint64_t written = 0;      // bytes of memory in the file
+    std::uint64_t holes = 0;        // all-zero or unreadable: left out of a sparse file
+};
+
+// writes the core of a stopped process. memory goes through in large chunks of process_vm_readv, and pages
+// that are all zero are not written at all: the file is sparse there. `shadow` puts back the bytes the
+// debugger has changed in what was just read (breakpoints, tracepoint jumps), and `protections` the
+// protection of the pages it has changed that of (page watchpoints), by page address. false with the
+// reason in `error`
+bool write_core(const std::string& path, pid_t pid, const std::vector<core_thread>& threads, memory& mem,
+                const std::function<void(std::uint64_t addr, void* buf, std::size_t len)>& shadow,
+                const std::map<std::uint64_t, int>& protections, core_summary& summary, std::string& error);
+
+// a core file mapped read-only, for `tdb <program> <core>`. opening it reads the headers and the notes and
+// nothing else; memory is served straight out of the mapping through the PT_LOAD segments, sorted by address
+// for a binary search. what a segment leaves out of the file (the kernel doesn't dump the code of mapped
+// files) comes from the mapped file itself, if NT_FILE names one
+class core_file {
+    public:
+        // a mapping of a file, from NT_FILE
+        struct mapped_file {
+            std::uint64_t start, end;
+            std::uint64_t offset;   // in the file, in bytes
+            std::string path;
+            bool executable;        // its segment is
+        };
+
+        // nullptr (and a message on stderr) if the file cannot be mapped or is not an x86-64 core
+        static std::unique_ptr<core_file> open(const std::string& path);
+        // whether the file starts with the header of an ELF core
+        static bool is_core(const std::string& path);
+        ~core_file();
+        core_file(const core_file&) = delete;
+        core_file& operator=(const core_file&) = delete;
+
+        pid_t pid() const { return m_pid; }
+        const std::vector<core_thread>& threads() const { return m_threads; }
+        const std::vector<mapped_file>& files() const { return m_files; }
+        // the command line it was started with, as far as NT_PRPSINFO keeps it
+        std::string_view command() const { return m_command; }
+        // an entry of the aux vector, 0 if it isn't there
+        std::uint64_t aux_value(std::uint64_t type) const;
+
+        // up to len bytes at addr, as a view into the mapping: shorter where a segment ends or its contents
+        // aren't in the core. nothing is copied
+        std::string_view view(std::uint64_t addr, std::size_t len) const;
+        // same contract as memory::read
+        std::size_t read(std::uint64_t addr, void* buf, std::size_t len) const;
+
+    private:
+        struct segment {
+            std::uint64_t vaddr, memsz;
+            std::uint64_t offset, filesz;
+        };
+        // a file of m_files, mapped on first use
+        struct backing {
+            const char* data = nullptr;
+            std::size_t size = 0;
+            bool tried = false;
+        };
+
+        core_file() = default;
+        void read_notes(std::string_view notes);
+        std::string_view file_view(std::uint64_t addr, std::size_t len) const;
+
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+        std::vector<segment> m_segments;    // sorted by vaddr
+        pid_t m_pid = 0;
+        std::vector<core_thread> m_threads;
+        std::vector<mapped_file> m_files;   // sorted by start
+        mutable std::vector<backing> m_backing;     // by index into m_files
+        std::string_view m_auxv;
+        std::string m_command;
+};
+
+#endif
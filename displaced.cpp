@@ -0,0 +1,119 @@
+#include "displaced.hpp"
+
+#include <cstring>
+#include <vector>
+#include "x86.hpp"
+
+namespace {
+    const std::size_t jmp_size = 5;
+
+    bool put_rel32(std::vector<std::uint8_t>& out, std::uint64_t from_end, std::uint64_t target) {
+        std::int64_t rel = static_cast<std::int64_t>(target - from_end);
+        if (rel != static_cast<std::int32_t>(rel)) {
+            return false;
+        }
+        std::int32_t rel32 = static_cast<std::int32_t>(rel);
+        out.insert(out.end(), reinterpret_cast<std::uint8_t*>(&rel32), reinterpret_cast<std::uint8_t*>(&rel32) + 4);
+        return true;
+    }
+
+    bool is_rep_string(const std::uint8_t* code, const x86_insn& insn) {
+        std::uint8_t op = code[insn.opcode_offset];
+        bool string = (op >= 0x6c && op <= 0x6f) || (op >= 0xa4 && op <= 0xa7) || (op >= 0xaa && op <= 0xaf);
+        if (insn.map != 0 || insn.vex != 0 || !string) {
+            return false;
+        }
+        for (std::size_t i = 0; i < insn.opcode_offset; ++i) {
+            if (code[i] == 0xf2 || code[i] == 0xf3) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+const displaced_stepper::copy* displaced_stepper::prepare(pid_t tid, std::uint64_t addr, const std::uint8_t* code,
+                                                          std::size_t avail) {
+    auto it = m_copies.find(addr);
+    if (it == m_copies.end()) {
+        it = m_copies.emplace(addr, make(tid, addr, code, avail)).first;
+    }
+    return it->second.addr != 0 ? &it->second : nullptr;
+}
+
+displaced_stepper::copy displaced_stepper::make(pid_t tid, std::uint64_t addr, const std::uint8_t* code,
+                                                std::size_t avail) {
+    x86_insn insn;
+    if (!x86_decode(code, avail, insn)) {
+        return copy{};
+    }
+    std::uint8_t op = code[insn.opcode_offset];
+    bool jcc8 = insn.map == 0 && op >= 0x70 && op <= 0x7f;
+    if ((insn.branch == x86_insn::rel8 && !jcc8 && op != 0xeb) || (insn.map == 0 && op >= 0xcc && op <= 0xce)) {
+        return copy{};
+    }
+    // a rel8 jump becomes its rel32 form, 4 bytes longer at most
+    std::uint64_t scratch = m_code.allocate(tid, addr, insn.length + 4 + jmp_size);
+    if (scratch == 0) {
+        return copy{};
+    }
+
+    std::vector<std::uint8_t> bytes;
+    if (insn.branch == x86_insn::rel8) {
+        std::uint64_t target = addr + insn.length + static_cast<std::int8_t>(code[insn.rel_offset]);
+        if (jcc8) {
+            bytes = {0x0f, static_cast<std::uint8_t>(0x80 | (op & 0x0f))};
+        } else {
+            bytes = {0xe9};
+        }
+        if (!put_rel32(bytes, scratch + bytes.size() + 4, target)) {
+            return copy{};
+        }
+    } else if (!x86_relocate(code, insn.length, addr, scratch, bytes)) {
+        return copy{};
+    }
+    copy c;
+    c.size = bytes.size();
+    bytes.push_back(0xe9);
+    if (!put_rel32(bytes, scratch + bytes.size() + 4, addr + insn.length)
+            || m_memory.write(scratch, bytes.data(), bytes.size()) < bytes.size()) {
+        return copy{};
+    }
+    c.addr = scratch;
+    c.length = insn.length;
+    c.call = insn.call;
+    c.syscall = insn.map == 1 && insn.vex == 0 && op == 0x05;
+    c.repeats = is_rep_string(code, insn);
+    return c;
+}
+
+void displaced_stepper::finish(const copy& c, std::uint64_t addr, user_regs_struct& regs) {
+    std::uint64_t after_copy = c.addr + c.size, after = addr + c.length;
+    if (regs.rip == c.addr) {
+        regs.rip = addr;
+        return;
+    }
+    if (regs.rip == after_copy) {
+        regs.rip = after;   // fell through; a branch taken is where it should be already
+    }
+    if (c.call) {
+        std::uint64_t pushed = 0;
+        if (m_memory.read(regs.rsp, &pushed, sizeof(pushed)) == sizeof(pushed) && pushed == after_copy) {
+            m_memory.write(regs.rsp, &after, sizeof(after));
+        }
+    }
+    if (c.syscall && regs.rcx == after_copy) {
+        regs.rcx = after;
+    }
+}
+
+void displaced_stepper::forget(std::uint64_t addr, std::size_t len) {
+    // an instruction is 15 bytes at most, so only copies starting that far before can overlap
+    for (auto it = m_copies.begin(); it != m_copies.end(); ) {
+        if (it->first + 15 > addr && it->first < addr + len) {
+            it = m_copies.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef TDB_DISPLACED_HPP
+#define TDB_DISPLACED_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/user.h>
+#include "inject.hpp"
+#include "memory.hpp"
+
+// displaced stepping: a thread resuming from a breakpoint single-steps a copy of the original instruction
+// instead of having the int3 taken out for the step, which lets other threads that run meanwhile go past
+// the breakpoint unseen. the copy sits in a code_pool chunk within rel32 reach, rip-relative operands and
+// branch displacements adjusted (x86_relocate), followed by a jmp back to the next instruction; after the
+// step rip goes from the copy back to the original code, and so does the return address a call pushed.
+// copies are made once per address and kept as long as the code stays the same
+class displaced_stepper {
+    public:
+        struct copy {
+            std::uint64_t addr = 0;     // 0: the instruction can't be displaced
+            std::size_t size = 0;       // of the instruction as copied, the jmp back comes right after
+            std::size_t length = 0;     // of the original
+            bool call = false;          // pushes the address after it
+            bool syscall = false;       // leaves the address after it in rcx
+            bool repeats = false;       // a rep string instruction, a step only does one iteration
+        };
+
+        displaced_stepper(memory& mem, code_pool& code) : m_memory(mem), m_code(code) {}
+
+        // the copy of the instruction at addr, whose own bytes (int3s shadowed) are code[0, avail). made
+        // through thread tid, stopped, the first time. nullptr if the instruction can only run where it is:
+        // loop and jrcxz have no rel32 form, int3 and int would trap in the copy
+        const copy* prepare(pid_t tid, std::uint64_t addr, const std::uint8_t* code, std::size_t avail);
+        // the thread stepped the copy of the instruction at addr: regs from after the step are moved back
+        // to the original code. a copy that didn't run (a signal first, or more rep iterations) means addr
+        void finish(const copy& c, std::uint64_t addr, user_regs_struct& regs);
+
+        // the code at [addr, addr + len) was written to
+        void forget(std::uint64_t addr, std::size_t len);
+        // the inferior exec'd, the copies went with its code pool
+        void reset() { m_copies.clear(); }
+
+    private:
+        copy make(pid_t tid, std::uint64_t addr, const std::uint8_t* code, std::size_t avail);
+
+        memory& m_memory;
+        code_pool& m_code;
+        std::unordered_map<std::uint64_t, copy> m_copies;  // by address of the original, failures too
+};
+
+#endif
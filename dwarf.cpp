@@ -0,0 +1,383 @@
+#include "dwarf.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+dwarf_sections::dwarf_sections(const elf_file& elf) {
+    info = elf.contents(elf.section(".debug_info"));
+    abbrev = elf.contents(elf.section(".debug_abbrev"));
+    line = elf.contents(elf.section(".debug_line"));
+    line_str = elf.contents(elf.section(".debug_line_str"));
+    str = elf.contents(elf.section(".debug_str"));
+    str_offsets = elf.contents(elf.section(".debug_str_offsets"));
+    addr = elf.contents(elf.section(".debug_addr"));
+    aranges = elf.contents(elf.section(".debug_aranges"));
+    ranges = elf.contents(elf.section(".debug_ranges"));
+    rnglists = elf.contents(elf.section(".debug_rnglists"));
+}
+
+void dwarf_cursor::skip(std::uint64_t n) {
+    if (n > m_data.size() - std::min(m_pos, m_data.size())) {
+        m_error = true;
+        m_pos = m_data.size();
+        return;
+    }
+    m_pos += n;
+}
+
+std::uint64_t dwarf_cursor::fixed(std::size_t size) {
+    if (m_pos > m_data.size() || size > m_data.size() - m_pos) {
+        m_error = true;
+        m_pos = m_data.size();
+        return 0;
+    }
+    std::uint64_t value = 0;
+    std::memcpy(&value, m_data.data() + m_pos, size);   // x86-64 is little endian like the file
+    m_pos += size;
+    return value;
+}
+
+std::uint64_t dwarf_cursor::uleb() {
+    std::uint64_t value = 0;
+    unsigned shift = 0;
+    while (m_pos < m_data.size()) {
+        std::uint8_t byte = m_data[m_pos++];
+        if (shift < 64) {
+            value |= std::uint64_t(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    m_error = true;
+    return value;
+}
+
+std::int64_t dwarf_cursor::sleb() {
+    std::int64_t value = 0;
+    unsigned shift = 0;
+    while (m_pos < m_data.size()) {
+        std::uint8_t byte = m_data[m_pos++];
+        if (shift < 64) {
+            value |= std::int64_t(byte & 0x7f) << shift;
+        }
+        shift += 7;
+        if ((byte & 0x80) == 0) {
+            if (shift < 64 && (byte & 0x40)) {
+                value |= -(std::int64_t(1) << shift);
+            }
+            return value;
+        }
+    }
+    m_error = true;
+    return value;
+}
+
+std::string_view dwarf_cursor::cstr() {
+    if (m_pos >= m_data.size()) {
+        m_error = true;
+        return {};
+    }
+    const char* start = m_data.data() + m_pos;
+    std::size_t len = strnlen(start, m_data.size() - m_pos);
+    if (len == m_data.size() - m_pos) {
+        m_error = true;     // unterminated
+        m_pos = m_data.size();
+        return {};
+    }
+    m_pos += len + 1;
+    return std::string_view(start, len);
+}
+
+std::string_view dwarf_cursor::bytes(std::uint64_t n) {
+    std::size_t start = m_pos;
+    skip(n);
+    if (m_error) {
+        return {};
+    }
+    return m_data.substr(start, n);
+}
+
+std::uint64_t dwarf_cursor::initial_length(bool& is64) {
+    std::uint64_t length = u32();
+    is64 = length == 0xffffffff;
+    if (is64) {
+        length = u64();
+    }
+    return length;
+}
+
+namespace {
+    // reads one abbreviation declaration, false at the terminating 0 code or on error
+    bool read_abbrev(dwarf_cursor& c, abbrev& ab) {
+        ab.code = c.uleb();
+        if (ab.code == 0 || c.error()) {
+            return false;
+        }
+        ab.tag = static_cast<std::uint16_t>(c.uleb());
+        ab.has_children = c.u8() != 0;
+        ab.attrs.clear();
+        while (!c.error()) {
+            abbrev_attr attr {static_cast<std::uint16_t>(c.uleb()), static_cast<std::uint16_t>(c.uleb()), 0};
+            if (attr.form == DW_FORM_implicit_const) {
+                attr.implicit_const = c.sleb();
+            }
+            if (attr.name == 0 && attr.form == 0) {
+                break;
+            }
+            ab.attrs.push_back(attr);
+        }
+        return !c.error();
+    }
+
+    // the root DIE only needs its own abbreviation, no point in parsing the whole table for it
+    bool find_abbrev(std::string_view section, std::uint64_t offset, std::uint64_t code, abbrev& ab) {
+        dwarf_cursor c {section, offset};
+        while (read_abbrev(c, ab)) {
+            if (ab.code == code) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void read_root_die(const dwarf_sections& sec, compile_unit& cu) {
+        dwarf_cursor c {sec.info, cu.die_offset};
+        abbrev ab;
+        if (!find_abbrev(sec.abbrev, cu.abbrev_offset, c.uleb(), ab)) {
+            return;
+        }
+        // the *_base attributes may come after the ones that need them, so resolve at the end
+        attr_value name, comp_dir, low_pc, high_pc;
+        for (const auto& attr : ab.attrs) {
+            attr_value value;
+            if (!read_attr(c, cu, attr.form, attr.implicit_const, value)) {
+                return;
+            }
+            switch (attr.name) {
+                case DW_AT_name: name = value; break;
+                case DW_AT_comp_dir: comp_dir = value; break;
+                case DW_AT_low_pc: low_pc = value; break;
+                case DW_AT_high_pc: high_pc = value; break;
+                case DW_AT_stmt_list: cu.stmt_list = value.u; break;
+                case DW_AT_ranges: cu.ranges = value.u; cu.ranges_form = value.form; break;
+                case DW_AT_str_offsets_base: cu.str_offsets_base = value.u; break;
+                case DW_AT_addr_base: case DW_AT_GNU_addr_base: cu.addr_base = value.u; break;
+                case DW_AT_rnglists_base: cu.rnglists_base = value.u; break;
+            }
+        }
+        cu.name = attr_string(sec, cu, name);
+        cu.comp_dir = attr_string(sec, cu, comp_dir);
+        if (low_pc.form != 0) {
+            cu.low_pc = attr_address(sec, cu, low_pc);
+        }
+        if (low_pc.form != 0 && high_pc.form != 0) {
+            bool is_address = high_pc.form == DW_FORM_addr || high_pc.form == DW_FORM_addrx
+                || (high_pc.form >= DW_FORM_addrx1 && high_pc.form <= DW_FORM_addrx4)
+                || high_pc.form == DW_FORM_GNU_addr_index;
+            // since DWARF 4 a constant high_pc is the size of the unit's code
+            cu.high_pc = is_address ? attr_address(sec, cu, high_pc) : cu.low_pc + high_pc.u;
+            cu.has_pc_range = cu.high_pc > cu.low_pc;
+        }
+    }
+}
+
+bool abbrev_table::parse(std::string_view section, std::uint64_t offset) {
+    dwarf_cursor c {section, offset};
+    abbrev ab;
+    m_abbrevs.clear();
+    m_dense = true;
+    while (read_abbrev(c, ab)) {
+        m_dense = m_dense && ab.code == m_abbrevs.size() + 1;
+        m_abbrevs.push_back(ab);
+    }
+    return !c.error();
+}
+
+const abbrev* abbrev_table::find(std::uint64_t code) const {
+    if (m_dense) {
+        return code != 0 && code <= m_abbrevs.size() ? &m_abbrevs[code - 1] : nullptr;
+    }
+    for (const auto& ab : m_abbrevs) {
+        if (ab.code == code) {
+            return &ab;
+        }
+    }
+    return nullptr;
+}
+
+bool read_attr(dwarf_cursor& c, const compile_unit& cu, std::uint16_t form, std::int64_t implicit_const, attr_value& value) {
+    value.form = form;
+    value.u = 0;
+    value.block = {};
+    switch (form) {
+        case DW_FORM_addr: value.u = c.fixed(cu.addr_size); break;
+        case DW_FORM_data1: case DW_FORM_ref1: case DW_FORM_flag: case DW_FORM_strx1: case DW_FORM_addrx1:
+            value.u = c.u8(); break;
+        case DW_FORM_data2: case DW_FORM_ref2: case DW_FORM_strx2: case DW_FORM_addrx2:
+            value.u = c.u16(); break;
+        case DW_FORM_strx3: case DW_FORM_addrx3:
+            value.u = c.fixed(3); break;
+        case DW_FORM_data4: case DW_FORM_ref4: case DW_FORM_strx4: case DW_FORM_addrx4: case DW_FORM_ref_sup4:
+            value.u = c.u32(); break;
+        case DW_FORM_data8: case DW_FORM_ref8: case DW_FORM_ref_sig8: case DW_FORM_ref_sup8:
+            value.u = c.u64(); break;
+        case DW_FORM_data16: value.block = c.bytes(16); break;
+        case DW_FORM_string: value.block = c.cstr(); break;
+        case DW_FORM_block: case DW_FORM_exprloc: value.block = c.bytes(c.uleb()); break;
+        case DW_FORM_block1: value.block = c.bytes(c.u8()); break;
+        case DW_FORM_block2: value.block = c.bytes(c.u16()); break;
+        case DW_FORM_block4: value.block = c.bytes(c.u32()); break;
+        case DW_FORM_sdata: value.u = static_cast<std::uint64_t>(c.sleb()); break;
+        case DW_FORM_udata: case DW_FORM_ref_udata: case DW_FORM_strx: case DW_FORM_addrx:
+        case DW_FORM_loclistx: case DW_FORM_rnglistx: case DW_FORM_GNU_addr_index: case DW_FORM_GNU_str_index:
+            value.u = c.uleb(); break;
+        case DW_FORM_strp: case DW_FORM_line_strp: case DW_FORM_sec_offset: case DW_FORM_strp_sup:
+        case DW_FORM_GNU_strp_alt: case DW_FORM_GNU_ref_alt:
+            value.u = c.offset(cu.is64); break;
+        case DW_FORM_ref_addr: value.u = cu.version <= 2 ? c.fixed(cu.addr_size) : c.offset(cu.is64); break;
+        case DW_FORM_flag_present: value.u = 1; break;
+        case DW_FORM_implicit_const: value.u = static_cast<std::uint64_t>(implicit_const); break;
+        case DW_FORM_indirect: return read_attr(c, cu, static_cast<std::uint16_t>(c.uleb()), implicit_const, value);
+        default: return false;
+    }
+    return !c.error();
+}
+
+std::uint64_t attr_reference(const compile_unit& cu, const attr_value& value) {
+    // only DW_FORM_ref_addr is relative to the section, the other reference forms to the unit
+    return value.form == DW_FORM_ref_addr ? value.u : cu.offset + value.u;
+}
+
+std::string_view attr_string(const dwarf_sections& sec, const compile_unit& cu, const attr_value& value) {
+    std::uint64_t offset = 0;
+    std::string_view table = sec.str;
+    switch (value.form) {
+        case DW_FORM_string: return value.block;
+        case DW_FORM_strp: offset = value.u; break;
+        case DW_FORM_line_strp: offset = value.u; table = sec.line_str; break;
+        case DW_FORM_strx: case DW_FORM_strx1: case DW_FORM_strx2: case DW_FORM_strx3: case DW_FORM_strx4:
+        case DW_FORM_GNU_str_index: {
+            std::size_t entry = cu.is64 ? 8 : 4;
+            dwarf_cursor c {sec.str_offsets, cu.str_offsets_base + value.u * entry};
+            offset = c.fixed(entry);
+            if (c.error()) {
+                return {};
+            }
+            break;
+        }
+        default: return {};
+    }
+    if (offset >= table.size()) {
+        return {};
+    }
+    const char* s = table.data() + offset;
+    return std::string_view(s, strnlen(s, table.size() - offset));
+}
+
+std::uint64_t attr_address(const dwarf_sections& sec, const compile_unit& cu, const attr_value& value) {
+    switch (value.form) {
+        case DW_FORM_addrx: case DW_FORM_addrx1: case DW_FORM_addrx2: case DW_FORM_addrx3: case DW_FORM_addrx4:
+        case DW_FORM_GNU_addr_index: {
+            dwarf_cursor c {sec.addr, cu.addr_base + value.u * cu.addr_size};
+            return c.fixed(cu.addr_size);
+        }
+        default: return value.u;
+    }
+}
+
+std::vector<compile_unit> read_units(const dwarf_sections& sec) {
+    std::vector<compile_unit> units;
+    dwarf_cursor c {sec.info};
+    while (!c.at_end()) {
+        compile_unit cu;
+        cu.offset = c.pos();
+        std::uint64_t length = c.initial_length(cu.is64);
+        if (c.error() || length == 0 || length > sec.info.size() - c.pos()) {
+            break;
+        }
+        cu.end = c.pos() + length;
+        cu.version = c.u16();
+        if (cu.version >= 5) {
+            cu.unit_type = c.u8();
+            cu.addr_size = c.u8();
+            cu.abbrev_offset = c.offset(cu.is64);
+            if (cu.unit_type == DW_UT_skeleton || cu.unit_type == DW_UT_split_compile) {
+                c.skip(8);  // dwo id
+            } else if (cu.unit_type == DW_UT_type || cu.unit_type == DW_UT_split_type) {
+                c.skip(8);  // type signature
+                c.offset(cu.is64);
+            }
+        } else {
+            cu.abbrev_offset = c.offset(cu.is64);
+            cu.addr_size = c.u8();
+        }
+        if (c.error() || cu.version < 2 || cu.version > 5) {
+            break;
+        }
+        cu.die_offset = c.pos();
+        read_root_die(sec, cu);
+        units.push_back(cu);
+        c.seek(cu.end);
+    }
+    return units;
+}
+
+void unit_ranges(const dwarf_sections& sec, const compile_unit& cu,
+                 std::vector<std::pair<std::uint64_t, std::uint64_t>>& out) {
+    if (cu.ranges_form == 0) {
+        if (cu.has_pc_range) {
+            out.emplace_back(cu.low_pc, cu.high_pc);
+        }
+        return;
+    }
+
+    std::uint64_t base = cu.low_pc;
+    if (cu.version < 5) {
+        // (begin, end) pairs relative to the base address, (-1, base) changes the base, (0, 0) ends the list
+        dwarf_cursor c {sec.ranges, cu.ranges};
+        while (!c.error()) {
+            std::uint64_t begin = c.fixed(cu.addr_size), end = c.fixed(cu.addr_size);
+            if (begin == 0 && end == 0) {
+                break;
+            }
+            if (begin == ~0ull || (cu.addr_size == 4 && begin == 0xffffffff)) {
+                base = end;
+            } else if (end > begin) {
+                out.emplace_back(base + begin, base + end);
+            }
+        }
+        return;
+    }
+
+    std::uint64_t offset = cu.ranges;
+    if (cu.ranges_form == DW_FORM_rnglistx) {
+        std::size_t entry = cu.is64 ? 8 : 4;
+        dwarf_cursor c {sec.rnglists, cu.rnglists_base + cu.ranges * entry};
+        offset = cu.rnglists_base + c.fixed(entry);
+    }
+    auto addrx = [&](std::uint64_t index) {
+        dwarf_cursor c {sec.addr, cu.addr_base + index * cu.addr_size};
+        return c.fixed(cu.addr_size);
+    };
+    dwarf_cursor c {sec.rnglists, offset};
+    while (!c.error()) {
+        std::uint8_t kind = c.u8();
+        std::uint64_t begin = 0, end = 0;
+        switch (kind) {
+            case DW_RLE_end_of_list: return;
+            case DW_RLE_base_addressx: base = addrx(c.uleb()); continue;
+            case DW_RLE_base_address: base = c.fixed(cu.addr_size); continue;
+            case DW_RLE_startx_endx: begin = addrx(c.uleb()); end = addrx(c.uleb()); break;
+            case DW_RLE_startx_length: begin = addrx(c.uleb()); end = begin + c.uleb(); break;
+            case DW_RLE_offset_pair: begin = base + c.uleb(); end = base + c.uleb(); break;
+            case DW_RLE_start_end: begin = c.fixed(cu.addr_size); end = c.fixed(cu.addr_size); break;
+            case DW_RLE_start_length: begin = c.fixed(cu.addr_size); end = begin + c.uleb(); break;
+            default: return;
+        }
+        if (end > begin) {
+            out.emplace_back(begin, end);
+        }
+    }
+}
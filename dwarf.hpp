@@ -0,0 +1,220 @@
+#ifndef TDB_DWARF_HPP
+#define TDB_DWARF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "elf.hpp"
+
+// the bits of DWARF (versions 2 to 5) shared by the line table, the .debug_info indexer and the unwinder.
+// everything works on string_views into the mapped ELF file, nothing is copied
+
+enum dwarf_form : std::uint16_t {
+    DW_FORM_addr = 0x01, DW_FORM_block2 = 0x03, DW_FORM_block4 = 0x04, DW_FORM_data2 = 0x05,
+    DW_FORM_data4 = 0x06, DW_FORM_data8 = 0x07, DW_FORM_string = 0x08, DW_FORM_block = 0x09,
+    DW_FORM_block1 = 0x0a, DW_FORM_data1 = 0x0b, DW_FORM_flag = 0x0c, DW_FORM_sdata = 0x0d,
+    DW_FORM_strp = 0x0e, DW_FORM_udata = 0x0f, DW_FORM_ref_addr = 0x10, DW_FORM_ref1 = 0x11,
+    DW_FORM_ref2 = 0x12, DW_FORM_ref4 = 0x13, DW_FORM_ref8 = 0x14, DW_FORM_ref_udata = 0x15,
+    DW_FORM_indirect = 0x16, DW_FORM_sec_offset = 0x17, DW_FORM_exprloc = 0x18, DW_FORM_flag_present = 0x19,
+    DW_FORM_strx = 0x1a, DW_FORM_addrx = 0x1b, DW_FORM_ref_sup4 = 0x1c, DW_FORM_strp_sup = 0x1d,
+    DW_FORM_data16 = 0x1e, DW_FORM_line_strp = 0x1f, DW_FORM_ref_sig8 = 0x20, DW_FORM_implicit_const = 0x21,
+    DW_FORM_loclistx = 0x22, DW_FORM_rnglistx = 0x23, DW_FORM_ref_sup8 = 0x24, DW_FORM_strx1 = 0x25,
+    DW_FORM_strx2 = 0x26, DW_FORM_strx3 = 0x27, DW_FORM_strx4 = 0x28, DW_FORM_addrx1 = 0x29,
+    DW_FORM_addrx2 = 0x2a, DW_FORM_addrx3 = 0x2b, DW_FORM_addrx4 = 0x2c,
+    DW_FORM_GNU_addr_index = 0x1f01, DW_FORM_GNU_str_index = 0x1f02,
+    DW_FORM_GNU_ref_alt = 0x1f20, DW_FORM_GNU_strp_alt = 0x1f21,
+};
+
+enum dwarf_tag : std::uint16_t {
+    DW_TAG_array_type = 0x01, DW_TAG_class_type = 0x02, DW_TAG_enumeration_type = 0x04,
+    DW_TAG_formal_parameter = 0x05, DW_TAG_lexical_block = 0x0b, DW_TAG_member = 0x0d,
+    DW_TAG_pointer_type = 0x0f, DW_TAG_reference_type = 0x10, DW_TAG_compile_unit = 0x11,
+    DW_TAG_structure_type = 0x13, DW_TAG_subroutine_type = 0x15, DW_TAG_typedef = 0x16,
+    DW_TAG_union_type = 0x17, DW_TAG_inlined_subroutine = 0x1d, DW_TAG_ptr_to_member_type = 0x1f,
+    DW_TAG_subrange_type = 0x21, DW_TAG_base_type = 0x24, DW_TAG_const_type = 0x26,
+    DW_TAG_subprogram = 0x2e, DW_TAG_variable = 0x34, DW_TAG_volatile_type = 0x35,
+    DW_TAG_restrict_type = 0x37, DW_TAG_namespace = 0x39, DW_TAG_rvalue_reference_type = 0x42,
+    DW_TAG_atomic_type = 0x47,
+};
+
+enum dwarf_attribute : std::uint16_t {
+    DW_AT_sibling = 0x01, DW_AT_location = 0x02, DW_AT_name = 0x03, DW_AT_byte_size = 0x0b,
+    DW_AT_stmt_list = 0x10, DW_AT_low_pc = 0x11, DW_AT_high_pc = 0x12,
+    DW_AT_comp_dir = 0x1b, DW_AT_upper_bound = 0x2f, DW_AT_abstract_origin = 0x31, DW_AT_count = 0x37,
+    DW_AT_declaration = 0x3c, DW_AT_specification = 0x47, DW_AT_type = 0x49, DW_AT_ranges = 0x55,
+    DW_AT_linkage_name = 0x6e,
+    DW_AT_str_offsets_base = 0x72, DW_AT_addr_base = 0x73, DW_AT_rnglists_base = 0x74,
+    DW_AT_GNU_ranges_base = 0x2132, DW_AT_GNU_addr_base = 0x2133,
+};
+
+enum dwarf_op : std::uint8_t {
+    DW_OP_addr = 0x03, DW_OP_deref = 0x06, DW_OP_const1u = 0x08, DW_OP_const1s = 0x09,
+    DW_OP_const2u = 0x0a, DW_OP_const2s = 0x0b, DW_OP_const4u = 0x0c, DW_OP_const4s = 0x0d,
+    DW_OP_const8u = 0x0e, DW_OP_const8s = 0x0f, DW_OP_constu = 0x10, DW_OP_consts = 0x11,
+    DW_OP_dup = 0x12, DW_OP_drop = 0x13, DW_OP_over = 0x14, DW_OP_swap = 0x16, DW_OP_and = 0x1a,
+    DW_OP_minus = 0x1c, DW_OP_mul = 0x1e, DW_OP_neg = 0x1f, DW_OP_not = 0x20, DW_OP_or = 0x21,
+    DW_OP_plus = 0x22, DW_OP_plus_uconst = 0x23, DW_OP_shl = 0x24, DW_OP_shr = 0x25, DW_OP_shra = 0x26,
+    DW_OP_xor = 0x27, DW_OP_eq = 0x29, DW_OP_ge = 0x2a, DW_OP_gt = 0x2b, DW_OP_le = 0x2c, DW_OP_lt = 0x2d,
+    DW_OP_ne = 0x2e, DW_OP_lit0 = 0x30, DW_OP_lit31 = 0x4f, DW_OP_breg0 = 0x70, DW_OP_breg31 = 0x8f,
+    DW_OP_bregx = 0x92, DW_OP_nop = 0x96, DW_OP_addrx = 0xa1, DW_OP_GNU_addr_index = 0xfb,
+};
+
+enum dwarf_cfa_opcode : std::uint8_t {
+    DW_CFA_advance_loc = 0x40, DW_CFA_offset = 0x80, DW_CFA_restore = 0xc0,
+    DW_CFA_nop = 0x00, DW_CFA_set_loc = 0x01, DW_CFA_advance_loc1 = 0x02, DW_CFA_advance_loc2 = 0x03,
+    DW_CFA_advance_loc4 = 0x04, DW_CFA_offset_extended = 0x05, DW_CFA_restore_extended = 0x06,
+    DW_CFA_undefined = 0x07, DW_CFA_same_value = 0x08, DW_CFA_register = 0x09,
+    DW_CFA_remember_state = 0x0a, DW_CFA_restore_state = 0x0b, DW_CFA_def_cfa = 0x0c,
+    DW_CFA_def_cfa_register = 0x0d, DW_CFA_def_cfa_offset = 0x0e, DW_CFA_def_cfa_expression = 0x0f,
+    DW_CFA_expression = 0x10, DW_CFA_offset_extended_sf = 0x11, DW_CFA_def_cfa_sf = 0x12,
+    DW_CFA_def_cfa_offset_sf = 0x13, DW_CFA_val_offset = 0x14, DW_CFA_val_offset_sf = 0x15,
+    DW_CFA_val_expression = 0x16, DW_CFA_GNU_args_size = 0x2e, DW_CFA_GNU_negative_offset_extended = 0x2f,
+};
+
+// pointer encodings of .eh_frame and .eh_frame_hdr: the low nibble is the format, the high one how it is relative
+enum dwarf_eh_encoding : std::uint8_t {
+    DW_EH_PE_absptr = 0x00, DW_EH_PE_uleb128 = 0x01, DW_EH_PE_udata2 = 0x02, DW_EH_PE_udata4 = 0x03,
+    DW_EH_PE_udata8 = 0x04, DW_EH_PE_sleb128 = 0x09, DW_EH_PE_sdata2 = 0x0a, DW_EH_PE_sdata4 = 0x0b,
+    DW_EH_PE_sdata8 = 0x0c, DW_EH_PE_pcrel = 0x10, DW_EH_PE_datarel = 0x30, DW_EH_PE_indirect = 0x80,
+    DW_EH_PE_omit = 0xff,
+};
+
+enum dwarf_unit_type : std::uint8_t {
+    DW_UT_compile = 0x01, DW_UT_type = 0x02, DW_UT_partial = 0x03, DW_UT_skeleton = 0x04,
+    DW_UT_split_compile = 0x05, DW_UT_split_type = 0x06,
+};
+
+enum dwarf_line_opcode : std::uint8_t {
+    DW_LNS_copy = 0x01, DW_LNS_advance_pc = 0x02, DW_LNS_advance_line = 0x03, DW_LNS_set_file = 0x04,
+    DW_LNS_set_column = 0x05, DW_LNS_negate_stmt = 0x06, DW_LNS_set_basic_block = 0x07,
+    DW_LNS_const_add_pc = 0x08, DW_LNS_fixed_advance_pc = 0x09, DW_LNS_set_prologue_end = 0x0a,
+    DW_LNS_set_epilogue_begin = 0x0b, DW_LNS_set_isa = 0x0c,
+    DW_LNE_end_sequence = 0x01, DW_LNE_set_address = 0x02, DW_LNE_define_file = 0x03,
+    DW_LNE_set_discriminator = 0x04,
+    DW_LNCT_path = 0x1, DW_LNCT_directory_index = 0x2,
+};
+
+enum dwarf_rnglist_entry : std::uint8_t {
+    DW_RLE_end_of_list = 0x00, DW_RLE_base_addressx = 0x01, DW_RLE_startx_endx = 0x02,
+    DW_RLE_startx_length = 0x03, DW_RLE_offset_pair = 0x04, DW_RLE_base_address = 0x05,
+    DW_RLE_start_end = 0x06, DW_RLE_start_length = 0x07,
+};
+
+// the debug sections of one ELF file, empty views for the ones it does not have
+struct dwarf_sections {
+    explicit dwarf_sections(const elf_file& elf);
+
+    std::string_view info, abbrev, line, line_str, str, str_offsets, addr, aranges, ranges, rnglists;
+};
+
+// bounds-checked little-endian reader. reading past the end yields zeros and sets the error flag,
+// so parsers can check once at the end of a record instead of before every field
+class dwarf_cursor {
+    public:
+        explicit dwarf_cursor(std::string_view data, std::size_t pos = 0) : m_data{data}, m_pos{pos} {}
+
+        bool at_end() const { return m_pos >= m_data.size(); }
+        bool error() const { return m_error; }
+        std::size_t pos() const { return m_pos; }
+        void seek(std::size_t pos) { m_pos = pos; }
+        void skip(std::uint64_t n);
+        std::string_view data() const { return m_data; }
+
+        std::uint8_t u8() { return static_cast<std::uint8_t>(fixed(1)); }
+        std::uint16_t u16() { return static_cast<std::uint16_t>(fixed(2)); }
+        std::uint32_t u32() { return static_cast<std::uint32_t>(fixed(4)); }
+        std::uint64_t u64() { return fixed(8); }
+        std::int8_t s8() { return static_cast<std::int8_t>(fixed(1)); }
+        std::uint64_t fixed(std::size_t size);
+        std::uint64_t uleb();
+        std::int64_t sleb();
+        std::string_view cstr();
+        std::string_view bytes(std::uint64_t n);
+
+        // DWARF "initial length": returns the length of the rest of the unit and sets is64 for the 64-bit format
+        std::uint64_t initial_length(bool& is64);
+        std::uint64_t offset(bool is64) { return fixed(is64 ? 8 : 4); }
+
+    private:
+        std::string_view m_data;
+        std::size_t m_pos;
+        bool m_error = false;
+};
+
+struct abbrev_attr {
+    std::uint16_t name;
+    std::uint16_t form;
+    std::int64_t implicit_const;
+};
+
+struct abbrev {
+    std::uint64_t code = 0;
+    std::uint16_t tag = 0;
+    bool has_children = false;
+    std::vector<abbrev_attr> attrs;
+};
+
+// one abbreviation table of .debug_abbrev. codes are almost always 1..n in order,
+// so they index straight into a vector
+class abbrev_table {
+    public:
+        bool parse(std::string_view section, std::uint64_t offset);
+        const abbrev* find(std::uint64_t code) const;
+
+    private:
+        std::vector<abbrev> m_abbrevs;
+        bool m_dense = true;
+};
+
+// a unit header of .debug_info plus what its root DIE says about it
+struct compile_unit {
+    std::uint64_t offset = 0;       // of the unit header in .debug_info
+    std::uint64_t die_offset = 0;   // of the root DIE
+    std::uint64_t end = 0;          // one past the last byte of the unit
+    std::uint16_t version = 0;
+    std::uint8_t unit_type = DW_UT_compile;
+    std::uint8_t addr_size = 8;
+    bool is64 = false;
+    std::uint64_t abbrev_offset = 0;
+
+    std::string_view name;
+    std::string_view comp_dir;
+    std::uint64_t stmt_list = ~0ull;    // offset of the line program in .debug_line
+    std::uint64_t low_pc = 0;
+    std::uint64_t high_pc = 0;          // one past the end, only valid if has_pc_range
+    bool has_pc_range = false;
+    std::uint64_t ranges = ~0ull;       // DW_AT_ranges, raw (an offset or an rnglistx index)
+    std::uint16_t ranges_form = 0;
+    std::uint64_t str_offsets_base = 8;
+    std::uint64_t addr_base = 8;
+    std::uint64_t rnglists_base = 0;
+};
+
+// an attribute value as read from the DIE, resolve it with the helpers below
+struct attr_value {
+    std::uint16_t form = 0;
+    std::uint64_t u = 0;        // constants, offsets, indices, addresses, references (unit relative)
+    std::string_view block;     // DW_FORM_string contents, blocks and exprlocs
+};
+
+// reads the value of one attribute (form may be DW_FORM_indirect), false on malformed data
+bool read_attr(dwarf_cursor& c, const compile_unit& cu, std::uint16_t form, std::int64_t implicit_const, attr_value& value);
+
+// the .debug_info offset a reference attribute points at
+std::uint64_t attr_reference(const compile_unit& cu, const attr_value& value);
+
+// the string an attribute refers to, whatever the form
+std::string_view attr_string(const dwarf_sections& sec, const compile_unit& cu, const attr_value& value);
+// the address an attribute refers to (DW_FORM_addr or one of the addrx forms)
+std::uint64_t attr_address(const dwarf_sections& sec, const compile_unit& cu, const attr_value& value);
+
+// all units of .debug_info with their root DIEs read, in section order. only touches the start of each unit
+std::vector<compile_unit> read_units(const dwarf_sections& sec);
+
+// the address ranges covered by a unit according to DW_AT_low_pc/high_pc or DW_AT_ranges
+// (.debug_ranges before DWARF 5, .debug_rnglists after), appended as [low, high) pairs
+void unit_ranges(const dwarf_sections& sec, const compile_unit& cu,
+                 std::vector<std::pair<std::uint64_t, std::uint64_t>>& out);
+
+#endif
@@ -0,0 +1,522 @@
+#include "dwarf_index.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dwarf.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+    // on-disk layout: header, records sorted by name, string pool. all little endian, used in place
+    const char index_magic[8] = {'T', 'D', 'B', 'I', 'D', 'X', '0', '1'};
+
+    struct index_header {
+        char magic[8];
+        std::uint32_t key_size;
+        std::uint32_t reserved;
+        char key[64];               // build id of the binary the index belongs to
+        std::uint64_t count;
+        std::uint64_t records;      // file offset of the first index_record
+        std::uint64_t strings;      // file offset of the string pool
+        std::uint64_t strings_size;
+    };
+
+    struct index_record {
+        std::uint64_t addr;
+        std::uint64_t size;
+        std::uint64_t die_offset;
+        std::uint32_t name;         // offset into the string pool
+        std::uint32_t name_len;
+        std::uint8_t kind;
+        std::uint8_t reserved[7];
+    };
+
+    // what a unit's task produces, before merging
+    struct raw_entry {
+        std::string name;
+        dwarf_index::kind what;
+        std::uint64_t addr;
+        std::uint64_t size;
+        std::uint64_t die_offset;
+    };
+
+    // the attributes of a DIE the indexer cares about
+    struct die_info {
+        std::uint16_t tag = 0;
+        bool has_children = false;
+        std::string_view name;
+        bool declaration = false;
+        std::uint64_t low_pc = 0;
+        bool has_low_pc = false;
+        std::string_view location;
+        std::uint64_t specification = 0;    // absolute .debug_info offsets, 0 if absent
+        std::uint64_t abstract_origin = 0;
+        std::uint64_t sibling = 0;
+        std::uint64_t type = 0;
+        std::uint64_t byte_size = 0;
+        bool has_byte_size = false;
+        std::uint64_t bound = 0;            // DW_AT_count, or DW_AT_upper_bound + 1
+        bool has_bound = false;
+    };
+
+    bool read_die(const dwarf_sections& sec, const compile_unit& cu, const abbrev& ab, dwarf_cursor& c, die_info& d) {
+        d = die_info{};
+        d.tag = ab.tag;
+        d.has_children = ab.has_children;
+        attr_value low_pc;
+        for (const auto& attr : ab.attrs) {
+            attr_value value;
+            if (!read_attr(c, cu, attr.form, attr.implicit_const, value)) {
+                return false;
+            }
+            switch (attr.name) {
+                case DW_AT_name: d.name = attr_string(sec, cu, value); break;
+                case DW_AT_declaration: d.declaration = value.u != 0; break;
+                case DW_AT_low_pc: low_pc = value; d.has_low_pc = true; break;
+                case DW_AT_location: d.location = value.block; break;
+                case DW_AT_specification: d.specification = attr_reference(cu, value); break;
+                case DW_AT_abstract_origin: d.abstract_origin = attr_reference(cu, value); break;
+                case DW_AT_sibling: d.sibling = attr_reference(cu, value); break;
+                case DW_AT_type: d.type = attr_reference(cu, value); break;
+                case DW_AT_byte_size: d.byte_size = value.u; d.has_byte_size = true; break;
+                case DW_AT_count: d.bound = value.u; d.has_bound = true; break;
+                case DW_AT_upper_bound: d.bound = value.u + 1; d.has_bound = true; break;
+            }
+        }
+        if (d.has_low_pc) {
+            d.low_pc = attr_address(sec, cu, low_pc);
+        }
+        return true;
+    }
+
+    // size in bytes of the type DIE at offset, following typedefs and qualifiers; 0 if we can't tell
+    std::uint64_t type_size(const dwarf_sections& sec, const compile_unit& cu, const abbrev_table& abbrevs,
+                            std::uint64_t offset, int depth = 0) {
+        if (offset <= cu.die_offset || offset >= cu.end || depth > 16) {
+            return 0;
+        }
+        dwarf_cursor c {sec.info, offset};
+        const abbrev* ab = abbrevs.find(c.uleb());
+        die_info d;
+        if (ab == nullptr || !read_die(sec, cu, *ab, c, d)) {
+            return 0;
+        }
+        if (d.has_byte_size) {
+            return d.byte_size;
+        }
+        switch (d.tag) {
+            case DW_TAG_pointer_type: case DW_TAG_reference_type: case DW_TAG_rvalue_reference_type:
+                return cu.addr_size;
+            case DW_TAG_typedef: case DW_TAG_const_type: case DW_TAG_volatile_type:
+            case DW_TAG_restrict_type: case DW_TAG_atomic_type:
+                return type_size(sec, cu, abbrevs, d.type, depth + 1);
+            case DW_TAG_array_type: {
+                std::uint64_t size = type_size(sec, cu, abbrevs, d.type, depth + 1);
+                // the dimensions are DW_TAG_subrange_type children
+                while (d.has_children && !c.error()) {
+                    std::uint64_t code = c.uleb();
+                    const abbrev* child = abbrevs.find(code);
+                    die_info sub;
+                    if (code == 0 || child == nullptr || !read_die(sec, cu, *child, c, sub)) {
+                        break;
+                    }
+                    if (sub.tag == DW_TAG_subrange_type) {
+                        size *= sub.has_bound ? sub.bound : 0;
+                    }
+                }
+                return size;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    std::uint64_t location_address(const dwarf_sections& sec, const compile_unit& cu, std::string_view expr, bool& ok) {
+        ok = false;
+        if (expr.size() == 1u + cu.addr_size && static_cast<std::uint8_t>(expr[0]) == DW_OP_addr) {
+            ok = true;
+            dwarf_cursor c {expr, 1};
+            return c.fixed(cu.addr_size);
+        }
+        if (!expr.empty() && (static_cast<std::uint8_t>(expr[0]) == DW_OP_addrx
+                || static_cast<std::uint8_t>(expr[0]) == DW_OP_GNU_addr_index)) {
+            dwarf_cursor c {expr, 1};
+            attr_value index;
+            index.form = DW_FORM_addrx;
+            index.u = c.uleb();
+            ok = c.at_end() && !c.error();
+            return attr_address(sec, cu, index);
+        }
+        return 0;   // a TLS variable, or something living in a register
+    }
+
+    // one task: walk every DIE of one unit
+    void index_unit(const dwarf_sections& sec, const compile_unit& cu, std::vector<raw_entry>& out) {
+        abbrev_table abbrevs;
+        if (!abbrevs.parse(sec.abbrev, cu.abbrev_offset)) {
+            return;
+        }
+        struct scope {
+            std::string name;   // qualified name of the enclosing namespace / class, "" at file scope
+            bool in_function;
+        };
+        std::vector<scope> stack;
+        // qualified names of the DIEs out-of-line definitions refer back to (member declarations mostly)
+        std::unordered_map<std::uint64_t, std::string> names;
+
+        dwarf_cursor c {sec.info, cu.die_offset};
+        die_info d;
+        while (c.pos() < cu.end && !c.error()) {
+            std::uint64_t offset = c.pos();
+            std::uint64_t code = c.uleb();
+            if (code == 0) {
+                if (stack.empty()) {
+                    break;
+                }
+                stack.pop_back();
+                if (stack.empty()) {
+                    break;
+                }
+                continue;
+            }
+            const abbrev* ab = abbrevs.find(code);
+            if (ab == nullptr || !read_die(sec, cu, *ab, c, d)) {
+                return;
+            }
+
+            const scope* parent = stack.empty() ? nullptr : &stack.back();
+            bool in_function = parent != nullptr && parent->in_function;
+            std::string qualified;
+            if (!d.name.empty()) {
+                qualified = parent == nullptr || parent->name.empty()
+                    ? std::string(d.name) : parent->name + "::" + std::string(d.name);
+            } else {
+                auto ref = names.find(d.specification != 0 ? d.specification : d.abstract_origin);
+                if (ref != names.end()) {
+                    qualified = ref->second;
+                }
+            }
+
+            bool push = d.has_children;
+            std::string scope_name = parent != nullptr ? parent->name : std::string();
+            bool scope_in_function = in_function;
+            switch (d.tag) {
+                case DW_TAG_namespace:
+                    scope_name = qualified.empty() ? (parent && !parent->name.empty() ? parent->name + "::" : "")
+                        + std::string("(anonymous namespace)") : qualified;
+                    break;
+                case DW_TAG_class_type: case DW_TAG_structure_type: case DW_TAG_union_type:
+                case DW_TAG_enumeration_type: case DW_TAG_typedef: case DW_TAG_base_type:
+                    if (!qualified.empty() && !d.declaration && !in_function) {
+                        std::uint64_t size = d.has_byte_size ? d.byte_size : type_size(sec, cu, abbrevs, offset);
+                        out.push_back({qualified, dwarf_index::type, 0, size, offset});
+                    }
+                    if (!qualified.empty()) {
+                        scope_name = qualified;
+                    }
+                    break;
+                case DW_TAG_subprogram:
+                    if (!qualified.empty()) {
+                        names[offset] = qualified;
+                        if (d.has_low_pc && !d.declaration) {
+                            out.push_back({qualified, dwarf_index::function, d.low_pc, 0, offset});
+                        }
+                    }
+                    // parameters and locals are of no interest, hop over them when the producer lets us
+                    if (d.has_children && d.sibling > c.pos() && d.sibling < cu.end) {
+                        c.seek(d.sibling);
+                        push = false;
+                    }
+                    scope_in_function = true;
+                    break;
+                case DW_TAG_variable: case DW_TAG_member:
+                    if (!qualified.empty() && !in_function) {
+                        if (d.declaration) {
+                            names[offset] = qualified;  // a static member, defined further down
+                        }
+                        bool ok = false;
+                        std::uint64_t addr = location_address(sec, cu, d.location, ok);
+                        if (ok && !d.declaration) {
+                            std::uint64_t type = d.type;
+                            if (type == 0 && d.specification != 0) {
+                                // a static member's definition: the declaration inside the class has the type
+                                dwarf_cursor sc {sec.info, d.specification};
+                                const abbrev* sab = abbrevs.find(sc.uleb());
+                                die_info spec;
+                                if (sab != nullptr && read_die(sec, cu, *sab, sc, spec)) {
+                                    type = spec.type;
+                                }
+                            }
+                            out.push_back({qualified, dwarf_index::variable, addr, type_size(sec, cu, abbrevs, type), offset});
+                        }
+                    }
+                    break;
+                default:
+                    break;
+            }
+            if (push) {
+                stack.push_back({std::move(scope_name), scope_in_function});
+            }
+        }
+    }
+
+    std::string hex(std::string_view bytes) {
+        static const char digits[] = "0123456789abcdef";
+        std::string out;
+        for (unsigned char b : bytes) {
+            out += digits[b >> 4];
+            out += digits[b & 15];
+        }
+        return out;
+    }
+
+    std::string cache_dir() {
+        const char* xdg = std::getenv("XDG_CACHE_HOME");
+        if (xdg != nullptr && *xdg != '\0') {
+            return std::string(xdg) + "/tdb";
+        }
+        const char* home = std::getenv("HOME");
+        return home != nullptr ? std::string(home) + "/.cache/tdb" : std::string();
+    }
+
+    // write to a temporary name and rename, so a concurrent session never maps a half-written file
+    bool write_file(const std::string& path, const std::vector<char>& data) {
+        std::string tmp = path + ".tmp" + std::to_string(getpid());
+        {
+            std::ofstream out {tmp, std::ios::binary | std::ios::trunc};
+            if (!out || !out.write(data.data(), data.size())) {
+                std::remove(tmp.c_str());
+                return false;
+            }
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+}
+
+dwarf_index::dwarf_index(const elf_file& elf) : m_elf{elf} {
+    std::string local = elf.path() + ".tdbidx";
+    std::string shared = cache_dir().empty() ? std::string() : cache_dir() + "/" + hex(key()) + ".tdbidx";
+    if (load(local)) {
+        m_cache_path = local;
+    } else if (!shared.empty() && load(shared)) {
+        m_cache_path = shared;
+    } else {
+        m_building = std::async(std::launch::async, [this] { build(); });
+        return;
+    }
+    m_from_cache = true;
+}
+
+dwarf_index::~dwarf_index() {
+    wait();
+    if (m_mapped) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+void dwarf_index::wait() {
+    if (m_building.valid()) {
+        m_building.get();
+    }
+}
+
+// the build id, or for binaries linked without one the size and modification time of the file
+std::string dwarf_index::key() const {
+    std::string_view id = m_elf.build_id();
+    if (!id.empty()) {
+        return std::string(id.substr(0, sizeof(index_header::key)));
+    }
+    struct stat st;
+    std::string key = "size:" + std::to_string(m_elf.file_size());
+    if (stat(m_elf.path().c_str(), &st) == 0) {
+        key += ",mtime:" + std::to_string(st.st_mtime);
+    }
+    return key.substr(0, sizeof(index_header::key));
+}
+
+bool dwarf_index::load(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(index_header)) {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    auto h = static_cast<const index_header*>(data);
+    std::string k = key();
+    std::size_t size = st.st_size;
+    bool valid = std::memcmp(h->magic, index_magic, sizeof(index_magic)) == 0
+        && h->key_size == k.size() && std::memcmp(h->key, k.data(), k.size()) == 0
+        && h->records <= size && h->count <= (size - h->records) / sizeof(index_record)
+        && h->strings <= size && h->strings_size <= size - h->strings;
+    if (!valid) {
+        munmap(data, size);     // another build of the binary, or not ours at all
+        return false;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = size;
+    m_mapped = true;
+    return true;
+}
+
+void dwarf_index::build() {
+    dwarf_sections sec {m_elf};
+    std::vector<compile_unit> units = read_units(sec);
+    std::vector<std::vector<raw_entry>> results(units.size());
+    {
+        // largest units first, so the long tasks don't end up starting last
+        std::vector<std::size_t> order(units.size());
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return units[a].end - units[a].offset > units[b].end - units[b].offset;
+        });
+        thread_pool pool;
+        for (auto i : order) {
+            pool.submit([&sec, &units, &results, i] { index_unit(sec, units[i], results[i]); });
+        }
+        pool.wait();
+    }
+
+    std::vector<raw_entry> all;
+    std::size_t total = 0;
+    for (const auto& r : results) {
+        total += r.size();
+    }
+    all.reserve(total);
+    for (auto& r : results) {
+        std::move(r.begin(), r.end(), std::back_inserter(all));
+        std::vector<raw_entry>().swap(r);
+    }
+    std::sort(all.begin(), all.end(), [](const raw_entry& a, const raw_entry& b) {
+        if (a.name != b.name) {
+            return a.name < b.name;
+        }
+        return a.what != b.what ? a.what < b.what : a.addr < b.addr;
+    });
+    // every unit that includes a header repeats its types, and inline functions show up once per unit
+    all.erase(std::unique(all.begin(), all.end(), [](const raw_entry& a, const raw_entry& b) {
+        return a.name == b.name && a.what == b.what && (a.what == type || a.addr == b.addr);
+    }), all.end());
+
+    // lay it out exactly like the cache file
+    std::size_t strings_size = 0;
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        if (i == 0 || all[i].name != all[i - 1].name) {
+            strings_size += all[i].name.size();
+        }
+    }
+    index_header h {};
+    std::memcpy(h.magic, index_magic, sizeof(index_magic));
+    std::string k = key();
+    h.key_size = k.size();
+    std::memcpy(h.key, k.data(), k.size());
+    h.count = all.size();
+    h.records = sizeof(index_header);
+    h.strings = h.records + all.size() * sizeof(index_record);
+    h.strings_size = strings_size;
+
+    std::vector<char> buffer(h.strings + strings_size);
+    std::memcpy(buffer.data(), &h, sizeof(h));
+    auto records = reinterpret_cast<index_record*>(buffer.data() + h.records);
+    char* strings = buffer.data() + h.strings;
+    std::uint32_t string_pos = 0;
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        if (i == 0 || all[i].name != all[i - 1].name) {
+            std::memcpy(strings + string_pos, all[i].name.data(), all[i].name.size());
+            string_pos += all[i].name.size();
+        }
+        index_record& r = records[i];
+        r = index_record{};
+        r.addr = all[i].addr;
+        r.size = all[i].size;
+        r.die_offset = all[i].die_offset;
+        r.name_len = all[i].name.size();
+        r.name = string_pos - r.name_len;
+        r.kind = all[i].what;
+    }
+
+    std::string local = m_elf.path() + ".tdbidx";
+    if (write_file(local, buffer)) {
+        m_cache_path = local;
+    } else if (!cache_dir().empty()) {
+        std::string dir = cache_dir();
+        mkdir(dir.substr(0, dir.rfind('/')).c_str(), 0755);
+        mkdir(dir.c_str(), 0755);
+        std::string shared = dir + "/" + hex(k) + ".tdbidx";
+        if (write_file(shared, buffer)) {
+            m_cache_path = shared;
+        }
+    }
+    m_buffer = std::move(buffer);
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+dwarf_index::entry dwarf_index::at(std::size_t i) const {
+    auto h = reinterpret_cast<const index_header*>(m_data);
+    auto r = reinterpret_cast<const index_record*>(m_data + h->records) + i;
+    std::string_view strings {m_data + h->strings, h->strings_size};
+    std::string_view name = r->name <= strings.size() ? strings.substr(r->name, r->name_len) : std::string_view{};
+    return entry{name, static_cast<kind>(r->kind), r->addr, r->size, r->die_offset};
+}
+
+std::size_t dwarf_index::size() {
+    wait();
+    return m_data != nullptr ? reinterpret_cast<const index_header*>(m_data)->count : 0;
+}
+
+std::vector<dwarf_index::entry> dwarf_index::lookup(std::string_view name, kind what) {
+    std::vector<entry> result;
+    std::size_t n = size();
+    // records are sorted by name: binary search for the first one not less than name
+    std::size_t lo = 0, hi = n;
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (at(mid).name < name) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (std::size_t i = lo; i < n; ++i) {
+        entry e = at(i);
+        if (e.name != name) {
+            break;
+        }
+        if (e.what == what) {
+            result.push_back(e);
+        }
+    }
+    return result;
+}
+
+std::vector<dwarf_index::entry> dwarf_index::search(std::string_view part, kind what, std::size_t limit) {
+    std::vector<entry> result;
+    std::size_t n = size();
+    for (std::size_t i = 0; i < n && result.size() < limit; ++i) {
+        entry e = at(i);
+        if (e.what == what && e.name.find(part) != std::string_view::npos) {
+            result.push_back(e);
+        }
+    }
+    return result;
+}
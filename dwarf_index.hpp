@@ -0,0 +1,64 @@
+#ifndef TDB_DWARF_INDEX_HPP
+#define TDB_DWARF_INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "elf.hpp"
+
+// names of the functions, global variables and types in .debug_info.
+//
+// the index is built once per binary: one task per compilation unit on a work-stealing thread pool,
+// then merged and sorted by name. the result is saved next to the binary (<binary>.tdbidx, or under
+// ~/.cache/tdb when that directory is read-only) tagged with the binary's build id, in a layout that
+// is used straight from an mmap of the file. the next session for the same build only maps it
+class dwarf_index {
+    public:
+        enum kind : std::uint8_t { function = 1, variable = 2, type = 3 };
+
+        struct entry {
+            std::string_view name;      // qualified, e.g. ns::widget::draw
+            kind what;
+            std::uint64_t addr;         // link-time address of a function or variable, 0 for types
+            std::uint64_t size;         // of a variable or type in bytes, 0 if unknown
+            std::uint64_t die_offset;   // of its DIE in .debug_info
+        };
+
+        // loads the cache file if there is a valid one, otherwise starts building in the background
+        explicit dwarf_index(const elf_file& elf);
+        ~dwarf_index();
+        dwarf_index(const dwarf_index&) = delete;
+        dwarf_index& operator=(const dwarf_index&) = delete;
+
+        // all of these wait for a background build to finish
+        std::vector<entry> lookup(std::string_view name, kind what);
+        // entries of one kind whose name contains `part`, at most `limit` of them
+        std::vector<entry> search(std::string_view part, kind what, std::size_t limit);
+        std::size_t size();
+
+        bool from_cache() const { return m_from_cache; }
+        const std::string& cache_path() const { return m_cache_path; }
+
+    private:
+        void wait();
+        void build();
+        bool load(const std::string& path);
+        std::string key() const;
+        entry at(std::size_t i) const;
+
+        const elf_file& m_elf;
+        std::future<void> m_building;
+        bool m_from_cache = false;
+        std::string m_cache_path;
+
+        // the index in its file layout, either mapped from the cache file or built in memory
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_mapped = false;
+        std::vector<char> m_buffer;
+};
+
+#endif
@@ -0,0 +1,292 @@
+#include "elf.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+    // heterogeneous comparison for binary searching the by-name index with a plain string
+    struct by_name {
+        const std::vector<elf_file::symbol>& symbols;
+        bool operator()(std::uint32_t a, std::string_view b) const { return symbols[a].name < b; }
+        bool operator()(std::string_view a, std::uint32_t b) const { return a < symbols[b].name; }
+    };
+}
+
+std::unique_ptr<elf_file> elf_file::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<std::size_t>(st.st_size) < sizeof(Elf64_Ehdr)) {
+        std::cerr << path << ": not an ELF file" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    // the page tables fill in as we touch the file, so opening a 300 MB binary costs nothing up front
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "cannot map " << path << ": " << std::strerror(errno) << std::endl;
+        return nullptr;
+    }
+
+    std::unique_ptr<elf_file> elf {new elf_file};
+    elf->m_path = path;
+    elf->m_data = static_cast<const char*>(data);
+    elf->m_size = st.st_size;
+    elf->m_ehdr = reinterpret_cast<const Elf64_Ehdr*>(data);
+
+    const Elf64_Ehdr& eh = *elf->m_ehdr;
+    if (std::memcmp(eh.e_ident, ELFMAG, SELFMAG) != 0 || eh.e_ident[EI_CLASS] != ELFCLASS64) {
+        std::cerr << path << ": not a 64-bit ELF file" << std::endl;
+        return nullptr;
+    }
+    if (eh.e_shoff != 0 && eh.e_shentsize == sizeof(Elf64_Shdr)
+            && eh.e_shoff + eh.e_shnum * sizeof(Elf64_Shdr) <= elf->m_size) {
+        elf->m_shdrs = reinterpret_cast<const Elf64_Shdr*>(elf->m_data + eh.e_shoff);
+        elf->m_shnum = eh.e_shnum;
+        if (eh.e_shstrndx < eh.e_shnum) {
+            elf->m_shstrtab = elf->contents(&elf->m_shdrs[eh.e_shstrndx]);
+        }
+    }
+    if (eh.e_phoff != 0 && eh.e_phentsize == sizeof(Elf64_Phdr)
+            && eh.e_phoff + eh.e_phnum * sizeof(Elf64_Phdr) <= elf->m_size) {
+        elf->m_phdrs = reinterpret_cast<const Elf64_Phdr*>(elf->m_data + eh.e_phoff);
+        elf->m_phnum = eh.e_phnum;
+    }
+    return elf;
+}
+
+elf_file::~elf_file() {
+    if (m_data != nullptr) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+
+bool elf_file::is_loaded(std::uint64_t addr) const {
+    for (std::size_t i = 0; i < m_phnum; ++i) {
+        if (m_phdrs[i].p_type == PT_LOAD && addr >= m_phdrs[i].p_vaddr && addr - m_phdrs[i].p_vaddr < m_phdrs[i].p_memsz) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const Elf64_Shdr* elf_file::section(std::string_view name) const {
+    for (std::size_t i = 0; i < m_shnum; ++i) {
+        if (section_name(&m_shdrs[i]) == name) {
+            return &m_shdrs[i];
+        }
+    }
+    return nullptr;
+}
+
+std::string_view elf_file::contents(const Elf64_Shdr* sec) const {
+    if (sec == nullptr || sec->sh_type == SHT_NOBITS || sec->sh_offset > m_size
+            || sec->sh_size > m_size - sec->sh_offset) {
+        return {};
+    }
+    return std::string_view(m_data + sec->sh_offset, sec->sh_size);
+}
+
+std::string_view elf_file::section_name(const Elf64_Shdr* sec) const {
+    if (sec->sh_name >= m_shstrtab.size()) {
+        return {};
+    }
+    const char* name = m_shstrtab.data() + sec->sh_name;
+    return std::string_view(name, strnlen(name, m_shstrtab.size() - sec->sh_name));
+}
+
+std::string_view elf_file::build_id() const {
+    for (std::size_t i = 0; i < m_shnum; ++i) {
+        if (m_shdrs[i].sh_type != SHT_NOTE) {
+            continue;
+        }
+        std::string_view notes = contents(&m_shdrs[i]);
+        std::size_t pos = 0;
+        while (pos + sizeof(Elf64_Nhdr) <= notes.size()) {
+            auto note = reinterpret_cast<const Elf64_Nhdr*>(notes.data() + pos);
+            std::size_t name = pos + sizeof(Elf64_Nhdr);
+            std::size_t desc = name + ((note->n_namesz + 3) & ~3u);
+            std::size_t next = desc + ((note->n_descsz + 3) & ~3u);
+            if (next > notes.size()) {
+                break;
+            }
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && notes.compare(name, 4, "GNU\0", 4) == 0) {
+                return notes.substr(desc, note->n_descsz);
+            }
+            pos = next;
+        }
+    }
+    return {};
+}
+
+void elf_file::add_symbols(const Elf64_Shdr* symtab) const {
+    if (symtab == nullptr || symtab->sh_link >= m_shnum) {
+        return;
+    }
+    std::string_view syms = contents(symtab);
+    std::string_view strtab = contents(&m_shdrs[symtab->sh_link]);
+    std::size_t count = syms.size() / sizeof(Elf64_Sym);
+    auto first = reinterpret_cast<const Elf64_Sym*>(syms.data());
+
+    m_symbols.reserve(m_symbols.size() + count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const Elf64_Sym& s = first[i];
+        unsigned char type = ELF64_ST_TYPE(s.st_info);
+        if (s.st_shndx == SHN_UNDEF || s.st_name == 0 || s.st_name >= strtab.size()) {
+            continue;
+        }
+        if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE && type != STT_GNU_IFUNC) {
+            continue;   // sections, files and TLS offsets are not addresses
+        }
+        const char* name = strtab.data() + s.st_name;
+        m_symbols.push_back({s.st_value, s.st_size, std::string_view(name, strnlen(name, strtab.size() - s.st_name)), type});
+    }
+}
+
+// a PLT entry has no symbol of its own. it is named after the one whose GOT slot its jmp *slot(%rip) goes
+// through, as objdump does: the JUMP_SLOT relocations give the slots of .plt and .plt.sec (with IBT), the
+// GLOB_DAT ones those of .plt.got (functions whose address is taken as well)
+void elf_file::add_plt_symbols() const {
+    std::unordered_map<std::uint64_t, std::string_view> slots;
+    for (std::size_t i = 0; i < m_shnum; ++i) {
+        if (m_shdrs[i].sh_type != SHT_RELA || m_shdrs[i].sh_link >= m_shnum) {
+            continue;
+        }
+        const Elf64_Shdr& symtab = m_shdrs[m_shdrs[i].sh_link];
+        if (symtab.sh_type != SHT_DYNSYM || symtab.sh_link >= m_shnum) {
+            continue;
+        }
+        std::string_view syms = contents(&symtab);
+        std::string_view strtab = contents(&m_shdrs[symtab.sh_link]);
+        std::string_view relas = contents(&m_shdrs[i]);
+        auto first = reinterpret_cast<const Elf64_Rela*>(relas.data());
+        for (std::size_t r = 0; r < relas.size() / sizeof(Elf64_Rela); ++r) {
+            std::uint32_t type = ELF64_R_TYPE(first[r].r_info), index = ELF64_R_SYM(first[r].r_info);
+            if ((type != R_X86_64_JUMP_SLOT && type != R_X86_64_GLOB_DAT) || index >= syms.size() / sizeof(Elf64_Sym)) {
+                continue;
+            }
+            const Elf64_Sym& sym = reinterpret_cast<const Elf64_Sym*>(syms.data())[index];
+            if (sym.st_name != 0 && sym.st_name < strtab.size()) {
+                const char* name = strtab.data() + sym.st_name;
+                slots[first[r].r_offset] = std::string_view(name, strnlen(name, strtab.size() - sym.st_name));
+            }
+        }
+    }
+    if (slots.empty()) {
+        return;
+    }
+    for (std::string_view plt : {".plt", ".plt.sec", ".plt.got"}) {
+        const Elf64_Shdr* sec = section(plt);
+        std::string_view code = contents(sec);
+        std::size_t entry = sec != nullptr && sec->sh_entsize != 0 ? sec->sh_entsize : 16;
+        for (std::size_t offset = 0; offset + entry <= code.size(); offset += entry) {
+            // the jmp comes after an endbr64 or a bnd prefix, if any; the first entry of .plt jumps to the resolver
+            for (std::size_t at = offset; at + 6 <= offset + entry; ++at) {
+                if (static_cast<unsigned char>(code[at]) != 0xff || code[at + 1] != 0x25) {
+                    continue;
+                }
+                std::int32_t disp;
+                std::memcpy(&disp, code.data() + at + 2, sizeof(disp));
+                auto slot = slots.find(sec->sh_addr + at + 6 + disp);
+                if (slot != slots.end()) {
+                    m_plt_names.push_back(std::string(slot->second) + "@plt");
+                    m_symbols.push_back({sec->sh_addr + offset, entry, m_plt_names.back(), STT_FUNC});
+                }
+                break;
+            }
+        }
+    }
+}
+
+void elf_file::build_symbol_index() const {
+    std::call_once(m_symbols_once, [this] {
+        add_symbols(section(".symtab"));
+        add_symbols(section(".dynsym"));
+        add_plt_symbols();
+
+        // .dynsym repeats most of .symtab, keep one copy of each (addr, name)
+        std::sort(m_symbols.begin(), m_symbols.end(), [](const symbol& a, const symbol& b) {
+            return a.addr != b.addr ? a.addr < b.addr : a.name < b.name;
+        });
+        m_symbols.erase(std::unique(m_symbols.begin(), m_symbols.end(), [](const symbol& a, const symbol& b) {
+            return a.addr == b.addr && a.name == b.name;
+        }), m_symbols.end());
+        m_symbols.shrink_to_fit();
+
+        m_symbol_addrs.resize(m_symbols.size());
+        m_symbol_reach.resize(m_symbols.size());
+        m_by_name.resize(m_symbols.size());
+        std::uint64_t reach = 0;
+        for (std::size_t i = 0; i < m_symbols.size(); ++i) {
+            m_symbol_addrs[i] = m_symbols[i].addr;
+            reach = std::max(reach, m_symbols[i].addr + m_symbols[i].size);
+            m_symbol_reach[i] = reach;
+            m_by_name[i] = i;
+        }
+        std::sort(m_by_name.begin(), m_by_name.end(), [this](std::uint32_t a, std::uint32_t b) {
+            return m_symbols[a].name < m_symbols[b].name;
+        });
+    });
+}
+
+const elf_file::symbol* elf_file::find_symbol(std::uint64_t addr) const {
+    build_symbol_index();
+    auto it = std::upper_bound(m_symbol_addrs.begin(), m_symbol_addrs.end(), addr);
+    if (it == m_symbol_addrs.begin()) {
+        return nullptr;
+    }
+    std::size_t best = it - m_symbol_addrs.begin() - 1;
+    // zero-sized labels and aliases can sit inside a real function, however many of them: walk down for the
+    // closest symbol that contains addr, as long as anything below can still reach that far
+    for (std::size_t i = best + 1; i-- > 0 && m_symbol_reach[i] > addr; ) {
+        if (addr < m_symbols[i].addr + m_symbols[i].size) {
+            return &m_symbols[i];
+        }
+    }
+    // hand-written assembly often has no size on its symbols, take a label just below addr then. not one in
+    // another section though: _init is no name for the PLT after it
+    if (section_at(m_symbols[best].addr) != section_at(addr)) {
+        return nullptr;
+    }
+    for (std::size_t i = best + 1; i-- > 0 && m_symbols[i].addr == m_symbols[best].addr; ) {
+        if (m_symbols[i].size == 0) {
+            return &m_symbols[i];
+        }
+    }
+    return nullptr;
+}
+
+const Elf64_Shdr* elf_file::section_at(std::uint64_t addr) const {
+    for (std::size_t i = 0; i < m_shnum; ++i) {
+        if ((m_shdrs[i].sh_flags & SHF_ALLOC) != 0 && addr >= m_shdrs[i].sh_addr
+                && addr - m_shdrs[i].sh_addr < m_shdrs[i].sh_size) {
+            return &m_shdrs[i];
+        }
+    }
+    return nullptr;
+}
+
+std::vector<const elf_file::symbol*> elf_file::lookup_symbol(std::string_view name) const {
+    build_symbol_index();
+    auto range = std::equal_range(m_by_name.begin(), m_by_name.end(), name, by_name{m_symbols});
+    std::vector<const symbol*> result;
+    for (auto it = range.first; it != range.second; ++it) {
+        result.push_back(&m_symbols[*it]);
+    }
+    return result;
+}
+
+std::size_t elf_file::symbol_count() const {
+    build_symbol_index();
+    return m_symbols.size();
+}
@@ -0,0 +1,86 @@
+#ifndef TDB_ELF_HPP
+#define TDB_ELF_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <elf.h>
+
+// a 64-bit ELF file mapped read-only into our address space.
+// nothing is copied out of the mapping: section contents and symbol names are views into it,
+// so the file must outlive everything handed out by it. only the names made up for PLT entries are not
+class elf_file {
+    public:
+        struct symbol {
+            std::uint64_t addr;     // link-time address, add the load bias for a PIE / shared object
+            std::uint64_t size;
+            std::string_view name;
+            unsigned char type;     // STT_FUNC, STT_OBJECT, ...
+        };
+
+        // nullptr (and a message on stderr) if the file cannot be opened or is not a 64-bit ELF
+        static std::unique_ptr<elf_file> open(const std::string& path);
+        ~elf_file();
+        elf_file(const elf_file&) = delete;
+        elf_file& operator=(const elf_file&) = delete;
+
+        const std::string& path() const { return m_path; }
+        const Elf64_Ehdr& header() const { return *m_ehdr; }
+        bool is_pie() const { return m_ehdr->e_type == ET_DYN; }
+
+        std::size_t file_size() const { return m_size; }
+        // contents of the NT_GNU_BUILD_ID note, empty if the linker did not write one
+        std::string_view build_id() const;
+
+        // nullptr if there is no such section
+        const Elf64_Shdr* section(std::string_view name) const;
+        std::string_view contents(const Elf64_Shdr* sec) const;
+        std::string_view section_name(const Elf64_Shdr* sec) const;
+        const Elf64_Shdr* sections_begin() const { return m_shdrs; }
+        const Elf64_Shdr* sections_end() const { return m_shdrs + m_shnum; }
+        const Elf64_Phdr* segments_begin() const { return m_phdrs; }
+        const Elf64_Phdr* segments_end() const { return m_phdrs + m_phnum; }
+        // whether a link-time address is inside one of the PT_LOAD segments
+        bool is_loaded(std::uint64_t addr) const;
+
+        // the symbol whose [addr, addr + size) contains addr, else the closest sizeless label below it in the
+        // same section. the index over .symtab, .dynsym and the PLT (puts@plt) is built on the first lookup,
+        // not when the file is opened
+        const symbol* find_symbol(std::uint64_t addr) const;
+        // all symbols called exactly `name` (there can be several local ones)
+        std::vector<const symbol*> lookup_symbol(std::string_view name) const;
+        std::size_t symbol_count() const;
+
+    private:
+        elf_file() = default;
+        void build_symbol_index() const;
+        void add_symbols(const Elf64_Shdr* symtab) const;
+        void add_plt_symbols() const;
+        const Elf64_Shdr* section_at(std::uint64_t addr) const;
+
+        std::string m_path;
+        const char* m_data = nullptr;
+        std::size_t m_size = 0;
+        const Elf64_Ehdr* m_ehdr = nullptr;
+        const Elf64_Shdr* m_shdrs = nullptr;
+        std::size_t m_shnum = 0;
+        const Elf64_Phdr* m_phdrs = nullptr;
+        std::size_t m_phnum = 0;
+        std::string_view m_shstrtab;
+
+        // symbol index, sorted by address. the addresses live in their own array so the binary
+        // search only walks 8-byte keys; m_by_name holds indices into m_symbols sorted by name
+        mutable std::once_flag m_symbols_once;
+        mutable std::vector<std::uint64_t> m_symbol_addrs;
+        mutable std::vector<std::uint64_t> m_symbol_reach;  // the highest end of any symbol up to this one
+        mutable std::vector<symbol> m_symbols;
+        mutable std::vector<std::uint32_t> m_by_name;
+        mutable std::deque<std::string> m_plt_names;     // "puts@plt"; a deque, so the views stay valid
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "event_loop.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace {
+    enum watch_kind { plain_fd, signal_fd, timer_fd };
+    const int max_events = 16;
+}
+
+event_loop::event_loop() : m_epoll{epoll_create1(EPOLL_CLOEXEC)} {}
+
+event_loop::~event_loop() {
+    for (auto& w : m_watches) {
+        if (w.second.kind != plain_fd) {
+            close(w.first);
+        }
+    }
+    if (m_epoll >= 0) {
+        close(m_epoll);
+    }
+}
+
+bool event_loop::add(int fd, callback cb) {
+    epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return false;
+    }
+    m_watches[fd] = watch{std::move(cb), plain_fd};
+    return true;
+}
+
+void event_loop::remove(int fd) {
+    auto it = m_watches.find(fd);
+    if (it == m_watches.end()) {
+        return;
+    }
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    if (it->second.kind != plain_fd) {
+        close(fd);
+    }
+    m_watches.erase(it);
+}
+
+void event_loop::pause(int fd, bool paused) {
+    if (m_watches.count(fd) == 0) {
+        return;
+    }
+    epoll_event ev {};
+    ev.events = paused ? 0 : EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, fd, &ev);
+}
+
+int event_loop::add_signal(int signo, callback cb) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, signo);
+    sigprocmask(SIG_BLOCK, &set, nullptr);
+    int fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if (!add(fd, std::move(cb))) {
+        close(fd);
+        return -1;
+    }
+    m_watches[fd].kind = signal_fd;
+    return fd;
+}
+
+int event_loop::add_timer(std::chrono::nanoseconds period, bool repeat, callback cb) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    itimerspec spec {};
+    spec.it_value.tv_sec = period.count() / 1000000000;
+    spec.it_value.tv_nsec = period.count() % 1000000000;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;  // zero would disarm it
+    }
+    if (repeat) {
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(fd, 0, &spec, nullptr) < 0 || !add(fd, std::move(cb))) {
+        close(fd);
+        return -1;
+    }
+    m_watches[fd].kind = timer_fd;
+    return fd;
+}
+
+void event_loop::cancel_timer(int id) {
+    remove(id);
+}
+
+void event_loop::run_once(int timeout_ms) {
+    epoll_event events[max_events];
+    int n = epoll_wait(m_epoll, events, max_events, timeout_ms);
+    for (int i = 0; i < n; ++i) {
+        int fd = events[i].data.fd;
+        auto it = m_watches.find(fd);
+        if (it == m_watches.end()) {
+            continue;   // removed by an earlier callback of this round
+        }
+        // signals and timer expirations coalesce: one callback covers however many there were
+        if (it->second.kind == signal_fd) {
+            signalfd_siginfo info;
+            while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+            }
+        } else if (it->second.kind == timer_fd) {
+            if (read(fd, &m_expirations, sizeof(m_expirations)) < 0 && errno == EAGAIN) {
+                continue;
+            }
+        }
+        // the callback may remove its own watch
+        callback cb = it->second.cb;
+        bool once = it->second.kind == timer_fd;
+        if (once) {
+            itimerspec spec;
+            once = timerfd_gettime(fd, &spec) == 0 && spec.it_interval.tv_sec == 0 && spec.it_interval.tv_nsec == 0;
+            if (once) {
+                remove(fd);
+            }
+        }
+        cb();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef TDB_EVENT_LOOP_HPP
+#define TDB_EVENT_LOOP_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+// one epoll instance multiplexing everything the debugger waits on: terminal input, tracee stops
+// (SIGCHLD through a signalfd) and timers (timerfds). callbacks run on the thread calling run_once
+class event_loop {
+    public:
+        using callback = std::function<void()>;
+
+        event_loop();
+        ~event_loop();
+        event_loop(const event_loop&) = delete;
+        event_loop& operator=(const event_loop&) = delete;
+
+        // calls cb whenever fd is readable. false if epoll refuses the fd (a regular file, say)
+        bool add(int fd, callback cb);
+        void remove(int fd);
+        // stops (or resumes) watching fd without forgetting its callback
+        void pause(int fd, bool paused);
+
+        // blocks signo and turns its deliveries into cb calls. returns the signalfd, -1 on failure.
+        // threads started before this must already have signo blocked, or they may take the signal
+        int add_signal(int signo, callback cb);
+
+        // calls cb once after `ms` milliseconds, or every `ms` if repeat. returns an id for cancel_timer,
+        // which for a one-shot timer is dead (and may be reused) once it has fired
+        int add_timer(std::uint64_t ms, bool repeat, callback cb) { return add_timer(std::chrono::milliseconds(ms), repeat, cb); }
+        int add_timer(std::chrono::nanoseconds period, bool repeat, callback cb);
+        void cancel_timer(int id);
+        // in a repeating timer's callback: how many periods it is for. the expirations of a timer the loop
+        // gets to late coalesce into one callback, more than one is ticks lost
+        std::uint64_t expirations() const { return m_expirations; }
+
+        // waits up to timeout_ms (-1: forever) and runs the callbacks of whatever is ready
+        void run_once(int timeout_ms = -1);
+
+    private:
+        struct watch {
+            callback cb;
+            int kind;       // plain fd, signalfd or timerfd: what to drain before calling back
+        };
+
+        int m_epoll;
+        std::unordered_map<int, watch> m_watches;
+        std::uint64_t m_expirations = 0;
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "hits.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <time.h>
+
+namespace {
+    // 1024 -> "1K": the histogram's bucket bounds
+    std::string bound(std::uint64_t ns) {
+        static const char* suffixes[] = {"", "K", "M", "G", "T", "P", "E"};
+        int i = 0;
+        while (ns >= 1024 && ns % 1024 == 0) {
+            ns /= 1024;
+            ++i;
+        }
+        return std::to_string(ns) + suffixes[i];
+    }
+
+    std::string duration(std::uint64_t ns) {
+        return ns < 10000 ? std::to_string(ns) + "ns" : ns < 10000000 ? std::to_string(ns / 1000) + "us"
+               : std::to_string(ns / 1000000) + "ms";
+    }
+}
+
+std::uint64_t hit_stats::now() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void hit_stats::hit(std::uint64_t addr, std::uint64_t when) {
+    entry& e = m_entries[addr];
+    if (e.hits++ != 0) {
+        std::uint64_t interval = when - e.last;
+        e.intervals[interval == 0 ? 0 : 63 - __builtin_clzll(interval)]++;
+    }
+    e.last = when;
+    m_holding.emplace(addr, when);
+}
+
+void hit_stats::resumed(std::uint64_t when) {
+    for (const auto& holding : m_holding) {
+        auto it = m_entries.find(holding.first);
+        if (it != m_entries.end()) {
+            it->second.held += when - holding.second;
+        }
+    }
+    m_holding.clear();
+}
+
+std::uint64_t hit_stats::hits(std::uint64_t addr) const {
+    auto it = m_entries.find(addr);
+    return it == m_entries.end() ? 0 : it->second.hits;
+}
+
+void hit_stats::remove(std::uint64_t addr) {
+    m_entries.erase(addr);
+    m_holding.erase(addr);
+}
+
+void hit_stats::clear() {
+    m_entries.clear();
+    m_holding.clear();
+}
+
+void hit_stats::write(std::ostream& out, std::uint64_t addr) const {
+    auto it = m_entries.find(addr);
+    if (it == m_entries.end()) {
+        out << "0 hits" << std::endl;
+        return;
+    }
+    const entry& e = it->second;
+    out << e.hits << (e.hits == 1 ? " hit" : " hits") << ", held " << duration(e.held / e.hits) << " each on average"
+        << std::endl;
+    std::size_t first = 0, last = e.intervals.size();
+    while (first < last && e.intervals[first] == 0) {
+        ++first;
+    }
+    while (last > first && e.intervals[last - 1] == 0) {
+        --last;
+    }
+    if (first == last) {
+        return;
+    }
+    std::uint64_t most = 0;
+    for (std::size_t i = first; i < last; ++i) {
+        most = std::max(most, e.intervals[i]);
+    }
+    out << "time between hits (ns):" << std::endl;
+    const std::size_t width = 40;
+    for (std::size_t i = first; i < last; ++i) {
+        std::string range = "[" + (i == 0 ? std::string("0") : bound(std::uint64_t{1} << i)) + ", "
+                            + (i == 63 ? std::string("...") : bound(std::uint64_t{2} << i)) + ")";
+        std::size_t bar = (e.intervals[i] * width + most - 1) / most;
+        out << "  " << std::left << std::setw(14) << range << std::right << std::setw(10) << e.intervals[i] << " |"
+            << std::string(bar, '@') << std::string(width - bar, ' ') << "|" << std::endl;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef TDB_HITS_HPP
+#define TDB_HITS_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <unordered_map>
+
+// what the breakpoints were hit for (`info hits`): per breakpoint, the number of reported hits, how long
+// the program was held there in all, and a log2 histogram of the time between one hit and the next
+class hit_stats {
+    public:
+        static std::uint64_t now();     // ns, CLOCK_MONOTONIC
+
+        void hit(std::uint64_t addr, std::uint64_t when);
+        // the program runs again: the hits it was held at since are over
+        void resumed(std::uint64_t when);
+        bool holding() const { return !m_holding.empty(); }
+        std::uint64_t hits(std::uint64_t addr) const;
+
+        void remove(std::uint64_t addr);
+        void clear();
+
+        // "40954 hits, held 14us each on average", then the histogram, one line per bucket from the first
+        // to the last that is not empty
+        void write(std::ostream& out, std::uint64_t addr) const;
+
+    private:
+        struct entry {
+            std::uint64_t hits = 0;
+            std::uint64_t last = 0;         // when it was hit last
+            std::uint64_t held = 0;         // ns, in all
+            std::array<std::uint64_t, 64> intervals {};     // bucket i: [2^i, 2^(i+1)) ns since the hit before
+        };
+
+        std::unordered_map<std::uint64_t, entry> m_entries;
+        std::unordered_map<std::uint64_t, std::uint64_t> m_holding;     // hits the program is held at, since when
+};
+
+#endif
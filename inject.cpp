@@ -0,0 +1,139 @@
+#include "inject.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <fstream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+namespace {
+    const std::uint64_t rel32_reach = 0x7fff0000;   // a little short of 2GB, leaving room for the code itself
+    const std::uint64_t page = 4096;
+}
+
+long remote_syscall(pid_t tid, memory& mem, long number, std::initializer_list<std::uint64_t> args, int* signal) {
+    static const unsigned char syscall_insn[] = {0x0f, 0x05};
+    user_regs_struct saved;
+    if (ptrace(PTRACE_GETREGS, tid, nullptr, &saved) < 0) {
+        return -errno;
+    }
+    unsigned char original[sizeof(syscall_insn)];
+    if (mem.read(saved.rip, original, sizeof(original)) < sizeof(original)
+            || mem.write(saved.rip, syscall_insn, sizeof(syscall_insn)) < sizeof(syscall_insn)) {
+        return -EFAULT;
+    }
+    user_regs_struct regs = saved;
+    regs.rax = number;
+    // orig_rax -1: not in a system call, so the kernel won't try to restart one the thread was stopped in
+    regs.orig_rax = -1;
+    decltype(regs.rdi)* slots[] = {&regs.rdi, &regs.rsi, &regs.rdx, &regs.r10, &regs.r8, &regs.r9};
+    std::size_t i = 0;
+    for (auto arg : args) {
+        *slots[i++] = arg;
+    }
+    long result = -ESRCH;
+    ptrace(PTRACE_SETREGS, tid, nullptr, &regs);
+    if (ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr) == 0) {
+        int wait_status;
+        while (waitpid(tid, &wait_status, __WALL) == tid && WIFSTOPPED(wait_status)) {
+            int sig = WSTOPSIG(wait_status);
+            if (sig == SIGTRAP && wait_status >> 16 == 0) {
+                user_regs_struct after;
+                ptrace(PTRACE_GETREGS, tid, nullptr, &after);
+                if (after.rip == saved.rip + sizeof(syscall_insn)) {
+                    result = after.rax;
+                    break;
+                }
+                // a thread stopped in a system call (say, at the exec stop) reports the step at the end of that
+                // call first, before it gets to ours, and with the call's result in rax: set up ours again
+                ptrace(PTRACE_SETREGS, tid, nullptr, &regs);
+            }
+            // an interrupt, or a signal that came before the step: hold on to the signal and step again
+            if (sig != SIGTRAP && signal != nullptr && *signal == 0 && wait_status >> 16 == 0) {
+                *signal = sig;
+            }
+            ptrace(PTRACE_SINGLESTEP, tid, nullptr, nullptr);
+        }
+    }
+    mem.write(saved.rip, original, sizeof(original));
+    ptrace(PTRACE_SETREGS, tid, nullptr, &saved);
+    return result;
+}
+
+std::uint64_t code_pool::allocate(pid_t tid, std::uint64_t near, std::size_t size) {
+    size = (size + 15) & ~std::size_t{15};
+    auto reachable = [near](std::uint64_t addr) {
+        return (addr > near ? addr - near : near - addr) < rel32_reach;
+    };
+    for (auto& c : m_chunks) {
+        if (c.size - c.used >= size && reachable(c.addr + c.used) && reachable(c.addr + c.used + size)) {
+            std::uint64_t addr = c.addr + c.used;
+            c.used += size;
+            return addr;
+        }
+    }
+    if (size > chunk_size) {
+        return 0;
+    }
+    std::uint64_t addr = map_near(tid, near);
+    if (addr == 0) {
+        return 0;
+    }
+    m_chunks.push_back(chunk{addr, chunk_size, size});
+    return addr;
+}
+
+// the hole in the address space closest to `near`, from /proc/<pid>/maps, mapped with MAP_FIXED_NOREPLACE
+// so that nothing that appeared since can be clobbered
+std::uint64_t code_pool::map_near(pid_t tid, std::uint64_t near) {
+    std::ifstream maps {"/proc/" + std::to_string(tid) + "/maps"};
+    std::uint64_t best = 0, best_distance = rel32_reach;
+    std::uint64_t previous_end = 0x10000;   // below is mmap_min_addr
+    auto consider = [&](std::uint64_t start, std::uint64_t end) {
+        if (end <= start || end - start < chunk_size) {
+            return;
+        }
+        // the end of the hole closest to near
+        std::uint64_t candidate = near < start ? start : near + chunk_size > end ? end - chunk_size : near;
+        candidate &= ~(page - 1);
+        std::uint64_t distance = candidate > near ? candidate + chunk_size - near : near - candidate;
+        if (candidate >= start && distance < best_distance) {
+            best = candidate;
+            best_distance = distance;
+        }
+    };
+    for (std::string line; std::getline(maps, line); ) {
+        auto dash = line.find('-');
+        auto space = line.find(' ');
+        if (dash == std::string::npos || space == std::string::npos) {
+            continue;
+        }
+        std::uint64_t start = std::stoull(line.substr(0, dash), nullptr, 16);
+        std::uint64_t end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+        consider(previous_end, start);
+        previous_end = end;
+    }
+    consider(previous_end, 0x7ffffffff000);
+    if (best == 0) {
+        return 0;
+    }
+    long addr = remote_syscall(tid, m_memory, SYS_mmap, {best, chunk_size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, static_cast<std::uint64_t>(-1), 0});
+    if (addr < 0 && addr > -4096) {
+        return 0;
+    }
+    if (static_cast<std::uint64_t>(addr) != best) {
+        // a kernel without MAP_FIXED_NOREPLACE took it for a hint
+        remote_syscall(tid, m_memory, SYS_munmap, {static_cast<std::uint64_t>(addr), chunk_size});
+        return 0;
+    }
+    return best;
+}
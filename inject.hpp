@@ -0,0 +1,44 @@
+#ifndef TDB_INJECT_HPP
+#define TDB_INJECT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+#include <sys/types.h>
+#include "memory.hpp"
+
+// makes a system call in the inferior: thread tid (stopped) executes a syscall instruction written over
+// its pc, then gets its registers and code back. returns what the kernel returned, -errno on failure.
+// a signal that arrives meanwhile is stored in *signal, for the caller to deliver on the next resume
+long remote_syscall(pid_t tid, memory& mem, long number, std::initializer_list<std::uint64_t> args,
+                    int* signal = nullptr);
+
+// executable memory in the inferior for code the debugger puts there (tracepoint trampolines,
+// displaced instructions). pieces are carved out of chunks mapped with remote mmaps, each chunk placed
+// within a rel32 jump of the code that asked for it
+class code_pool {
+    public:
+        explicit code_pool(memory& mem) : m_memory(mem) {}
+
+        // `size` bytes within 2GB of `near`, mapped by thread tid if need be. 0 if there is no room
+        std::uint64_t allocate(pid_t tid, std::uint64_t near, std::size_t size);
+        // the inferior exec'd, its chunks are gone
+        void reset() { m_chunks.clear(); }
+
+    private:
+        struct chunk {
+            std::uint64_t addr;
+            std::size_t size;
+            std::size_t used;
+        };
+
+        static const std::size_t chunk_size = 64 * 1024;
+
+        std::uint64_t map_near(pid_t tid, std::uint64_t near);
+
+        memory& m_memory;
+        std::vector<chunk> m_chunks;
+};
+
+#endif
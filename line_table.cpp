@@ -0,0 +1,482 @@
+#include "line_table.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+// the fixed part of a line program header, everything needed to run the state machine
+struct line_header {
+    std::uint16_t version = 0;
+    bool is64 = false;
+    std::uint8_t addr_size = 8;
+    std::uint8_t min_inst_length = 1;
+    bool default_is_stmt = true;
+    std::int8_t line_base = 0;
+    std::uint8_t line_range = 1;
+    std::uint8_t opcode_base = 1;
+    std::uint8_t opcode_lengths[256] = {};
+    std::size_t program = 0;    // first opcode
+    std::size_t end = 0;        // one past the last one
+};
+
+namespace {
+    std::string join_path(std::string_view dir, std::string_view name) {
+        if (dir.empty() || (!name.empty() && name[0] == '/')) {
+            return std::string(name);
+        }
+        std::string path {dir};
+        if (path.back() != '/') {
+            path += '/';
+        }
+        path.append(name.data(), name.size());
+        return path;
+    }
+
+    // "test.cpp" and "src/test.cpp" both name "/home/me/src/test.cpp"
+    bool path_matches(std::string_view path, std::string_view wanted) {
+        if (path.size() < wanted.size() || path.compare(path.size() - wanted.size(), wanted.size(), wanted) != 0) {
+            return false;
+        }
+        return path.size() == wanted.size() || wanted[0] == '/' || path[path.size() - wanted.size() - 1] == '/';
+    }
+}
+
+std::ptrdiff_t line_table::row_for(std::uint64_t pc) const {
+    auto it = std::upper_bound(address.begin(), address.end(), pc);
+    if (it == address.begin()) {
+        return -1;
+    }
+    std::ptrdiff_t row = it - address.begin() - 1;
+    // past the end of a sequence, i.e. in a gap between two
+    return (flags[row] & end_sequence) ? -1 : row;
+}
+
+void line_index::load_units() {
+    if (m_loaded) {
+        return;
+    }
+    m_loaded = true;
+    m_cus = read_units(m_sections);
+
+    // every line program of .debug_line, found by hopping over their lengths
+    std::unordered_map<std::uint64_t, std::size_t> by_offset;
+    dwarf_cursor c {m_sections.line};
+    while (!c.at_end()) {
+        std::uint64_t offset = c.pos();
+        bool is64 = false;
+        std::uint64_t length = c.initial_length(is64);
+        if (c.error() || length == 0) {
+            break;
+        }
+        by_offset[offset] = m_units.size();
+        m_units.push_back(unit{offset});
+        c.skip(length);
+    }
+
+    std::unordered_map<std::uint64_t, std::size_t> unit_of_cu;     // .debug_info offset -> line program
+    for (const auto& cu : m_cus) {
+        auto it = by_offset.find(cu.stmt_list);
+        if (it != by_offset.end()) {
+            m_units[it->second].cu = &cu;
+            unit_of_cu[cu.offset] = it->second;
+        }
+    }
+
+    // .debug_aranges: sets of (address, length) per unit of .debug_info
+    std::vector<bool> covered(m_units.size(), false);
+    dwarf_cursor a {m_sections.aranges};
+    while (!a.at_end()) {
+        std::size_t start = a.pos();
+        bool is64 = false;
+        std::uint64_t length = a.initial_length(is64);
+        if (a.error() || length == 0) {
+            break;
+        }
+        std::size_t end = a.pos() + length;
+        a.u16();    // version
+        std::uint64_t info_offset = a.offset(is64);
+        std::uint8_t addr_size = a.u8();
+        a.u8();     // segment selector size
+        if (addr_size == 0 || a.error()) {
+            break;
+        }
+        // the tuples are aligned to their own size, counted from the start of the set
+        std::size_t tuple = 2 * addr_size;
+        a.seek(start + (a.pos() - start + tuple - 1) / tuple * tuple);
+        auto unit = unit_of_cu.find(info_offset);
+        while (a.pos() + tuple <= end && !a.error()) {
+            std::uint64_t addr = a.fixed(addr_size), len = a.fixed(addr_size);
+            if (addr == 0 && len == 0) {
+                break;
+            }
+            if (unit != unit_of_cu.end() && len != 0) {
+                m_ranges.push_back({addr, addr + len, unit->second});
+                covered[unit->second] = true;
+            }
+        }
+        a.seek(end);
+    }
+
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+    for (std::size_t i = 0; i < m_units.size(); ++i) {
+        if (covered[i]) {
+            continue;
+        }
+        ranges.clear();
+        if (m_units[i].cu != nullptr) {
+            unit_ranges(m_sections, *m_units[i].cu, ranges);
+        }
+        for (const auto& r : ranges) {
+            m_ranges.push_back({r.first, r.second, i});
+        }
+        if (ranges.empty()) {
+            m_uncovered.push_back(i);
+        }
+    }
+    std::sort(m_ranges.begin(), m_ranges.end(), [](const range& a, const range& b) { return a.low < b.low; });
+}
+
+bool line_index::read_header(unit& u, dwarf_cursor& c, line_header& h) {
+    c.seek(u.offset);
+    std::uint64_t length = c.initial_length(h.is64);
+    h.end = c.pos() + length;
+    h.version = c.u16();
+    if (h.version < 2 || h.version > 5 || h.end > c.data().size()) {
+        return false;
+    }
+    if (h.version >= 5) {
+        h.addr_size = c.u8();
+        c.u8();     // segment selector size
+    }
+    std::uint64_t header_length = c.offset(h.is64);
+    h.program = c.pos() + header_length;
+    h.min_inst_length = c.u8();
+    if (h.version >= 4) {
+        c.u8();     // maximum operations per instruction, only ever 1 on x86
+    }
+    h.default_is_stmt = c.u8() != 0;
+    h.line_base = c.s8();
+    h.line_range = c.u8();
+    h.opcode_base = c.u8();
+    for (unsigned op = 1; op < h.opcode_base; ++op) {
+        h.opcode_lengths[op] = c.u8();
+    }
+    if (c.error() || h.line_range == 0 || h.program > h.end) {
+        return false;
+    }
+    if (u.header_read) {
+        return true;
+    }
+
+    std::string_view comp_dir = u.cu != nullptr ? u.cu->comp_dir : std::string_view{};
+    if (h.version < 5) {
+        // directory 0 is the compilation directory, files are numbered from 1
+        std::vector<std::string>& dirs = u.dirs;
+        dirs.assign(1, std::string(comp_dir));
+        for (std::string_view dir = c.cstr(); !dir.empty() && !c.error(); dir = c.cstr()) {
+            dirs.push_back(join_path(comp_dir, dir));
+        }
+        u.files.push_back(std::string());
+        for (std::string_view name = c.cstr(); !name.empty() && !c.error(); name = c.cstr()) {
+            std::uint64_t dir = c.uleb();
+            c.uleb();   // modification time
+            c.uleb();   // length
+            u.files.push_back(join_path(dir < dirs.size() ? dirs[dir] : std::string_view{}, name));
+        }
+    } else {
+        // DWARF 5 describes the layout of the entries first. directory 0 is the compilation directory itself
+        compile_unit fake;
+        fake.version = h.version;
+        fake.is64 = h.is64;
+        fake.addr_size = h.addr_size;
+        if (u.cu != nullptr) {
+            fake.str_offsets_base = u.cu->str_offsets_base;
+        }
+        auto read_entries = [&](auto on_entry) {
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> format(c.u8());
+            for (auto& f : format) {
+                f.first = c.uleb();
+                f.second = c.uleb();
+            }
+            std::uint64_t count = c.uleb();
+            for (std::uint64_t i = 0; i < count && !c.error(); ++i) {
+                std::string_view path;
+                std::uint64_t dir = 0;
+                for (const auto& f : format) {
+                    attr_value value;
+                    if (!read_attr(c, fake, static_cast<std::uint16_t>(f.second), 0, value)) {
+                        return;
+                    }
+                    if (f.first == DW_LNCT_path) {
+                        path = attr_string(m_sections, fake, value);
+                    } else if (f.first == DW_LNCT_directory_index) {
+                        dir = value.u;
+                    }
+                }
+                on_entry(path, dir);
+            }
+        };
+        std::vector<std::string>& dirs = u.dirs;
+        dirs.clear();
+        read_entries([&](std::string_view path, std::uint64_t) {
+            dirs.push_back(dirs.empty() ? join_path(comp_dir, path) : join_path(dirs[0], path));
+        });
+        read_entries([&](std::string_view path, std::uint64_t dir) {
+            u.files.push_back(join_path(dir < dirs.size() ? dirs[dir] : std::string_view{}, path));
+        });
+    }
+    u.header_read = true;
+    return !c.error();
+}
+
+const line_table* line_index::decode(std::size_t index) {
+    unit& u = m_units[index];
+    if (u.table) {
+        return u.table.get();
+    }
+    u.table.reset(new line_table);
+    line_header h;
+    dwarf_cursor c {m_sections.line};
+    if (!read_header(u, c, h)) {
+        return u.table.get();
+    }
+
+    // rows in program order, sequences get sorted by address afterwards
+    line_table raw;
+    std::vector<std::pair<std::size_t, std::size_t>> sequences;    // [first row, last row]
+    std::vector<std::string> files = u.files;
+
+    std::uint64_t address = 0;
+    std::uint32_t file = 1, line = 1, column = 0;
+    bool is_stmt = h.default_is_stmt;
+    std::size_t sequence_start = 0;
+    auto reset = [&] {
+        address = 0;
+        file = 1;
+        line = 1;
+        column = 0;
+        is_stmt = h.default_is_stmt;
+        sequence_start = raw.size();
+    };
+    auto emit = [&](bool end) {
+        raw.address.push_back(address);
+        raw.file.push_back(file);
+        raw.line.push_back(line);
+        raw.column.push_back(static_cast<std::uint16_t>(std::min<std::uint32_t>(column, 0xffff)));
+        raw.flags.push_back((is_stmt ? line_table::is_stmt : 0) | (end ? line_table::end_sequence : 0));
+    };
+
+    c.seek(h.program);
+    while (c.pos() < h.end && !c.error()) {
+        std::uint8_t op = c.u8();
+        if (op >= h.opcode_base) {
+            // special opcode: advance address and line together and append a row
+            unsigned adjusted = op - h.opcode_base;
+            address += (adjusted / h.line_range) * h.min_inst_length;
+            line += h.line_base + static_cast<int>(adjusted % h.line_range);
+            emit(false);
+        } else if (op == 0) {
+            std::uint64_t len = c.uleb();
+            std::size_t next = c.pos() + len;
+            switch (len == 0 ? 0 : c.u8()) {
+                case DW_LNE_end_sequence:
+                    emit(true);
+                    // functions dropped by the linker keep their line rows at address 0
+                    if (raw.address[sequence_start] != 0) {
+                        sequences.emplace_back(sequence_start, raw.size() - 1);
+                    }
+                    reset();
+                    break;
+                case DW_LNE_set_address:
+                    address = c.fixed(len - 1);
+                    break;
+                case DW_LNE_define_file: {
+                    std::string_view name = c.cstr();
+                    std::uint64_t dir = c.uleb();
+                    files.push_back(join_path(dir < u.dirs.size() ? u.dirs[dir] : std::string_view{}, name));
+                    break;
+                }
+                default:
+                    break;  // discriminators and vendor extensions don't matter to us
+            }
+            c.seek(next);
+        } else {
+            switch (op) {
+                case DW_LNS_copy: emit(false); break;
+                case DW_LNS_advance_pc: address += c.uleb() * h.min_inst_length; break;
+                case DW_LNS_advance_line: line += static_cast<std::int32_t>(c.sleb()); break;
+                case DW_LNS_set_file: file = static_cast<std::uint32_t>(c.uleb()); break;
+                case DW_LNS_set_column: column = static_cast<std::uint32_t>(c.uleb()); break;
+                case DW_LNS_negate_stmt: is_stmt = !is_stmt; break;
+                case DW_LNS_const_add_pc: address += ((255 - h.opcode_base) / h.line_range) * h.min_inst_length; break;
+                case DW_LNS_fixed_advance_pc: address += c.u16(); break;
+                case DW_LNS_set_basic_block: case DW_LNS_set_prologue_end: case DW_LNS_set_epilogue_begin: break;
+                default:
+                    // an opcode from a newer standard, the header tells us how many operands to skip
+                    for (unsigned i = 0; i < h.opcode_lengths[op]; ++i) {
+                        c.uleb();
+                    }
+                    break;
+            }
+        }
+    }
+
+    // lay the sequences out by address so the whole table is one sorted array
+    std::sort(sequences.begin(), sequences.end(), [&](const auto& a, const auto& b) {
+        return raw.address[a.first] < raw.address[b.first];
+    });
+    line_table& t = *u.table;
+    t.files = std::move(files);
+    std::size_t rows = 0;
+    for (const auto& s : sequences) {
+        rows += s.second - s.first + 1;
+    }
+    t.address.reserve(rows);
+    t.file.reserve(rows);
+    t.line.reserve(rows);
+    t.column.reserve(rows);
+    t.flags.reserve(rows);
+    for (const auto& s : sequences) {
+        t.address.insert(t.address.end(), raw.address.begin() + s.first, raw.address.begin() + s.second + 1);
+        t.file.insert(t.file.end(), raw.file.begin() + s.first, raw.file.begin() + s.second + 1);
+        t.line.insert(t.line.end(), raw.line.begin() + s.first, raw.line.begin() + s.second + 1);
+        t.column.insert(t.column.end(), raw.column.begin() + s.first, raw.column.begin() + s.second + 1);
+        t.flags.insert(t.flags.end(), raw.flags.begin() + s.first, raw.flags.begin() + s.second + 1);
+    }
+    for (std::size_t i = 0; i < t.size(); ++i) {
+        if ((t.flags[i] & (line_table::is_stmt | line_table::end_sequence)) == line_table::is_stmt) {
+            t.by_line.push_back(i);
+        }
+    }
+    std::sort(t.by_line.begin(), t.by_line.end(), [&t](std::uint32_t a, std::uint32_t b) {
+        if (t.file[a] != t.file[b]) {
+            return t.file[a] < t.file[b];
+        }
+        return t.line[a] != t.line[b] ? t.line[a] < t.line[b] : t.address[a] < t.address[b];
+    });
+    return u.table.get();
+}
+
+const line_table* line_index::find_table(std::uint64_t pc, std::ptrdiff_t& row) {
+    load_units();
+    auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), pc, [](std::uint64_t pc, const range& r) {
+        return pc < r.low;
+    });
+    // ranges of different units hardly ever overlap, a few steps back is plenty
+    for (int tries = 0; it != m_ranges.begin() && tries < 4; ++tries) {
+        --it;
+        if (pc < it->high) {
+            const line_table* t = decode(it->unit);
+            row = t->row_for(pc);
+            if (row >= 0) {
+                return t;
+            }
+        }
+    }
+    for (auto index : m_uncovered) {
+        const line_table* t = decode(index);
+        row = t->row_for(pc);
+        if (row >= 0) {
+            return t;
+        }
+    }
+    return nullptr;
+}
+
+bool line_index::find(std::uint64_t pc, location& loc) {
+    std::ptrdiff_t row = -1;
+    const line_table* t = find_table(pc, row);
+    if (t == nullptr) {
+        return false;
+    }
+    std::uint32_t file = t->file[row];
+    loc.file = file < t->files.size() ? std::string_view(t->files[file]) : std::string_view{};
+    loc.line = t->line[row];
+    loc.column = t->column[row];
+    loc.addr = t->address[row];
+    return true;
+}
+
+// rows of a line are usually contiguous; the range stops at the first row of another line or the sequence end
+bool line_index::line_range(std::uint64_t pc, location& loc, std::uint64_t& low, std::uint64_t& high) {
+    if (!find(pc, loc)) {
+        return false;
+    }
+    std::ptrdiff_t row = -1;
+    const line_table* t = find_table(pc, row);
+    auto same = [t, row](std::size_t other) {
+        return t->line[other] == t->line[row] && t->file[other] == t->file[row];
+    };
+    std::size_t first = row, next = row + 1;
+    while (first > 0 && !(t->flags[first - 1] & line_table::end_sequence) && same(first - 1)) {
+        --first;
+    }
+    // every sequence ends with an end_sequence row, which has the address just past it
+    while (next + 1 < t->size() && !(t->flags[next] & line_table::end_sequence) && same(next)) {
+        ++next;
+    }
+    low = t->address[first];
+    high = t->address[next];
+    return true;
+}
+
+std::vector<std::uint64_t> line_index::find_addresses(std::string_view file, std::uint32_t line, std::uint32_t& actual_line) {
+    load_units();
+    // only units whose header mentions the file get their line program decoded
+    std::vector<std::pair<const line_table*, std::uint32_t>> matches;
+    dwarf_cursor c {m_sections.line};
+    for (std::size_t i = 0; i < m_units.size(); ++i) {
+        unit& u = m_units[i];
+        line_header h;
+        if (!u.header_read && !read_header(u, c, h)) {
+            continue;
+        }
+        bool any = false;
+        for (const auto& f : u.files) {
+            any = any || (!f.empty() && path_matches(f, file));
+        }
+        if (!any) {
+            continue;
+        }
+        const line_table* t = decode(i);
+        for (std::uint32_t f = 0; f < t->files.size(); ++f) {
+            if (!t->files[f].empty() && path_matches(t->files[f], file)) {
+                matches.emplace_back(t, f);
+            }
+        }
+    }
+
+    auto first_at_or_after = [](const line_table* t, std::uint32_t f, std::uint32_t line) {
+        return std::lower_bound(t->by_line.begin(), t->by_line.end(), std::make_pair(f, line),
+            [t](std::uint32_t row, const std::pair<std::uint32_t, std::uint32_t>& key) {
+                return t->file[row] != key.first ? t->file[row] < key.first : t->line[row] < key.second;
+            });
+    };
+
+    actual_line = ~0u;
+    for (const auto& m : matches) {
+        auto it = first_at_or_after(m.first, m.second, line);
+        if (it != m.first->by_line.end() && m.first->file[*it] == m.second) {
+            actual_line = std::min(actual_line, m.first->line[*it]);
+        }
+    }
+    std::vector<std::uint64_t> result;
+    if (actual_line == ~0u) {
+        return result;
+    }
+    for (const auto& m : matches) {
+        const line_table* t = m.first;
+        for (auto it = first_at_or_after(t, m.second, actual_line);
+                it != t->by_line.end() && t->file[*it] == m.second && t->line[*it] == actual_line; ++it) {
+            std::uint32_t row = *it;
+            // only where the line starts, not every row a loop or the scheduler split it into
+            bool starts = row == 0 || (t->flags[row - 1] & line_table::end_sequence)
+                || t->line[row - 1] != actual_line || t->file[row - 1] != m.second;
+            if (starts) {
+                result.push_back(t->address[row]);
+            }
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
@@ -0,0 +1,86 @@
+#ifndef TDB_LINE_TABLE_HPP
+#define TDB_LINE_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "dwarf.hpp"
+#include "elf.hpp"
+
+// the decoded line program of one compilation unit. rows are stored column by column (struct of arrays)
+// and sorted by address, so pc -> line is a binary search over a dense array of addresses.
+// by_line orders the statement rows by (file, line, address) for file:line -> addresses
+struct line_table {
+    enum : std::uint8_t { is_stmt = 1, end_sequence = 2 };
+
+    std::vector<std::uint64_t> address;
+    std::vector<std::uint32_t> file;
+    std::vector<std::uint32_t> line;
+    std::vector<std::uint16_t> column;
+    std::vector<std::uint8_t> flags;
+    std::vector<std::uint32_t> by_line;
+    std::vector<std::string> files;     // full paths, indexed by `file`
+
+    std::size_t size() const { return address.size(); }
+    // the row in effect at pc, or -1 if pc is not covered by any sequence
+    std::ptrdiff_t row_for(std::uint64_t pc) const;
+};
+
+struct line_header;
+
+// source lines for every compilation unit of an ELF file. line programs are interpreted on demand,
+// one unit at a time, and kept once decoded; the only thing done for every unit is reading its header
+// when looking for a source file by name
+class line_index {
+    public:
+        struct location {
+            std::string_view file;
+            std::uint32_t line = 0;
+            std::uint32_t column = 0;
+            std::uint64_t addr = 0;     // start of the row
+        };
+
+        explicit line_index(const elf_file& elf) : m_sections{elf} {}
+
+        bool empty() const { return m_sections.line.empty(); }
+
+        // addresses are link-time addresses (no load bias)
+        bool find(std::uint64_t pc, location& loc);
+        // the addresses around pc that belong to the same source line, [low, high), and its location
+        bool line_range(std::uint64_t pc, location& loc, std::uint64_t& low, std::uint64_t& high);
+        // the statement addresses where `line` of `file` starts. if no code belongs to that line, the next
+        // line with code is used instead and returned through actual_line. file may be a path suffix
+        std::vector<std::uint64_t> find_addresses(std::string_view file, std::uint32_t line, std::uint32_t& actual_line);
+
+    private:
+        struct unit {
+            std::uint64_t offset;               // of the line program in .debug_line
+            const compile_unit* cu = nullptr;   // the unit that points at it, if any
+            bool header_read = false;
+            std::vector<std::string> files;
+            std::vector<std::string> dirs;      // include directories, made absolute; for DW_LNE_define_file
+            std::unique_ptr<line_table> table;
+        };
+        struct range {
+            std::uint64_t low, high;
+            std::size_t unit;
+        };
+
+        void load_units();
+        bool read_header(unit& u, dwarf_cursor& c, line_header& h);
+        const line_table* decode(std::size_t index);
+        const line_table* find_table(std::uint64_t pc, std::ptrdiff_t& row);
+
+        dwarf_sections m_sections;
+        bool m_loaded = false;
+        std::vector<compile_unit> m_cus;
+        std::vector<unit> m_units;
+        std::vector<range> m_ranges;            // sorted by low, from .debug_aranges and the units' own ranges
+        std::vector<std::size_t> m_uncovered;   // units without any range information, decoded on a miss
+};
+
+#endif
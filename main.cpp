@@ -1,95 +1,3468 @@
 #include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
 #include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/ptrace.h>
+#include <sys/user.h>
+#include <sys/wait.h>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <unordered_map>
+#include <cxxabi.h>
+#include "memory.hpp"
+#include "breakpoint.hpp"
+#include "elf.hpp"
+#include "line_table.hpp"
+#include "dwarf_index.hpp"
+#include "unwind.hpp"
+#include "registers.hpp"
+#include "event_loop.hpp"
+#include "threads.hpp"
+#include "condition.hpp"
+#include "inject.hpp"
+#include "tracepoint.hpp"
+#include "watchpoint.hpp"
+#include "syscalls.hpp"
+#include "x86.hpp"
+#include "displaced.hpp"
+#include "profile.hpp"
+#include "command.hpp"
+#include "hits.hpp"
+#include "core.hpp"
 extern "C" {
     #include "linenoise.h"
 }
 
+// how the program is started: the arguments and redirections of `run`, and `set env|cwd|output`
+struct launch_options {
+    std::vector<std::string> args;      // after the program's name
+    std::string input, output;          // files for stdin and stdout, empty for the debugger's own
+    std::map<std::string, std::string> env;     // on top of the debugger's environment
+    std::set<std::string> unset_env;
+    std::string cwd;
+    bool pty = false;   // stdout and stderr go to a pseudo-terminal the debugger prints from, around the prompt
+};
+
+static pid_t launch(const std::string& prog, const launch_options& options, const std::vector<int>* syscalls,
+                    int* pty_master);
+
+class debugger;
+
+// one command of the interpreter, in a command_table. its handler gets the words from its own name on
+struct debugger_command {
+    std::string_view name;
+    std::string_view alias;             // a short name, "" for none
+    std::size_t min_args, max_args;     // how many words may follow the name
+    bool (*run)(debugger& d, const command_args& args);     // false if the arguments don't parse: usage is printed
+    std::string_view usage;             // of the arguments
+    std::string_view help;
+    const command_table<debugger_command>* subcommands = nullptr;  // `info` and `set`: the next word is one of these
+    bool resumes = false;               // the program runs on: nothing after it in a `commands` block
+    bool live = false;                  // needs a process, which a core file hasn't (nor has any that resumes)
+};
+
+// a line of a script (`tdb -x`), looked up when the script was read
+struct script_line {
+    std::string text;
+    const debugger_command* command;
+    std::size_t level;      // where the command's own words start
+    std::string name;       // in full, for its usage
+};
+
 class debugger {
     public:
         debugger(std::string prog_name, pid_t pid)
-            : m_prog_name{std::move(prog_name)}, m_pid{pid} {}
+            : m_prog_name{std::move(prog_name)}, m_pid{pid}, m_memory{pid}, m_cache{m_memory}, m_breakpoints{m_memory},
+              m_code{m_memory}, m_displaced{m_memory, m_code}, m_tracepoints{m_memory, m_breakpoints, m_code},
+              m_watchpoints{m_memory},
+              m_syscalls{m_memory},
+              m_unwinder{pid, m_cache},
+              m_elf{elf_file::open(m_prog_name)},
+              m_lines{m_elf ? new line_index{*m_elf} : nullptr},
+              m_index{m_elf && m_elf->section(".debug_info") ? new dwarf_index{*m_elf} : nullptr},
+              m_current{pid} {
+            m_threads.add(pid);
+        }
         void run();
-        void handle_command(const std::string& line);
-        std::vector<std::string> split(const std::string& s, char delim);
-        bool is_prefix(const std::string& s, const std::string& of);
-        void continue_execution();
+        void handle_command(std::string_view line);
+        // reads a script ("-" for stdin) and checks that every line is a command, before anything runs.
+        // false, with the complaints printed, if one is not
+        static bool read_script(const std::string& path, std::vector<script_line>& lines);
+        // the lines run before any from stdin, each once the program has stopped after the one before
+        void queue_script(std::vector<script_line> lines);
+        // stdin isn't read: the debugger quits when the scripts are done and the program has stopped
+        void set_batch() { m_batch = true; }
+        // line editing completes command names from the table
+        static void complete(const char* line, linenoiseCompletions* completions);
+        void continue_execution(std::uint64_t seconds = 0);
+        void interrupt();
+        void handle_stop(pid_t tid, int wait_status);
+        bool require_stopped();
+        void apply_breakpoints();
+        bool step_over_breakpoint(inferior_thread& t);
+        bool single_step(inferior_thread& t);
+        bool set_breakpoint(std::uint64_t addr);
+        void remove_breakpoint(std::uint64_t addr);
+        void initialise_load_bias();
+        bool resolve_location(const std::string& location, std::vector<std::uint64_t>& addrs);
+        bool add_breakpoint(const command_args& args);
+        bool delete_breakpoints(const command_args& args);
+        void print_breakpoints();
+        bool print_hits(const command_args& args);
+        bool define_commands(const command_args& args);
+        void add_block_line(script_line line);
+        void set_logging(std::string_view file);
+        void print_symbol(std::string_view what);
+        std::string describe_address(std::uint64_t addr);
+        const elf_file::symbol* symbol_at(std::uint64_t addr, std::uint64_t& bias);
+        bool disassemble(const command_args& args);
+        void print_source(std::uint64_t addr);
+        void print_registers(const std::string& which);
+        bool access_memory(const command_args& args);
+        bool access_register(const command_args& args);
+        std::size_t read_memory(std::uint64_t addr, void* buf, std::size_t len);
+        std::size_t write_memory(std::uint64_t addr, const void* buf, std::size_t len);
+        void dump_memory(const std::string& file, std::uint64_t addr, std::uint64_t len);
+        bool write_core_file(const command_args& args);
+        void list_names(dwarf_index::kind what, const std::string& part);
+        void print_variable(const std::string& name);
+        void print_backtrace();
+        void print_threads();
+        void select_thread(pid_t tid);
+        bool add_tracepoint(const command_args& args);
+        bool remove_tracepoints(const command_args& args);
+        void print_tracepoints();
+        void dump_trace_frames(std::size_t count);
+        bool add_watchpoint(const command_args& args);
+        bool remove_watchpoints(const command_args& args);
+        void print_watchpoints();
+        bool catch_syscalls(const command_args& args);
+        void uncatch_syscalls(const command_args& args);
+        void print_catchpoints();
+        bool start_profile(const command_args& args);
+        enum step_kind { no_step, step_into, step_over, step_out };
+        void start_step(step_kind kind);
+        // the program was started with a filter for these already (see launch())
+        void syscalls_filtered(const std::vector<int>& numbers) { m_syscalls.added(numbers); }
+        void attached(const std::vector<pid_t>& tids);
+        // `tdb <program> <core>`: the threads, registers and memory are the core's, and there is no process
+        void load_core(std::unique_ptr<core_file> core);
+        void launched(const launch_options& options, int pty_master) { m_launch = options; watch_output(pty_master); }
+        bool run_program(const command_args& args);
+        void detach(bool force);
     private:
+        static const command_table<debugger_command>& commands();
+        // the command args names, walking into subcommands; its own words start at `level`. nullptr with the
+        // complaint in `error` if it is unknown, ambiguous or given the wrong number of arguments
+        static const debugger_command* find_command(const command_args& args, std::size_t& level, std::string& name,
+                                                    std::string& error);
+        void run_command(const debugger_command& command, const command_args& args, const std::string& name);
+        bool print_help(const command_args& args);
+        bool set_env(const command_args& args);
+        std::vector<pid_t> stopped_threads();
+        bool parse_collect(const std::string& arg, tracepoint_manager::item& it);
+        stop_kind record_stop(inferior_thread& t, int wait_status);
+        stop_kind step_page_access(inferior_thread& t);
+        bool report_unreported();
+        void report_stop(inferior_thread& t, stop_kind kind);
+        void print_stop(inferior_thread& t, stop_kind kind);
+        void stop_all();
+        bool thread_exited(pid_t tid, int wait_status);
+        bool condition_holds(inferior_thread& t);
+        bool run_block_in_place(inferior_thread& t);
+        void resume(inferior_thread& t);
+        // PTRACE_SYSCALL for a thread in a caught system call, so that it stops at the exit too
+        __ptrace_request continue_request(pid_t tid) { return m_syscalls.in_call(tid) ? PTRACE_SYSCALL : PTRACE_CONT; }
+        void print_syscall(pid_t tid, const std::string& line);
+        bool line_at(std::uint64_t pc, line_index::location& loc, std::uint64_t& low, std::uint64_t& high);
+        stop_kind advance_step(inferior_thread& t);
+        void plan_step();
+        void add_temporary(std::uint64_t addr);
+        void end_step();
+        bool is_temporary(std::uint64_t addr) const;
+        void take_sample(inferior_thread& t);
+        void started(pid_t pid);
+        void watch_output(int fd);
+        void on_output();
+        void stop_sampling();
+        void end_profile();
+        inferior_thread& current() { return *m_threads.find(m_current); }
+        register_cache& regs() { return current().regs; }
+        bool running() { return m_alive && current().running; }
+        void take_out();
+
+        void on_input();
+        void on_child();
+        void process_lines();
+        void execute(const std::string& line);
+        void start_editing();
+        void stop_editing();
+
         std::string m_prog_name;
         pid_t m_pid;
+        memory m_memory;
+        memory_cache m_cache;   // reads during a stop, dropped whenever the inferior runs or is written
+        breakpoint_manager m_breakpoints;
+        std::unordered_map<std::uint64_t, condition> m_conditions;  // of the conditional breakpoints, by address
+
+        // `commands <location>`: lines run at each hit of a breakpoint, looked up when they were defined
+        struct command_block {
+            bool silent = false;    // the hit itself isn't reported
+            std::vector<script_line> lines;
+            // ends in a plain `continue`: the block runs right in the stop handler, and only the thread that hit
+            // the breakpoint stops, as for a condition
+            bool in_place = false;
+        };
+        std::unordered_map<std::uint64_t, command_block> m_blocks;
+        bool m_defining = false;    // lines go into m_block until `end`
+        std::vector<std::uint64_t> m_block_addrs;
+        command_block m_block;
+        hit_stats m_hits;
+        std::ofstream m_log;        // `set logging`: std::cout goes here
+        std::streambuf* m_stdout = nullptr;
+        code_pool m_code;       // executable memory in the inferior for trampolines
+        displaced_stepper m_displaced;  // copies of instructions under breakpoints, to step past them
+        tracepoint_manager m_tracepoints;
+        int m_drain_timer = -1;     // empties the trace ring while there are tracepoints
+        watchpoint_manager m_watchpoints;
+        std::unordered_map<pid_t, watchpoint_manager::hit> m_watch_hits;   // to report, by thread
+        syscall_tracer m_syscalls;  // `catch syscall`
+
+        // a source-level step in progress. wherever it can leave the line gets a temporary breakpoint and the
+        // thread runs at full speed in between; only indirect branches (ret, jmp *rax, ...) in the line are
+        // single-stepped, since where they go is known only once they run
+        struct step_state {
+            step_kind kind = no_step;
+            pid_t tid = 0;
+            std::uint64_t low = 0, high = 0;    // the line being stepped
+            std::uint64_t frame = 0;            // its frame's CFA: a hit in a deeper frame (recursion) doesn't count
+            std::uint64_t return_sp = 0;        // running out of a frame: the stack pointer once it has returned
+            std::vector<std::uint64_t> temporary;   // breakpoints of the step's own
+            std::vector<std::uint64_t> calls;       // call targets (step): a hit there enters the function
+        } m_step;
+        unwinder m_unwinder;    // walks the stack with the CFI of whichever ELF files the frames are in
+        std::unique_ptr<elf_file> m_elf;    // the program's binary, mapped; nullptr if it could not be read
+        std::uint64_t m_load_bias = 0;      // where a PIE actually got loaded, 0 for a fixed-address executable
+        std::unique_ptr<line_index> m_lines;    // DWARF line tables of m_elf, decoded one unit at a time
+        std::unique_ptr<dwarf_index> m_index;   // names in .debug_info, built in the background or loaded from the cache
+        std::unordered_map<std::string, std::vector<std::string>> m_sources;    // source files shown so far, by line
+        bool m_alive = true;        // false once the inferior has exited, was killed or detached from
+        bool m_attached = false;    // `tdb -p`: it was running before us, and is detached from rather than killed at the end
+        std::unique_ptr<core_file> m_core;  // what is being looked at, if not a process
+        launch_options m_launch;    // for the next `run`
+        int m_output = -1;          // the pty master with the program's output, with `set output pty`
+
+        // with all-stop (the default) a stop of one thread stops them all and continue resumes them all;
+        // in non-stop mode both only concern the thread in question
+        thread_table m_threads;
+        pid_t m_current;            // the thread commands apply to
+        bool m_non_stop = false;
+
+        // the prompt and the inferior are served by one event loop, so commands are read while it runs
+        event_loop m_events;
+        bool m_quit = false;
+        bool m_tty = false;         // input is a terminal: line editing, and commands are taken while running
+        bool m_stdin_watched = false;   // false if stdin is a regular file, which epoll can't watch
+        bool m_editing = false;     // a linenoise edit is in progress
+        bool m_input_eof = false;
+        linenoiseState m_edit;
+        char m_edit_buf[4096];
+        std::string m_input;        // read but not yet executed, when not line editing
+        std::deque<script_line> m_script;   // `tdb -x`: not yet executed
+        bool m_batch = false;       // `tdb -b`: no prompt, nothing read from stdin
+        int m_stop_timer = -1;      // `continue <seconds>`
+
+        // `profile`: a timer interrupts the running threads, and each of those stops is one sample of the
+        // thread's stack, taken in handle_stop, after which it runs on. it ends at the program's next stop
+        profile_samples m_profile;
+        bool m_profiling = false;
+        int m_profile_timer = -1;
+        std::uint64_t m_profile_hz = 0;
+        std::uint64_t m_profile_wanted = 0;     // a sample of each running thread per tick
+        std::string m_profile_file;     // where the folded stacks go
 };
 
+static std::string demangle(std::string_view name) {
+    std::string mangled {name};
+    if (name.substr(0, 2) != "_Z") {
+        return mangled;     // __cxa_demangle takes a bare "f" for a type, float
+    }
+    int status = 0;
+    char* plain = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+    if (status != 0 || plain == nullptr) {
+        return mangled;
+    }
+    std::string result {plain};
+    std::free(plain);
+    return result;
+}
+
+static void print_hex_dump(std::uint64_t addr, const unsigned char* bytes, std::size_t len) {
+    for (std::size_t line = 0; line < len; line += 16) {
+        std::cout << std::hex << std::setfill('0') << std::setw(16) << addr + line << ": ";
+        std::size_t n = std::min<std::size_t>(16, len - line);
+        for (std::size_t i = 0; i < 16; ++i) {
+            if (i < n) {
+                std::cout << std::setw(2) << static_cast<unsigned>(bytes[line + i]) << ' ';
+            } else {
+                std::cout << "   ";
+            }
+        }
+        std::cout << ' ';
+        for (std::size_t i = 0; i < n; ++i) {
+            unsigned char c = bytes[line + i];
+            std::cout << (c >= 0x20 && c < 0x7f ? static_cast<char>(c) : '.');
+        }
+        std::cout << std::dec << std::setfill(' ') << std::endl;
+    }
+}
+
 void debugger::run() {
+    initialise_load_bias();
+    m_events.add_signal(SIGCHLD, [this] { on_child(); });
+    if (m_batch) {
+        m_input_eof = true;     // linenoise is never started, and the scripts are all there is
+    } else {
+        m_tty = isatty(STDIN_FILENO);
+        m_stdin_watched = m_events.add(STDIN_FILENO, [this] { on_input(); });
+        linenoiseSetCompletionCallback(complete);
+    }
+    process_lines();    // the scripts, from the first stop
+    while (!m_quit) {
+        if (!m_stdin_watched && !running()) {
+            on_input();     // stdin is a file, always readable
+        } else {
+            m_events.run_once();
+        }
+        if (m_quit && m_attached && m_alive && m_syscalls.filtered() && m_tty && m_stdin_watched) {
+            // leaving would take the tracer the filter stops for away: that is for the user to say
+            std::cerr << "the system call filter of `catch syscall` stays in the program, and without a tracer the calls "
+                      << "it stops for fail with ENOSYS: `detach force` to leave it all the same" << std::endl;
+            m_quit = false;
+            start_editing();
+        }
+    }
+    stop_editing();
+    set_logging("off");
+    if (m_attached && m_alive && m_syscalls.filtered()) {
+        // nobody to ask: it is not left to fail its calls. everything else of ours goes, and it runs on traced
+        std::cerr << "the system call filter of `catch syscall` stays in the program, and without a tracer the calls "
+                  << "it stops for would fail with ENOSYS: tdb stays attached until it exits" << std::endl;
+        stop_all();
+        take_out();
+        m_syscalls.remove({});
+        m_non_stop = false;     // one resume for every thread
+        while (m_alive) {
+            if (!m_threads.any_running()) {
+                continue_execution(0);
+            }
+            m_events.run_once();
+        }
+    } else if (m_attached && m_alive) {
+        // it goes on without us, and not with our int3s in it
+        stop_all();
+        detach(false);
+    }
+}
+
+// on a terminal the line is edited with linenoise's multiplexed API while the inferior is stopped,
+// and read in cooked mode while it runs (so its output isn't mangled by raw mode). from a pipe or
+// file, lines are read as they come, but only executed while the inferior is stopped
+void debugger::on_input() {
+    if (m_editing) {
+        char* line = linenoiseEditFeed(&m_edit);
+        if (line == linenoiseEditMore) {
+            return;
+        }
+        stop_editing();
+        if (line == nullptr) {
+            if (errno == EAGAIN) {
+                start_editing();    // ^C drops the line
+            } else {
+                m_quit = true;      // ^D
+            }
+            return;
+        }
+        execute(line);
+        linenoiseFree(line);
+        start_editing();
+        return;
+    }
+    if (m_input_eof) {
+        process_lines();
+        return;
+    }
+    char buf[4096];
+    ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (n <= 0) {
+        m_input_eof = true;
+        if (m_stdin_watched) {
+            m_events.remove(STDIN_FILENO);
+            m_stdin_watched = false;
+        }
+        m_quit = m_tty;
+    } else {
+        m_input.append(buf, n);
+    }
+    process_lines();
+}
+
+void debugger::process_lines() {
+    // script lines wait for the program to stop, whatever the input is; they were looked up when read
+    while (!m_quit && !m_script.empty() && !running()) {
+        script_line line = std::move(m_script.front());
+        m_script.pop_front();
+        if (m_defining) {
+            add_block_line(std::move(line));
+            continue;
+        }
+        command_args args {line.text};
+        run_command(*line.command, args.from(line.level), line.name);
+    }
+    while (!m_quit && m_script.empty() && (m_tty || !running())) {
+        auto newline = m_input.find('\n');
+        if (newline == std::string::npos && !(m_input_eof && !m_input.empty())) {
+            break;
+        }
+        std::string line = m_input.substr(0, newline);
+        m_input.erase(0, newline == std::string::npos ? newline : newline + 1);
+        execute(line);
+    }
+    if (m_input_eof && m_input.empty() && m_script.empty() && !running()) {
+        m_quit = true;
+    }
+    if (!m_tty && m_stdin_watched) {
+        m_events.pause(STDIN_FILENO, running());   // one command at a time: wait for the stop first
+    }
+    start_editing();
+}
+
+void debugger::execute(const std::string& line) {
+    if (m_defining) {
+        add_block_line(script_line{line, nullptr, 0, {}});
+    } else {
+        handle_command(line);
+    }
+    if (m_tty) {
+        linenoiseHistoryAdd(line.c_str());
+    }
+}
+
+void debugger::start_editing() {
+    if (m_tty && !running() && !m_editing && !m_quit && m_script.empty()) {
+        linenoiseEditStart(&m_edit, -1, -1, m_edit_buf, sizeof(m_edit_buf), m_defining ? "> " : "tdbg> ");
+        m_editing = true;
+    }
+}
+
+void debugger::stop_editing() {
+    if (m_editing) {
+        linenoiseEditStop(&m_edit);
+        m_editing = false;
+    }
+}
+
+void debugger::on_child() {
+    // stops are reported while the prompt may be up; linenoise clears and redraws it around our output
+    bool editing = m_editing;
+    if (editing) {
+        linenoiseHide(&m_edit);
+    }
     int wait_status;
-    waitpid(m_pid, &wait_status, 0);    // wait for the SIGTRAP signal sent by the child process to the parent process. In the context of ptrace, this signal is designed to be sent when the child process entries/exits a system call
+    pid_t tid;
+    while (m_alive && (tid = waitpid(-1, &wait_status, WNOHANG | __WALL)) > 0) {
+        handle_stop(tid, wait_status);
+    }
+    if (editing) {
+        linenoiseShow(&m_edit);
+    }
+    if (!running()) {
+        process_lines();    // commands that were waiting for this stop
+    }
+}
+
+void debugger::handle_command(std::string_view line) {
+    command_args args {line};
+    if (args.empty()) {
+        return;
+    }
+    std::size_t level;
+    std::string name, error;
+    const debugger_command* command = find_command(args, level, name, error);
+    if (command == nullptr) {
+        std::cerr << error << std::endl;
+    } else {
+        run_command(*command, args.from(level), name);
+    }
+}
+
+// the first word picks the entry; an entry with subcommands looks the next one up in its own table
+const debugger_command* debugger::find_command(const command_args& args, std::size_t& level, std::string& name,
+                                               std::string& error) {
+    const command_table<debugger_command>* table = &commands();
+    for (level = 0; ; ++level) {
+        std::vector<std::string_view> candidates;
+        const debugger_command* command = table->find(args[level], &candidates);
+        if (command == nullptr && candidates.empty()) {
+            error = "unknown command " + name + std::string(args[level]) + " (try help"
+                    + (name.empty() ? "" : " " + name.substr(0, name.size() - 1)) + ")";
+            return nullptr;
+        }
+        if (command == nullptr) {
+            error = "ambiguous command " + name + std::string(args[level]) + ":";
+            for (auto candidate : candidates) {
+                error += " " + name + std::string(candidate);
+            }
+            return nullptr;
+        }
+        name += command->name;
+        if (command->subcommands != nullptr && args.size() > level + 1) {
+            table = command->subcommands;
+            name += " ";
+            continue;
+        }
+        std::size_t given = args.size() - level - 1;
+        if (command->run == nullptr || given < command->min_args || given > command->max_args) {
+            error = "usage: " + name + " " + std::string(command->usage);
+            return nullptr;
+        }
+        return command;
+    }
+}
+
+void debugger::run_command(const debugger_command& command, const command_args& args, const std::string& name) {
+    if (m_core && (command.resumes || command.live)) {
+        std::cerr << name << ": not with a core file, there is no process" << std::endl;
+        return;
+    }
+    if (!command.run(*this, args)) {
+        std::cerr << "usage: " << name << " " << command.usage << std::endl;
+    }
+}
+
+bool debugger::read_script(const std::string& path, std::vector<script_line>& lines) {
+    std::ifstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            std::cerr << "cannot read " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+    std::istream& in = path == "-" ? std::cin : file;
+    bool ok = true;
+    bool block = false;     // in a `commands` block, where `silent` and `end` are lines too
+    std::size_t number = 0;
+    for (std::string text; std::getline(in, text); ) {
+        ++number;
+        command_args args {text};
+        if (args.empty() || args[0][0] == '#') {
+            continue;
+        }
+        script_line line {text, nullptr, 0, {}};
+        if (block && args.size() == 1 && (args[0] == "silent" || args[0] == "end")) {
+            block = args[0] != "end";
+            lines.push_back(std::move(line));
+            continue;
+        }
+        std::string error;
+        line.command = find_command(args, line.level, line.name, error);
+        if (line.command == nullptr) {
+            std::cerr << path << ":" << number << ": " << error << std::endl;
+            ok = false;
+        } else if (line.command->name == "commands") {
+            block = true;
+        }
+        lines.push_back(std::move(line));
+    }
+    if (block) {
+        std::cerr << path << ": a commands block without its end" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+void debugger::queue_script(std::vector<script_line> lines) {
+    for (auto& line : lines) {
+        m_script.push_back(std::move(line));
+    }
+}
+
+void debugger::complete(const char* line, linenoiseCompletions* completions) {
+    std::string_view text = line;
+    command_args args {text};
+    // the word being typed is the last one, or a new one after a space
+    bool fresh = text.empty() || text.back() == ' ' || text.back() == '\t';
+    std::size_t word = fresh ? args.size() : args.size() - 1;
+    const command_table<debugger_command>* table = &commands();
+    for (std::size_t i = 0; i < word; ++i) {
+        const debugger_command* command = table->find(args[i]);
+        if (command == nullptr || command->subcommands == nullptr) {
+            return;
+        }
+        table = command->subcommands;
+    }
+    std::string typed {text.substr(0, fresh ? text.size() : args[word].data() - text.data())};
+    for (auto name : table->complete(args[word])) {
+        linenoiseAddCompletion(completions, (typed + std::string(name) + " ").c_str());
+    }
+}
+
+// help [command [subcommand]]: the commands, or one of them in full
+bool debugger::print_help(const command_args& args) {
+    const command_table<debugger_command>* table = &commands();
+    std::string prefix;
+    for (std::size_t i = 1; i < args.size(); ++i) {
+        const debugger_command* command = table->find(args[i]);
+        if (command == nullptr) {
+            std::cerr << "unknown command " << prefix << args[i] << std::endl;
+            return true;
+        }
+        if (command->subcommands == nullptr) {
+            std::cout << prefix << command->name << " " << command->usage << std::endl;
+            if (!command->alias.empty()) {
+                std::cout << "  (also " << command->alias << ")" << std::endl;
+            }
+            std::cout << "  " << command->help << std::endl;
+            return true;
+        }
+        table = command->subcommands;
+        prefix += std::string(command->name) + " ";
+    }
+    for (const debugger_command& command : *table) {
+        std::string name = prefix + std::string(command.name);
+        if (!command.alias.empty()) {
+            name += ", " + std::string(command.alias);
+        }
+        std::cout << "  " << std::left << std::setw(22) << name << std::right << command.help << std::endl;
+    }
+    if (prefix.empty()) {
+        std::cout << "a command can be shortened to any prefix only it has" << std::endl;
+    }
+    return true;
+}
+
+// the commands, sorted by name: a word is a name, an alias, or a prefix only one name has. each entry says how
+// many words it takes, its handler gets them as views into the line
+const command_table<debugger_command>& debugger::commands() {
+    static constexpr std::size_t many = SIZE_MAX;
+
+    static constexpr debugger_command info_commands[] = {
+        {"breakpoints", "", 0, 0, [](debugger& d, const command_args&) { d.print_breakpoints(); return true; },
+         "", "the breakpoints, with their conditions"},
+        {"catchpoints", "", 0, 0, [](debugger& d, const command_args&) { d.print_catchpoints(); return true; },
+         "", "the caught system calls"},
+        {"functions", "", 0, 1, [](debugger& d, const command_args& a) {
+             d.list_names(dwarf_index::function, std::string(a[1]));
+             return true;
+         }, "[substring]", "function names from the debug information"},
+        {"hits", "", 0, 1, [](debugger& d, const command_args& a) { return d.print_hits(a); },
+         "[addr|symbol|file:line]", "how often breakpoints were hit, and the time between hits"},
+        {"line", "", 1, 1, [](debugger& d, const command_args& a) {
+             std::vector<std::uint64_t> addrs;
+             if (d.resolve_location(std::string(a[1]), addrs)) {
+                 for (auto addr : addrs) {
+                     d.print_source(addr);
+                 }
+             }
+             return true;
+         }, "<location>", "the source line of a location"},
+        {"registers", "", 0, 1, [](debugger& d, const command_args& a) {
+             d.print_registers(std::string(a[1]));
+             return true;
+         }, "[name|float]", "the registers of the current thread"},
+        {"symbol", "", 1, 1, [](debugger& d, const command_args& a) { d.print_symbol(a[1]); return true; },
+         "<addr|name>", "the symbol at an address, or the address of a name"},
+        {"threads", "", 0, 0, [](debugger& d, const command_args&) { d.print_threads(); return true; },
+         "", "the threads, with why each is stopped"},
+        {"tracepoints", "", 0, 0, [](debugger& d, const command_args&) { d.print_tracepoints(); return true; },
+         "", "the tracepoints, with their hit counts"},
+        {"types", "", 0, 1, [](debugger& d, const command_args& a) {
+             d.list_names(dwarf_index::type, std::string(a[1]));
+             return true;
+         }, "[substring]", "type names from the debug information"},
+        {"variables", "", 0, 1, [](debugger& d, const command_args& a) {
+             d.list_names(dwarf_index::variable, std::string(a[1]));
+             return true;
+         }, "[substring]", "global variable names from the debug information"},
+        {"watchpoints", "", 0, 0, [](debugger& d, const command_args&) { d.print_watchpoints(); return true; },
+         "", "the watchpoints"},
+    };
+    static constexpr command_table<debugger_command> info {info_commands};
+    static_assert(info.sorted(), "info commands must be sorted by name");
+
+    // settings of `run` apply from the next one
+    static constexpr debugger_command set_commands[] = {
+        {"cwd", "", 1, 1, [](debugger& d, const command_args& a) { d.m_launch.cwd = a[1]; return true; },
+         "<dir>", "the working directory of the next run"},
+        {"env", "", 1, many, [](debugger& d, const command_args& a) { return d.set_env(a); },
+         "<name>=<value>", "a variable in the next run's environment"},
+        {"logging", "", 1, 1, [](debugger& d, const command_args& a) { d.set_logging(a[1]); return true; },
+         "<file>|off", "appends what the commands print to a file, instead of showing it"},
+        {"non-stop", "", 1, 1, [](debugger& d, const command_args& a) {
+             if (a[1] != "on" && a[1] != "off") {
+                 return false;
+             }
+             if (d.m_threads.any_running()) {
+                 std::cerr << "cannot change non-stop mode while the program is running" << std::endl;
+             } else {
+                 d.m_non_stop = a[1] == "on";
+             }
+             return true;
+         }, "on|off", "whether a thread stopping stops the others"},
+        {"output", "", 1, 1, [](debugger& d, const command_args& a) {
+             if (a[1] != "pty" && a[1] != "terminal") {
+                 return false;
+             }
+             d.m_launch.pty = a[1] == "pty";
+             return true;
+         }, "pty|terminal", "whether the next run writes to a pseudo-terminal of ours, or to the terminal"},
+    };
+    static constexpr command_table<debugger_command> set {set_commands};
+    static_assert(set.sorted(), "set commands must be sorted by name");
+
+    static constexpr debugger_command top[] = {
+        {"backtrace", "bt", 0, 0, [](debugger& d, const command_args&) { d.print_backtrace(); return true; },
+         "", "the call stack of the current thread"},
+        {"break", "b", 1, many, [](debugger& d, const command_args& a) { return d.add_breakpoint(a); },
+         "<addr|symbol|file:line> [if <condition>]", "sets a breakpoint, that stops only where the condition holds",
+         nullptr, false, true},
+        {"catch", "", 1, many, [](debugger& d, const command_args& a) { return d.catch_syscalls(a); },
+         "syscall [name|number[,...]]...", "reports system calls, all of them without a list", nullptr, false, true},
+        {"commands", "", 1, 1, [](debugger& d, const command_args& a) { return d.define_commands(a); },
+         "<addr|symbol|file:line>, then [silent], commands, end",
+         "commands to run at each hit of a breakpoint; ending them with continue makes it a tracepoint"},
+        {"continue", "c", 0, 1, [](debugger& d, const command_args& a) {
+             std::uint64_t seconds = 0;
+             if (a.size() > 1 && !a.number(1, seconds)) {
+                 return false;
+             }
+             if (d.require_stopped()) {
+                 d.continue_execution(seconds);
+             }
+             return true;
+         }, "[seconds]", "resumes the program, interrupting it again after that long", nullptr, true},
+        {"delete", "d", 0, 1, [](debugger& d, const command_args& a) { return d.delete_breakpoints(a); },
+         "[addr]", "deletes a breakpoint, or all of them"},
+        {"detach", "", 0, 1, [](debugger& d, const command_args& a) {
+             if (a.size() > 1 && a[1] != "force") {
+                 return false;
+             }
+             d.detach(a.size() > 1);
+             return true;
+         }, "[force]", "lets the program go on without the debugger", nullptr, true},
+        {"disassemble", "", 0, 2, [](debugger& d, const command_args& a) { return d.disassemble(a); },
+         "[addr|symbol|file:line] [count]", "the function around the pc or a location, or count instructions"},
+        {"dump", "", 3, 3, [](debugger& d, const command_args& a) {
+             std::uint64_t addr = 0, len = 0;
+             if (!a.number(2, addr) || !a.number(3, len)) {
+                 return false;
+             }
+             if (d.require_stopped()) {
+                 d.dump_memory(std::string(a[1]), addr, len);
+             }
+             return true;
+         }, "<file> <addr> <len>", "saves memory to a file"},
+        {"echo", "", 0, many, [](debugger&, const command_args& a) { std::cout << a.rest(1) << std::endl; return true; },
+         "[text]", "prints the text: for command blocks, scripts and logs"},
+        {"finish", "", 0, 0, [](debugger& d, const command_args&) { d.start_step(step_out); return true; },
+         "", "runs until the current function returns", nullptr, true},
+        {"gcore", "", 0, 1, [](debugger& d, const command_args& a) { return d.write_core_file(a); },
+         "[file]", "writes a core file of the program, core.<pid> by default", nullptr, false, true},
+        {"help", "", 0, 2, [](debugger& d, const command_args& a) { return d.print_help(a); },
+         "[command]", "the commands, or what one of them does"},
+        {"info", "", 1, many, nullptr, "<what> ...", "breakpoints, threads, registers, symbols, ...: see help info",
+         &info},
+        {"interrupt", "i", 0, 0, [](debugger& d, const command_args&) { d.interrupt(); return true; },
+         "", "stops the running program", nullptr, false, true},
+        {"memory", "m", 2, 3, [](debugger& d, const command_args& a) { return d.access_memory(a); },
+         "read <addr> [len] | memory write <addr> <value> [size (1-8)]", "reads or writes the program's memory"},
+        {"next", "n", 0, 0, [](debugger& d, const command_args&) { d.start_step(step_over); return true; },
+         "", "runs to the next source line, stepping over calls", nullptr, true},
+        {"print", "p", 1, 1, [](debugger& d, const command_args& a) {
+             if (d.require_stopped()) {
+                 d.print_variable(std::string(a[1]));
+             }
+             return true;
+         }, "<variable>", "the value of a global variable"},
+        {"profile", "", 2, 3, [](debugger& d, const command_args& a) { return d.start_profile(a); },
+         "<hz> <seconds> [file]", "runs the program, sampling the stacks of its threads", nullptr, true},
+        {"register", "", 2, 3, [](debugger& d, const command_args& a) { return d.access_register(a); },
+         "read <name> | register write <name> <value>", "reads or writes a register of the current thread"},
+        {"run", "r", 0, many, [](debugger& d, const command_args& a) { return d.run_program(a); },
+         "[args...] [< file] [> file]", "starts the program again, from the beginning", nullptr, true},
+        {"set", "", 1, many, nullptr, "<setting> <value>", "non-stop mode, and the environment of run: see help set",
+         &set},
+        {"step", "s", 0, 0, [](debugger& d, const command_args&) { d.start_step(step_into); return true; },
+         "", "runs to the next source line, stepping into calls", nullptr, true},
+        {"tdump", "", 0, 1, [](debugger& d, const command_args& a) {
+             std::uint64_t count = 20;
+             if (a.size() > 1 && !a.number(1, count)) {
+                 return false;
+             }
+             d.dump_trace_frames(count);
+             return true;
+         }, "[count]", "the last hits of the tracepoints"},
+        {"thread", "t", 1, 1, [](debugger& d, const command_args& a) {
+             std::uint64_t tid = 0;
+             if (!a.number(1, tid)) {
+                 return false;
+             }
+             d.select_thread(tid);
+             return true;
+         }, "<tid>", "selects the thread the other commands are about"},
+        {"trace", "", 3, many, [](debugger& d, const command_args& a) { return d.add_tracepoint(a); },
+         "<location> collect <register|*addr[@len]|*register[+offset][@len]|variable>...",
+         "collects values at a location, without stopping there", nullptr, false, true},
+        {"uncatch", "", 0, many, [](debugger& d, const command_args& a) { d.uncatch_syscalls(a); return true; },
+         "[name|number[,...]]...", "stops reporting system calls, all of them without a list"},
+        {"unset", "", 2, 2, [](debugger& d, const command_args& a) {
+             if (a[1] != "env") {
+                 return false;
+             }
+             d.m_launch.env.erase(std::string(a[2]));
+             d.m_launch.unset_env.emplace(a[2]);
+             return true;
+         }, "env <name>", "leaves a variable out of the next run's environment"},
+        {"untrace", "", 0, 1, [](debugger& d, const command_args& a) { return d.remove_tracepoints(a); },
+         "[id]", "removes a tracepoint, or all of them"},
+        {"unwatch", "", 0, 1, [](debugger& d, const command_args& a) { return d.remove_watchpoints(a); },
+         "[id]", "removes a watchpoint, or all of them"},
+        {"watch", "w", 1, 3, [](debugger& d, const command_args& a) { return d.add_watchpoint(a); },
+         "<addr|variable> [len] [r|w|rw]", "stops when the memory is written, read, or either",
+         nullptr, false, true},
+    };
+    static constexpr command_table<debugger_command> table {top};
+    static_assert(table.sorted(), "commands must be sorted by name");
+    return table;
+}
+
+// break <location> [if <condition>]
+bool debugger::add_breakpoint(const command_args& args) {
+    bool conditional = args.size() > 2;
+    if (conditional && (args[2] != "if" || args.size() < 4)) {
+        return false;
+    }
+    std::vector<std::uint64_t> addrs;
+    if (!resolve_location(std::string(args[1]), addrs)) {
+        return true;
+    }
+    condition cond;
+    if (conditional) {
+        // compiled here once, each hit only runs the bytecode
+        std::string error;
+        auto resolve = [this](std::string_view name, std::uint64_t& addr, std::uint64_t& size) {
+            auto variables = m_index ? m_index->lookup(name, dwarf_index::variable) : std::vector<dwarf_index::entry>{};
+            if (variables.empty()) {
+                return false;
+            }
+            addr = variables.front().addr + m_load_bias;
+            size = variables.front().size;
+            return true;
+        };
+        if (!condition::compile(std::string(args.rest(3)), resolve, cond, error)) {
+            std::cerr << "bad condition: " << error << std::endl;
+            return true;
+        }
+    }
+    for (auto addr : addrs) {
+        // a breakpoint that is there already keeps its condition, or lack of one
+        if (set_breakpoint(addr) && conditional) {
+            m_conditions[addr] = cond;
+        }
+    }
+    apply_breakpoints();
+    return true;
+}
+
+bool debugger::delete_breakpoints(const command_args& args) {
+    std::uint64_t addr = 0;
+    if (args.size() < 2) {
+        m_breakpoints.remove_all();
+        m_conditions.clear();
+        m_blocks.clear();
+        m_hits.clear();
+    } else if (!args.number(1, addr)) {
+        return false;
+    } else {
+        remove_breakpoint(addr);
+    }
+    apply_breakpoints();
+    return true;
+}
 
-    char* line = nullptr;
-    while ((line = linenoise("tdbg> ")) != nullptr) {   // will loop forever? 
-        handle_command(line);   // implicit type conversion will create an rvalue, the the argument must be const lvalue reference or rvalue reference
-        linenoiseHistoryAdd(line);
-        linenoiseFree(line);    // almost just free so linenoise returns a pointer to the heap 
+void debugger::print_breakpoints() {
+    for (auto addr : m_breakpoints.addresses()) {
+        std::cout << "breakpoint at 0x" << std::hex << addr << std::dec;
+        auto cond = m_conditions.find(addr);
+        if (cond != m_conditions.end()) {
+            std::cout << " if " << cond->second.text();
+        }
+        if (std::uint64_t hits = m_hits.hits(addr)) {
+            std::cout << "  hits " << hits;
+        }
+        std::cout << std::endl;
+        auto block = m_blocks.find(addr);
+        if (block != m_blocks.end()) {
+            if (block->second.silent) {
+                std::cout << "    silent" << std::endl;
+            }
+            for (const auto& line : block->second.lines) {
+                std::cout << "    " << line.text << std::endl;
+            }
+        }
     }
 }
 
-void debugger::handle_command(const std::string& line) {
-    // std::cout << "Handling command: " << line << std::endl;
-    std::vector<std::string> args = split(line, ' ');
-    std::string command = args[0];
-    if (is_prefix(command, "continue")) {
-        // continue_execution();
-        continue_execution();
+// info hits [location]: the breakpoints at the location, or every one hit so far
+bool debugger::print_hits(const command_args& args) {
+    std::vector<std::uint64_t> addrs;
+    std::uint64_t addr = 0;
+    if (args.number(1, addr)) {
+        addrs.push_back(addr);
+    } else if (args.size() > 1) {
+        if (!resolve_location(std::string(args[1]), addrs)) {
+            return true;
+        }
     } else {
-        std::cerr << "not implemented" << std::endl;
+        for (auto addr : m_breakpoints.addresses()) {
+            if (m_hits.hits(addr) != 0) {
+                addrs.push_back(addr);
+            }
+        }
     }
+    for (auto addr : addrs) {
+        std::cout << "breakpoint at " << describe_address(addr) << ": ";
+        m_hits.write(std::cout, addr);
+    }
+    return true;
+}
 
+// commands <location>: the lines up to `end` become the breakpoint's block, replacing any it had
+bool debugger::define_commands(const command_args& args) {
+    std::vector<std::uint64_t> addrs;
+    std::uint64_t addr = 0;
+    if (args.number(1, addr)) {
+        addrs.push_back(addr);
+    } else if (!resolve_location(std::string(args[1]), addrs)) {
+        addrs.clear();      // the lines up to `end` still belong to the block, and go nowhere
+    }
+    m_block_addrs.clear();
+    for (auto addr : addrs) {
+        if (!m_breakpoints.contains(addr)) {
+            std::cerr << "no breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+        } else {
+            m_block_addrs.push_back(addr);
+        }
+    }
+    m_block = command_block{};
+    m_defining = true;
+    if (m_tty) {
+        std::cout << "Commands for the breakpoint, one per line, then end" << std::endl;
+    }
+    return true;
 }
 
-std::vector<std::string> debugger::split(const std::string& s, char delim) {
-    std::vector<std::string> result;
-    std::stringstream s_stream {s}; // stringstream can be used as input or output whereas istringstream is used for input only
-    std::string substring;
-    while (std::getline(s_stream, substring, delim)) { // read from std::istream, stop at deliminator, return the same istream
-        result.push_back(substring);
+void debugger::add_block_line(script_line line) {
+    command_args args {line.text};
+    if (args.empty() || args[0][0] == '#') {
+        return;
     }
-    return result;
+    if (args.size() == 1 && args[0] == "end") {
+        const auto& lines = m_block.lines;
+        m_block.in_place = !lines.empty() && lines.back().command->name == "continue"
+                           && command_args(lines.back().text).size() == lines.back().level + 1;
+        for (auto addr : m_block_addrs) {
+            m_blocks[addr] = m_block;
+        }
+        m_defining = false;
+        return;
+    }
+    if (args.size() == 1 && args[0] == "silent") {
+        m_block.silent = true;
+        return;
+    }
+    std::string error;
+    if (line.command == nullptr && (line.command = find_command(args, line.level, line.name, error)) == nullptr) {
+        std::cerr << error << std::endl;
+    } else if (line.command->name == "commands") {
+        std::cerr << "a commands block can't define another one" << std::endl;
+    } else if (!m_block.lines.empty() && m_block.lines.back().command->resumes) {
+        std::cerr << "the block ends with " << m_block.lines.back().name << ": " << line.text << " would never run"
+                  << std::endl;
+    } else {
+        m_block.lines.push_back(std::move(line));
+    }
+}
+
+// the block of a breakpoint that ends in `continue` runs while the thread is still in the stop handler: the other
+// threads go on running, and this one resumes right after, so a hit costs the trap and whatever the block does
+bool debugger::run_block_in_place(inferior_thread& t) {
+    auto it = m_blocks.find(t.regs.pc());
+    if (it == m_blocks.end() || !it->second.in_place) {
+        return false;
+    }
+    command_block block = it->second;     // its own lines may delete it
+    pid_t previous = m_current;
+    m_current = t.tid;
+    m_hits.hit(t.regs.pc(), hit_stats::now());
+    print_stop(t, stop_breakpoint);
+    for (std::size_t i = 0; i + 1 < block.lines.size(); ++i) {
+        const script_line& line = block.lines[i];
+        command_args args {line.text};
+        run_command(*line.command, args.from(line.level), line.name);
+    }
+    if (m_threads.find(previous) != nullptr) {
+        m_current = previous;
+    }
+    if (m_threads.find(t.tid) == &t && step_over_breakpoint(t)) {
+        resume(t);
+    }
+    return true;
+}
+
+// set logging <file>|off: std::cout goes to the end of the file, until it is set off again
+void debugger::set_logging(std::string_view file) {
+    if (m_log.is_open()) {
+        std::cout.flush();
+        std::cout.rdbuf(m_stdout);
+        m_log.close();
+    }
+    if (file == "off") {
+        return;
+    }
+    m_log.open(std::string(file), std::ios::app);
+    if (!m_log) {
+        std::cerr << "cannot open " << file << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    m_stdout = std::cout.rdbuf(m_log.rdbuf());
+}
+
+void debugger::print_symbol(std::string_view what) {
+    std::uint64_t addr = 0;
+    std::vector<std::uint64_t> addrs;
+    if (parse_number(what, addr)) {
+        std::cout << describe_address(addr) << std::endl;
+    } else if (resolve_location(std::string(what), addrs)) {
+        std::cout << what << " is at 0x" << std::hex << addrs.front() << std::dec << std::endl;
+    }
+}
+
+// memory read <addr> [len] | memory write <addr> <value> [size]
+bool debugger::access_memory(const command_args& args) {
+    std::uint64_t addr = 0;
+    if (!args.number(2, addr)) {
+        return false;
+    }
+    if (args.is(1, "read")) {
+        std::uint64_t len = 64;
+        if (args.size() > 3 && !args.number(3, len)) {
+            return false;
+        }
+        if (!require_stopped()) {
+            return true;
+        }
+        std::vector<unsigned char> bytes(len);
+        std::size_t n = read_memory(addr, bytes.data(), bytes.size());
+        print_hex_dump(addr, bytes.data(), n);
+        if (n < len) {
+            std::cerr << "cannot access memory at 0x" << std::hex << addr + n << std::dec << std::endl;
+        }
+    } else if (args.is(1, "write")) {
+        std::uint64_t value = 0, size = 8;
+        if (!args.number(3, value) || (args.size() > 4 && (!args.number(4, size) || size == 0 || size > 8))) {
+            return false;
+        }
+        if (!require_stopped()) {
+            return true;
+        }
+        // little endian, so the low `size` bytes of value are the ones to write
+        if (write_memory(addr, &value, size) < size) {
+            std::cerr << "cannot access memory at 0x" << std::hex << addr << std::dec << std::endl;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
 
+// register read <name> | register write <name> <value>
+bool debugger::access_register(const command_args& args) {
+    const register_cache::info* reg = register_cache::find(args[2]);
+    std::uint64_t value = 0;
+    if (args.is(1, "read") && args.size() == 3) {
+        print_registers(std::string(args[2]));
+    } else if (args.is(1, "write") && reg != nullptr && args.number(3, value)) {
+        if (require_stopped()) {
+            // stays in the cache until the inferior resumes
+            register_cache::set(regs().modify(), *reg, value);
+        }
+    } else {
+        return false;
+    }
+    return true;
 }
 
-bool debugger::is_prefix(const std::string& prefix, const std::string& longstring) {
-    if (prefix.size() > longstring.size()) {
+bool debugger::remove_watchpoints(const command_args& args) {
+    std::uint64_t id = 0;
+    if (args.size() > 1 && !args.number(1, id)) {
         return false;
+    }
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to remove watchpoints" << std::endl;
+        return true;
+    }
+    if (args.size() > 1) {
+        if (!m_watchpoints.remove(id, stopped_threads())) {
+            std::cerr << "no watchpoint " << id << std::endl;
+        }
     } else {
-        return std::equal(prefix.begin(), prefix.end(), longstring.begin());    // this is almost is_prefix
+        while (!m_watchpoints.watchpoints().empty()) {
+            m_watchpoints.remove(m_watchpoints.watchpoints().begin()->first, stopped_threads());
+        }
+    }
+    current().regs.invalidate();
+    return true;
+}
+
+bool debugger::remove_tracepoints(const command_args& args) {
+    std::uint64_t id = 0;
+    if (args.size() > 1 && !args.number(1, id)) {
+        return false;
+    }
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to remove tracepoints" << std::endl;
+        return true;
+    }
+    if (args.size() < 2) {
+        m_tracepoints.remove_all();
+    } else if (!m_tracepoints.remove(id)) {
+        std::cerr << "no tracepoint " << id << std::endl;
+    }
+    m_cache.invalidate();
+    return true;
+}
+
+// set env <name>=<value>: the value is the rest of the line, spaces and all
+bool debugger::set_env(const command_args& args) {
+    std::string_view value = args.rest(1);
+    auto eq = value.find('=');
+    if (eq == std::string_view::npos || eq == 0) {
+        return false;
+    }
+    std::string name {value.substr(0, eq)};
+    m_launch.env[name] = value.substr(eq + 1);
+    m_launch.unset_env.erase(name);
+    return true;
+}
+
+// resumes the inferior and returns; its next stop comes in through the event loop.
+// with a timeout it is interrupted again after that many seconds unless it stops by itself first
+void debugger::continue_execution(std::uint64_t seconds) {
+    // breakpoints set or deleted during this stop all go in with one pass over the text
+    for (auto addr : m_breakpoints.sync()) {
+        std::cerr << "cannot insert breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+    }
+    m_cache.invalidate();
+    if (report_unreported()) {
+        return;
+    }
+    // every thread gets past its breakpoint before any of them runs. that is by a displaced step which leaves
+    // the int3 in, except for the few instructions that have to be lifted for it (then, in non-stop mode, the
+    // other threads already run: there is a short window while one is lifted)
+    std::vector<pid_t> resuming;
+    for (auto& entry : m_threads) {
+        inferior_thread& t = entry.second;
+        if (!t.running && !t.starting && (!m_non_stop || t.tid == m_current)) {
+            resuming.push_back(t.tid);
+        }
+    }
+    for (auto tid : resuming) {
+        inferior_thread* t = m_threads.find(tid);
+        if (t != nullptr && !step_over_breakpoint(*t) && !m_alive) {
+            return;
+        }
+    }
+    for (auto tid : resuming) {
+        inferior_thread* t = m_threads.find(tid);
+        if (t != nullptr && !t->running) {
+            resume(*t);
+        }
+    }
+    if (seconds != 0) {
+        m_stop_timer = m_events.add_timer(seconds * 1000, false, [this] {
+            m_stop_timer = -1;
+            interrupt();
+        });
     }
 }
 
-void debugger::continue_execution() {
-    ptrace(PT_CONTINUE, m_pid, (caddr_t)1, 0);
+// a thread that hit something of its own while the others were being stopped is reported now, rather than
+// resumed past it. false if there is none
+bool debugger::report_unreported() {
+    for (auto& entry : m_threads) {
+        inferior_thread& t = entry.second;
+        if (!t.running && t.unreported != stop_none && (!m_non_stop || t.tid == m_current)) {
+            stop_kind kind = t.unreported;
+            t.unreported = stop_none;
+            m_current = t.tid;
+            if (m_step.kind != no_step) {
+                end_step();
+            }
+            report_stop(t, kind);
+            return true;
+        }
+    }
+    return false;
+}
+
+// PTRACE_INTERRUPT only works on a PTRACE_SEIZE'd tracee, which is why main() seizes instead of PTRACE_TRACEME.
+// in all-stop mode stopping the current thread is enough, the rest follow
+void debugger::interrupt() {
+    if (!running()) {
+        std::cerr << "the program is not running" << std::endl;
+        return;
+    }
+    // no more samples: if one's interrupt is on its way, the one stop both make is this one
+    stop_sampling();
+    current().sampling = false;
+    current().interrupting = true;
+    ptrace(PTRACE_INTERRUPT, m_current, nullptr, nullptr);
+}
+
+bool debugger::require_stopped() {
+    if (!m_alive) {
+        std::cerr << "the program is not being run" << std::endl;
+        return false;
+    }
+    if (running()) {
+        std::cerr << "the program is running, interrupt it first" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// breakpoints changed while the inferior runs: stop it just long enough to patch the text
+void debugger::apply_breakpoints() {
+    if (!m_alive || !m_threads.any_running()) {
+        return;     // they go in when it resumes
+    }
+    if (m_threads.any_stopped()) {
+        // non-stop: the text can be written through a thread that is stopped anyway
+        for (auto addr : m_breakpoints.sync()) {
+            std::cerr << "cannot insert breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+        }
+        m_cache.invalidate();
+        return;
+    }
+    pid_t tid = m_current;
+    current().stopping = true;
+    ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr);
     int wait_status;
-    waitpid(m_pid, &wait_status, 0);
+    while (waitpid(tid, &wait_status, __WALL) == tid) {
+        inferior_thread* t = m_threads.find(tid);
+        if (t != nullptr && WIFSTOPPED(wait_status) && wait_status >> 16 == PTRACE_EVENT_STOP
+                && WSTOPSIG(wait_status) == SIGTRAP) {
+            t->stopping = false;
+            t->sampling = false;
+            t->interrupting = false;
+            for (auto addr : m_breakpoints.sync()) {
+                std::cerr << "cannot insert breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+            }
+            m_cache.invalidate();
+            ptrace(continue_request(tid), tid, nullptr, nullptr);
+            return;
+        }
+        // it stopped for a reason of its own first. if that is reported, the breakpoints go in with the next
+        // continue and the interrupt, still due, is dropped when it comes; if it ran on, the interrupt is waited for
+        handle_stop(tid, wait_status);
+        t = m_threads.find(tid);
+        if (!m_alive || t == nullptr || !t->running || !t->stopping) {
+            return;
+        }
+    }
 }
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Program name not specified";
-        return -1;
+
+// if the thread is stopped on a breakpoint, execute the instruction under it with the original byte in place,
+// then put the int3 back. returns false if the thread is gone afterwards
+bool debugger::step_over_breakpoint(inferior_thread& t) {
+    return !m_breakpoints.inserted(t.regs.pc()) || single_step(t);
+}
+
+// executes one instruction of the thread. on a breakpoint that is the displaced copy of the instruction,
+// or if it can't be displaced, the original with the breakpoint lifted. returns false if the thread is gone
+bool debugger::single_step(inferior_thread& t) {
+    std::uint64_t pc = t.regs.pc();
+    const displaced_stepper::copy* displaced = nullptr;
+    if (m_breakpoints.inserted(pc)) {
+        std::uint8_t code[15];
+        std::size_t n = read_memory(pc, code, sizeof(code));
+        displaced = m_displaced.prepare(t.tid, pc, code, n);
+        if (displaced != nullptr) {
+            t.regs.set_pc(displaced->addr);
+        }
+    }
+    bool lifted = m_breakpoints.inserted(pc) && displaced == nullptr;
+    m_cache.invalidate();
+    t.regs.flush();
+    t.regs.invalidate();
+    if (lifted) {
+        m_breakpoints.lift(pc);
+    }
+    ptrace(PTRACE_SINGLESTEP, t.tid, nullptr, t.pending_signal);
+    t.pending_signal = 0;
+    int wait_status;
+    while (waitpid(t.tid, &wait_status, __WALL) > 0 && WIFSTOPPED(wait_status)) {
+        if (wait_status >> 16 == PTRACE_EVENT_STOP) {
+            // an interrupt left over from stopping the world (or a sample's) got in before the step: step again
+            t.stopping = false;
+            t.sampling = false;
+            t.interrupting = false;
+        } else if (displaced != nullptr && displaced->repeats && WSTOPSIG(wait_status) == SIGTRAP
+                   && static_cast<std::uint64_t>(ptrace(PTRACE_PEEKUSER, t.tid, offsetof(user_regs_struct, rip), nullptr))
+                      == displaced->addr) {
+            // rep movs and friends trap after every iteration, the copy is done when rip leaves it
+        } else {
+            break;
+        }
+        ptrace(PTRACE_SINGLESTEP, t.tid, nullptr, nullptr);
     }
+    if (lifted) {
+        m_breakpoints.restore(pc);
+    }
+    if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+        thread_exited(t.tid, wait_status);
+        return false;
+    }
+    if (displaced != nullptr) {
+        m_displaced.finish(*displaced, pc, t.regs.modify());
+    }
+    if (WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) != SIGTRAP) {
+        t.pending_signal = WSTOPSIG(wait_status);   // arrived during the step, deliver it on the real resume
+    }
+    return true;
+}
 
-    char* prog = argv[1];
-    pid_t pid = fork();
-    if (pid == 0) {
-        // child process
-        std::cout << "Child process " << std::endl;
-
-        // replace the current process with the executable
-        ptrace(PT_TRACE_ME, 0, nullptr, 0);    // child declares it's being traced by the parent. Other parameters are ommitted
-        execl(prog, prog, nullptr); // the list of arguments are terminated by null. TODO: support execution of programs with arguments
-    } else if (pid > 0){
-        // parent process
-        std::cout << "Started to debug process " << pid << std::endl;
-        debugger dbg {prog, pid};
-        dbg.run();
+void debugger::resume(inferior_thread& t) {
+    if (m_hits.holding()) {
+        m_hits.resumed(hit_stats::now());
+    }
+    t.regs.flush();
+    t.regs.invalidate();
+    ptrace(continue_request(t.tid), t.tid, nullptr, t.pending_signal);
+    t.pending_signal = 0;
+    t.running = true;
+    t.stop_reason.clear();      // the next stop says why
+}
+
+// the thread is on a breakpoint: should it stop there? runs the condition's bytecode against the registers
+// of this stop, which were fetched to find the breakpoint anyway
+bool debugger::condition_holds(inferior_thread& t) {
+    auto cond = m_conditions.find(t.regs.pc());
+    if (cond == m_conditions.end()) {
+        return true;
+    }
+    m_cache.invalidate();   // other threads may have run since the last stop
+    std::uint64_t value = 0;
+    // through read_memory: loads see the program's bytes, not our int3s
+    auto read = [this](std::uint64_t addr, void* buf, std::size_t len) { return read_memory(addr, buf, len); };
+    if (!cond->second.evaluate(t.regs.regs(), read, value)) {
+        std::cerr << "cannot evaluate " << cond->second.text() << ", stopping" << std::endl;
+        return true;
+    }
+    return value != 0;
+}
+
+// a thread or the whole process is gone. returns true if it was the whole process
+bool debugger::thread_exited(pid_t tid, int wait_status) {
+    print_syscall(tid, m_syscalls.unfinished(tid));
+    if (m_step.kind != no_step && m_step.tid == tid) {
+        end_step();
+    }
+    if (tid != m_pid) {
+        m_threads.remove(tid);
+        std::cout << "[thread " << tid << " exited]" << std::endl;
+        if (m_current == tid) {
+            m_current = m_pid;
+        }
+        return false;
+    }
+    for (auto calling : m_syscalls.calling()) {
+        print_syscall(calling, m_syscalls.unfinished(calling));   // exit_group() in another thread
+    }
+    m_alive = false;
+    if (m_stop_timer >= 0) {
+        m_events.cancel_timer(m_stop_timer);
+        m_stop_timer = -1;
+    }
+    if (WIFEXITED(wait_status)) {
+        std::cout << "Process " << m_pid << " exited with code " << WEXITSTATUS(wait_status) << std::endl;
+    } else {
+        std::cout << "Process " << m_pid << " killed by signal " << strsignal(WTERMSIG(wait_status)) << std::endl;
+    }
+    end_profile();
+    return true;
+}
+
+void debugger::handle_stop(pid_t tid, int wait_status) {
+    if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+        thread_exited(tid, wait_status);
+        return;
+    }
+    if (!WIFSTOPPED(wait_status)) {
+        return;
+    }
+    bool added = false;
+    inferior_thread& t = m_threads.add(tid, &added);
+    if (added) {
+        t.starting = true;  // its first stop overtook the clone event of its parent
+        t.running = true;
+    }
+    int event = wait_status >> 16;
+    if (event == PTRACE_EVENT_CLONE) {
+        unsigned long child = 0;
+        ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &child);
+        inferior_thread& n = m_threads.add(child, &added);
+        if (added) {
+            n.starting = true;
+            n.running = true;
+        }
+        std::cout << "[new thread " << child << "]" << std::endl;
+        ptrace(continue_request(tid), tid, nullptr, nullptr);
+        return;
+    }
+    if (t.starting) {
+        // a new thread's first stop: it runs if the rest of the program does. debug registers are not
+        // inherited, it gets the watchpoints the others have
+        t.starting = false;
+        m_watchpoints.apply(tid);
+        if (m_non_stop || m_threads.any_running(tid)) {
+            ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+        } else {
+            t.running = false;
+            t.stop_reason = "new thread";
+        }
+        return;
+    }
+    if (t.sampling && event == PTRACE_EVENT_STOP && WSTOPSIG(wait_status) == SIGTRAP) {
+        // the profiler's interrupt. it may come late, once the thread has stopped for something else and been
+        // resumed: it is a sample all the same. if the world is being stopped too, it is the stop for that
+        t.sampling = false;
+        if (!t.stopping) {
+            take_sample(t);
+            resume(t);
+            return;
+        }
+    }
+    if (t.stopping && event == PTRACE_EVENT_STOP && WSTOPSIG(wait_status) == SIGTRAP) {
+        // we interrupted it to stop the world, but it had stopped for something else first and has
+        // been resumed since: this stop is stale
+        t.stopping = false;
+        t.interrupting = false;
+        ptrace(continue_request(tid), tid, nullptr, nullptr);
+        return;
+    }
+    if (t.interrupting && event == PTRACE_EVENT_STOP && WSTOPSIG(wait_status) == SIGTRAP) {
+        t.interrupting = false;     // the user's interrupt; one that is still due is settled by report_stop
+    }
+
+    stop_kind kind = record_stop(t, wait_status);
+    if (t.page_fault != 0) {
+        kind = step_page_access(t);
+        if (kind == stop_none) {
+            return;     // running again, or another thread's stop has been reported instead
+        }
+    }
+    if (kind == stop_none) {
+        resume(t);      // a system call
+        return;
+    }
+    if (kind == stop_breakpoint && is_temporary(t.regs.pc())) {
+        // a breakpoint of a step: another thread passing by, a deeper frame, or somewhere the step goes on from
+        kind = t.tid == m_step.tid ? advance_step(t) : stop_none;
+        if (kind == stop_none) {
+            // the step's breakpoints may have moved: in with them through this thread, which is stopped anyway
+            for (auto addr : m_breakpoints.sync()) {
+                std::cerr << "cannot insert breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+            }
+            m_cache.invalidate();
+            if (m_threads.find(tid) == &t && step_over_breakpoint(t)) {
+                resume(t);
+            }
+            return;
+        }
+    }
+    if (kind == stop_breakpoint && !condition_holds(t)) {
+        // false condition: straight back to running, without stopping the other threads or reporting anything
+        if (step_over_breakpoint(t)) {
+            resume(t);
+        }
+        return;
+    }
+    if (kind == stop_breakpoint && m_step.kind == no_step && run_block_in_place(t)) {
+        return;
+    }
+    if (m_stop_timer >= 0) {
+        m_events.cancel_timer(m_stop_timer);
+        m_stop_timer = -1;
+    }
+    if (!m_non_stop || current().running) {
+        m_current = tid;
     }
+    if (!m_non_stop) {
+        stop_all();
+    }
+    if (m_step.kind != no_step) {
+        end_step();     // finished, or something else happened first
+    }
+    report_stop(t, kind);
+}
+
+// the thread faulted on a page protected for a watchpoint. the access is let through with the page back to its
+// own protection for one instruction, and nothing else may run meanwhile: another thread's access to the page
+// would go unseen. so the others are stopped first, as for a reported stop, and only resumed once the page is
+// protected again. returns the stop to report; stop_none once the thread runs again, with the others or
+// stopped along with them for one of theirs that has been reported
+stop_kind debugger::step_page_access(inferior_thread& t) {
+    std::uint64_t fault = t.page_fault;
+    t.page_fault = 0;
+    pid_t tid = t.tid;
+    bool wanted = t.interrupting;
+    std::vector<pid_t> paused, interrupted;
+    for (auto& entry : m_threads) {
+        if (entry.second.running && !entry.second.starting) {
+            paused.push_back(entry.first);
+            if (entry.second.interrupting) {
+                interrupted.push_back(entry.first);
+            }
+        }
+    }
+    stop_all();
+    if (!m_alive) {
+        return stop_none;
+    }
+    // the user's interrupt that stopping them took the place of is a stop to report all the same
+    for (auto other : interrupted) {
+        inferior_thread* o = m_threads.find(other);
+        if (o != nullptr && !o->running && !o->interrupting && o->unreported == stop_none) {
+            o->unreported = stop_interrupt;
+            o->stop_reason = "interrupted";
+        }
+    }
+
+    m_watchpoints.lift_page(tid, fault);
+    bool stepped = single_step(t);     // an exit or a signal that comes instead is seen there
+    if (!m_alive) {
+        return stop_none;
+    }
+    pid_t through = tid;
+    for (auto it = m_threads.begin(); !stepped && it != m_threads.end(); ++it) {
+        if (!it->second.running && !it->second.starting) {
+            through = it->first;    // it has gone meanwhile: the page is protected again through another one
+            break;
+        }
+    }
+    watchpoint_manager::hit hit;
+    m_watchpoints.restore_page(through, fault, hit);
+    m_cache.invalidate();
+    stop_kind kind = stop_none;
+    if (stepped) {
+        t.regs.invalidate();
+        if (t.pending_signal != 0) {
+            // a real fault (say, a write to a read-only page) or an unrelated signal
+            t.stop_reason = std::string("signal ") + strsignal(t.pending_signal);
+            kind = stop_signal;
+        } else if (hit.id != 0) {
+            m_watch_hits[tid] = hit;
+            t.stop_reason = "watchpoint " + std::to_string(hit.id);
+            kind = stop_watchpoint;
+        } else if (wanted && !t.interrupting) {
+            t.stop_reason = "interrupted";  // the user's interrupt came in during the step
+            kind = stop_interrupt;
+        }
+    }
+    if (kind != stop_none && !m_non_stop) {
+        return kind;    // the world stays stopped for it
+    }
+    if (!m_non_stop && report_unreported()) {
+        return stop_none;
+    }
+    for (auto other : paused) {
+        inferior_thread* o = m_threads.find(other);
+        if (o == nullptr || o->running || other == tid) {
+            continue;
+        }
+        if (o->unreported != stop_none) {
+            // non-stop: its own stop, reported as if it had come in by itself
+            stop_kind own = o->unreported;
+            o->unreported = stop_none;
+            if (current().running) {
+                m_current = other;
+            }
+            report_stop(*o, own);
+        } else if (step_over_breakpoint(*o)) {
+            resume(*o);
+        }
+        if (!m_alive) {
+            return stop_none;
+        }
+    }
+    if (kind == stop_none && stepped && m_threads.find(tid) == &t) {
+        resume(t);
+    }
+    return kind;
+}
+
+// works out why a thread stopped and leaves it ready to resume. nothing is printed but the exits of
+// caught system calls, which do not stop anything
+stop_kind debugger::record_stop(inferior_thread& t, int wait_status) {
+    t.running = false;
+    int sig = WSTOPSIG(wait_status);
+    int event = wait_status >> 16;
+    if (event == PTRACE_EVENT_SECCOMP) {
+        // a call the filter traces; if it is still caught, resume() goes on with PTRACE_SYSCALL to the exit
+        m_syscalls.enter(t.tid, t.regs.regs());
+        return stop_none;
+    }
+    if (sig == (SIGTRAP | 0x80)) {
+        print_syscall(t.tid, m_syscalls.finish(t.tid, t.regs.regs().rax));
+        return stop_none;
+    }
+    if (event == PTRACE_EVENT_STOP && sig == SIGTRAP) {
+        t.stop_reason = "interrupted";
+        return stop_interrupt;
+    }
+    if (event == PTRACE_EVENT_STOP) {
+        t.stop_reason = std::string("stopped by ") + strsignal(sig);
+        return stop_group;
+    }
+    if (event == PTRACE_EVENT_EXEC) {
+        // the other threads are gone, and the one that called exec now has the pid as its tid
+        unsigned long former = t.tid;
+        ptrace(PTRACE_GETEVENTMSG, t.tid, nullptr, &former);
+        for (auto tid : m_syscalls.calling()) {
+            print_syscall(tid, tid == static_cast<pid_t>(former) ? m_syscalls.finish(tid, 0) : m_syscalls.unfinished(tid));
+        }
+        std::vector<pid_t> gone;
+        for (auto& entry : m_threads) {
+            if (entry.first != m_pid) {
+                gone.push_back(entry.first);
+            }
+        }
+        for (auto tid : gone) {
+            m_threads.remove(tid);
+        }
+        m_current = m_pid;
+        m_memory.reset(m_pid);
+        m_cache.invalidate();
+        m_tracepoints.reset();
+        m_code.reset();
+        m_displaced.reset();
+        m_watchpoints.reset();
+        t.stop_reason = "exec";
+        return stop_exec;
+    }
+    if (sig == SIGINT) {
+        // ^C on the terminal while it ran reaches the whole foreground group, us included; it only means "stop"
+        t.stop_reason = "interrupted";
+        return stop_interrupt;
+    }
+    siginfo_t info;
+    std::memset(&info, 0, sizeof(info));
+    ptrace(PTRACE_GETSIGINFO, t.tid, nullptr, &info);
+    if (sig == SIGSEGV && info.si_code == SEGV_ACCERR
+            && m_watchpoints.protected_page(reinterpret_cast<std::uint64_t>(info.si_addr))) {
+        // a page protected for a watchpoint. the access is not made yet, step_page_access lets it through
+        t.page_fault = reinterpret_cast<std::uint64_t>(info.si_addr);
+        return stop_none;
+    }
+    if (sig != SIGTRAP) {
+        t.pending_signal = sig;
+        t.stop_reason = std::string("signal ") + strsignal(sig);
+        return stop_signal;
+    }
+    if (info.si_code == TRAP_HWBKPT) {
+        // the access has happened, the pc is after the instruction that made it
+        m_cache.invalidate();
+        watchpoint_manager::hit hit;
+        if (!m_watchpoints.hardware_hit(t.tid, hit)) {
+            return stop_none;
+        }
+        m_watch_hits[t.tid] = hit;
+        t.stop_reason = "watchpoint " + std::to_string(hit.id);
+        return stop_watchpoint;
+    }
+    if (info.si_code == SI_KERNEL || info.si_code == TRAP_BRKPT) {
+        // the int3 has executed, so the pc is one past the breakpoint. a hash lookup tells us whether it was ours
+        std::uint64_t pc = t.regs.pc() - 1;
+        if (m_breakpoints.inserted(pc)) {
+            t.regs.set_pc(pc);
+            t.stop_reason = "breakpoint";
+            return stop_breakpoint;
+        }
+    }
+    t.stop_reason = "trap";
+    return stop_trap;
 }
 
+void debugger::report_stop(inferior_thread& t, stop_kind kind) {
+    if (!m_alive || m_threads.find(t.tid) != &t) {
+        return;
+    }
+    if (t.interrupting) {
+        // it stopped for something else before the user's interrupt got it: this is the stop the user gets,
+        // and the interrupt's own, still due, is dropped when it comes
+        t.interrupting = false;
+        t.stopping = true;
+    }
+    if (kind == stop_step || kind == stop_finish) {
+        t.stop_reason = kind == stop_step ? "step" : "finish";     // not the temporary breakpoint it ended on
+    }
+    if (kind == stop_breakpoint) {
+        m_hits.hit(t.regs.pc(), hit_stats::now());
+    }
+    print_stop(t, kind);
+    end_profile();
+    auto block = m_blocks.find(t.regs.pc());
+    if (kind == stop_breakpoint && block != m_blocks.end()) {
+        // run before anything else that is waiting, from process_lines once the stop is handled
+        m_script.insert(m_script.begin(), block->second.lines.begin(), block->second.lines.end());
+    }
+}
+
+void debugger::print_stop(inferior_thread& t, stop_kind kind) {
+    std::uint64_t pc = t.regs.pc();
+    auto block = m_blocks.find(pc);
+    if (kind == stop_breakpoint && block != m_blocks.end() && block->second.silent) {
+        return;
+    }
+    if (m_threads.size() > 1) {
+        std::cout << "[thread " << t.tid << "] ";
+    }
+    switch (kind) {
+        case stop_breakpoint:
+            std::cout << "Hit breakpoint at " << describe_address(pc) << std::endl;
+            print_source(pc);
+            break;
+        case stop_watchpoint: {
+            const auto& hit = m_watch_hits[t.tid];
+            auto w = m_watchpoints.watchpoints().find(hit.id);
+            if (w == m_watchpoints.watchpoints().end()) {
+                break;
+            }
+            auto show = [](const std::vector<std::uint8_t>& bytes) {
+                std::ostringstream out;
+                if (bytes.size() <= 8) {
+                    std::uint64_t value = 0;
+                    std::memcpy(&value, bytes.data(), bytes.size());
+                    out << value << " (0x" << std::hex << value << ")";
+                } else {
+                    out << std::hex << std::setfill('0');
+                    for (auto b : bytes) {
+                        out << std::setw(2) << static_cast<unsigned>(b);
+                    }
+                }
+                return out.str();
+            };
+            std::cout << "Watchpoint " << hit.id << " (0x" << std::hex << w->second.addr << std::dec << ", "
+                      << w->second.len << " bytes) at " << describe_address(pc) << std::endl;
+            if (hit.old_value != w->second.value) {
+                std::cout << "Old value = " << show(hit.old_value) << std::endl;
+                std::cout << "New value = " << show(w->second.value) << std::endl;
+            } else {
+                std::cout << "Value = " << show(w->second.value) << std::endl;
+            }
+            print_source(pc);
+            break;
+        }
+        case stop_step: {
+            line_index::location loc;
+            std::uint64_t low, high;
+            if (!line_at(pc, loc, low, high)) {
+                std::cout << "Stopped at " << describe_address(pc) << std::endl;
+            } else if (pc != low) {
+                std::cout << describe_address(pc) << std::endl;     // in the middle of the line
+            }
+            print_source(pc);
+            break;
+        }
+        case stop_finish:
+            std::cout << "Returned to " << describe_address(pc) << std::endl;
+            std::cout << "Value returned: " << static_cast<std::int64_t>(t.regs.regs().rax) << " (0x" << std::hex
+                      << t.regs.regs().rax << std::dec << ")" << std::endl;
+            print_source(pc);
+            break;
+        case stop_interrupt:
+            std::cout << "Interrupted at " << describe_address(pc) << std::endl;
+            print_source(pc);
+            break;
+        case stop_signal:
+            std::cout << "Program received signal " << strsignal(t.pending_signal) << std::endl;
+            break;
+        case stop_group:
+            // group-stop (SIGSTOP, SIGTSTP, ...); the signal itself was reported when it was delivered
+            std::cout << "Program " << t.stop_reason << std::endl;
+            break;
+        case stop_exec:
+            std::cout << "Process " << m_pid << " is executing a new program" << std::endl;
+            break;
+        case stop_trap:
+            std::cout << "Stopped at " << describe_address(pc) << std::endl;
+            break;
+        case stop_none:
+            break;
+    }
+}
+
+// all-stop: one thread has stopped, so every other one is interrupted and waited for before the
+// prompt comes back. what they were doing when the interrupt got them is kept as their stop reason
+void debugger::stop_all() {
+    std::vector<pid_t> waiting;
+    for (auto& entry : m_threads) {
+        inferior_thread& t = entry.second;
+        if (t.running && !t.starting) {
+            if (!t.stopping && !t.sampling && !t.interrupting) {
+                // one interrupt at a time: a second one sent before the first's stop is seen makes a stop of its own
+                ptrace(PTRACE_INTERRUPT, t.tid, nullptr, nullptr);
+            }
+            t.stopping = true;
+            waiting.push_back(t.tid);
+        }
+    }
+    for (auto tid : waiting) {
+        inferior_thread* t = m_threads.find(tid);
+        while (m_alive && t != nullptr && t->running) {
+            int wait_status;
+            if (waitpid(tid, &wait_status, __WALL) < 0) {
+                m_threads.remove(tid);
+                break;
+            }
+            if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+                thread_exited(tid, wait_status);
+                break;
+            }
+            int event = wait_status >> 16;
+            if (event == PTRACE_EVENT_STOP && WSTOPSIG(wait_status) == SIGTRAP) {
+                t->stopping = false;
+                t->sampling = false;
+                t->interrupting = false;
+                t->running = false;
+                t->stop_reason = "stopped";
+            } else if (event == PTRACE_EVENT_CLONE) {
+                // the new thread stays stopped when its first stop comes in, nothing else runs
+                unsigned long child = 0;
+                ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &child);
+                bool added = false;
+                inferior_thread& n = m_threads.add(child, &added);
+                if (added) {
+                    n.starting = true;
+                    n.running = true;
+                }
+                t = m_threads.find(tid);
+                t->running = false;
+                t->stop_reason = "stopped";
+            } else {
+                // the interrupt is still due, handle_stop drops it later. a fault on a page protected for a
+                // watchpoint is left to happen again once it runs, when nothing else has to be stopped first
+                t->unreported = record_stop(*t, wait_status);
+                t->page_fault = 0;
+                if (t->unreported == stop_breakpoint && (is_temporary(t->regs.pc()) || !condition_holds(*t))) {
+                    t->unreported = stop_none;  // stepped past on the next continue
+                }
+            }
+        }
+    }
+}
+
+// run [args...] [< in] [> out]: starts the program from the beginning, killing it first if it is still there.
+// without arguments, those of the last run (or the command line) again. breakpoints in the program's own code
+// are kept, moved along with its load address
+bool debugger::run_program(const command_args& args) {
+    if (m_attached) {
+        std::cerr << "the program was not started by the debugger" << std::endl;
+        return true;
+    }
+    launch_options options = m_launch;
+    if (args.size() > 1) {
+        options.args.clear();
+        options.input.clear();
+        options.output.clear();
+        for (std::size_t i = 1; i < args.size(); ++i) {
+            std::string_view arg = args[i];
+            if (arg[0] != '<' && arg[0] != '>') {
+                options.args.emplace_back(arg);
+                continue;
+            }
+            std::string_view file = arg.substr(1);
+            if (file.empty() && i + 1 < args.size()) {
+                file = args[++i];
+            }
+            if (file.empty()) {
+                return false;
+            }
+            (arg[0] == '<' ? options.input : options.output) = file;
+        }
+    }
+    if (m_alive) {
+        kill(m_pid, SIGKILL);
+        int wait_status;
+        pid_t tid;
+        while (m_alive && (tid = waitpid(-1, &wait_status, __WALL)) > 0) {
+            if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+                thread_exited(tid, wait_status);
+            }
+        }
+    }
+    // the filter for the caught system calls goes in before the exec, as with -s
+    std::vector<int> caught(m_syscalls.caught().begin(), m_syscalls.caught().end());
+    bool filter = m_syscalls.catches_all() || !caught.empty();
+    int pty_master = -1;
+    pid_t pid = launch(m_prog_name, options, filter ? &caught : nullptr, &pty_master);
+    if (pid < 0) {
+        return true;
+    }
+    m_launch = options;
+    std::cout << "Started to debug process " << pid << std::endl;
+    started(pid);
+    watch_output(pty_master);
+    return true;
+}
+
+// a new process of the same program, stopped at its exec: everything that was about the old one goes
+void debugger::started(pid_t pid) {
+    if (m_step.kind != no_step) {
+        end_step();
+    }
+    std::uint64_t old_bias = m_load_bias;
+    m_pid = pid;
+    m_current = pid;
+    m_threads.clear();
+    m_threads.add(pid);
+    m_memory.reset(pid);
+    m_cache.invalidate();
+    m_unwinder.reset(pid);
+    m_tracepoints.reset();
+    m_code.reset();
+    m_displaced.reset();
+    m_watchpoints.reset();
+    m_watch_hits.clear();
+    m_syscalls.restart();
+    m_alive = true;
+    initialise_load_bias();
+    // libraries are not even mapped yet: only breakpoints in the program itself survive
+    auto move = [this, old_bias](std::uint64_t addr) -> std::uint64_t {
+        if (!m_elf || addr < old_bias || !m_elf->is_loaded(addr - old_bias)) {
+            return 0;
+        }
+        return addr - old_bias + m_load_bias;
+    };
+    for (auto addr : m_breakpoints.restart(move)) {
+        std::cout << "Deleted breakpoint at 0x" << std::hex << addr << std::dec << " outside the program" << std::endl;
+    }
+    std::unordered_map<std::uint64_t, condition> conditions;
+    for (auto& entry : m_conditions) {
+        if (std::uint64_t addr = move(entry.first)) {
+            conditions.emplace(addr, std::move(entry.second));
+        }
+    }
+    m_conditions.swap(conditions);
+    std::unordered_map<std::uint64_t, command_block> blocks;
+    for (auto& entry : m_blocks) {
+        if (std::uint64_t addr = move(entry.first)) {
+            blocks.emplace(addr, std::move(entry.second));
+        }
+    }
+    m_blocks.swap(blocks);
+    m_hits.clear();
+}
+
+// `set output pty`: the program's output comes in on the event loop and is printed with the prompt out of the way
+void debugger::watch_output(int fd) {
+    if (m_output >= 0) {
+        m_events.remove(m_output);
+        close(m_output);
+    }
+    m_output = fd;
+    if (fd >= 0) {
+        m_events.add(fd, [this] { on_output(); });
+    }
+}
+
+void debugger::on_output() {
+    char buf[4096];
+    ssize_t n = read(m_output, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (n <= 0) {
+        watch_output(-1);   // EIO: every copy of the other side is closed, the program is gone
+        return;
+    }
+    if (m_editing) {
+        linenoiseHide(&m_edit);
+    }
+    // the pty turns \n into \r\n, which is what a terminal in raw mode (line editing) needs anyway
+    std::cout.write(buf, n);
+    std::cout.flush();
+    if (m_editing) {
+        linenoiseShow(&m_edit);
+    }
+}
+
+// `tdb -p`: the threads were seized (see attach()) and are still running. they are stopped together, every one
+// interrupted before any is waited for, so that the process is held for as short a time as possible
+void debugger::attached(const std::vector<pid_t>& tids) {
+    m_attached = true;
+    for (auto tid : tids) {
+        m_threads.add(tid).running = true;
+    }
+    stop_all();
+    if (!m_alive) {
+        return;
+    }
+    initialise_load_bias();
+    std::cout << "Attached to process " << m_pid << " (" << m_threads.size() << " thread"
+              << (m_threads.size() > 1 ? "s" : "") << ") at " << describe_address(regs().pc()) << std::endl;
+}
+
+// the core's first thread is the one it is about: the one that got the signal, or the current one of gcore
+void debugger::load_core(std::unique_ptr<core_file> core) {
+    m_core = std::move(core);
+    m_memory.use_core(m_core.get());
+    std::vector<unwinder::mapping> code;
+    for (const auto& f : m_core->files()) {
+        if (f.executable) {
+            code.push_back(unwinder::mapping{f.start, f.end, f.offset, f.path});
+        }
+    }
+    m_unwinder.use_mappings(code);
+    m_threads.clear();
+    for (const auto& c : m_core->threads()) {
+        inferior_thread& t = m_threads.add(c.tid);
+        t.regs.load(c.regs, c.has_fp_regs ? &c.fp_regs : nullptr);
+        t.stop_reason = c.signal != 0 ? std::string("signal ") + strsignal(c.signal) : "core dumped";
+    }
+    const core_thread& first = m_core->threads().front();
+    m_current = first.tid;
+    initialise_load_bias();
+    if (!m_core->command().empty()) {
+        std::cout << "Core was generated by `" << m_core->command() << "'" << std::endl;
+    }
+    if (first.signal != 0) {
+        std::cout << "Program terminated with signal " << strsignal(first.signal) << std::endl;
+    }
+    std::cout << "Process " << m_pid << " (" << m_threads.size() << " thread" << (m_threads.size() > 1 ? "s" : "")
+              << ") at " << describe_address(regs().pc()) << std::endl;
+    print_source(regs().pc());
+}
+
+// detach [force]: takes out everything that was put into the program (breakpoints, tracepoints, watchpoints)
+// and lets every thread go on, with the signal it stopped with. a seccomp filter can't be taken out, and with
+// no tracer the calls it traces fail with ENOSYS: that takes `force`
+void debugger::detach(bool force) {
+    if (!require_stopped()) {
+        return;
+    }
+    if (m_threads.any_running()) {
+        std::cerr << "every thread must be stopped to detach" << std::endl;
+        return;
+    }
+    if (m_syscalls.filtered()) {
+        std::cerr << (force ? "warning: " : "") << "the system call filter of `catch syscall` stays in the program; "
+                  << "without a tracer the calls it stops for fail with ENOSYS" << std::endl;
+        if (!force) {
+            std::cerr << "`detach force` to detach all the same" << std::endl;
+            return;
+        }
+    }
+    // a new thread has to be in its first stop to be detached from
+    for (auto& entry : m_threads) {
+        int wait_status;
+        if (entry.second.starting && waitpid(entry.first, &wait_status, __WALL) == entry.first) {
+            entry.second.starting = false;
+        }
+    }
+    take_out();
+    for (auto& entry : m_threads) {
+        ptrace(PTRACE_DETACH, entry.first, nullptr, entry.second.pending_signal);
+    }
+    if (m_drain_timer >= 0) {
+        m_events.cancel_timer(m_drain_timer);
+        m_drain_timer = -1;
+    }
+    m_alive = false;
+    std::cout << "Detached from process " << m_pid << std::endl;
+}
+
+// everything that was put into the stopped program goes: breakpoints, tracepoints, watchpoints; registers
+// written back
+void debugger::take_out() {
+    if (m_step.kind != no_step) {
+        end_step();
+    }
+    m_tracepoints.remove_all();
+    std::vector<pid_t> tids = stopped_threads();    // registers go back here too
+    std::vector<int> watched;
+    for (auto& entry : m_watchpoints.watchpoints()) {
+        watched.push_back(entry.first);
+    }
+    for (auto id : watched) {
+        m_watchpoints.remove(id, tids);
+    }
+    m_breakpoints.remove_all();
+    m_conditions.clear();
+    m_blocks.clear();
+    for (auto addr : m_breakpoints.sync()) {
+        std::cerr << "cannot remove breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+    }
+}
+
+// false if there was one already, or there can't be one
+bool debugger::set_breakpoint(std::uint64_t addr) {
+    if (m_tracepoints.covers(addr)) {
+        std::cerr << "0x" << std::hex << addr << std::dec << " is patched by a tracepoint" << std::endl;
+        return false;
+    }
+    if (!m_breakpoints.add(addr)) {
+        std::cerr << "breakpoint at 0x" << std::hex << addr << std::dec << " already exists";
+        auto cond = m_conditions.find(addr);
+        if (cond != m_conditions.end()) {
+            std::cerr << " (if " << cond->second.text() << ")";
+        }
+        std::cerr << ", delete it first to change it" << std::endl;
+        return false;
+    }
+    std::cout << "Set breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+    return true;
+}
+
+void debugger::remove_breakpoint(std::uint64_t addr) {
+    if (!m_breakpoints.remove(addr)) {
+        std::cerr << "no breakpoint at 0x" << std::hex << addr << std::dec << std::endl;
+    }
+    m_conditions.erase(addr);
+    m_blocks.erase(addr);
+    m_hits.remove(addr);
+}
+
+// a PIE is linked at 0 and moved by the kernel. the entry point in the aux vector is the real one,
+// the one in the ELF header the link-time one, the difference is the bias for every symbol
+void debugger::initialise_load_bias() {
+    if (!m_elf || !m_elf->is_pie()) {
+        return;
+    }
+    if (m_core) {
+        std::uint64_t entry = m_core->aux_value(AT_ENTRY);
+        m_load_bias = entry != 0 ? entry - m_elf->header().e_entry : 0;
+        return;
+    }
+    std::ifstream auxv {"/proc/" + std::to_string(m_pid) + "/auxv", std::ios::binary};
+    std::uint64_t entry[2];
+    while (auxv.read(reinterpret_cast<char*>(entry), sizeof(entry))) {
+        if (entry[0] == AT_ENTRY) {
+            m_load_bias = entry[1] - m_elf->header().e_entry;
+            return;
+        }
+    }
+}
+
+// a location is an address, the name of a symbol or file:line. a source line can map to several addresses
+bool debugger::resolve_location(const std::string& location, std::vector<std::uint64_t>& addrs) {
+    std::uint64_t addr = 0;
+    if (parse_number(location, addr)) {
+        addrs.push_back(addr);
+        return true;
+    }
+    if (!m_elf) {
+        std::cerr << "no symbols loaded" << std::endl;
+        return false;
+    }
+
+    auto colon = location.rfind(':');
+    std::uint64_t line = 0;
+    if (colon != std::string::npos && colon > 0 && parse_number(location.substr(colon + 1), line)) {
+        std::string file = location.substr(0, colon);
+        std::uint32_t actual_line = 0;
+        for (auto a : m_lines->find_addresses(file, line, actual_line)) {
+            addrs.push_back(a + m_load_bias);
+        }
+        if (addrs.empty()) {
+            std::cerr << "no code for " << location << std::endl;
+            return false;
+        }
+        if (actual_line != line) {
+            std::cout << "no code at line " << line << ", using line " << actual_line << std::endl;
+        }
+        return true;
+    }
+
+    auto symbols = m_elf->lookup_symbol(location);
+    if (symbols.empty() && m_index) {
+        // not in .symtab under that name, but DWARF knows functions by their qualified C++ name
+        auto functions = m_index->lookup(location, dwarf_index::function);
+        if (!functions.empty()) {
+            addrs.push_back(functions.front().addr + m_load_bias);
+            return true;
+        }
+    }
+    if (symbols.empty()) {
+        std::cerr << "no symbol " << location << std::endl;
+        return false;
+    }
+    addrs.push_back(symbols.front()->addr + m_load_bias);
+    return true;
+}
+
+// test.cpp:5    std::cout << i << std::endl;
+void debugger::print_source(std::uint64_t addr) {
+    line_index::location loc;
+    if (!m_lines || addr < m_load_bias || !m_lines->find(addr - m_load_bias, loc)) {
+        return;
+    }
+    std::string file {loc.file};
+    auto it = m_sources.find(file);
+    if (it == m_sources.end()) {
+        std::vector<std::string> lines;
+        std::ifstream in {file};
+        for (std::string text; std::getline(in, text); ) {
+            lines.push_back(text);
+        }
+        it = m_sources.emplace(file, std::move(lines)).first;
+    }
+    std::cout << file.substr(file.rfind('/') + 1) << ":" << loc.line;
+    if (loc.line >= 1 && loc.line <= it->second.size()) {
+        std::cout << "\t" << it->second[loc.line - 1];
+    }
+    std::cout << std::endl;
+}
+
+// the symbol addr is in, in the program or a shared library; `bias` is that file's load bias
+const elf_file::symbol* debugger::symbol_at(std::uint64_t addr, std::uint64_t& bias) {
+    bias = m_load_bias;
+    if (m_elf && addr >= bias && m_elf->is_loaded(addr - bias)) {
+        return m_elf->find_symbol(addr - bias);
+    } else if (const elf_file* module = m_unwinder.module_at(addr, bias)) {
+        return module->find_symbol(addr - bias);    // code in a shared library
+    }
+    return nullptr;
+}
+
+// 0x401167 <main+17>
+std::string debugger::describe_address(std::uint64_t addr) {
+    std::ostringstream out;
+    out << "0x" << std::hex << addr;
+    std::uint64_t bias;
+    const elf_file::symbol* sym = symbol_at(addr, bias);
+    if (sym != nullptr) {
+        out << " <" << demangle(sym->name);
+        if (addr - bias != sym->addr) {
+            out << "+" << std::dec << addr - bias - sym->addr;
+        }
+        out << ">";
+    }
+    return out.str();
+}
+
+// disassemble [location] [count]: the whole function the pc (or the start of a function) is in, or count
+// instructions (10 by default) from anywhere else. the code comes in with one read, our int3s taken out
+bool debugger::disassemble(const command_args& args) {
+    std::uint64_t count = 0;
+    if (args.size() > 2 && (!args.number(2, count) || count == 0)) {
+        return false;
+    }
+    if (!require_stopped()) {
+        return true;
+    }
+    std::uint64_t pc = regs().pc(), start = pc;
+    if (args.size() > 1 && !args.number(1, start)) {
+        std::vector<std::uint64_t> addrs;
+        if (!resolve_location(std::string(args[1]), addrs)) {
+            return true;
+        }
+        start = addrs.front();
+    }
+    std::uint64_t bias, end = 0;
+    const elf_file::symbol* sym = symbol_at(start, bias);
+    if (count == 0 && sym != nullptr && sym->size != 0 && (args.size() < 2 || start == sym->addr + bias)) {
+        start = sym->addr + bias;
+        end = start + sym->size;
+    } else if (count == 0) {
+        count = 10;
+    }
+
+    std::vector<std::uint8_t> code(end != 0 ? end - start : count * 15);   // 15: the longest an instruction can be
+    code.resize(read_memory(start, code.data(), code.size()));
+    if (code.empty()) {
+        std::cerr << "cannot access memory at 0x" << std::hex << start << std::dec << std::endl;
+        return true;
+    }
+    // " <main+4>" for branch targets and rip-relative operands
+    x86_symbolizer symbolize = [this](std::uint64_t addr) {
+        std::string where = describe_address(addr);
+        auto space = where.find(' ');
+        return space == std::string::npos ? std::string{} : where.substr(space);
+    };
+    if (end != 0) {
+        std::cout << "Dump of assembler code for function " << demangle(sym->name) << ":" << std::endl;
+    }
+    std::size_t offset = 0;
+    for (std::uint64_t n = 0; offset < code.size() && (end != 0 || n < count); ++n) {
+        std::uint64_t addr = start + offset;
+        x86_insn insn;
+        std::string text;
+        if (!x86_disassemble(code.data() + offset, code.size() - offset, addr, insn, text, symbolize)) {
+            text = "(bad)";
+            insn.length = 1;
+        }
+        std::cout << (addr == pc ? "=> " : "   ");
+        if (end != 0) {
+            std::cout << "0x" << std::hex << addr << std::dec << " <+" << offset << ">:\t" << text << std::endl;
+        } else {
+            std::cout << describe_address(addr) << ":\t" << text << std::endl;
+        }
+        offset += insn.length;
+    }
+    if (end != 0) {
+        std::cout << "End of assembler dump." << std::endl;
+    }
+    return true;
+}
+
+// reads show the program's own bytes, not our int3s
+std::size_t debugger::read_memory(std::uint64_t addr, void* buf, std::size_t len) {
+    std::size_t n = m_cache.read(addr, buf, len);
+    m_breakpoints.shadow(addr, buf, n);
+    return n;
+}
+
+std::size_t debugger::write_memory(std::uint64_t addr, const void* buf, std::size_t len) {
+    std::vector<unsigned char> bytes(static_cast<const unsigned char*>(buf), static_cast<const unsigned char*>(buf) + len);
+    m_breakpoints.prepare_write(addr, bytes.data(), len);
+    std::size_t n = m_memory.write(addr, bytes.data(), len);
+    m_cache.invalidate(addr, len);
+    m_displaced.forget(addr, len);
+    return n;
+}
+
+void debugger::dump_memory(const std::string& file, std::uint64_t addr, std::uint64_t len) {
+    std::ofstream out {file, std::ios::binary};
+    if (!out) {
+        std::cerr << "cannot open " << file << std::endl;
+        return;
+    }
+    // large chunks keep it to a handful of process_vm_readv calls even for multi-megabyte buffers
+    std::vector<char> chunk(std::min<std::uint64_t>(len, 8 << 20));
+    std::uint64_t done = 0;
+    while (done < len) {
+        std::size_t want = std::min<std::uint64_t>(chunk.size(), len - done);
+        std::size_t n = read_memory(addr + done, chunk.data(), want);
+        out.write(chunk.data(), n);
+        done += n;
+        if (n < want) {
+            std::cerr << "cannot access memory at 0x" << std::hex << addr + done << std::dec << std::endl;
+            break;
+        }
+    }
+    std::cout << "wrote " << done << " bytes to " << file << std::endl;
+}
+
+// gcore [file]: the threads go in with the registers as the debugger has them, the current one first, and memory
+// with the original bytes under breakpoints and tracepoints
+bool debugger::write_core_file(const command_args& args) {
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to write a core file" << std::endl;
+        return true;
+    }
+    std::string path = args.size() > 1 ? std::string(args[1]) : "core." + std::to_string(m_pid);
+    std::vector<core_thread> threads;
+    auto add = [&threads](inferior_thread& t) {
+        core_thread c {t.tid, t.regs.regs(), {}, false, t.pending_signal};
+        if (const user_fpregs_struct* fp = t.regs.fp_regs()) {
+            c.fp_regs = *fp;
+            c.has_fp_regs = true;
+        }
+        threads.push_back(c);
+    };
+    add(current());
+    for (auto& entry : m_threads) {
+        if (entry.first != m_current && !entry.second.starting) {
+            add(entry.second);
+        }
+    }
+    auto shadow = [this](std::uint64_t addr, void* buf, std::size_t len) {
+        m_breakpoints.shadow(addr, buf, len);
+        for (const auto& entry : m_tracepoints.tracepoints()) {
+            const auto& tp = entry.second;
+            for (std::size_t i = 0; i < tp.original.size(); ++i) {
+                if (tp.addr + i >= addr && tp.addr + i < addr + len) {
+                    static_cast<std::uint8_t*>(buf)[tp.addr + i - addr] = tp.original[i];
+                }
+            }
+        }
+    };
+    core_summary summary;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!write_core(path, m_pid, threads, m_memory, shadow, m_watchpoints.protections(), summary, error)) {
+        std::cerr << "cannot write " << path << ": " << error << std::endl;
+        return true;
+    }
+    std::cout << "Saved corefile " << path << ": " << summary.segments << " segments, " << (summary.written >> 10)
+              << "K written, " << (summary.holes >> 10) << "K of zeros left as holes, in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count()
+              << "ms" << std::endl;
+    return true;
+}
+
+// info functions|variables|types: what .debug_info has by that (partial) name
+void debugger::list_names(dwarf_index::kind what, const std::string& part) {
+    if (!m_index) {
+        std::cerr << "no debugging information" << std::endl;
+        return;
+    }
+    const std::size_t limit = 200;
+    auto entries = m_index->search(part, what, limit + 1);
+    for (std::size_t i = 0; i < entries.size() && i < limit; ++i) {
+        const auto& e = entries[i];
+        if (what == dwarf_index::type) {
+            std::cout << e.name;
+            if (e.size != 0) {
+                std::cout << " (" << e.size << " bytes)";
+            }
+            std::cout << std::endl;
+        } else {
+            std::cout << "0x" << std::hex << e.addr + m_load_bias << std::dec << "  " << e.name << std::endl;
+        }
+    }
+    if (entries.size() > limit) {
+        std::cout << "(more than " << limit << " matches, showing the first " << limit << ")" << std::endl;
+    }
+}
+
+// no type information beyond the size yet: the raw bytes, and the value when it fits in an integer
+void debugger::print_variable(const std::string& name) {
+    auto variables = m_index ? m_index->lookup(name, dwarf_index::variable) : std::vector<dwarf_index::entry>{};
+    if (variables.empty()) {
+        std::cerr << "no variable " << name << std::endl;
+        return;
+    }
+    const auto& v = variables.front();
+    std::uint64_t addr = v.addr + m_load_bias;
+    std::size_t size = v.size != 0 ? std::min<std::uint64_t>(v.size, 4096) : 8;
+    std::vector<unsigned char> bytes(size);
+    std::size_t n = read_memory(addr, bytes.data(), size);
+    if (n < size) {
+        std::cerr << "cannot access memory at 0x" << std::hex << addr + n << std::dec << std::endl;
+        return;
+    }
+    if (size <= 8) {
+        std::uint64_t value = 0;
+        std::memcpy(&value, bytes.data(), size);
+        std::cout << name << " = " << value << " (0x" << std::hex << value << std::dec << ")" << std::endl;
+    } else {
+        print_hex_dump(addr, bytes.data(), size);
+    }
+}
+
+// every thread, the current one first: that is the one system calls are made through
+std::vector<pid_t> debugger::stopped_threads() {
+    std::vector<pid_t> tids {m_current};
+    for (auto& entry : m_threads) {
+        entry.second.regs.flush();
+        if (entry.first != m_current) {
+            tids.push_back(entry.first);
+        }
+    }
+    return tids;
+}
+
+// watch <addr|variable> [len] [r|w|rw]
+bool debugger::add_watchpoint(const command_args& args) {
+    std::uint64_t addr = 0, len = 0;
+    watchpoint_manager::kind what = watchpoint_manager::write;
+    std::size_t next = 2;
+    if (args.number(next, len)) {
+        ++next;
+    }
+    if (args.size() > next) {
+        if (args[next] == "r") {
+            what = watchpoint_manager::read;
+        } else if (args[next] == "rw") {
+            what = watchpoint_manager::read_write;
+        } else if (args[next] != "w" || args.size() > next + 1) {
+            return false;
+        }
+    }
+    if (!args.number(1, addr)) {
+        auto variables = m_index ? m_index->lookup(args[1], dwarf_index::variable) : std::vector<dwarf_index::entry>{};
+        if (variables.empty()) {
+            std::cerr << "no variable " << args[1] << std::endl;
+            return true;
+        }
+        addr = variables.front().addr + m_load_bias;
+        if (len == 0) {
+            len = variables.front().size;
+        }
+    }
+    if (len == 0) {
+        len = 8;
+    }
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to set a watchpoint" << std::endl;
+        return true;
+    }
+    std::string error;
+    int id = m_watchpoints.add(addr, len, what, stopped_threads(), error);
+    current().regs.invalidate();
+    if (id < 0) {
+        std::cerr << "cannot watch 0x" << std::hex << addr << std::dec << ": " << error << std::endl;
+        return true;
+    }
+    const auto& w = m_watchpoints.watchpoints().at(id);
+    std::cout << (w.hardware ? "Hardware watchpoint " : "Page watchpoint ") << id << " at 0x" << std::hex << addr
+              << std::dec << ", " << len << " bytes" << std::endl;
+    return true;
+}
+
+// 1  hw    w   0x55d0c3e4d010  8 bytes
+void debugger::print_watchpoints() {
+    for (const auto& entry : m_watchpoints.watchpoints()) {
+        const auto& w = entry.second;
+        std::cout << w.id << "  " << (w.hardware ? "hw  " : "page") << "  "
+                  << (w.what == watchpoint_manager::read ? "r " : w.what == watchpoint_manager::write ? "w " : "rw")
+                  << "  0x" << std::hex << w.addr << std::dec << "  " << w.len << " bytes" << std::endl;
+    }
+}
+
+bool debugger::line_at(std::uint64_t pc, line_index::location& loc, std::uint64_t& low, std::uint64_t& high) {
+    if (!m_lines || pc < m_load_bias || !m_lines->line_range(pc - m_load_bias, loc, low, high)) {
+        return false;
+    }
+    low += m_load_bias;
+    high += m_load_bias;
+    return true;
+}
+
+// step: to the next line, into calls of functions with line information; next: to the next line of this
+// frame; finish: out of this frame. the thread runs until the step's breakpoints stop it
+void debugger::start_step(step_kind kind) {
+    if (!require_stopped()) {
+        return;
+    }
+    inferior_thread& t = current();
+    m_cache.invalidate();
+    auto frames = m_unwinder.backtrace(t.regs.regs(), 2);
+    line_index::location loc;
+    end_step();
+    m_step.kind = kind;
+    m_step.tid = t.tid;
+    if (kind == step_out || !line_at(t.regs.pc(), loc, m_step.low, m_step.high)) {
+        if (frames.size() < 2) {
+            std::cerr << "\"finish\" not meaningful in the outermost frame" << std::endl;
+            m_step = step_state{};
+            return;
+        }
+        if (kind != step_out) {
+            std::cout << "Running until exit from " << describe_address(t.regs.pc()) << ", which has no line information"
+                      << std::endl;
+        }
+        m_step.return_sp = frames[1].sp;
+        add_temporary(frames[1].pc);
+    } else {
+        m_step.frame = frames.size() > 1 ? frames[1].sp : 0;
+        if (advance_step(t) != stop_none) {
+            // can't happen from inside the line, but a thread that went away is as good as stopped
+            end_step();
+            return;
+        }
+        if (m_threads.find(m_step.tid) == nullptr) {
+            return;
+        }
+    }
+    continue_execution();
+}
+
+// the stepping thread is stopped somewhere inside or after the step (at one of its breakpoints, or after an
+// indirect branch was single-stepped). stop_step/stop_finish if the step is done there, otherwise stop_none
+// with the breakpoints set for where it goes on from
+stop_kind debugger::advance_step(inferior_thread& t) {
+    m_cache.invalidate();
+    pid_t tid = t.tid;
+    for (;;) {
+        std::uint64_t pc = t.regs.pc();
+        if (m_step.return_sp != 0) {
+            // running out of a frame: only its own return counts, not that of a deeper recursion
+            if (t.regs.regs().rsp < m_step.return_sp) {
+                return stop_none;
+            }
+            m_step.return_sp = 0;
+            if (m_step.kind == step_out) {
+                return stop_finish;
+            }
+        }
+        auto frames = m_unwinder.backtrace(t.regs.regs(), 2);
+        std::uint64_t cfa = frames.size() > 1 ? frames[1].sp : 0;
+        bool in_line = pc >= m_step.low && pc < m_step.high;
+        line_index::location loc;
+        std::uint64_t low, high;
+
+        if (cfa < m_step.frame) {
+            // deeper than the frame being stepped: a recursion passing one of the breakpoints, or a call entered
+            bool entered = m_step.kind == step_into && !in_line
+                           && std::find(m_step.calls.begin(), m_step.calls.end(), pc) != m_step.calls.end();
+            if (!entered) {
+                return stop_none;
+            }
+        } else if (in_line && cfa == m_step.frame) {
+            unsigned char code[16];
+            std::size_t n = read_memory(pc, code, sizeof(code));
+            x86_insn insn;
+            if (x86_decode(code, n, insn) && insn.indirect && !(insn.call && m_step.kind == step_over)) {
+                if (!single_step(t)) {
+                    return stop_none;   // gone, and the step with it
+                }
+                if (t.pending_signal != 0) {
+                    return stop_step;   // a signal got in the way
+                }
+                m_cache.invalidate();
+                continue;
+            }
+            plan_step();
+            return stop_none;
+        }
+
+        // somewhere new: a called function (step), the caller (returned), or another line of this frame
+        if (!line_at(pc, loc, low, high)) {
+            if (cfa > m_step.frame || frames.size() < 2) {
+                return stop_step;   // returned into code without line information
+            }
+            // a library function, a PLT stub: run out of it
+            for (auto addr : m_step.temporary) {
+                m_breakpoints.remove(addr);
+            }
+            m_step.temporary.clear();
+            m_step.return_sp = frames[1].sp;
+            add_temporary(frames[1].pc);
+            return stop_none;
+        }
+        if (cfa >= m_step.frame && pc == low && loc.line != 0) {
+            return stop_step;       // the start of a line
+        }
+        // the middle of a line (back in the caller), line 0 (compiler-generated code), or the first line of
+        // a function that was stepped into: the prologue, which goes on to the function's first statement
+        m_step.low = low;
+        m_step.high = high;
+        m_step.frame = cfa;
+        if (m_threads.find(tid) != &t) {
+            return stop_none;
+        }
+    }
+}
+
+// covers the ways out of [low, high): the fall-through at its end, branches that leave it, calls (step), and
+// indirect branches, which stop before they execute to be single-stepped
+void debugger::plan_step() {
+    for (auto addr : m_step.temporary) {
+        m_breakpoints.remove(addr);
+    }
+    m_step.temporary.clear();
+    m_step.calls.clear();
+    std::vector<unsigned char> code(m_step.high - m_step.low);
+    code.resize(read_memory(m_step.low, code.data(), code.size()));
+    std::uint64_t addr = m_step.low;
+    for (std::size_t offset = 0; offset < code.size(); ) {
+        x86_insn insn;
+        if (!x86_decode(code.data() + offset, code.size() - offset, insn)) {
+            add_temporary(addr);    // don't know what this does, better stop before it
+            break;
+        }
+        std::uint64_t next = addr + insn.length;
+        if (insn.branch != x86_insn::no_branch) {
+            std::int64_t rel = 0;
+            if (insn.branch == x86_insn::rel8) {
+                rel = static_cast<std::int8_t>(code[offset + insn.rel_offset]);
+            } else {
+                std::int32_t rel32;
+                std::memcpy(&rel32, &code[offset + insn.rel_offset], sizeof(rel32));
+                rel = rel32;
+            }
+            std::uint64_t target = next + rel;
+            if (insn.call && m_step.kind == step_into) {
+                add_temporary(target);
+                m_step.calls.push_back(target);
+            } else if (!insn.call && (target < m_step.low || target >= m_step.high)) {
+                add_temporary(target);
+            }
+        } else if (insn.indirect && !(insn.call && m_step.kind == step_over)) {
+            add_temporary(addr);
+        }
+        offset += insn.length;
+        addr = next;
+    }
+    add_temporary(m_step.high);
+}
+
+// where the user has a breakpoint already, that one does the job (and is reported as such)
+void debugger::add_temporary(std::uint64_t addr) {
+    if (!m_breakpoints.contains(addr) && !m_tracepoints.covers(addr)) {
+        m_breakpoints.add(addr);
+        m_step.temporary.push_back(addr);
+    }
+}
+
+bool debugger::is_temporary(std::uint64_t addr) const {
+    return m_step.kind != no_step && std::find(m_step.temporary.begin(), m_step.temporary.end(), addr) != m_step.temporary.end();
+}
+
+// the breakpoints go when the inferior next resumes
+void debugger::end_step() {
+    for (auto addr : m_step.temporary) {
+        m_breakpoints.remove(addr);
+    }
+    m_step = step_state{};
+}
+
+// catch syscall [name|number[,...]]...: none is all of them
+bool debugger::catch_syscalls(const command_args& args) {
+    if (!args.is(1, "syscall")) {
+        return false;
+    }
+    std::string list;
+    for (std::size_t i = 2; i < args.size(); ++i) {
+        list.append(args[i]).push_back(',');
+    }
+    std::vector<int> numbers;
+    std::string error;
+    if (!syscall_tracer::parse(list, numbers, error)) {
+        std::cerr << error << std::endl;
+        return true;
+    }
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to catch system calls" << std::endl;
+        return true;
+    }
+    if (m_syscalls.filtered() && !m_syscalls.covers(numbers)) {
+        std::cerr << "the filter in the program doesn't trace these: one for every system call goes in, "
+                  << "the calls that aren't caught stop and are resumed straight away" << std::endl;
+    }
+    stopped_threads();  // registers written back: the filter is installed by system calls of the current thread
+    bool ok = m_syscalls.add(m_current, numbers, error);
+    current().regs.invalidate();
+    m_cache.invalidate();
+    if (!ok) {
+        std::cerr << error << std::endl;
+        return true;
+    }
+    print_catchpoints();
+    return true;
+}
+
+// uncatch [name|number[,...]]...: none is all of them. the filter stays, the calls just aren't reported:
+// they still stop, for no more than being resumed
+void debugger::uncatch_syscalls(const command_args& args) {
+    std::string list;
+    for (std::size_t i = 1; i < args.size(); ++i) {
+        list.append(args[i]).push_back(',');
+    }
+    std::vector<int> numbers;
+    std::string error;
+    if (!syscall_tracer::parse(list, numbers, error)) {
+        std::cerr << error << std::endl;
+        return;
+    }
+    m_syscalls.remove(numbers);
+}
+
+void debugger::print_catchpoints() {
+    if (m_syscalls.catches_all()) {
+        std::cout << "Catching all system calls" << std::endl;
+    } else if (!m_syscalls.caught().empty()) {
+        std::cout << "Catching system calls:";
+        for (auto number : m_syscalls.caught()) {
+            std::cout << " " << syscall_tracer::name(number);
+        }
+        std::cout << std::endl;
+    }
+}
+
+void debugger::print_syscall(pid_t tid, const std::string& line) {
+    if (line.empty()) {
+        return;
+    }
+    if (m_threads.size() > 1) {
+        std::cout << "[thread " << tid << "] ";
+    }
+    std::cout << line << std::endl;
+}
+
+// profile <hz> <seconds> [file]: runs the program for that long, sampling the stack of every running thread hz
+// times a second. a sample costs one interrupt, one register fetch and the stack reads of the unwind
+bool debugger::start_profile(const command_args& args) {
+    std::uint64_t hz = 0, seconds = 0;
+    if (!args.number(1, hz) || !args.number(2, seconds) || hz == 0 || seconds == 0) {
+        return false;
+    }
+    if (!require_stopped()) {
+        return true;
+    }
+    m_profile.clear();
+    m_profiling = true;
+    m_profile_hz = hz;
+    m_profile_wanted = 0;
+    m_profile_file = args.size() > 3 ? args[3] : "profile.folded";
+    m_profile_timer = m_events.add_timer(std::chrono::nanoseconds(1000000000 / hz), true, [this] {
+        // every tick is a sample wanted of every running thread, including the ticks that coalesced into this
+        // one and the threads still on their last sample: what is not taken is reported as dropped
+        std::uint64_t ticks = m_events.expirations();
+        for (auto& entry : m_threads) {
+            inferior_thread& t = entry.second;
+            if (!t.running || t.starting) {
+                continue;
+            }
+            m_profile_wanted += ticks;
+            if (!t.stopping && !t.sampling) {
+                t.sampling = true;
+                ptrace(PTRACE_INTERRUPT, t.tid, nullptr, nullptr);
+            }
+        }
+    });
+    continue_execution(seconds);
+    return true;
+}
+
+void debugger::take_sample(inferior_thread& t) {
+    if (!m_profiling) {
+        return;     // an interrupt from a profile that has ended since
+    }
+    m_cache.invalidate();   // the other threads run on
+    std::vector<std::uint64_t> stack;
+    for (auto& f : m_unwinder.backtrace(t.regs.regs())) {
+        stack.push_back(f.pc);
+    }
+    m_profile.add(stack);
+}
+
+void debugger::stop_sampling() {
+    if (m_profile_timer >= 0) {
+        m_events.cancel_timer(m_profile_timer);
+        m_profile_timer = -1;
+    }
+}
+
+// the program stopped or exited: the folded stacks go to the file, and the functions that took the most
+// samples are listed
+void debugger::end_profile() {
+    if (!m_profiling) {
+        return;
+    }
+    stop_sampling();
+    m_profiling = false;
+    auto name = [this](std::uint64_t addr) {
+        std::uint64_t bias;
+        const elf_file::symbol* sym = symbol_at(addr, bias);
+        if (sym != nullptr) {
+            return demangle(sym->name);
+        }
+        std::ostringstream out;
+        out << "0x" << std::hex << addr;
+        return out.str();
+    };
+    std::ofstream out {m_profile_file};
+    if (!out) {
+        std::cerr << "cannot write " << m_profile_file << std::endl;
+    } else {
+        m_profile.write_folded(out, name);
+    }
+    std::cout << m_profile.count() << " samples, folded stacks in " << m_profile_file << std::endl;
+    if (m_profile_wanted > m_profile.count()) {
+        std::uint64_t dropped = m_profile_wanted - m_profile.count();
+        std::cout << dropped << " of " << m_profile_wanted << " samples dropped (the timer fell behind, or a thread was "
+                  << "still on its last one): " << m_profile_hz * m_profile.count() / m_profile_wanted << " Hz of the "
+                  << m_profile_hz << " asked for" << std::endl;
+    }
+    if (m_profile.count() != 0) {
+        m_profile.write_top(std::cout, name, 20);
+    }
+}
+
+// rdi, $rdi, *rsp+8@16, *0x601040@4, counter
+bool debugger::parse_collect(const std::string& arg, tracepoint_manager::item& it) {
+    it.name = arg;
+    std::string text = arg[0] == '$' ? arg.substr(1) : arg;
+    if (const register_cache::info* reg = register_cache::find(text)) {
+        it.reg = reg->offset / 8;
+        return true;
+    }
+    if (text[0] != '*') {
+        auto variables = m_index ? m_index->lookup(text, dwarf_index::variable) : std::vector<dwarf_index::entry>{};
+        if (variables.empty()) {
+            return false;
+        }
+        it.deref = true;
+        it.addr = variables.front().addr + m_load_bias;
+        it.len = variables.front().size != 0 ? variables.front().size : 8;
+        return true;
+    }
+    it.deref = true;
+    text = text.substr(text[1] == '$' ? 2 : 1);
+    std::uint64_t value = 0;
+    auto at = text.find('@');
+    if (at != std::string::npos) {
+        if (!parse_number(text.substr(at + 1), value) || value == 0 || value > tracepoint_manager::max_record) {
+            return false;
+        }
+        it.len = value;
+        text.resize(at);
+    }
+    auto sign = text.find_first_of("+-", 1);
+    std::int64_t offset = 0;
+    if (sign != std::string::npos) {
+        if (!parse_number(text.substr(sign + 1), value)) {
+            return false;
+        }
+        offset = text[sign] == '-' ? -static_cast<std::int64_t>(value) : static_cast<std::int64_t>(value);
+        text.resize(sign);
+    }
+    if (const register_cache::info* reg = register_cache::find(text)) {
+        it.reg = reg->offset / 8;
+        it.addr = offset;
+        return true;
+    }
+    if (!parse_number(text, value)) {
+        return false;
+    }
+    it.addr = value + offset;
+    return true;
+}
+
+// trace <location> collect <item>...
+bool debugger::add_tracepoint(const command_args& args) {
+    if (args[2] != "collect") {
+        return false;
+    }
+    std::vector<std::uint64_t> addrs;
+    if (!m_alive || m_threads.any_running()) {
+        std::cerr << "the program must be stopped to set a tracepoint" << std::endl;
+        return true;
+    }
+    std::vector<tracepoint_manager::item> items;
+    for (std::size_t i = 3; i < args.size(); ++i) {
+        tracepoint_manager::item it;
+        if (!parse_collect(std::string(args[i]), it)) {
+            std::cerr << "cannot collect " << args[i] << std::endl;
+            return true;
+        }
+        items.push_back(it);
+    }
+    if (!resolve_location(std::string(args[1]), addrs)) {
+        return true;
+    }
+    std::vector<std::uint64_t> pcs;
+    for (auto& entry : m_threads) {
+        pcs.push_back(entry.second.regs.pc());
+        // the injected system calls go through the thread's own registers
+        entry.second.regs.flush();
+    }
+    current().regs.invalidate();
+    for (auto addr : addrs) {
+        std::string error;
+        int id = m_tracepoints.add(m_current, addr, items, pcs, error);
+        if (id < 0) {
+            std::cerr << "cannot trace 0x" << std::hex << addr << std::dec << ": " << error << std::endl;
+        } else {
+            std::cout << "Tracepoint " << id << " at " << describe_address(addr) << std::endl;
+        }
+    }
+    m_cache.invalidate();
+    if (m_drain_timer < 0 && !m_tracepoints.tracepoints().empty()) {
+        m_drain_timer = m_events.add_timer(100, true, [this] { m_tracepoints.drain(); });
+    }
+    return true;
+}
+
+// 1  0x55d0c3e4a1b2 <step+4>  hits 999999  collect rdi total
+void debugger::print_tracepoints() {
+    m_tracepoints.drain();
+    for (const auto& entry : m_tracepoints.tracepoints()) {
+        const auto& tp = entry.second;
+        std::cout << tp.id << "  " << describe_address(tp.addr) << "  hits " << tp.hits << "  collect";
+        for (const auto& it : tp.collect) {
+            std::cout << " " << it.name;
+        }
+        std::cout << std::endl;
+    }
+    if (m_tracepoints.lost() != 0) {
+        std::cout << m_tracepoints.lost() << " hits lost (the trace buffer was full)" << std::endl;
+    }
+}
+
+// the last `count` hits: #41  tracepoint 1: rdi = 0x29  total = 0x334
+void debugger::dump_trace_frames(std::size_t count) {
+    m_tracepoints.drain();
+    const auto& frames = m_tracepoints.frames();
+    const auto& tracepoints = m_tracepoints.tracepoints();
+    std::size_t first = frames.size() > count ? frames.size() - count : 0;
+    for (std::size_t i = first; i < frames.size(); ++i) {
+        const auto& f = frames[i];
+        std::cout << "#" << i << "  tracepoint " << f.id << ":";
+        auto tp = tracepoints.find(f.id);
+        std::size_t pos = 0;
+        for (std::size_t k = 0; tp != tracepoints.end() && k < tp->second.collect.size(); ++k) {
+            const auto& it = tp->second.collect[k];
+            std::size_t len = it.deref ? it.len : 8;
+            if (pos + len > f.data.size()) {
+                break;
+            }
+            std::cout << "  " << it.name << " = ";
+            if (len <= 8) {
+                std::uint64_t value = 0;
+                std::memcpy(&value, f.data.data() + pos, len);
+                std::cout << "0x" << std::hex << value << std::dec;
+            } else {
+                std::cout << std::hex << std::setfill('0');
+                for (std::size_t b = 0; b < len; ++b) {
+                    std::cout << std::setw(2) << static_cast<unsigned>(f.data[pos + b]);
+                }
+                std::cout << std::dec << std::setfill(' ');
+            }
+            pos += (len + 7) & ~std::size_t{7};
+        }
+        std::cout << std::endl;
+    }
+}
+
+// * 12346  stopped: breakpoint  0x55d0c3e4a1b2 <worker+8>
+void debugger::print_threads() {
+    if (!m_alive) {
+        std::cerr << "the program is not being run" << std::endl;
+        return;
+    }
+    for (auto& entry : m_threads) {
+        inferior_thread& t = entry.second;
+        std::cout << (t.tid == m_current ? "* " : "  ") << t.tid;
+        if (t.running) {
+            std::cout << "  running" << std::endl;
+        } else {
+            std::cout << "  stopped: " << t.stop_reason << "  " << describe_address(t.regs.pc()) << std::endl;
+        }
+    }
+}
+
+void debugger::select_thread(pid_t tid) {
+    if (m_threads.find(tid) == nullptr) {
+        std::cerr << "no thread " << tid << std::endl;
+        return;
+    }
+    m_current = tid;
+    inferior_thread& t = current();
+    std::cout << "[switching to thread " << tid << "]" << std::endl;
+    if (!t.running) {
+        print_source(t.regs.pc());
+    }
+}
+
+// #1  0x55d0c3e4a1b2 <main+37> at test.cpp:9
+void debugger::print_backtrace() {
+    if (!require_stopped()) {
+        return;
+    }
+    auto frames = m_unwinder.backtrace(regs().regs());
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        std::uint64_t pc = frames[i].pc;
+        std::cout << "#" << i << "  " << describe_address(pc);
+        // a return address can be the first byte of the next line, the call is the byte before it
+        line_index::location loc;
+        std::uint64_t at = i == 0 ? pc : pc - 1;
+        if (m_lines && at >= m_load_bias && m_lines->find(at - m_load_bias, loc)) {
+            std::string_view file = loc.file;
+            std::cout << " at " << file.substr(file.rfind('/') + 1) << ":" << loc.line;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// general purpose registers, one of them by name, or "float" for the SSE/AVX registers
+void debugger::print_registers(const std::string& which) {
+    if (!require_stopped()) {
+        return;
+    }
+    const user_regs_struct& gp = regs().regs();
+    auto print = [](const std::string& name, std::uint64_t value) {
+        std::cout << std::left << std::setw(10) << name << std::right << "0x" << std::hex << std::setfill('0')
+                  << std::setw(16) << value << std::dec << std::setfill(' ') << "  " << value << std::endl;
+    };
+    if (which.empty()) {
+        for (auto reg = register_cache::begin(); reg != register_cache::end(); ++reg) {
+            print(std::string(reg->name), register_cache::get(gp, *reg));
+        }
+        return;
+    }
+    if (const register_cache::info* reg = register_cache::find(which)) {
+        print(which, register_cache::get(gp, *reg));
+        return;
+    }
+
+    const user_fpregs_struct* fp = regs().fp_regs();
+    const unsigned char* high = regs().ymm_high();
+    bool all = std::string_view("float").substr(0, which.size()) == which;
+    bool found = false;
+    for (int i = 0; i < 16 && fp != nullptr; ++i) {
+        std::string xmm = "xmm" + std::to_string(i), ymm = "ymm" + std::to_string(i);
+        bool want_ymm = which == ymm && high != nullptr;
+        if (!all && which != xmm && !want_ymm) {
+            continue;
+        }
+        found = true;
+        // printed most significant dword first, like the register reads
+        const unsigned char* low = reinterpret_cast<const unsigned char*>(fp->xmm_space) + 16 * i;
+        bool wide = (all || want_ymm) && high != nullptr;
+        std::cout << std::left << std::setw(10) << (wide ? ymm : xmm) << std::right << "0x" << std::hex << std::setfill('0');
+        if (wide) {
+            for (int b = 15; b >= 0; --b) {
+                std::cout << std::setw(2) << static_cast<unsigned>(high[16 * i + b]);
+            }
+        }
+        for (int b = 15; b >= 0; --b) {
+            std::cout << std::setw(2) << static_cast<unsigned>(low[b]);
+        }
+        std::cout << std::dec << std::setfill(' ') << std::endl;
+    }
+    if (all && fp != nullptr) {
+        std::cout << std::left << std::setw(10) << "mxcsr" << std::right << "0x" << std::hex << fp->mxcsr << std::dec << std::endl;
+    }
+    if (!found) {
+        std::cerr << "no register " << which << std::endl;
+    }
+}
+
+// starts prog stopped right after its exec, traced with PTRACE_SEIZE. the child stops itself so that
+// we can seize it before it execs; -1 if that did not work out. with options.pty, the master side of the
+// program's terminal goes to pty_master
+static pid_t launch(const std::string& prog, const launch_options& options, const std::vector<int>* syscalls,
+                    int* pty_master) {
+    // everything the child needs is put together here, the filter too: between fork and exec only
+    // async-signal-safe calls. a thread of ours (the index's pool) may hold the malloc or a stream lock at
+    // the fork, and the child would wait on it for ever. so it doesn't print either: what goes wrong there
+    // comes back through a pipe that the exec closes, and is reported from here
+    std::vector<sock_filter> filter;
+    sock_fprog program {};
+    if (syscalls != nullptr) {
+        filter = syscall_tracer::filter(*syscalls);
+        program = {static_cast<unsigned short>(filter.size()), filter.data()};
+    }
+    std::vector<std::string> env;
+    for (char** e = environ; *e != nullptr; ++e) {
+        std::string entry = *e;
+        std::string name = entry.substr(0, entry.find('='));
+        if (options.env.count(name) == 0 && options.unset_env.count(name) == 0) {
+            env.push_back(entry);
+        }
+    }
+    for (auto& e : options.env) {
+        env.push_back(e.first + "=" + e.second);
+    }
+    std::vector<char*> argv {const_cast<char*>(prog.c_str())}, envp;
+    for (auto& a : options.args) {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+    for (auto& e : env) {
+        envp.push_back(const_cast<char*>(e.c_str()));
+    }
+    envp.push_back(nullptr);
+    int master = -1, slave = -1;
+    if (options.pty) {
+        master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+        if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0
+                || (slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0) {
+            std::cerr << "cannot open a pseudo-terminal: " << std::strerror(errno) << std::endl;
+            if (master >= 0) {
+                close(master);
+            }
+            return -1;
+        }
+    }
+
+    enum child_step : int { open_input, open_output, change_dir, install_filter, execute };
+    struct child_error {
+        int step;
+        int error;      // errno
+    };
+    int errors[2];
+    if (pipe2(errors, O_CLOEXEC) < 0) {
+        std::cerr << "cannot create a pipe: " << std::strerror(errno) << std::endl;
+        if (master >= 0) {
+            close(master);
+            close(slave);
+        }
+        return -1;
+    }
+    auto report = [&] {
+        close(errors[1]);
+        child_error e;
+        while (read(errors[0], &e, sizeof(e)) == sizeof(e)) {
+            switch (e.step) {
+                case open_input: std::cerr << "cannot open " << options.input; break;
+                case open_output: std::cerr << "cannot open " << options.output; break;
+                case change_dir: std::cerr << "cannot change to " << options.cwd; break;
+                case install_filter: std::cerr << "cannot install the system call filter"; break;
+                default: std::cerr << "cannot execute " << prog; break;
+            }
+            std::cerr << ": " << std::strerror(e.error) << std::endl;
+        }
+        close(errors[0]);
+    };
+    pid_t pid = fork();
+    if (pid == 0) {
+        // the debugger blocks SIGCHLD and ignores SIGINT, both would outlive the exec
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, nullptr);
+        signal(SIGINT, SIG_DFL);
+        // the files are relative to the debugger's directory, like the program itself
+        auto fail = [&errors](int step) {
+            child_error e {step, errno};
+            ssize_t written = write(errors[1], &e, sizeof(e));
+            (void) written;     // nowhere else to say it
+        };
+        int in = options.input.empty() ? -1 : open(options.input.c_str(), O_RDONLY);
+        if (!options.input.empty() && in < 0) {
+            fail(open_input);
+            _exit(127);
+        }
+        int out = options.output.empty() ? -1 : open(options.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (!options.output.empty() && out < 0) {
+            fail(open_output);
+            _exit(127);
+        }
+        if (!options.cwd.empty() && chdir(options.cwd.c_str()) < 0) {
+            fail(change_dir);
+            _exit(127);
+        }
+        if (slave >= 0) {
+            dup2(slave, STDOUT_FILENO);
+            dup2(slave, STDERR_FILENO);
+        }
+        if (in >= 0) {
+            dup2(in, STDIN_FILENO);
+            close(in);
+        }
+        if (out >= 0) {
+            dup2(out, STDOUT_FILENO);
+            close(out);
+        }
+        raise(SIGSTOP);
+        // traced from here on, so the stops the filter asks for have somewhere to go
+        if (syscalls != nullptr && !syscall_tracer::install(program)) {
+            fail(install_filter);   // it runs all the same, the calls just aren't caught
+        }
+        execve(prog.c_str(), argv.data(), envp.data());
+        fail(execute);
+        _exit(127);
+    }
+    if (slave >= 0) {
+        close(slave);
+    }
+    int wait_status;
+    if (pid < 0 || waitpid(pid, &wait_status, WUNTRACED) < 0 || !WIFSTOPPED(wait_status)) {
+        report();
+        if (master >= 0) {
+            close(master);
+        }
+        return -1;
+    }
+    // the tracee dies with us, stops again at the exec, and every thread it starts is traced too.
+    // system calls only stop where a seccomp filter says so, and their exits are told apart by SIGTRAP | 0x80
+    long trace_options = PTRACE_O_TRACEEXEC | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL | PTRACE_O_TRACESECCOMP
+                         | PTRACE_O_TRACESYSGOOD;
+    if (ptrace(PTRACE_SEIZE, pid, nullptr, trace_options) < 0) {
+        std::cerr << "cannot trace process " << pid << ": " << std::strerror(errno) << std::endl;
+        kill(pid, SIGKILL);
+        waitpid(pid, &wait_status, 0);
+        report();
+        if (master >= 0) {
+            close(master);
+        }
+        return -1;
+    }
+    kill(pid, SIGCONT);
+    for (;;) {
+        if (waitpid(pid, &wait_status, __WALL) < 0 || !WIFSTOPPED(wait_status)) {
+            report();
+            if (master >= 0) {
+                close(master);
+            }
+            return -1;
+        }
+        if (wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8))) {
+            report();   // the exec closed the pipe: only a filter that didn't go in can be in it
+            if (pty_master != nullptr) {
+                *pty_master = master;
+            }
+            return pid;
+        }
+        // the SIGCONT and the stop it ends: swallow both
+        ptrace(PTRACE_CONT, pid, nullptr, nullptr);
+    }
+}
+
+// `tdb -p`: seizes every thread of a running process, without stopping any of them yet. /proc/<pid>/task is
+// listed again until no new thread turns up, since one not seized yet may have started others meanwhile
+// (those started by seized threads are traced already). the threads, none if the process can't be traced
+static std::vector<pid_t> attach(pid_t pid) {
+    // no PTRACE_O_EXITKILL: the process was there before us and is to outlive us
+    long options = PTRACE_O_TRACEEXEC | PTRACE_O_TRACECLONE | PTRACE_O_TRACESECCOMP | PTRACE_O_TRACESYSGOOD;
+    if (ptrace(PTRACE_SEIZE, pid, nullptr, options) < 0) {
+        std::cerr << "cannot attach to process " << pid << ": " << std::strerror(errno) << std::endl;
+        return {};
+    }
+    std::vector<pid_t> tids {pid};
+    for (bool more = true; more; ) {
+        more = false;
+        DIR* dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+        if (dir == nullptr) {
+            break;
+        }
+        while (dirent* entry = readdir(dir)) {
+            pid_t tid = std::atoi(entry->d_name);
+            if (tid <= 0 || std::find(tids.begin(), tids.end(), tid) != tids.end()) {
+                continue;
+            }
+            more = true;
+            // EPERM: already traced, through the clone event of a seized thread. ESRCH: gone
+            if (ptrace(PTRACE_SEIZE, tid, nullptr, options) == 0 || errno == EPERM) {
+                tids.push_back(tid);
+            }
+        }
+        closedir(dir);
+    }
+    return tids;
+}
+
+int main(int argc, char* argv[]) {
+    // -s open,mmap: catch these system calls from the very start, the exec included
+    // -p pid: attach to a running process instead, its program from /proc/<pid>/exe unless given
+    // -x file: run the commands in the file first ("-" for stdin), -b: and then quit, without reading stdin
+    // <program> <core>: look at a core file instead, when the one argument after the program is one
+    std::vector<int> syscalls;
+    std::string catch_list;
+    bool catching = false;
+    std::uint64_t attach_to = 0;
+    std::vector<std::string> scripts;
+    bool batch = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "+s:p:x:b")) != -1) {
+        std::string error;
+        bool ok = false;
+        if (opt == 's' && syscall_tracer::parse(optarg, syscalls, error)) {
+            catching = ok = true;
+            catch_list = optarg;
+        } else if (opt == 'p') {
+            ok = parse_number(optarg, attach_to) && attach_to > 0;
+        } else if (opt == 'x') {
+            scripts.push_back(optarg);
+            ok = true;
+        } else if (opt == 'b') {
+            batch = ok = true;
+        }
+        if (!ok) {
+            if (!error.empty()) {
+                std::cerr << error << std::endl;
+            }
+            std::cerr << "usage: " << argv[0] << " [-s syscall[,...]] [-x script]... [-b] <program> [args...]\n"
+                      << "       " << argv[0] << " [-s syscall[,...]] [-x script]... [-b] -p <pid> [program]\n"
+                      << "       " << argv[0] << " [-x script]... [-b] <program> <core>" << std::endl;
+            return -1;
+        }
+    }
+    if (optind >= argc && attach_to == 0) {
+        std::cerr << "Program name not specified";
+        return -1;
+    }
+    // the scripts are checked before anything is started: a typo shouldn't show up halfway through a run
+    if (batch && scripts.empty()) {
+        scripts.push_back("-");
+    }
+    std::vector<script_line> lines;
+    bool scripts_ok = true;
+    for (const auto& path : scripts) {
+        scripts_ok = debugger::read_script(path, lines) && scripts_ok;
+    }
+    if (!scripts_ok) {
+        return 1;
+    }
+
+    std::string prog;
+    pid_t pid;
+    std::vector<pid_t> tids;
+    launch_options options;
+    std::unique_ptr<core_file> core;
+    if (attach_to == 0 && argc - optind == 2 && core_file::is_core(argv[optind + 1])) {
+        core = core_file::open(argv[optind + 1]);
+        if (!core) {
+            return -1;
+        }
+        prog = argv[optind];
+        pid = core->pid();
+    } else if (attach_to != 0) {
+        pid = attach_to;
+        tids = attach(pid);
+        if (tids.empty()) {
+            return -1;
+        }
+        prog = optind < argc ? argv[optind] : "/proc/" + std::to_string(pid) + "/exe";
+    } else {
+        prog = argv[optind];
+        options.args.assign(argv + optind + 1, argv + argc);
+        pid = launch(prog, options, catching ? &syscalls : nullptr, nullptr);
+        if (pid < 0) {
+            return -1;
+        }
+        std::cout << "Started to debug process " << pid << std::endl;
+    }
+    // stops arrive as SIGCHLD on a signalfd. block it before any thread starts, so none of them takes it.
+    // ^C while the program runs is meant for the program
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, nullptr);
+    signal(SIGINT, SIG_IGN);
+    debugger dbg {prog, pid};
+    if (core) {
+        dbg.load_core(std::move(core));
+    } else if (attach_to != 0) {
+        dbg.attached(tids);
+        if (catching) {
+            dbg.handle_command("catch syscall " + catch_list);     // too late for a filter before exec
+        }
+    } else {
+        dbg.launched(options, -1);
+        if (catching) {
+            dbg.syscalls_filtered(syscalls);
+        }
+    }
+    dbg.queue_script(std::move(lines));
+    if (batch) {
+        dbg.set_batch();
+    }
+    dbg.run();
+}
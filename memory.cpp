@@ -0,0 +1,323 @@
+#include "memory.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include "core.hpp"
+
+namespace {
+    const std::size_t page_size = 4096;
+    const std::size_t word_size = sizeof(long);
+
+    std::size_t page_left(std::uint64_t addr) {
+        return page_size - (addr & (page_size - 1));
+    }
+}
+
+memory::~memory() {
+    if (m_mem_fd >= 0) {
+        close(m_mem_fd);
+    }
+}
+
+void memory::reset(pid_t pid) {
+    if (m_mem_fd >= 0) {
+        close(m_mem_fd);
+    }
+    m_mem_fd = -1;
+    m_pid = pid;
+    m_vm_ok = true;
+    m_proc_ok = true;
+}
+
+std::size_t memory::read(std::uint64_t addr, void* buf, std::size_t len) {
+    if (m_core != nullptr) {
+        return m_core->read(addr, buf, len);
+    }
+    auto out = static_cast<char*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        std::size_t n = vm_read(addr + done, out + done, len - done);
+        if (n == 0) {
+            // process_vm_readv refused the page at addr + done (or is unavailable altogether).
+            // only hand the slow paths a single page, so we go back to the fast path right after it
+            std::size_t chunk = m_vm_ok ? std::min(len - done, page_left(addr + done)) : len - done;
+            n = proc_read(addr + done, out + done, chunk);
+            if (n == 0) {
+                n = peek_read(addr + done, out + done, chunk);
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::write(std::uint64_t addr, const void* buf, std::size_t len) {
+    if (m_core != nullptr) {
+        return 0;
+    }
+    auto in = static_cast<const char*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        std::size_t n = vm_write(addr + done, in + done, len - done);
+        if (n == 0) {
+            // typically a read-only page (code), which process_vm_writev cannot touch but /proc/<pid>/mem can
+            std::size_t chunk = m_vm_ok ? std::min(len - done, page_left(addr + done)) : len - done;
+            n = proc_write(addr + done, in + done, chunk);
+            if (n == 0) {
+                n = poke_write(addr + done, in + done, chunk);
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::read(std::vector<request>& requests) {
+    std::vector<iovec> local, remote;
+    std::size_t total = 0;
+    std::size_t i = 0;
+    while (i < requests.size()) {
+        if (!m_vm_ok || m_core != nullptr) {
+            requests[i].done = read(requests[i].addr, requests[i].buf, requests[i].len);
+            total += requests[i].done;
+            ++i;
+            continue;
+        }
+
+        std::size_t batch = std::min<std::size_t>(IOV_MAX, requests.size() - i);
+        local.resize(batch);
+        remote.resize(batch);
+        for (std::size_t k = 0; k < batch; ++k) {
+            local[k].iov_base = requests[i + k].buf;
+            local[k].iov_len = requests[i + k].len;
+            remote[k].iov_base = reinterpret_cast<void*>(requests[i + k].addr);
+            remote[k].iov_len = requests[i + k].len;
+        }
+        ssize_t n = process_vm_readv(m_pid, local.data(), batch, remote.data(), batch, 0);
+        if (n < 0) {
+            if (errno == ENOSYS || errno == EPERM) {
+                m_vm_ok = false;
+            }
+            n = 0;
+        }
+        total += n;
+
+        // the kernel stops at the first inaccessible byte, so everything before it is complete
+        std::size_t left = n;
+        std::size_t j = i;
+        while (j < i + batch && left >= requests[j].len) {
+            requests[j].done = requests[j].len;
+            left -= requests[j].len;
+            ++j;
+        }
+        if (j == i + batch) {
+            i = j;
+            continue;
+        }
+
+        // request j stopped part way through: finish it through the fallbacks and batch the rest again
+        auto& r = requests[j];
+        r.done = left + read(r.addr + left, static_cast<char*>(r.buf) + left, r.len - left);
+        total += r.done - left;
+        i = j + 1;
+    }
+    return total;
+}
+
+std::size_t memory::vm_read(std::uint64_t addr, void* buf, std::size_t len) {
+    std::size_t done = 0;
+    while (m_vm_ok && done < len) {
+        iovec local {static_cast<char*>(buf) + done, len - done};
+        iovec remote {reinterpret_cast<void*>(addr + done), len - done};
+        ssize_t n = process_vm_readv(m_pid, &local, 1, &remote, 1, 0);
+        if (n <= 0) {
+            if (n < 0 && (errno == ENOSYS || errno == EPERM)) {
+                m_vm_ok = false;
+            }
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::vm_write(std::uint64_t addr, const void* buf, std::size_t len) {
+    std::size_t done = 0;
+    while (m_vm_ok && done < len) {
+        iovec local {const_cast<char*>(static_cast<const char*>(buf)) + done, len - done};
+        iovec remote {reinterpret_cast<void*>(addr + done), len - done};
+        ssize_t n = process_vm_writev(m_pid, &local, 1, &remote, 1, 0);
+        if (n <= 0) {
+            if (n < 0 && (errno == ENOSYS || errno == EPERM)) {
+                m_vm_ok = false;
+            }
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+int memory::mem_fd() {
+    if (m_mem_fd < 0 && m_proc_ok) {
+        std::string path = "/proc/" + std::to_string(m_pid) + "/mem";
+        m_mem_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (m_mem_fd < 0) {
+            m_mem_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (m_mem_fd < 0) {
+            m_proc_ok = false;
+        }
+    }
+    return m_mem_fd;
+}
+
+std::size_t memory::proc_read(std::uint64_t addr, void* buf, std::size_t len) {
+    int fd = mem_fd();
+    std::size_t done = 0;
+    while (fd >= 0 && done < len) {
+        ssize_t n = pread(fd, static_cast<char*>(buf) + done, len - done, addr + done);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::proc_write(std::uint64_t addr, const void* buf, std::size_t len) {
+    int fd = mem_fd();
+    std::size_t done = 0;
+    while (fd >= 0 && done < len) {
+        ssize_t n = pwrite(fd, static_cast<const char*>(buf) + done, len - done, addr + done);
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::peek_read(std::uint64_t addr, void* buf, std::size_t len) {
+    auto out = static_cast<char*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        std::uint64_t word_addr = (addr + done) & ~(word_size - 1);
+        std::size_t offset = addr + done - word_addr;
+        errno = 0;
+        long word = ptrace(PTRACE_PEEKDATA, m_pid, word_addr, nullptr);   // -1 is a valid value, only errno tells
+        if (errno != 0) {
+            break;
+        }
+        std::size_t n = std::min(word_size - offset, len - done);
+        std::memcpy(out + done, reinterpret_cast<char*>(&word) + offset, n);
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory::poke_write(std::uint64_t addr, const void* buf, std::size_t len) {
+    auto in = static_cast<const char*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        std::uint64_t word_addr = (addr + done) & ~(word_size - 1);
+        std::size_t offset = addr + done - word_addr;
+        std::size_t n = std::min(word_size - offset, len - done);
+        long word = 0;
+        if (n != word_size) {
+            // partial word: keep the bytes around the ones we are writing
+            errno = 0;
+            word = ptrace(PTRACE_PEEKDATA, m_pid, word_addr, nullptr);
+            if (errno != 0) {
+                break;
+            }
+        }
+        std::memcpy(reinterpret_cast<char*>(&word) + offset, in + done, n);
+        if (ptrace(PTRACE_POKEDATA, m_pid, word_addr, word) < 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+std::size_t memory_cache::read(std::uint64_t addr, void* buf, std::size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (len > max_cached_read || m_memory.core() != nullptr) {
+        return m_memory.read(addr, buf, len);
+    }
+
+    std::uint64_t first = addr & ~(std::uint64_t)(page_size - 1);
+    std::uint64_t last = (addr + len - 1) & ~(std::uint64_t)(page_size - 1);
+
+    // make room first: the pages of the range that are cached now have to be there still when they are copied out
+    if (m_pages.size() + (last - first) / page_size + 1 > max_pages) {
+        m_pages.clear();
+    }
+
+    // gather every page we have not seen during this stop and fetch them all at once
+    std::vector<memory::request> missing;
+    std::vector<std::unique_ptr<page>> fetched;
+    for (std::uint64_t p = first; p <= last; p += page_size) {
+        if (m_pages.find(p) == m_pages.end()) {
+            fetched.emplace_back(new page);
+            missing.push_back({p, fetched.back()->data, page_size, 0});
+        }
+    }
+    if (!missing.empty()) {
+        m_memory.read(missing);
+        for (std::size_t i = 0; i < missing.size(); ++i) {
+            fetched[i]->valid = missing[i].done;
+            m_pages[missing[i].addr] = std::move(fetched[i]);
+        }
+    }
+
+    auto out = static_cast<unsigned char*>(buf);
+    std::size_t done = 0;
+    while (done < len) {
+        std::uint64_t cur = addr + done;
+        const page& pg = *m_pages[cur & ~(std::uint64_t)(page_size - 1)];
+        std::size_t offset = cur & (page_size - 1);
+        if (offset >= pg.valid) {
+            break;
+        }
+        std::size_t n = std::min(len - done, pg.valid - offset);
+        std::memcpy(out + done, pg.data + offset, n);
+        done += n;
+    }
+    return done;
+}
+
+void memory_cache::invalidate() {
+    m_pages.clear();
+}
+
+void memory_cache::invalidate(std::uint64_t addr, std::size_t len) {
+    if (len == 0 || m_pages.empty()) {
+        return;
+    }
+    std::uint64_t first = addr & ~(std::uint64_t)(page_size - 1);
+    std::uint64_t last = (addr + len - 1) & ~(std::uint64_t)(page_size - 1);
+    if ((last - first) / page_size >= m_pages.size()) {
+        m_pages.clear();
+        return;
+    }
+    for (std::uint64_t p = first; p <= last; p += page_size) {
+        m_pages.erase(p);
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef TDB_MEMORY_HPP
+#define TDB_MEMORY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+class core_file;
+
+// bulk access to the address space of the inferior
+// every transfer tries, in order:
+//   1. process_vm_readv / process_vm_writev (one syscall for the whole range, no ptrace round trip)
+//   2. pread / pwrite on /proc/<pid>/mem (also works on read-only pages such as .text)
+//   3. PTRACE_PEEKDATA / PTRACE_POKEDATA, one word at a time (last resort)
+// with a core file there is no process: reads come out of the core's mapping, and nothing can be written
+class memory {
+    public:
+        // one piece of a vectored transfer. `done` is filled in with the number of bytes transferred
+        struct request {
+            std::uint64_t addr;
+            void* buf;
+            std::size_t len;
+            std::size_t done;
+        };
+
+        explicit memory(pid_t pid) : m_pid{pid} {}
+        ~memory();
+        memory(const memory&) = delete;
+        memory& operator=(const memory&) = delete;
+
+        // both return the number of bytes transferred from the start of the range,
+        // which is less than len only if the inferior has no accessible memory at addr + result
+        std::size_t read(std::uint64_t addr, void* buf, std::size_t len);
+        std::size_t write(std::uint64_t addr, const void* buf, std::size_t len);
+
+        // scatter read of many remote ranges, batched into as few process_vm_readv calls as possible
+        // returns the total number of bytes read, per-request counts are in request::done
+        std::size_t read(std::vector<request>& requests);
+
+        // the process image was replaced (e.g. exec) or the pid changed: drop the cached /proc fd
+        void reset(pid_t pid);
+        // the address space is the one in a core file from now on
+        void use_core(const core_file* core) { m_core = core; }
+        const core_file* core() const { return m_core; }
+
+    private:
+        std::size_t vm_read(std::uint64_t addr, void* buf, std::size_t len);
+        std::size_t vm_write(std::uint64_t addr, const void* buf, std::size_t len);
+        std::size_t proc_read(std::uint64_t addr, void* buf, std::size_t len);
+        std::size_t proc_write(std::uint64_t addr, const void* buf, std::size_t len);
+        std::size_t peek_read(std::uint64_t addr, void* buf, std::size_t len);
+        std::size_t poke_write(std::uint64_t addr, const void* buf, std::size_t len);
+        int mem_fd();
+
+        pid_t m_pid;
+        int m_mem_fd = -1;      // /proc/<pid>/mem, opened on first use
+        bool m_vm_ok = true;    // cleared when process_vm_* is unavailable (ENOSYS / EPERM), so we stop trying
+        bool m_proc_ok = true;  // same for /proc/<pid>/mem
+        const core_file* m_core = nullptr;
+};
+
+// page-granular read cache in front of `memory`, valid for the duration of one stop of the inferior.
+// whoever resumes the inferior (continue, step) or writes to it must invalidate it. a core file is mapped
+// already, and is read through it uncached
+class memory_cache {
+    public:
+        static const std::size_t page_size = 4096;
+
+        explicit memory_cache(memory& mem) : m_memory(mem) {}
+
+        // same contract as memory::read. all missing pages of the range are fetched in one vectored read
+        std::size_t read(std::uint64_t addr, void* buf, std::size_t len);
+
+        void invalidate();
+        void invalidate(std::uint64_t addr, std::size_t len);
+
+    private:
+        struct page {
+            unsigned char data[page_size];
+            std::size_t valid;  // readable bytes from the start of the page, less than page_size at a hole
+        };
+
+        // reads bigger than this (memory dumps) go straight to the inferior rather than flushing the cache
+        static const std::size_t max_cached_read = 64 * 1024;
+        static const std::size_t max_pages = 16384;
+
+        memory& m_memory;
+        std::unordered_map<std::uint64_t, std::unique_ptr<page>> m_pages;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "profile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+
+std::size_t profile_samples::stack_hash::operator()(const std::vector<std::uint64_t>& stack) const {
+    std::size_t h = stack.size();
+    for (auto pc : stack) {
+        h ^= std::hash<std::uint64_t>{}(pc) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+void profile_samples::add(const std::vector<std::uint64_t>& stack) {
+    if (!stack.empty()) {
+        ++m_stacks[stack];
+        ++m_count;
+    }
+}
+
+void profile_samples::clear() {
+    m_stacks.clear();
+    m_count = 0;
+}
+
+std::vector<std::string> profile_samples::names(const std::vector<std::uint64_t>& stack, const symbolizer& name,
+                                                std::unordered_map<std::uint64_t, std::string>& known) const {
+    std::vector<std::string> result;
+    for (std::size_t i = 0; i < stack.size(); ++i) {
+        std::uint64_t at = i == 0 ? stack[i] : stack[i] - 1;
+        auto it = known.find(at);
+        if (it == known.end()) {
+            it = known.emplace(at, name(at)).first;
+        }
+        result.push_back(it->second);
+    }
+    return result;
+}
+
+void profile_samples::write_folded(std::ostream& out, const symbolizer& name) const {
+    std::unordered_map<std::uint64_t, std::string> known;
+    // distinct stacks can fold into the same line once named (different return addresses in one function)
+    std::unordered_map<std::string, std::uint64_t> lines;
+    for (auto& entry : m_stacks) {
+        auto frames = names(entry.first, name, known);
+        std::string line;
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+            if (!line.empty()) {
+                line += ';';
+            }
+            // ';' separates frames and the last space the count: neither may be in a name
+            std::string frame = *it;
+            std::replace(frame.begin(), frame.end(), ';', ':');
+            std::replace(frame.begin(), frame.end(), ' ', '_');
+            line += frame;
+        }
+        lines[line] += entry.second;
+    }
+    std::vector<std::pair<std::string, std::uint64_t>> sorted(lines.begin(), lines.end());
+    std::sort(sorted.begin(), sorted.end());
+    for (auto& l : sorted) {
+        out << l.first << " " << l.second << "\n";
+    }
+}
+
+void profile_samples::write_top(std::ostream& out, const symbolizer& name, std::size_t limit) const {
+    std::unordered_map<std::uint64_t, std::string> known;
+    std::unordered_map<std::string, std::uint64_t> self, total;
+    for (auto& entry : m_stacks) {
+        auto frames = names(entry.first, name, known);
+        self[frames.front()] += entry.second;
+        // a recursive function counts once per sample
+        for (auto& f : std::set<std::string>(frames.begin(), frames.end())) {
+            total[f] += entry.second;
+        }
+    }
+    std::vector<std::pair<std::string, std::uint64_t>> sorted(self.begin(), self.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    char line[64];
+    out << "  self%  total%  samples  function\n";
+    for (std::size_t i = 0; i < sorted.size() && i < limit; ++i) {
+        std::snprintf(line, sizeof(line), "%6.1f%%  %5.1f%%  %7llu  ", 100.0 * sorted[i].second / m_count,
+                      100.0 * total[sorted[i].first] / m_count, static_cast<unsigned long long>(sorted[i].second));
+        out << line << sorted[i].first << "\n";
+    }
+}
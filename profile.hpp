@@ -0,0 +1,43 @@
+#ifndef TDB_PROFILE_HPP
+#define TDB_PROFILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// the samples `profile` takes: call stacks (return addresses, innermost first) counted by stack. names
+// only come in for the report, once per distinct address
+class profile_samples {
+    public:
+        // a function name for an address, "0x7f..." if there is none
+        using symbolizer = std::function<std::string(std::uint64_t addr)>;
+
+        void add(const std::vector<std::uint64_t>& stack);
+        std::uint64_t count() const { return m_count; }
+        void clear();
+
+        // folded stacks, one line per distinct stack, outermost frame first: "main;work;compute 42".
+        // what flamegraph.pl and friends read
+        void write_folded(std::ostream& out, const symbolizer& name) const;
+        // the `limit` functions with the most samples of their own, with the share of samples they are
+        // anywhere on the stack for
+        void write_top(std::ostream& out, const symbolizer& name, std::size_t limit) const;
+
+    private:
+        struct stack_hash {
+            std::size_t operator()(const std::vector<std::uint64_t>& stack) const;
+        };
+
+        // the names of a stack's frames; a return address is looked up one byte back, in the call
+        std::vector<std::string> names(const std::vector<std::uint64_t>& stack, const symbolizer& name,
+                                       std::unordered_map<std::uint64_t, std::string>& known) const;
+
+        std::unordered_map<std::vector<std::uint64_t>, std::uint64_t, stack_hash> m_stacks;
+        std::uint64_t m_count = 0;
+};
+
+#endif
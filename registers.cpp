@@ -0,0 +1,161 @@
+#include "registers.hpp"
+
+#include <cstddef>
+#include <cstring>
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+
+namespace {
+    #define REG(name) register_cache::info{#name, offsetof(user_regs_struct, name)}
+    // in the order `info registers` prints them
+    const register_cache::info registers[] = {
+        REG(rax), REG(rbx), REG(rcx), REG(rdx), REG(rsi), REG(rdi), REG(rbp), REG(rsp),
+        REG(r8), REG(r9), REG(r10), REG(r11), REG(r12), REG(r13), REG(r14), REG(r15),
+        REG(rip), REG(eflags), REG(cs), REG(ss), REG(ds), REG(es), REG(fs), REG(gs),
+        REG(fs_base), REG(gs_base), REG(orig_rax),
+    };
+    #undef REG
+
+    // XSAVE layout: the header's XSTATE_BV at 512, the AVX component (ymm upper halves) at 576
+    const std::size_t xstate_bv_offset = 512;
+    const std::size_t ymm_high_offset = 576;
+    const std::uint64_t xfeature_avx = 1 << 2;
+
+    bool get_regset(pid_t pid, int type, void* buf, std::size_t& len) {
+        iovec iov {buf, len};
+        if (ptrace(PTRACE_GETREGSET, pid, reinterpret_cast<void*>(static_cast<long>(type)), &iov) < 0) {
+            return false;
+        }
+        len = iov.iov_len;
+        return true;
+    }
+
+    bool set_regset(pid_t pid, int type, void* buf, std::size_t len) {
+        iovec iov {buf, len};
+        return ptrace(PTRACE_SETREGSET, pid, reinterpret_cast<void*>(static_cast<long>(type)), &iov) == 0;
+    }
+}
+
+const user_regs_struct& register_cache::regs() {
+    if (!m_valid) {
+        std::size_t len = sizeof(m_regs);
+        if (!get_regset(m_pid, NT_PRSTATUS, &m_regs, len)) {
+            std::memset(&m_regs, 0, sizeof(m_regs));    // the inferior is gone; callers find a zero pc
+        }
+        m_valid = true;
+    }
+    return m_regs;
+}
+
+user_regs_struct& register_cache::modify() {
+    regs();
+    m_dirty = true;
+    return m_regs;
+}
+
+const user_fpregs_struct* register_cache::fp_regs() {
+    if (!m_fp_valid && m_fp_ok) {
+        std::size_t len = sizeof(m_fp_regs);
+        m_fp_ok = get_regset(m_pid, NT_PRFPREG, &m_fp_regs, len);
+        m_fp_valid = m_fp_ok;
+    }
+    return m_fp_valid ? &m_fp_regs : nullptr;
+}
+
+user_fpregs_struct* register_cache::modify_fp_regs() {
+    if (fp_regs() == nullptr) {
+        return nullptr;
+    }
+    m_fp_dirty = true;
+    return &m_fp_regs;
+}
+
+bool register_cache::fetch_xstate() {
+    if (m_xstate_valid || !m_xstate_ok) {
+        return m_xstate_valid;
+    }
+    // the kernel trims the iovec to the size of its XSAVE area
+    m_xstate.resize(4096);
+    std::size_t len = m_xstate.size();
+    m_xstate_ok = get_regset(m_pid, NT_X86_XSTATE, m_xstate.data(), len) && len >= ymm_high_offset + 256;
+    m_xstate.resize(m_xstate_ok ? len : 0);
+    m_xstate_valid = m_xstate_ok;
+    return m_xstate_valid;
+}
+
+const unsigned char* register_cache::ymm_high() {
+    if (!fetch_xstate()) {
+        return nullptr;
+    }
+    std::uint64_t features;
+    std::memcpy(&features, m_xstate.data() + xstate_bv_offset, sizeof(features));
+    if ((features & xfeature_avx) == 0) {
+        // the component is in its initial state (all zeros), the area holds whatever was there before
+        std::memset(m_xstate.data() + ymm_high_offset, 0, 256);
+    }
+    return m_xstate.data() + ymm_high_offset;
+}
+
+bool register_cache::flush() {
+    bool ok = true;
+    if (m_dirty) {
+        ok = set_regset(m_pid, NT_PRSTATUS, &m_regs, sizeof(m_regs)) && ok;
+        m_dirty = false;
+    }
+    if (m_fp_dirty) {
+        ok = set_regset(m_pid, NT_PRFPREG, &m_fp_regs, sizeof(m_fp_regs)) && ok;
+        m_fp_dirty = false;
+    }
+    return ok;
+}
+
+void register_cache::invalidate() {
+    m_valid = m_dirty = false;
+    m_fp_valid = m_fp_dirty = false;
+    m_xstate_valid = false;
+}
+
+void register_cache::reset(pid_t pid) {
+    invalidate();
+    m_pid = pid;
+    m_fp_ok = m_xstate_ok = true;
+}
+
+void register_cache::load(const user_regs_struct& regs, const user_fpregs_struct* fp_regs) {
+    invalidate();
+    m_regs = regs;
+    m_valid = true;
+    if (fp_regs != nullptr) {
+        m_fp_regs = *fp_regs;
+    }
+    m_fp_valid = m_fp_ok = fp_regs != nullptr;
+    m_xstate_ok = false;    // a core of ours has no NT_X86_XSTATE
+}
+
+const register_cache::info* register_cache::find(std::string_view name) {
+    for (const auto& reg : registers) {
+        if (reg.name == name) {
+            return &reg;
+        }
+    }
+    return nullptr;
+}
+
+const register_cache::info* register_cache::begin() {
+    return registers;
+}
+
+const register_cache::info* register_cache::end() {
+    return registers + sizeof(registers) / sizeof(registers[0]);
+}
+
+std::uint64_t register_cache::get(const user_regs_struct& regs, const info& reg) {
+    std::uint64_t value;
+    std::memcpy(&value, reinterpret_cast<const char*>(&regs) + reg.offset, sizeof(value));
+    return value;
+}
+
+void register_cache::set(user_regs_struct& regs, const info& reg, std::uint64_t value) {
+    std::memcpy(reinterpret_cast<char*>(&regs) + reg.offset, &value, sizeof(value));
+}
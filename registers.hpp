@@ -0,0 +1,66 @@
+#ifndef TDB_REGISTERS_HPP
+#define TDB_REGISTERS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+
+// the registers of the stopped inferior, fetched with one PTRACE_GETREGSET per register set and stop.
+// changes are only made to the copy and go back in one PTRACE_SETREGSET per dirty set from flush(),
+// which whoever resumes the inferior calls first; invalidate() then drops the copy
+class register_cache {
+    public:
+        // a general purpose register by name, for the commands
+        struct info {
+            std::string_view name;
+            std::size_t offset;     // in user_regs_struct
+        };
+
+        explicit register_cache(pid_t pid) : m_pid{pid} {}
+
+        const user_regs_struct& regs();
+        // marks the general purpose set dirty, so the caller can change it
+        user_regs_struct& modify();
+        // x87/SSE state (FXSAVE layout); nullptr if the kernel won't give it out
+        const user_fpregs_struct* fp_regs();
+        user_fpregs_struct* modify_fp_regs();
+        // the upper halves of ymm0-15, 16 bytes each, from the XSAVE area; nullptr without AVX
+        const unsigned char* ymm_high();
+
+        std::uint64_t pc() { return regs().rip; }
+        void set_pc(std::uint64_t pc) { modify().rip = pc; }
+
+        // writes back whatever was modified, false if the kernel refused
+        bool flush();
+        // the inferior is about to run (flush first) or has exited
+        void invalidate();
+        void reset(pid_t pid);
+        // the registers as a core file has them, instead of from the thread. nothing is fetched after this
+        void load(const user_regs_struct& regs, const user_fpregs_struct* fp_regs);
+
+        static const info* find(std::string_view name);
+        static const info* begin();
+        static const info* end();
+        static std::uint64_t get(const user_regs_struct& regs, const info& reg);
+        static void set(user_regs_struct& regs, const info& reg, std::uint64_t value);
+
+    private:
+        bool fetch_xstate();
+
+        pid_t m_pid;
+        user_regs_struct m_regs;
+        user_fpregs_struct m_fp_regs;
+        std::vector<unsigned char> m_xstate;
+        bool m_valid = false;
+        bool m_dirty = false;
+        bool m_fp_valid = false;
+        bool m_fp_dirty = false;
+        bool m_fp_ok = true;        // cleared if NT_PRFPREG fails, so we stop asking
+        bool m_xstate_valid = false;
+        bool m_xstate_ok = true;
+};
+
+#endif
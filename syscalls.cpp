@@ -0,0 +1,784 @@
+#include "syscalls.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <fcntl.h>
+#include <linux/audit.h>
+#include <linux/seccomp.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "inject.hpp"
+
+namespace {
+    // the x86-64 system calls by number. the arguments, one letter each:
+    // d int, u unsigned, x hex, o octal, f file descriptor, s string, p pointer,
+    // b buffer going in (the next argument is its length), B buffer coming out (as long as the result)
+    // nullptr: not decoded, all six are shown in hex
+    struct syscall_info {
+        const char* name;
+        const char* args;
+    };
+
+    const syscall_info syscalls[] = {
+    /*   0 */ {"read", "fBu"},
+    /*   1 */ {"write", "fbu"},
+    /*   2 */ {"open", "sxo"},
+    /*   3 */ {"close", "f"},
+    /*   4 */ {"stat", "sp"},
+    /*   5 */ {"fstat", "fp"},
+    /*   6 */ {"lstat", "sp"},
+    /*   7 */ {"poll", "pud"},
+    /*   8 */ {"lseek", "fdd"},
+    /*   9 */ {"mmap", "puxxfx"},
+    /*  10 */ {"mprotect", "pux"},
+    /*  11 */ {"munmap", "pu"},
+    /*  12 */ {"brk", "p"},
+    /*  13 */ {"rt_sigaction", "dppu"},
+    /*  14 */ {"rt_sigprocmask", "dppu"},
+    /*  15 */ {"rt_sigreturn", ""},
+    /*  16 */ {"ioctl", "fxx"},
+    /*  17 */ {"pread64", "fBud"},
+    /*  18 */ {"pwrite64", "fbud"},
+    /*  19 */ {"readv", "fpd"},
+    /*  20 */ {"writev", "fpd"},
+    /*  21 */ {"access", "so"},
+    /*  22 */ {"pipe", "p"},
+    /*  23 */ {"select", "dpppp"},
+    /*  24 */ {"sched_yield", ""},
+    /*  25 */ {"mremap", "puuxp"},
+    /*  26 */ {"msync", nullptr},
+    /*  27 */ {"mincore", nullptr},
+    /*  28 */ {"madvise", "pud"},
+    /*  29 */ {"shmget", nullptr},
+    /*  30 */ {"shmat", nullptr},
+    /*  31 */ {"shmctl", nullptr},
+    /*  32 */ {"dup", "f"},
+    /*  33 */ {"dup2", "ff"},
+    /*  34 */ {"pause", ""},
+    /*  35 */ {"nanosleep", "pp"},
+    /*  36 */ {"getitimer", nullptr},
+    /*  37 */ {"alarm", "u"},
+    /*  38 */ {"setitimer", "dpp"},
+    /*  39 */ {"getpid", ""},
+    /*  40 */ {"sendfile", "ffpu"},
+    /*  41 */ {"socket", "ddd"},
+    /*  42 */ {"connect", "fpu"},
+    /*  43 */ {"accept", "fpp"},
+    /*  44 */ {"sendto", "fbuxpu"},
+    /*  45 */ {"recvfrom", "fBuxpp"},
+    /*  46 */ {"sendmsg", "fpx"},
+    /*  47 */ {"recvmsg", "fpx"},
+    /*  48 */ {"shutdown", "fd"},
+    /*  49 */ {"bind", "fpu"},
+    /*  50 */ {"listen", "fd"},
+    /*  51 */ {"getsockname", "fpp"},
+    /*  52 */ {"getpeername", "fpp"},
+    /*  53 */ {"socketpair", "dddp"},
+    /*  54 */ {"setsockopt", "fddpu"},
+    /*  55 */ {"getsockopt", "fddpp"},
+    /*  56 */ {"clone", "xpppp"},
+    /*  57 */ {"fork", ""},
+    /*  58 */ {"vfork", ""},
+    /*  59 */ {"execve", "spp"},
+    /*  60 */ {"exit", "d"},
+    /*  61 */ {"wait4", "dpxp"},
+    /*  62 */ {"kill", "dd"},
+    /*  63 */ {"uname", "p"},
+    /*  64 */ {"semget", nullptr},
+    /*  65 */ {"semop", nullptr},
+    /*  66 */ {"semctl", nullptr},
+    /*  67 */ {"shmdt", nullptr},
+    /*  68 */ {"msgget", nullptr},
+    /*  69 */ {"msgsnd", nullptr},
+    /*  70 */ {"msgrcv", nullptr},
+    /*  71 */ {"msgctl", nullptr},
+    /*  72 */ {"fcntl", "fdx"},
+    /*  73 */ {"flock", "fd"},
+    /*  74 */ {"fsync", "f"},
+    /*  75 */ {"fdatasync", "f"},
+    /*  76 */ {"truncate", "sd"},
+    /*  77 */ {"ftruncate", "fd"},
+    /*  78 */ {"getdents", "fpu"},
+    /*  79 */ {"getcwd", "pu"},
+    /*  80 */ {"chdir", "s"},
+    /*  81 */ {"fchdir", "f"},
+    /*  82 */ {"rename", "ss"},
+    /*  83 */ {"mkdir", "so"},
+    /*  84 */ {"rmdir", "s"},
+    /*  85 */ {"creat", "so"},
+    /*  86 */ {"link", "ss"},
+    /*  87 */ {"unlink", "s"},
+    /*  88 */ {"symlink", "ss"},
+    /*  89 */ {"readlink", "spu"},
+    /*  90 */ {"chmod", "so"},
+    /*  91 */ {"fchmod", "fo"},
+    /*  92 */ {"chown", "sdd"},
+    /*  93 */ {"fchown", nullptr},
+    /*  94 */ {"lchown", nullptr},
+    /*  95 */ {"umask", "o"},
+    /*  96 */ {"gettimeofday", "pp"},
+    /*  97 */ {"getrlimit", "dp"},
+    /*  98 */ {"getrusage", nullptr},
+    /*  99 */ {"sysinfo", nullptr},
+    /* 100 */ {"times", nullptr},
+    /* 101 */ {"ptrace", nullptr},
+    /* 102 */ {"getuid", ""},
+    /* 103 */ {"syslog", nullptr},
+    /* 104 */ {"getgid", ""},
+    /* 105 */ {"setuid", "d"},
+    /* 106 */ {"setgid", "d"},
+    /* 107 */ {"geteuid", ""},
+    /* 108 */ {"getegid", ""},
+    /* 109 */ {"setpgid", nullptr},
+    /* 110 */ {"getppid", ""},
+    /* 111 */ {"getpgrp", nullptr},
+    /* 112 */ {"setsid", nullptr},
+    /* 113 */ {"setreuid", nullptr},
+    /* 114 */ {"setregid", nullptr},
+    /* 115 */ {"getgroups", nullptr},
+    /* 116 */ {"setgroups", nullptr},
+    /* 117 */ {"setresuid", nullptr},
+    /* 118 */ {"getresuid", nullptr},
+    /* 119 */ {"setresgid", nullptr},
+    /* 120 */ {"getresgid", nullptr},
+    /* 121 */ {"getpgid", nullptr},
+    /* 122 */ {"setfsuid", nullptr},
+    /* 123 */ {"setfsgid", nullptr},
+    /* 124 */ {"getsid", nullptr},
+    /* 125 */ {"capget", nullptr},
+    /* 126 */ {"capset", nullptr},
+    /* 127 */ {"rt_sigpending", nullptr},
+    /* 128 */ {"rt_sigtimedwait", nullptr},
+    /* 129 */ {"rt_sigqueueinfo", nullptr},
+    /* 130 */ {"rt_sigsuspend", nullptr},
+    /* 131 */ {"sigaltstack", "pp"},
+    /* 132 */ {"utime", nullptr},
+    /* 133 */ {"mknod", nullptr},
+    /* 134 */ {"uselib", nullptr},
+    /* 135 */ {"personality", nullptr},
+    /* 136 */ {"ustat", nullptr},
+    /* 137 */ {"statfs", nullptr},
+    /* 138 */ {"fstatfs", nullptr},
+    /* 139 */ {"sysfs", nullptr},
+    /* 140 */ {"getpriority", nullptr},
+    /* 141 */ {"setpriority", nullptr},
+    /* 142 */ {"sched_setparam", nullptr},
+    /* 143 */ {"sched_getparam", nullptr},
+    /* 144 */ {"sched_setscheduler", nullptr},
+    /* 145 */ {"sched_getscheduler", nullptr},
+    /* 146 */ {"sched_get_priority_max", nullptr},
+    /* 147 */ {"sched_get_priority_min", nullptr},
+    /* 148 */ {"sched_rr_get_interval", nullptr},
+    /* 149 */ {"mlock", nullptr},
+    /* 150 */ {"munlock", nullptr},
+    /* 151 */ {"mlockall", nullptr},
+    /* 152 */ {"munlockall", nullptr},
+    /* 153 */ {"vhangup", nullptr},
+    /* 154 */ {"modify_ldt", nullptr},
+    /* 155 */ {"pivot_root", nullptr},
+    /* 156 */ {"_sysctl", nullptr},
+    /* 157 */ {"prctl", "dxxxx"},
+    /* 158 */ {"arch_prctl", "xp"},
+    /* 159 */ {"adjtimex", nullptr},
+    /* 160 */ {"setrlimit", nullptr},
+    /* 161 */ {"chroot", nullptr},
+    /* 162 */ {"sync", nullptr},
+    /* 163 */ {"acct", nullptr},
+    /* 164 */ {"settimeofday", nullptr},
+    /* 165 */ {"mount", nullptr},
+    /* 166 */ {"umount2", nullptr},
+    /* 167 */ {"swapon", nullptr},
+    /* 168 */ {"swapoff", nullptr},
+    /* 169 */ {"reboot", nullptr},
+    /* 170 */ {"sethostname", nullptr},
+    /* 171 */ {"setdomainname", nullptr},
+    /* 172 */ {"iopl", nullptr},
+    /* 173 */ {"ioperm", nullptr},
+    /* 174 */ {"create_module", nullptr},
+    /* 175 */ {"init_module", nullptr},
+    /* 176 */ {"delete_module", nullptr},
+    /* 177 */ {"get_kernel_syms", nullptr},
+    /* 178 */ {"query_module", nullptr},
+    /* 179 */ {"quotactl", nullptr},
+    /* 180 */ {"nfsservctl", nullptr},
+    /* 181 */ {"getpmsg", nullptr},
+    /* 182 */ {"putpmsg", nullptr},
+    /* 183 */ {"afs_syscall", nullptr},
+    /* 184 */ {"tuxcall", nullptr},
+    /* 185 */ {"security", nullptr},
+    /* 186 */ {"gettid", ""},
+    /* 187 */ {"readahead", nullptr},
+    /* 188 */ {"setxattr", nullptr},
+    /* 189 */ {"lsetxattr", nullptr},
+    /* 190 */ {"fsetxattr", nullptr},
+    /* 191 */ {"getxattr", nullptr},
+    /* 192 */ {"lgetxattr", nullptr},
+    /* 193 */ {"fgetxattr", nullptr},
+    /* 194 */ {"listxattr", nullptr},
+    /* 195 */ {"llistxattr", nullptr},
+    /* 196 */ {"flistxattr", nullptr},
+    /* 197 */ {"removexattr", nullptr},
+    /* 198 */ {"lremovexattr", nullptr},
+    /* 199 */ {"fremovexattr", nullptr},
+    /* 200 */ {"tkill", nullptr},
+    /* 201 */ {"time", nullptr},
+    /* 202 */ {"futex", "pddppd"},
+    /* 203 */ {"sched_setaffinity", "dup"},
+    /* 204 */ {"sched_getaffinity", "dup"},
+    /* 205 */ {"set_thread_area", nullptr},
+    /* 206 */ {"io_setup", nullptr},
+    /* 207 */ {"io_destroy", nullptr},
+    /* 208 */ {"io_getevents", nullptr},
+    /* 209 */ {"io_submit", nullptr},
+    /* 210 */ {"io_cancel", nullptr},
+    /* 211 */ {"get_thread_area", nullptr},
+    /* 212 */ {"lookup_dcookie", nullptr},
+    /* 213 */ {"epoll_create", "d"},
+    /* 214 */ {"epoll_ctl_old", nullptr},
+    /* 215 */ {"epoll_wait_old", nullptr},
+    /* 216 */ {"remap_file_pages", nullptr},
+    /* 217 */ {"getdents64", "fpu"},
+    /* 218 */ {"set_tid_address", "p"},
+    /* 219 */ {"restart_syscall", nullptr},
+    /* 220 */ {"semtimedop", nullptr},
+    /* 221 */ {"fadvise64", nullptr},
+    /* 222 */ {"timer_create", nullptr},
+    /* 223 */ {"timer_settime", nullptr},
+    /* 224 */ {"timer_gettime", nullptr},
+    /* 225 */ {"timer_getoverrun", nullptr},
+    /* 226 */ {"timer_delete", nullptr},
+    /* 227 */ {"clock_settime", nullptr},
+    /* 228 */ {"clock_gettime", "dp"},
+    /* 229 */ {"clock_getres", nullptr},
+    /* 230 */ {"clock_nanosleep", "ddpp"},
+    /* 231 */ {"exit_group", "d"},
+    /* 232 */ {"epoll_wait", "fpdd"},
+    /* 233 */ {"epoll_ctl", "fdfp"},
+    /* 234 */ {"tgkill", "ddd"},
+    /* 235 */ {"utimes", nullptr},
+    /* 236 */ {"vserver", nullptr},
+    /* 237 */ {"mbind", nullptr},
+    /* 238 */ {"set_mempolicy", nullptr},
+    /* 239 */ {"get_mempolicy", nullptr},
+    /* 240 */ {"mq_open", nullptr},
+    /* 241 */ {"mq_unlink", nullptr},
+    /* 242 */ {"mq_timedsend", nullptr},
+    /* 243 */ {"mq_timedreceive", nullptr},
+    /* 244 */ {"mq_notify", nullptr},
+    /* 245 */ {"mq_getsetattr", nullptr},
+    /* 246 */ {"kexec_load", nullptr},
+    /* 247 */ {"waitid", nullptr},
+    /* 248 */ {"add_key", nullptr},
+    /* 249 */ {"request_key", nullptr},
+    /* 250 */ {"keyctl", nullptr},
+    /* 251 */ {"ioprio_set", nullptr},
+    /* 252 */ {"ioprio_get", nullptr},
+    /* 253 */ {"inotify_init", nullptr},
+    /* 254 */ {"inotify_add_watch", nullptr},
+    /* 255 */ {"inotify_rm_watch", nullptr},
+    /* 256 */ {"migrate_pages", nullptr},
+    /* 257 */ {"openat", "fsxo"},
+    /* 258 */ {"mkdirat", "fso"},
+    /* 259 */ {"mknodat", nullptr},
+    /* 260 */ {"fchownat", nullptr},
+    /* 261 */ {"futimesat", nullptr},
+    /* 262 */ {"newfstatat", "fspx"},
+    /* 263 */ {"unlinkat", "fsx"},
+    /* 264 */ {"renameat", "fsfs"},
+    /* 265 */ {"linkat", nullptr},
+    /* 266 */ {"symlinkat", nullptr},
+    /* 267 */ {"readlinkat", "fspu"},
+    /* 268 */ {"fchmodat", nullptr},
+    /* 269 */ {"faccessat", "fso"},
+    /* 270 */ {"pselect6", "dppppp"},
+    /* 271 */ {"ppoll", "pupp"},
+    /* 272 */ {"unshare", nullptr},
+    /* 273 */ {"set_robust_list", "pu"},
+    /* 274 */ {"get_robust_list", nullptr},
+    /* 275 */ {"splice", nullptr},
+    /* 276 */ {"tee", nullptr},
+    /* 277 */ {"sync_file_range", nullptr},
+    /* 278 */ {"vmsplice", nullptr},
+    /* 279 */ {"move_pages", nullptr},
+    /* 280 */ {"utimensat", nullptr},
+    /* 281 */ {"epoll_pwait", "fpddpu"},
+    /* 282 */ {"signalfd", nullptr},
+    /* 283 */ {"timerfd_create", "dx"},
+    /* 284 */ {"eventfd", "u"},
+    /* 285 */ {"fallocate", nullptr},
+    /* 286 */ {"timerfd_settime", "fxpp"},
+    /* 287 */ {"timerfd_gettime", nullptr},
+    /* 288 */ {"accept4", "fppx"},
+    /* 289 */ {"signalfd4", "fpux"},
+    /* 290 */ {"eventfd2", "ux"},
+    /* 291 */ {"epoll_create1", "x"},
+    /* 292 */ {"dup3", "ffx"},
+    /* 293 */ {"pipe2", "px"},
+    /* 294 */ {"inotify_init1", nullptr},
+    /* 295 */ {"preadv", nullptr},
+    /* 296 */ {"pwritev", nullptr},
+    /* 297 */ {"rt_tgsigqueueinfo", nullptr},
+    /* 298 */ {"perf_event_open", nullptr},
+    /* 299 */ {"recvmmsg", nullptr},
+    /* 300 */ {"fanotify_init", nullptr},
+    /* 301 */ {"fanotify_mark", nullptr},
+    /* 302 */ {"prlimit64", "ddpp"},
+    /* 303 */ {"name_to_handle_at", nullptr},
+    /* 304 */ {"open_by_handle_at", nullptr},
+    /* 305 */ {"clock_adjtime", nullptr},
+    /* 306 */ {"syncfs", nullptr},
+    /* 307 */ {"sendmmsg", nullptr},
+    /* 308 */ {"setns", nullptr},
+    /* 309 */ {"getcpu", nullptr},
+    /* 310 */ {"process_vm_readv", nullptr},
+    /* 311 */ {"process_vm_writev", nullptr},
+    /* 312 */ {"kcmp", nullptr},
+    /* 313 */ {"finit_module", nullptr},
+    /* 314 */ {"sched_setattr", nullptr},
+    /* 315 */ {"sched_getattr", nullptr},
+    /* 316 */ {"renameat2", nullptr},
+    /* 317 */ {"seccomp", "dxp"},
+    /* 318 */ {"getrandom", "Bux"},
+    /* 319 */ {"memfd_create", "sx"},
+    /* 320 */ {"kexec_file_load", nullptr},
+    /* 321 */ {"bpf", nullptr},
+    /* 322 */ {"execveat", "fsppx"},
+    /* 323 */ {"userfaultfd", nullptr},
+    /* 324 */ {"membarrier", nullptr},
+    /* 325 */ {"mlock2", nullptr},
+    /* 326 */ {"copy_file_range", nullptr},
+    /* 327 */ {"preadv2", nullptr},
+    /* 328 */ {"pwritev2", nullptr},
+    /* 329 */ {"pkey_mprotect", nullptr},
+    /* 330 */ {"pkey_alloc", nullptr},
+    /* 331 */ {"pkey_free", nullptr},
+    /* 332 */ {"statx", "fsxxp"},
+    /* 333 */ {"io_pgetevents", nullptr},
+    /* 334 */ {"rseq", "pudd"},
+    /* 335 */ {nullptr, nullptr},
+    /* 336 */ {nullptr, nullptr},
+    /* 337 */ {nullptr, nullptr},
+    /* 338 */ {nullptr, nullptr},
+    /* 339 */ {nullptr, nullptr},
+    /* 340 */ {nullptr, nullptr},
+    /* 341 */ {nullptr, nullptr},
+    /* 342 */ {nullptr, nullptr},
+    /* 343 */ {nullptr, nullptr},
+    /* 344 */ {nullptr, nullptr},
+    /* 345 */ {nullptr, nullptr},
+    /* 346 */ {nullptr, nullptr},
+    /* 347 */ {nullptr, nullptr},
+    /* 348 */ {nullptr, nullptr},
+    /* 349 */ {nullptr, nullptr},
+    /* 350 */ {nullptr, nullptr},
+    /* 351 */ {nullptr, nullptr},
+    /* 352 */ {nullptr, nullptr},
+    /* 353 */ {nullptr, nullptr},
+    /* 354 */ {nullptr, nullptr},
+    /* 355 */ {nullptr, nullptr},
+    /* 356 */ {nullptr, nullptr},
+    /* 357 */ {nullptr, nullptr},
+    /* 358 */ {nullptr, nullptr},
+    /* 359 */ {nullptr, nullptr},
+    /* 360 */ {nullptr, nullptr},
+    /* 361 */ {nullptr, nullptr},
+    /* 362 */ {nullptr, nullptr},
+    /* 363 */ {nullptr, nullptr},
+    /* 364 */ {nullptr, nullptr},
+    /* 365 */ {nullptr, nullptr},
+    /* 366 */ {nullptr, nullptr},
+    /* 367 */ {nullptr, nullptr},
+    /* 368 */ {nullptr, nullptr},
+    /* 369 */ {nullptr, nullptr},
+    /* 370 */ {nullptr, nullptr},
+    /* 371 */ {nullptr, nullptr},
+    /* 372 */ {nullptr, nullptr},
+    /* 373 */ {nullptr, nullptr},
+    /* 374 */ {nullptr, nullptr},
+    /* 375 */ {nullptr, nullptr},
+    /* 376 */ {nullptr, nullptr},
+    /* 377 */ {nullptr, nullptr},
+    /* 378 */ {nullptr, nullptr},
+    /* 379 */ {nullptr, nullptr},
+    /* 380 */ {nullptr, nullptr},
+    /* 381 */ {nullptr, nullptr},
+    /* 382 */ {nullptr, nullptr},
+    /* 383 */ {nullptr, nullptr},
+    /* 384 */ {nullptr, nullptr},
+    /* 385 */ {nullptr, nullptr},
+    /* 386 */ {nullptr, nullptr},
+    /* 387 */ {nullptr, nullptr},
+    /* 388 */ {nullptr, nullptr},
+    /* 389 */ {nullptr, nullptr},
+    /* 390 */ {nullptr, nullptr},
+    /* 391 */ {nullptr, nullptr},
+    /* 392 */ {nullptr, nullptr},
+    /* 393 */ {nullptr, nullptr},
+    /* 394 */ {nullptr, nullptr},
+    /* 395 */ {nullptr, nullptr},
+    /* 396 */ {nullptr, nullptr},
+    /* 397 */ {nullptr, nullptr},
+    /* 398 */ {nullptr, nullptr},
+    /* 399 */ {nullptr, nullptr},
+    /* 400 */ {nullptr, nullptr},
+    /* 401 */ {nullptr, nullptr},
+    /* 402 */ {nullptr, nullptr},
+    /* 403 */ {nullptr, nullptr},
+    /* 404 */ {nullptr, nullptr},
+    /* 405 */ {nullptr, nullptr},
+    /* 406 */ {nullptr, nullptr},
+    /* 407 */ {nullptr, nullptr},
+    /* 408 */ {nullptr, nullptr},
+    /* 409 */ {nullptr, nullptr},
+    /* 410 */ {nullptr, nullptr},
+    /* 411 */ {nullptr, nullptr},
+    /* 412 */ {nullptr, nullptr},
+    /* 413 */ {nullptr, nullptr},
+    /* 414 */ {nullptr, nullptr},
+    /* 415 */ {nullptr, nullptr},
+    /* 416 */ {nullptr, nullptr},
+    /* 417 */ {nullptr, nullptr},
+    /* 418 */ {nullptr, nullptr},
+    /* 419 */ {nullptr, nullptr},
+    /* 420 */ {nullptr, nullptr},
+    /* 421 */ {nullptr, nullptr},
+    /* 422 */ {nullptr, nullptr},
+    /* 423 */ {nullptr, nullptr},
+    /* 424 */ {"pidfd_send_signal", nullptr},
+    /* 425 */ {"io_uring_setup", nullptr},
+    /* 426 */ {"io_uring_enter", nullptr},
+    /* 427 */ {"io_uring_register", nullptr},
+    /* 428 */ {"open_tree", nullptr},
+    /* 429 */ {"move_mount", nullptr},
+    /* 430 */ {"fsopen", nullptr},
+    /* 431 */ {"fsconfig", nullptr},
+    /* 432 */ {"fsmount", nullptr},
+    /* 433 */ {"fspick", nullptr},
+    /* 434 */ {"pidfd_open", nullptr},
+    /* 435 */ {"clone3", "pu"},
+    /* 436 */ {"close_range", nullptr},
+    /* 437 */ {"openat2", "fspu"},
+    /* 438 */ {"pidfd_getfd", nullptr},
+    /* 439 */ {"faccessat2", "fsox"},
+    /* 440 */ {"process_madvise", nullptr},
+    /* 441 */ {"epoll_pwait2", nullptr},
+    /* 442 */ {"mount_setattr", nullptr},
+    /* 443 */ {"quotactl_fd", nullptr},
+    /* 444 */ {"landlock_create_ruleset", nullptr},
+    /* 445 */ {"landlock_add_rule", nullptr},
+    /* 446 */ {"landlock_restrict_self", nullptr},
+    /* 447 */ {"memfd_secret", nullptr},
+    /* 448 */ {"process_mrelease", nullptr},
+    /* 449 */ {"futex_waitv", nullptr},
+    /* 450 */ {"set_mempolicy_home_node", nullptr},
+    };
+
+    const std::size_t syscall_count = sizeof(syscalls) / sizeof(syscalls[0]);
+    // a BPF jump offset is 8 bits, and every JEQ jumps over the ones after it
+    const std::size_t max_numbers = 250;
+    const std::size_t shown_bytes = 32;
+
+    std::uint64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    std::string escape(const char* bytes, std::size_t len) {
+        std::ostringstream out;
+        out << '"';
+        for (std::size_t i = 0; i < len; ++i) {
+            unsigned char c = bytes[i];
+            switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                case '\r': out << "\\r"; break;
+                default:
+                    if (c >= 0x20 && c < 0x7f) {
+                        out << c;
+                    } else {
+                        out << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(c)
+                            << std::dec << std::setfill(' ');
+                    }
+            }
+        }
+        out << '"';
+        return out.str();
+    }
+}
+
+const char* syscall_tracer::name(long number) {
+    if (number < 0 || static_cast<std::size_t>(number) >= syscall_count) {
+        return nullptr;
+    }
+    return syscalls[number].name;
+}
+
+bool syscall_tracer::parse(const std::string& list, std::vector<int>& numbers, std::string& error) {
+    std::istringstream in {list};
+    for (std::string item; std::getline(in, item, ','); ) {
+        if (item.empty()) {
+            continue;
+        }
+        char* end = nullptr;
+        long number = std::strtol(item.c_str(), &end, 0);
+        if (*end == '\0' && name(number) != nullptr) {
+            numbers.push_back(number);
+            continue;
+        }
+        std::size_t i = 0;
+        while (i < syscall_count && (syscalls[i].name == nullptr || item != syscalls[i].name)) {
+            ++i;
+        }
+        if (i == syscall_count) {
+            error = "no system call " + item;
+            return false;
+        }
+        numbers.push_back(i);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    numbers.erase(std::unique(numbers.begin(), numbers.end()), numbers.end());
+    if (numbers.size() > max_numbers) {
+        error = "too many system calls, catch them all instead";
+        return false;
+    }
+    return true;
+}
+
+// load the arch, allow anything that isn't x86-64; load the number, one JEQ per number jumping to
+// the trace at the end; allow
+std::vector<sock_filter> syscall_tracer::filter(const std::vector<int>& numbers) {
+    std::vector<sock_filter> program;
+    program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)));
+    if (numbers.empty()) {
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0));
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+        program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+        return program;
+    }
+    program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0,
+                               static_cast<unsigned char>(numbers.size() + 1)));
+    program.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)));
+    for (std::size_t i = 0; i < numbers.size(); ++i) {
+        program.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, static_cast<unsigned>(numbers[i]),
+                                   static_cast<unsigned char>(numbers.size() - i), 0));
+    }
+    program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    program.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    return program;
+}
+
+// without CAP_SYS_ADMIN a filter needs no_new_privs, which exec keeps: set-user-ID bits are ignored from then on
+bool syscall_tracer::install(const sock_fprog& prog) {
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0 && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog) == 0;
+}
+
+void syscall_tracer::restart() {
+    m_filtered = m_caught;
+    m_filtered_all = m_all;
+    m_calls.clear();
+}
+
+void syscall_tracer::added(const std::vector<int>& numbers) {
+    if (numbers.empty()) {
+        m_all = m_filtered_all = true;
+    }
+    m_caught.insert(numbers.begin(), numbers.end());
+    m_filtered.insert(numbers.begin(), numbers.end());
+}
+
+bool syscall_tracer::covers(const std::vector<int>& numbers) const {
+    if (m_filtered_all) {
+        return true;
+    }
+    if (numbers.empty()) {
+        return false;
+    }
+    for (auto number : numbers) {
+        if (m_filtered.count(number) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the same as install(), through system calls made by the inferior: the program goes into a page mapped
+// for the occasion. SECCOMP_FILTER_FLAG_TSYNC puts it on every thread, not just the calling one
+bool syscall_tracer::add(pid_t tid, const std::vector<int>& numbers, std::string& error) {
+    if (!covers(numbers)) {
+        // the second filter is the last: it traces every call
+        bool every = numbers.empty() || filtered();
+        std::vector<sock_filter> program = filter(every ? std::vector<int>{} : numbers);
+        std::size_t size = sizeof(sock_fprog) + program.size() * sizeof(sock_filter);
+        long page = remote_syscall(tid, m_memory, SYS_mmap, {0, size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, static_cast<std::uint64_t>(-1), 0});
+        if (page < 0 && page > -4096) {
+            error = std::string("cannot map memory in the program: ") + std::strerror(-page);
+            return false;
+        }
+        std::uint64_t addr = page;
+        std::uint64_t code = addr + sizeof(sock_fprog);
+        sock_fprog prog {static_cast<unsigned short>(program.size()), nullptr};
+        std::memcpy(&prog.filter, &code, sizeof(code));     // the inferior's address
+        m_memory.write(addr, &prog, sizeof(prog));
+        m_memory.write(code, program.data(), program.size() * sizeof(sock_filter));
+        long result = remote_syscall(tid, m_memory, SYS_prctl, {PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0});
+        if (result == 0) {
+            result = remote_syscall(tid, m_memory, SYS_seccomp, {SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_TSYNC, addr});
+        }
+        remote_syscall(tid, m_memory, SYS_munmap, {addr, size});
+        if (result != 0) {
+            // positive: the thread that could not be synchronized
+            error = result < 0 ? std::string("cannot install the filter: ") + std::strerror(-result)
+                               : "cannot install the filter on thread " + std::to_string(result);
+            return false;
+        }
+        m_filtered.insert(numbers.begin(), numbers.end());
+        m_filtered_all = every;
+    }
+    m_caught.insert(numbers.begin(), numbers.end());
+    m_all = m_all || numbers.empty();
+    return true;
+}
+
+void syscall_tracer::remove(const std::vector<int>& numbers) {
+    if (numbers.empty()) {
+        m_caught.clear();
+        m_all = false;
+    }
+    for (auto number : numbers) {
+        m_caught.erase(number);
+    }
+}
+
+bool syscall_tracer::enter(pid_t tid, const user_regs_struct& regs) {
+    long number = regs.orig_rax;
+    if (!m_all && m_caught.count(number) == 0) {
+        return false;
+    }
+    call c {number, {regs.rdi, regs.rsi, regs.rdx, regs.r10, regs.r8, regs.r9}, {}, 0};
+    const char* types = name(number) != nullptr ? syscalls[number].args : nullptr;
+    std::size_t count = types != nullptr ? std::strlen(types) : 6;
+    for (std::size_t i = 0; i < count; ++i) {
+        char type = types != nullptr ? types[i] : 'x';
+        c.shown.push_back(type == 'B' ? std::string() : show(type, c.args[i], i + 1 < 6 ? c.args[i + 1] : 0));
+    }
+    c.start = now();
+    m_calls[tid] = std::move(c);
+    return true;
+}
+
+// openat(AT_FDCWD, "/etc/hosts", 0x80000, 0) = 3 <0.000012>
+std::string syscall_tracer::finish(pid_t tid, long result) {
+    auto it = m_calls.find(tid);
+    if (it == m_calls.end()) {
+        return std::string();
+    }
+    call& c = it->second;
+    std::uint64_t elapsed = now() - c.start;
+    const char* types = name(c.number) != nullptr ? syscalls[c.number].args : nullptr;
+    std::ostringstream out;
+    out << (name(c.number) != nullptr ? name(c.number) : "syscall_" + std::to_string(c.number)) << '(';
+    for (std::size_t i = 0; i < c.shown.size(); ++i) {
+        if (types != nullptr && types[i] == 'B') {
+            c.shown[i] = result > 0 ? read_buffer(c.args[i], result) : show('p', c.args[i], 0);
+        }
+        out << (i > 0 ? ", " : "") << c.shown[i];
+    }
+    out << ") = ";
+    if (result < 0 && result > -4096) {
+        const char* error = strerrorname_np(-result);
+        out << "-1 " << (error != nullptr ? error : std::to_string(-result)) << " (" << std::strerror(-result) << ")";
+    } else if (types != nullptr && std::strchr("pux", types[0]) != nullptr && result > 0xffff) {
+        out << "0x" << std::hex << result << std::dec;     // mmap, brk, ...
+    } else {
+        out << result;
+    }
+    out << " <" << elapsed / 1000000000 << '.' << std::setw(6) << std::setfill('0') << elapsed % 1000000000 / 1000 << '>';
+    m_calls.erase(it);
+    return out.str();
+}
+
+std::string syscall_tracer::unfinished(pid_t tid) {
+    auto it = m_calls.find(tid);
+    if (it == m_calls.end()) {
+        return std::string();
+    }
+    std::ostringstream out;
+    out << (name(it->second.number) != nullptr ? name(it->second.number) : "syscall") << '(';
+    for (std::size_t i = 0; i < it->second.shown.size(); ++i) {
+        out << (i > 0 ? ", " : "") << (it->second.shown[i].empty() ? "..." : it->second.shown[i]);
+    }
+    out << ") = ?";
+    m_calls.erase(it);
+    return out.str();
+}
+
+std::vector<pid_t> syscall_tracer::calling() const {
+    std::vector<pid_t> tids;
+    for (const auto& entry : m_calls) {
+        tids.push_back(entry.first);
+    }
+    return tids;
+}
+
+std::string syscall_tracer::show(char type, std::uint64_t value, std::uint64_t next) const {
+    std::ostringstream out;
+    switch (type) {
+        case 'd':
+            out << static_cast<std::int64_t>(value);
+            break;
+        case 'f':
+            if (static_cast<int>(value) == AT_FDCWD) {
+                out << "AT_FDCWD";
+            } else {
+                out << static_cast<int>(value);
+            }
+            break;
+        case 'u':
+            out << value;
+            break;
+        case 'o':
+            out << (value != 0 ? "0" : "") << std::oct << value;
+            break;
+        case 's':
+            return value == 0 ? "NULL" : read_string(value);
+        case 'b':
+            return read_buffer(value, next);
+        case 'p':
+            if (value == 0) {
+                return "NULL";
+            }
+            out << "0x" << std::hex << value;
+            break;
+        default:
+            out << "0x" << std::hex << value;
+    }
+    return out.str();
+}
+
+std::string syscall_tracer::read_string(std::uint64_t addr) const {
+    char bytes[64];
+    std::size_t n = m_memory.read(addr, bytes, sizeof(bytes));
+    if (n == 0) {
+        return show('p', addr, 0);     // not readable
+    }
+    std::size_t len = std::find(bytes, bytes + n, '\0') - bytes;
+    return escape(bytes, len) + (len == n ? "..." : "");
+}
+
+std::string syscall_tracer::read_buffer(std::uint64_t addr, std::uint64_t len) const {
+    char bytes[shown_bytes];
+    std::size_t n = m_memory.read(addr, bytes, std::min<std::uint64_t>(len, sizeof(bytes)));
+    return escape(bytes, n) + (n < len ? "..." : "");
+}
@@ -0,0 +1,83 @@
+#ifndef TDB_SYSCALLS_HPP
+#define TDB_SYSCALLS_HPP
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <linux/filter.h>
+#include <sys/types.h>
+#include <sys/user.h>
+#include "memory.hpp"
+
+// system call tracing (`catch syscall`). PTRACE_SYSCALL would stop every thread at the entry and the
+// exit of every system call; instead a seccomp filter in the inferior returns SECCOMP_RET_TRACE for the
+// caught numbers only, so the kernel stops just those (PTRACE_EVENT_SECCOMP) and everything else runs
+// at full speed. from that stop the thread goes on with PTRACE_SYSCALL, for one more stop at the exit
+// that gives the result and how long the call took.
+//
+// a seccomp filter can't be taken out or replaced, only stacked on, and every filter runs at every call. so
+// uncaught numbers still stop, and are resumed at once; and there are never more than two: once one is in,
+// catching a number it doesn't trace adds one that traces every call, and no more go in after that
+class syscall_tracer {
+    public:
+        explicit syscall_tracer(memory& mem) : m_memory(mem) {}
+
+        // "open,mmap,2": names or numbers; false with the reason in `error`. an empty list is every call
+        static bool parse(const std::string& list, std::vector<int>& numbers, std::string& error);
+        static const char* name(long number);
+        // the BPF program: SECCOMP_RET_TRACE for the numbers (all of them if empty), SECCOMP_RET_ALLOW for
+        // everything else, calls of other ABIs included
+        static std::vector<sock_filter> filter(const std::vector<int>& numbers);
+        // for the child before it execs: a filter on itself, the program built by filter() before the fork. two
+        // prctl calls and nothing else, so it is safe between fork and exec. only works once the tracer has
+        // PTRACE_O_TRACESECCOMP set, a traced call without a tracer fails with ENOSYS
+        static bool install(const sock_fprog& prog);
+
+        // reports the numbers from now on, adding a filter through thread tid (stopped), for every thread, if
+        // the one in already doesn't trace them all (see covers()). false with the reason in `error`
+        bool add(pid_t tid, const std::vector<int>& numbers, std::string& error);
+        // the filter installed by the child before exec
+        void added(const std::vector<int>& numbers);
+        void remove(const std::vector<int>& numbers);     // an empty list is all of them
+        // the program was started again, with a filter for what is caught (see install())
+        void restart();
+        const std::set<int>& caught() const { return m_caught; }
+        bool catches_all() const { return m_all; }
+        // a filter has been installed; it stays for good
+        bool filtered() const { return m_filtered_all || !m_filtered.empty(); }
+        // do the filters installed so far trace all of the numbers; if not, add() puts in the one for every call
+        bool covers(const std::vector<int>& numbers) const;
+
+        // the thread is at a PTRACE_EVENT_SECCOMP stop. true if the call is reported: the thread is to be
+        // resumed with PTRACE_SYSCALL, for the exit
+        bool enter(pid_t tid, const user_regs_struct& regs);
+        bool in_call(pid_t tid) const { return m_calls.count(tid) != 0; }
+        // the exit of the thread's call: the line for it, with the result and the time it took
+        std::string finish(pid_t tid, long result);
+        // the thread won't come back from its call (exit, or gone with an exec): its line, if it was in one
+        std::string unfinished(pid_t tid);
+        std::vector<pid_t> calling() const;
+
+    private:
+        struct call {
+            long number;
+            std::uint64_t args[6];
+            std::vector<std::string> shown;     // the arguments as decoded at the entry; output buffers wait for the exit
+            std::uint64_t start;    // ns, CLOCK_MONOTONIC
+        };
+
+        std::string show(char type, std::uint64_t value, std::uint64_t next) const;
+        std::string read_string(std::uint64_t addr) const;
+        std::string read_buffer(std::uint64_t addr, std::uint64_t len) const;
+
+        memory& m_memory;
+        std::set<int> m_caught;     // reported
+        bool m_all = false;
+        std::set<int> m_filtered;   // in the filters installed so far
+        bool m_filtered_all = false;
+        std::unordered_map<pid_t, call> m_calls;    // the threads between the entry and the exit of a reported call
+};
+
+#endif
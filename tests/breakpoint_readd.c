@@ -0,0 +1,14 @@
+// a breakpoint set, deleted and set again before the program gets there
+int counter;
+
+void stop(void) {}
+
+void work(void) { counter++; }
+
+int main(void) {
+    stop();
+    work();
+    stop();
+    work();
+    return 0;
+}
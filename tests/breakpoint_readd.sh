@@ -0,0 +1,17 @@
+# `delete` leaves nothing behind that keeps the same breakpoint, set again, from going in: neither before it
+# was ever inserted nor while it is
+. "$(dirname "$0")/lib.sh"
+compile
+run <<'SCRIPT'
+break work
+delete
+break stop
+continue
+break work
+continue
+delete
+break work
+continue
+SCRIPT
+[ "$(count 'Hit breakpoint at .* <work>')" -eq 2 ] || fail "work was not hit twice"
+pass
@@ -0,0 +1,10 @@
+// more pages than the memory cache holds, to read in one stop
+static char area[80 << 20];
+
+void stop(void) {}
+
+int main(void) {
+    area[0] = 1;
+    stop();
+    return 0;
+}
@@ -0,0 +1,14 @@
+# memory_cache drops everything once it holds max_pages (16384): a read that spans a cached page and a new one
+# right then has to find the cached one again. two-page reads sliding one page at a time fill it and hit that
+. "$(dirname "$0")/lib.sh"
+compile -no-pie
+area=$(nm "$prog" | awk '$3 == "area" { print $1 }')
+run <<SCRIPT
+break stop
+continue
+$(awk -v base=$((0x$area)) 'BEGIN { for (i = 0; i < 17000; ++i) printf "dump /dev/null %d 8192\n", base + i * 4096 }')
+echo done
+SCRIPT
+[ "$(count 'wrote 8192 bytes')" -eq 17000 ] || fail "not every read went through"
+expect "^done"
+pass
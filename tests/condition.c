@@ -0,0 +1,11 @@
+// conditions over a global and over the code under the breakpoint itself
+int counter;
+
+void work(void) { counter++; }
+
+int main(void) {
+    work();
+    work();
+    work();
+    return 0;
+}
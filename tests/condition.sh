@@ -0,0 +1,25 @@
+# a condition that reads the byte under its own breakpoint sees the program's byte, not the int3; and setting
+# the breakpoint again leaves its condition alone
+. "$(dirname "$0")/lib.sh"
+compile -no-pie
+work=0x$(nm "$prog" | awk '$3 == "work" { print $1 }')
+first=$(objdump -d --start-address="$work" --stop-address=$((work + 1)) "$prog" | awk -F'\t' '/^ *[0-9a-f]+:/ { print $2; exit }' | tr -d ' ')
+run <<SCRIPT
+break work if u8[$work] == 0x$first
+continue
+continue
+continue
+continue
+SCRIPT
+[ "$(count 'Hit breakpoint at .* <work>')" -eq 3 ] || fail "the condition on the code under the breakpoint did not hold"
+run <<'SCRIPT'
+break work if counter == 1
+break work
+continue
+print counter
+continue
+SCRIPT
+expect "already exists (if counter == 1)"
+[ "$(count 'Hit breakpoint at .* <work>')" -eq 1 ] || fail "the condition was replaced"
+expect "counter = 1 "
+pass
@@ -0,0 +1,14 @@
+// a global on a page of its own, for a page watchpoint
+struct {
+    long value;
+    long more[7];
+} data __attribute__((aligned(4096)));
+
+void stop(void) {}
+
+int main(void) {
+    data.value = 42;
+    stop();
+    data.value = 43;
+    return 0;
+}
@@ -0,0 +1,25 @@
+# a core written while a page watchpoint has the page protected has the page as the program sees it
+. "$(dirname "$0")/lib.sh"
+compile
+core=$build/gcore_watch.core
+rm -f "$core"
+run <<SCRIPT
+break stop
+continue
+print data
+watch data 64 rw
+gcore $core
+SCRIPT
+expect "Saved corefile"
+page=$(echo "$output" | awk -F: '/^[0-9a-f]+: 2a/ { print $1; exit }')
+# the page's segment (or the one it is part of again) is read-write, with its bytes in the file
+readelf -lW "$core" | grep LOAD | while read -r type offset vaddr paddr filesz memsz flags rest; do
+    if [ $((vaddr)) -le $((0x$page)) ] && [ $((0x$page)) -lt $((vaddr + memsz)) ]; then
+        [ "$flags" = RW ] && [ $((filesz)) -ne 0 ] && echo good
+    fi
+done | grep -q good || fail "the watched page is not read-write in the core"
+run "$core" <<'SCRIPT'
+print data
+SCRIPT
+expect ": 2a 00 00 00 00 00 00 00"
+pass
@@ -0,0 +1,52 @@
+# sourced by every test: each one builds a small program from tests/<name>.c, runs tdb on it in batch mode
+# with a script on stdin, and looks for what has to be (or must not be) in the output
+
+here=$(cd "$(dirname "$0")" && pwd)
+name=$(basename "$0" .sh)
+tdb=${TDB:-$here/../main}
+build=$here/build
+prog=$build/$name
+output=
+mkdir -p "$build"
+
+fail() {
+    echo "FAIL $name: $*"
+    if [ -n "$output" ]; then
+        printf '%s\n' "$output" | tail -20 | sed 's/^/    /'
+    fi
+    exit 1
+}
+
+pass() {
+    echo "ok   $name"
+    exit 0
+}
+
+# tests/<name>.c into build/<name>, with any extra compiler flags
+compile() {
+    ${CC:-cc} -g -O0 "$@" "$here/$name.c" -o "$prog" || fail "cannot build $name.c"
+}
+
+# tdb -b on the program, the script from stdin; a crash or a hang fails the test
+run() {
+    output=$(timeout "${TIMEOUT:-60}" "$tdb" -b "$prog" "$@" 2>&1)
+    status=$?
+    if [ $status -ge 124 ]; then
+        fail "tdb exited with status $status"
+    fi
+}
+
+expect() {
+    printf '%s\n' "$output" | grep -q -- "$1" || fail "no \"$1\" in the output"
+}
+
+reject() {
+    if printf '%s\n' "$output" | grep -q -- "$1"; then
+        fail "\"$1\" in the output"
+    fi
+}
+
+# how many lines of the output have the pattern
+count() {
+    printf '%s\n' "$output" | grep -c -- "$1"
+}
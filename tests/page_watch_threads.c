@@ -0,0 +1,33 @@
+// four threads write all over one page; a few of the writes are to the watched counter
+#include <pthread.h>
+
+#define THREADS 4
+#define WRITES 5
+#define NOISE 500
+
+struct {
+    long counter[8];
+    long noise[THREADS][32];
+} page __attribute__((aligned(4096)));
+
+static void* worker(void* arg) {
+    long* mine = page.noise[(long) arg];
+    for (int i = 0; i < WRITES; ++i) {
+        for (int j = 0; j < NOISE; ++j) {
+            mine[j % 32] += j;
+        }
+        __atomic_add_fetch(&page.counter[0], 1, __ATOMIC_SEQ_CST);
+    }
+    return 0;
+}
+
+int main(void) {
+    pthread_t threads[THREADS];
+    for (long i = 0; i < THREADS; ++i) {
+        pthread_create(&threads[i], 0, worker, (void*) i);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], 0);
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+# a watchpoint too big for the debug registers watches its page, and is seen by every thread: no write to it
+# gets through while another thread's access to the page is being let through
+. "$(dirname "$0")/lib.sh"
+compile -pthread
+script="watch page 64 w"
+for i in $(seq 24); do
+    script="$script
+continue"
+done
+run <<SCRIPT
+$script
+SCRIPT
+expect "exited with code 0"
+[ "$(count 'Watchpoint 1 (')" -eq 20 ] || fail "$(count 'Watchpoint 1 (') of the 20 writes seen"
+pass
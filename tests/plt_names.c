@@ -0,0 +1,9 @@
+// a call through the PLT, and one to a function whose name is a mangled type on its own
+#include <stdio.h>
+
+int f(int x) { return x + 1; }
+
+int main(void) {
+    puts("hello");
+    return f(1) - 2;
+}
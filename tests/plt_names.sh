@@ -0,0 +1,13 @@
+# call targets are named: a PLT entry after the function it jumps to, and a plain C name as it is
+. "$(dirname "$0")/lib.sh"
+compile
+run <<'SCRIPT'
+break main
+continue
+disassemble
+SCRIPT
+expect "call .*<puts@plt>"
+expect "call .*<f>"
+reject "<_init+"
+reject "<float>"
+pass
@@ -0,0 +1,15 @@
+#!/bin/sh
+# runs every test in this directory (`make check`); each is a shell script that exits non-zero when it fails
+cd "$(dirname "$0")" || exit 1
+failed=0
+for t in *.sh; do
+    case $t in
+        lib.sh|run.sh) continue ;;
+    esac
+    sh "./$t" || failed=$((failed + 1))
+done
+if [ $failed -ne 0 ]; then
+    echo "$failed failed"
+    exit 1
+fi
+echo "all passed"
@@ -0,0 +1,7 @@
+// a function with more labels inside it than find_symbol used to look past
+void many(void) {
+    __asm__ volatile(
+        "l1: nop\nl2: nop\nl3: nop\nl4: nop\nl5: nop\nl6: nop\nl7: nop\nl8: nop\nl9: nop\nl10: nop\n"
+        "l11: nop\nl12: nop\n");
+}
+int main(void) { many(); return 0; }
@@ -0,0 +1,11 @@
+# an address past a dozen sizeless labels inside a function is still named after the function
+. "$(dirname "$0")/lib.sh"
+compile -no-pie
+addr=$(nm "$prog" | awk '$3 == "l12" { print $1 }')
+run <<SCRIPT
+break main
+continue
+info symbol $(printf '0x%x' $((0x$addr + 1)))
+SCRIPT
+expect "<many+"
+pass
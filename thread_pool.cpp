@@ -0,0 +1,99 @@
+#include "thread_pool.hpp"
+
+thread_pool::thread_pool(unsigned threads) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        m_queues.emplace_back(new queue);
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&thread_pool::worker, this, i);
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> guard {m_lock};
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void thread_pool::submit(std::function<void()> task) {
+    unsigned target;
+    {
+        std::lock_guard<std::mutex> guard {m_lock};
+        target = m_next++ % m_queues.size();
+        ++m_pending;
+        ++m_queued;
+    }
+    {
+        std::lock_guard<std::mutex> guard {m_queues[target]->lock};
+        m_queues[target]->tasks.push_back(std::move(task));
+    }
+    m_wake.notify_one();
+}
+
+// own queue first (newest task, its data is likely still in cache), then the oldest task of the others
+bool thread_pool::take(unsigned self, std::function<void()>& task) {
+    {
+        queue& own = *m_queues[self];
+        std::lock_guard<std::mutex> guard {own.lock};
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < m_queues.size(); ++i) {
+        queue& victim = *m_queues[(self + i) % m_queues.size()];
+        std::lock_guard<std::mutex> guard {victim.lock};
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void thread_pool::run_one(std::function<void()>& task) {
+    {
+        std::lock_guard<std::mutex> guard {m_lock};
+        --m_queued;
+    }
+    task();
+    task = nullptr;
+    std::lock_guard<std::mutex> guard {m_lock};
+    if (--m_pending == 0) {
+        m_idle.notify_all();
+    }
+}
+
+void thread_pool::worker(unsigned self) {
+    std::function<void()> task;
+    for (;;) {
+        if (take(self, task)) {
+            run_one(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard {m_lock};
+        m_wake.wait(guard, [this] { return m_stop || m_queued > 0; });
+        if (m_stop) {
+            return;
+        }
+    }
+}
+
+void thread_pool::wait() {
+    std::function<void()> task;
+    while (take(0, task)) {
+        run_one(task);
+    }
+    std::unique_lock<std::mutex> guard {m_lock};
+    m_idle.wait(guard, [this] { return m_pending == 0; });
+}
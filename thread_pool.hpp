@@ -0,0 +1,51 @@
+#ifndef TDB_THREAD_POOL_HPP
+#define TDB_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a small work-stealing pool: every worker has its own deque, takes new work from the back of it
+// and, once it runs dry, steals from the front of somebody else's. tasks of very different sizes
+// (compilation units range from a few bytes to many megabytes of DWARF) still keep every core busy
+class thread_pool {
+    public:
+        explicit thread_pool(unsigned threads = std::thread::hardware_concurrency());
+        ~thread_pool();
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        unsigned size() const { return static_cast<unsigned>(m_queues.size()); }
+
+        // tasks are dealt out round-robin, stealing evens out whatever that gets wrong
+        void submit(std::function<void()> task);
+        // blocks until every task submitted so far has run. the calling thread runs tasks too
+        void wait();
+
+    private:
+        struct queue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        bool take(unsigned self, std::function<void()>& task);
+        void run_one(std::function<void()>& task);
+        void worker(unsigned self);
+
+        std::vector<std::unique_ptr<queue>> m_queues;
+        std::vector<std::thread> m_threads;
+        std::mutex m_lock;
+        std::condition_variable m_wake;     // new work or shutdown
+        std::condition_variable m_idle;     // m_pending dropped to zero
+        std::size_t m_pending = 0;          // submitted but not finished
+        std::size_t m_queued = 0;           // submitted but not started
+        unsigned m_next = 0;
+        bool m_stop = false;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#include "threads.hpp"
+
+inferior_thread& thread_table::add(pid_t tid, bool* added) {
+    auto result = m_threads.emplace(tid, inferior_thread{tid});
+    if (added != nullptr) {
+        *added = result.second;
+    }
+    return result.first->second;
+}
+
+inferior_thread* thread_table::find(pid_t tid) {
+    auto it = m_threads.find(tid);
+    return it != m_threads.end() ? &it->second : nullptr;
+}
+
+void thread_table::remove(pid_t tid) {
+    m_threads.erase(tid);
+}
+
+bool thread_table::any_running(pid_t except) const {
+    for (const auto& t : m_threads) {
+        if (t.first != except && t.second.running && !t.second.starting) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool thread_table::any_stopped() const {
+    for (const auto& t : m_threads) {
+        if (!t.second.running) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef TDB_THREADS_HPP
+#define TDB_THREADS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include "registers.hpp"
+
+// why a thread stopped, as far as reporting it goes
+enum stop_kind { stop_none, stop_breakpoint, stop_watchpoint, stop_step, stop_finish, stop_interrupt, stop_signal, stop_group,
+                 stop_exec, stop_trap };
+
+// one thread of the inferior, as ptrace sees it
+struct inferior_thread {
+    explicit inferior_thread(pid_t tid) : tid{tid}, regs{tid} {}
+
+    pid_t tid;
+    register_cache regs;        // of this thread, fetched once per stop
+    bool running = false;
+    bool starting = false;      // announced by a clone event, its first stop not seen yet
+    bool stopping = false;      // interrupted by us to stop the world rather than by the user
+    bool sampling = false;      // interrupted by the profiler, that stop not seen yet
+    bool interrupting = false;  // interrupted by the user (`interrupt`, ^C, `continue <seconds>`), that stop not seen yet
+    int pending_signal = 0;     // the signal it stopped with, delivered when it resumes
+    std::uint64_t page_fault = 0;   // where it faulted on a page protected for a watchpoint, the access not made yet
+    std::string stop_reason;    // why it last stopped, for `info threads`
+    stop_kind unreported = stop_none;   // stopped by itself while the world was being stopped for another thread
+};
+
+// every thread of the inferior by tid; new ones come in through PTRACE_EVENT_CLONE
+class thread_table {
+    public:
+        using iterator = std::map<pid_t, inferior_thread>::iterator;
+
+        // the thread, added first if it is new; `added` says which
+        inferior_thread& add(pid_t tid, bool* added = nullptr);
+        inferior_thread* find(pid_t tid);
+        void remove(pid_t tid);
+        void clear() { m_threads.clear(); }
+
+        // is any thread running, leaving out `except` and threads that have not started yet
+        bool any_running(pid_t except = 0) const;
+        bool any_stopped() const;
+
+        std::size_t size() const { return m_threads.size(); }
+        iterator begin() { return m_threads.begin(); }
+        iterator end() { return m_threads.end(); }
+
+    private:
+        std::map<pid_t, inferior_thread> m_threads;     // ordered, so `info threads` lists them by tid
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include "tracepoint.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include "x86.hpp"
+
+namespace {
+    // machine register numbers by user_regs_struct slot; the ones the trampoline saves itself
+    // (rax rbx rcx rdx), rip, eflags and rsp are read back from its stack or known at patch time
+    enum : int { no_reg = -1, saved_rip = -2, saved_eflags = -3, saved_rsp = -4 };
+    const int machine_register[] = {
+        15, 14, 13, 12, 5, 3, 11, 10, 9, 8, 0, 1, 2, 6, 7,     // r15 .. rdi
+        no_reg, saved_rip, no_reg, saved_eflags, saved_rsp,     // orig_rax rip cs eflags rsp
+    };
+    const int rax = 0, rcx = 1, rdx = 2, rbx = 3;
+
+    // the trampoline's stack from its rsp down: ticket, rdx, rcx, rbx, rax, eflags, then the red zone it skipped
+    std::int32_t saved_offset(int reg) {
+        switch (reg) {
+            case rdx: return 8;
+            case rcx: return 16;
+            case rbx: return 24;
+            case rax: return 32;
+            case saved_eflags: return 40;
+            default: return -1;
+        }
+    }
+    const std::int32_t red_zone = 128, original_rsp = 48 + red_zone;
+
+    // the few instruction forms the trampoline is made of
+    struct assembler {
+        std::vector<std::uint8_t>& code;
+
+        void bytes(std::initializer_list<std::uint8_t> b) { code.insert(code.end(), b); }
+        void imm32(std::uint32_t v) {
+            for (int i = 0; i < 4; ++i) {
+                code.push_back(static_cast<std::uint8_t>(v >> (8 * i)));
+            }
+        }
+        void imm64(std::uint64_t v) { imm32(static_cast<std::uint32_t>(v)); imm32(static_cast<std::uint32_t>(v >> 32)); }
+
+        // dst (rax or rdx) = the value the register had when the tracepoint was hit
+        void load_register(int dst, int reg, std::uint64_t pc) {
+            if (reg == saved_rip) {
+                bytes({0x48, static_cast<std::uint8_t>(0xb8 + dst)});     // mov dst, imm64
+                imm64(pc);
+            } else if (reg == saved_rsp) {
+                bytes({0x48, 0x8d, static_cast<std::uint8_t>(0x84 | dst << 3), 0x24});    // lea dst, [rsp + disp32]
+                imm32(original_rsp);
+            } else if (saved_offset(reg) >= 0) {
+                bytes({0x48, 0x8b, static_cast<std::uint8_t>(0x84 | dst << 3), 0x24});    // mov dst, [rsp + disp32]
+                imm32(saved_offset(reg));
+            } else {
+                // mov dst, reg
+                bytes({static_cast<std::uint8_t>(0x48 | (reg >= 8 ? 4 : 0)), 0x89,
+                       static_cast<std::uint8_t>(0xc0 | (reg & 7) << 3 | dst)});
+            }
+        }
+    };
+}
+
+tracepoint_manager::~tracepoint_manager() {
+    if (m_ring != nullptr) {
+        munmap(m_ring, m_ring_size);
+    }
+}
+
+// the ring is a memfd: we map it, and the inferior opens it through /proc/<our pid>/fd and maps it too
+bool tracepoint_manager::create_ring(pid_t tid, std::string& error) {
+    std::size_t size = header_size + slot_size * slot_count;
+    int fd = syscall(SYS_memfd_create, "tdb-trace", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        error = std::string("cannot create the trace buffer: ") + std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void* local = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (local == MAP_FAILED) {
+        error = std::string("cannot map the trace buffer: ") + std::strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    // the path goes on the thread's stack, well below its red zone, and is taken off again afterwards
+    std::string path = "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(fd);
+    user_regs_struct regs;
+    ptrace(PTRACE_GETREGS, tid, nullptr, &regs);
+    std::uint64_t where = (regs.rsp - 1024) & ~std::uint64_t{15};
+    std::vector<char> saved(path.size() + 1);
+    long remote_fd = -EFAULT;
+    if (m_memory.read(where, saved.data(), saved.size()) == saved.size()
+            && m_memory.write(where, path.c_str(), path.size() + 1) == path.size() + 1) {
+        remote_fd = remote_syscall(tid, m_memory, SYS_open, {where, O_RDWR | O_CLOEXEC});
+        m_memory.write(where, saved.data(), saved.size());
+    }
+    long remote = remote_fd;
+    if (remote_fd >= 0) {
+        remote = remote_syscall(tid, m_memory, SYS_mmap, {0, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                                          static_cast<std::uint64_t>(remote_fd), 0});
+        remote_syscall(tid, m_memory, SYS_close, {static_cast<std::uint64_t>(remote_fd)});
+    }
+    close(fd);
+    if (remote < 0) {
+        error = std::string("cannot map the trace buffer into the program: ") + std::strerror(-remote);
+        munmap(local, size);
+        return false;
+    }
+    m_ring = static_cast<unsigned char*>(local);
+    m_ring_size = size;
+    m_remote_ring = remote;
+    m_tail = 0;
+    return true;
+}
+
+std::vector<std::uint8_t> tracepoint_manager::trampoline(const tracepoint& tp, std::uint64_t at, std::size_t patch_len) const {
+    std::vector<std::uint8_t> code;
+    assembler a {code};
+    a.bytes({0x48, 0x8d, 0x64, 0x24, 0x80});                 // lea rsp, [rsp - 128]: step over the red zone
+    a.bytes({0x9c, 0x50, 0x53, 0x51, 0x52});                 // pushfq; push rax; push rbx; push rcx; push rdx
+    a.bytes({0x48, 0xbb});                                   // mov rbx, ring
+    a.imm64(m_remote_ring);
+    a.bytes({0xb8, 0x01, 0x00, 0x00, 0x00});                 // mov eax, 1
+    a.bytes({0xf0, 0x48, 0x0f, 0xc1, 0x03});                 // lock xadd [rbx], rax: rax = our ticket
+    a.bytes({0x50});                                         // push rax
+    a.bytes({0x48, 0x89, 0xc1});                             // mov rcx, rax
+    a.bytes({0x48, 0x81, 0xe1});                             // and rcx, slot_count - 1
+    a.imm32(slot_count - 1);
+    static_assert(slot_size == 1 << 8, "the trampoline shifts by 8");
+    a.bytes({0x48, 0xc1, 0xe1, 8});                          // shl rcx, log2(slot_size)
+    a.bytes({0x48, 0x8d, 0x8c, 0x0b});                       // lea rcx, [rbx + rcx + header_size]
+    a.imm32(header_size);
+    a.bytes({0x48, 0xc7, 0x01, 0, 0, 0, 0});                 // mov qword [rcx], 0: the slot is being written
+    a.bytes({0xc7, 0x41, 0x08});                             // mov dword [rcx + 8], id
+    a.imm32(tp.id);
+
+    std::uint32_t out = 16;
+    for (const auto& it : tp.collect) {
+        int reg = it.reg >= 0 ? machine_register[it.reg] : no_reg;
+        if (!it.deref) {
+            a.load_register(rdx, reg, tp.addr);
+            a.bytes({0x48, 0x89, 0x91});                     // mov [rcx + disp32], rdx
+            a.imm32(out);
+            out += 8;
+            continue;
+        }
+        std::int64_t disp = it.addr;
+        if (reg == no_reg) {
+            a.bytes({0x48, 0xb8});                           // mov rax, address
+            a.imm64(it.addr);
+            disp = 0;
+        } else {
+            a.load_register(rax, reg, tp.addr);
+        }
+        // as wide as possible without reading past the end of the object
+        for (std::uint32_t done = 0; done < it.len; ) {
+            std::uint32_t left = it.len - done;
+            std::uint32_t from = static_cast<std::uint32_t>(disp + done), to = out + done;
+            if (left >= 8) {
+                a.bytes({0x48, 0x8b, 0x90}); a.imm32(from);  // mov rdx, [rax + disp32]
+                a.bytes({0x48, 0x89, 0x91}); a.imm32(to);    // mov [rcx + disp32], rdx
+                done += 8;
+            } else if (left >= 4) {
+                a.bytes({0x8b, 0x90}); a.imm32(from);        // mov edx, [rax + disp32]
+                a.bytes({0x89, 0x91}); a.imm32(to);          // mov [rcx + disp32], edx
+                done += 4;
+            } else if (left >= 2) {
+                a.bytes({0x0f, 0xb7, 0x90}); a.imm32(from);  // movzx edx, word [rax + disp32]
+                a.bytes({0x66, 0x89, 0x91}); a.imm32(to);    // mov [rcx + disp32], dx
+                done += 2;
+            } else {
+                a.bytes({0x0f, 0xb6, 0x90}); a.imm32(from);  // movzx edx, byte [rax + disp32]
+                a.bytes({0x88, 0x91}); a.imm32(to);          // mov [rcx + disp32], dl
+                done += 1;
+            }
+        }
+        out += (it.len + 7) & ~7u;
+    }
+
+    a.bytes({0x58});                                         // pop rax
+    a.bytes({0x48, 0xff, 0xc0});                             // inc rax
+    a.bytes({0x48, 0x89, 0x01});                             // mov [rcx], rax: published
+    a.bytes({0x5a, 0x59, 0x5b, 0x58, 0x9d});                 // pop rdx; pop rcx; pop rbx; pop rax; popfq
+    a.bytes({0x48, 0x8d, 0xa4, 0x24});                       // lea rsp, [rsp + 128]
+    a.imm32(red_zone);
+    // the instructions the jmp replaced, then back to the one after them
+    if (!x86_relocate(tp.original.data(), patch_len, tp.addr, at, code)) {
+        return {};
+    }
+    std::uint64_t end = at + code.size() + 5;
+    a.bytes({0xe9});
+    a.imm32(static_cast<std::uint32_t>(tp.addr + patch_len - end));
+    return code;
+}
+
+int tracepoint_manager::add(pid_t tid, std::uint64_t addr, std::vector<item> collect,
+                            const std::vector<std::uint64_t>& pcs, std::string& error) {
+    std::size_t record = 16;
+    for (const auto& it : collect) {
+        int reg = it.reg >= 0 && it.reg < static_cast<int>(sizeof(machine_register) / sizeof(machine_register[0]))
+                ? machine_register[it.reg] : no_reg;
+        if (it.reg >= 0 && reg == no_reg) {
+            error = "cannot collect " + it.name + " in a tracepoint";
+            return -1;
+        }
+        if (it.deref && (it.len == 0 || (it.reg >= 0 && it.addr != static_cast<std::int32_t>(it.addr)))) {
+            error = "cannot collect " + it.name;
+            return -1;
+        }
+        record += it.deref ? (it.len + 7) & ~7u : 8;
+    }
+    if (record - 16 > max_record) {
+        error = "too much to collect, at most " + std::to_string(max_record) + " bytes per hit";
+        return -1;
+    }
+
+    // whole instructions covering the 5 bytes of the jmp
+    unsigned char code[32];
+    std::size_t n = m_memory.read(addr, code, sizeof(code));
+    m_breakpoints.shadow(addr, code, n);
+    std::size_t patch_len = 0;
+    while (patch_len < 5) {
+        x86_insn insn;
+        if (!x86_decode(code + patch_len, n - patch_len, insn)) {
+            error = "cannot decode the instructions at the location";
+            return -1;
+        }
+        patch_len += insn.length;
+    }
+    for (std::uint64_t a = addr; a < addr + patch_len; ++a) {
+        if (m_breakpoints.contains(a) || covers(a)) {
+            error = "there is a breakpoint or tracepoint in the way";
+            return -1;
+        }
+    }
+    for (auto pc : pcs) {
+        if (pc > addr && pc < addr + patch_len) {
+            error = "a thread is stopped in the middle of the instructions to patch";
+            return -1;
+        }
+    }
+
+    if (m_ring == nullptr && !create_ring(tid, error)) {
+        return -1;
+    }
+    tracepoint tp;
+    tp.id = m_next_id;
+    tp.addr = addr;
+    tp.collect = std::move(collect);
+    tp.original.assign(code, code + patch_len);
+    tp.record_size = record;
+    // the trampoline's size does not depend on where it goes, so a first build sizes the allocation
+    std::vector<std::uint8_t> body = trampoline(tp, addr, patch_len);
+    std::uint64_t at = body.empty() ? 0 : m_pool.allocate(tid, addr, body.size());
+    if (at != 0) {
+        body = trampoline(tp, at, patch_len);
+    }
+    if (body.empty()) {
+        error = "cannot move the instructions at the location (a short jump, or too far from free memory)";
+        return -1;
+    }
+    if (at == 0 || m_memory.write(at, body.data(), body.size()) < body.size()) {
+        error = "cannot place the trampoline";
+        return -1;
+    }
+    std::vector<std::uint8_t> jmp(patch_len, 0x90);
+    jmp[0] = 0xe9;
+    std::uint32_t rel = static_cast<std::uint32_t>(at - (addr + 5));
+    std::memcpy(jmp.data() + 1, &rel, sizeof(rel));
+    if (m_memory.write(addr, jmp.data(), jmp.size()) < jmp.size()) {
+        error = "cannot patch the location";
+        return -1;
+    }
+    tp.trampoline = at;
+    m_tracepoints.emplace(tp.id, std::move(tp));
+    return m_next_id++;
+}
+
+bool tracepoint_manager::remove(int id) {
+    auto it = m_tracepoints.find(id);
+    if (it == m_tracepoints.end()) {
+        return false;
+    }
+    drain();
+    const tracepoint& tp = it->second;
+    m_memory.write(tp.addr, tp.original.data(), tp.original.size());
+    m_tracepoints.erase(it);
+    return true;
+}
+
+void tracepoint_manager::remove_all() {
+    while (!m_tracepoints.empty()) {
+        remove(m_tracepoints.begin()->first);
+    }
+}
+
+bool tracepoint_manager::covers(std::uint64_t addr) const {
+    for (const auto& entry : m_tracepoints) {
+        const tracepoint& tp = entry.second;
+        if (addr >= tp.addr && addr < tp.addr + tp.original.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void tracepoint_manager::drain() {
+    if (m_ring == nullptr) {
+        return;
+    }
+    auto head = __atomic_load_n(reinterpret_cast<std::uint64_t*>(m_ring), __ATOMIC_ACQUIRE);
+    if (head - m_tail > slot_count) {
+        // lapped: everything older than the last slot_count tickets is gone
+        m_lost += head - slot_count - m_tail;
+        m_tail = head - slot_count;
+    }
+    while (m_tail < head) {
+        unsigned char* slot = m_ring + header_size + (m_tail & (slot_count - 1)) * slot_size;
+        auto seq = reinterpret_cast<std::uint64_t*>(slot);
+        std::uint64_t before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (before < m_tail + 1) {
+            break;      // the writer has its ticket but hasn't published yet
+        }
+        if (before == m_tail + 1) {
+            std::uint32_t id;
+            std::memcpy(&id, slot + 8, sizeof(id));
+            auto tp = m_tracepoints.find(id);
+            std::size_t size = tp != m_tracepoints.end() ? tp->second.record_size : 16;
+            frame f {static_cast<int>(id), std::vector<std::uint8_t>(slot + 16, slot + size)};
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(seq, __ATOMIC_RELAXED) != before) {
+                ++m_lost;       // overwritten while we copied
+            } else {
+                if (tp != m_tracepoints.end()) {
+                    ++tp->second.hits;
+                }
+                m_frames.push_back(std::move(f));
+                if (m_frames.size() > max_frames) {
+                    m_frames.pop_front();
+                }
+            }
+        } else {
+            ++m_lost;
+        }
+        ++m_tail;
+    }
+}
+
+void tracepoint_manager::reset() {
+    m_tracepoints.clear();
+    if (m_ring != nullptr) {
+        munmap(m_ring, m_ring_size);
+        m_ring = nullptr;
+    }
+    m_remote_ring = 0;
+    m_tail = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef TDB_TRACEPOINT_HPP
+#define TDB_TRACEPOINT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "breakpoint.hpp"
+#include "inject.hpp"
+#include "memory.hpp"
+
+// fast tracepoints: the instructions at the location are replaced by a jmp to a trampoline in the inferior
+// that stores the collected registers and memory in a ring buffer shared with the debugger, runs the
+// displaced instructions and jumps back. a hit costs a few dozen instructions and no stop at all;
+// the debugger drains the ring whenever it gets around to it.
+//
+// the ring is a memfd mapped by both sides. writers (any thread of the inferior) take a ticket with
+// lock xadd on the head and fill slot ticket % slots, clearing its sequence word first and setting it
+// to ticket + 1 last. the reader checks the sequence word on both sides of its copy, so a slot that is
+// being overwritten because the reader fell behind is counted as lost instead of read torn
+class tracepoint_manager {
+    public:
+        // one thing to collect per hit
+        struct item {
+            std::string name;           // as the user wrote it, for printing
+            int reg = -1;               // a user_regs_struct slot (offset / 8): its value, or the base address with deref
+            std::int64_t addr = 0;      // the address (reg -1), or the offset from the register's value
+            std::uint32_t len = 8;      // bytes read at the address
+            bool deref = false;
+        };
+
+        struct tracepoint {
+            int id;
+            std::uint64_t addr;
+            std::vector<item> collect;
+            std::vector<std::uint8_t> original;     // the bytes under the jmp
+            std::uint64_t trampoline;
+            std::size_t record_size;
+            std::uint64_t hits = 0;
+        };
+
+        // one hit, as drained from the ring
+        struct frame {
+            int id;
+            std::vector<std::uint8_t> data;     // the items of the tracepoint, in order, each rounded up to 8 bytes
+        };
+
+        static const std::size_t max_record = 240;
+
+        tracepoint_manager(memory& mem, breakpoint_manager& breakpoints, code_pool& pool)
+            : m_memory(mem), m_breakpoints(breakpoints), m_pool(pool) {}
+        ~tracepoint_manager();
+        tracepoint_manager(const tracepoint_manager&) = delete;
+        tracepoint_manager& operator=(const tracepoint_manager&) = delete;
+
+        // patches a tracepoint in through thread tid. every thread must be stopped, with its pc in `pcs`.
+        // returns its id, or -1 with the reason in `error`
+        int add(pid_t tid, std::uint64_t addr, std::vector<item> collect, const std::vector<std::uint64_t>& pcs,
+                std::string& error);
+        bool remove(int id);    // puts the original instructions back; the trampoline stays for threads still in it
+        void remove_all();
+        // is addr within the bytes some tracepoint has patched
+        bool covers(std::uint64_t addr) const;
+
+        // moves whatever is in the ring into frames()
+        void drain();
+        const std::deque<frame>& frames() const { return m_frames; }
+        const std::map<int, tracepoint>& tracepoints() const { return m_tracepoints; }
+        std::uint64_t lost() const { return m_lost; }
+
+        // the inferior exec'd: its ring and trampolines are gone
+        void reset();
+
+    private:
+        static const std::size_t slot_size = 256;
+        static const std::size_t slot_count = 4096;     // a power of two
+        static const std::size_t header_size = 64;      // the head, on a cache line of its own
+        static const std::size_t max_frames = 100000;   // kept in the debugger
+
+        bool create_ring(pid_t tid, std::string& error);
+        std::vector<std::uint8_t> trampoline(const tracepoint& tp, std::uint64_t at, std::size_t patch_len) const;
+
+        memory& m_memory;
+        breakpoint_manager& m_breakpoints;
+        code_pool& m_pool;
+        std::map<int, tracepoint> m_tracepoints;
+        int m_next_id = 1;
+
+        unsigned char* m_ring = nullptr;        // our mapping of it
+        std::size_t m_ring_size = 0;
+        std::uint64_t m_remote_ring = 0;        // the inferior's
+        std::uint64_t m_tail = 0;               // next ticket to read
+        std::uint64_t m_lost = 0;
+        std::deque<frame> m_frames;
+};
+
+#endif
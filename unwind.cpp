@@ -0,0 +1,702 @@
+#include "unwind.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "dwarf.hpp"
+
+namespace {
+    // rows are memoized per pc; a program that keeps hitting new pcs just starts over
+    const std::size_t max_rows = 1 << 16;
+
+    // an .eh_frame style encoded pointer. section_addr is the link-time address of the data the cursor
+    // reads, for pc-relative values; data_base is what datarel values are relative to
+    bool read_encoded(dwarf_cursor& c, std::uint8_t enc, std::uint64_t section_addr, std::uint64_t data_base,
+                      std::uint64_t& value) {
+        if (enc == DW_EH_PE_omit) {
+            return false;
+        }
+        std::uint64_t here = section_addr + c.pos();
+        switch (enc & 0x0f) {
+            case DW_EH_PE_absptr: case DW_EH_PE_udata8: case DW_EH_PE_sdata8: value = c.u64(); break;
+            case DW_EH_PE_uleb128: value = c.uleb(); break;
+            case DW_EH_PE_udata2: value = c.u16(); break;
+            case DW_EH_PE_udata4: value = c.u32(); break;
+            case DW_EH_PE_sleb128: value = c.sleb(); break;
+            case DW_EH_PE_sdata2: value = static_cast<std::int16_t>(c.u16()); break;
+            case DW_EH_PE_sdata4: value = static_cast<std::int32_t>(c.u32()); break;
+            default: return false;
+        }
+        switch (enc & 0x70) {
+            case 0: break;
+            case DW_EH_PE_pcrel: value += here; break;
+            case DW_EH_PE_datarel: value += data_base; break;
+            default: return false;  // textrel and funcrel are not used on x86-64
+        }
+        return (enc & DW_EH_PE_indirect) == 0 && !c.error();
+    }
+
+    // user_regs_struct in DWARF register order
+    void to_dwarf(const user_regs_struct& r, std::uint64_t* regs) {
+        const std::uint64_t values[DW_REG_count] = {
+            r.rax, r.rdx, r.rcx, r.rbx, r.rsi, r.rdi, r.rbp, r.rsp,
+            r.r8, r.r9, r.r10, r.r11, r.r12, r.r13, r.r14, r.r15, r.rip,
+        };
+        std::copy(values, values + DW_REG_count, regs);
+    }
+}
+
+call_frame_info::call_frame_info(const elf_file& elf) {
+    const Elf64_Shdr* eh_frame = elf.section(".eh_frame");
+    const Elf64_Shdr* hdr = elf.section(".eh_frame_hdr");
+    m_eh_frame = elf.contents(eh_frame);
+    m_eh_frame_addr = eh_frame != nullptr ? eh_frame->sh_addr : 0;
+    m_eh_frame_hdr = elf.contents(hdr);
+    m_eh_frame_hdr_addr = hdr != nullptr ? hdr->sh_addr : 0;
+    m_debug_frame = elf.contents(elf.section(".debug_frame"));
+
+    // version 1, then the encodings of eh_frame_ptr, fde_count and the table
+    if (m_eh_frame_hdr.size() >= 4 && m_eh_frame_hdr[0] == 1
+            && static_cast<std::uint8_t>(m_eh_frame_hdr[3]) == (DW_EH_PE_datarel | DW_EH_PE_sdata4)) {
+        dwarf_cursor c {m_eh_frame_hdr, 4};
+        std::uint64_t eh_frame_ptr = 0, count = 0;
+        if (read_encoded(c, m_eh_frame_hdr[1], m_eh_frame_hdr_addr, m_eh_frame_hdr_addr, eh_frame_ptr)
+                && read_encoded(c, m_eh_frame_hdr[2], m_eh_frame_hdr_addr, m_eh_frame_hdr_addr, count)
+                && count <= (m_eh_frame_hdr.size() - c.pos()) / 8) {
+            m_hdr_table = m_eh_frame_hdr.substr(c.pos(), count * 8);
+            m_hdr_count = count;
+        }
+    }
+}
+
+bool call_frame_info::find(std::uint64_t pc, cfa_row& row) {
+    auto it = m_rows.find(pc);
+    if (it != m_rows.end()) {
+        row = it->second;
+        return true;
+    }
+    fde_ref fde;
+    if (!find_fde(pc, fde) || !read_fde(fde, pc, row)) {
+        return false;
+    }
+    if (m_rows.size() >= max_rows) {
+        m_rows.clear();
+    }
+    m_rows.emplace(pc, row);
+    return true;
+}
+
+bool call_frame_info::find_fde(std::uint64_t pc, fde_ref& fde) {
+    if (m_hdr_count != 0 && search_hdr(pc, fde)) {
+        return true;
+    }
+    // no usable header, or the pc is only described by .debug_frame
+    if (!m_table_built) {
+        build_table();
+    }
+    auto it = std::upper_bound(m_table.begin(), m_table.end(), pc,
+                               [](std::uint64_t pc, const fde_ref& f) { return pc < f.begin; });
+    if (it == m_table.begin() || pc >= std::prev(it)->end) {
+        return false;
+    }
+    fde = *std::prev(it);
+    return true;
+}
+
+// the header's table is (initial location, FDE address) pairs sorted by location, both relative to the header
+bool call_frame_info::search_hdr(std::uint64_t pc, fde_ref& fde) {
+    auto entry = [this](std::size_t i, int field) {
+        dwarf_cursor c {m_hdr_table, i * 8 + field * 4};
+        return m_eh_frame_hdr_addr + static_cast<std::int32_t>(c.u32());
+    };
+    std::size_t lo = 0, hi = m_hdr_count;
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        if (entry(mid, 0) <= pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return false;
+    }
+    std::uint64_t fde_addr = entry(lo - 1, 1);
+    if (fde_addr < m_eh_frame_addr || fde_addr - m_eh_frame_addr >= m_eh_frame.size()) {
+        return false;
+    }
+    fde.begin = entry(lo - 1, 0);
+    fde.offset = fde_addr - m_eh_frame_addr;
+    fde.debug_frame = false;
+    // the table has no end addresses, read_fde checks the FDE's own range
+    fde.end = ~0ull;
+    return true;
+}
+
+void call_frame_info::build_table() {
+    m_table_built = true;
+    if (m_hdr_count == 0) {
+        scan(m_eh_frame, m_eh_frame_addr, false);
+    }
+    scan(m_debug_frame, 0, true);
+    std::sort(m_table.begin(), m_table.end(), [](const fde_ref& a, const fde_ref& b) { return a.begin < b.begin; });
+}
+
+// collects the range of every FDE in a section
+void call_frame_info::scan(std::string_view section, std::uint64_t section_addr, bool debug_frame) {
+    dwarf_cursor c {section};
+    while (!c.at_end() && !c.error()) {
+        std::uint64_t offset = c.pos();
+        bool is64 = false;
+        std::uint64_t length = c.initial_length(is64);
+        if (length == 0) {
+            if (debug_frame) {
+                continue;
+            }
+            break;      // the terminator of .eh_frame
+        }
+        std::uint64_t end = c.pos() + length;
+        if (end > section.size()) {
+            break;
+        }
+        std::uint64_t id_pos = c.pos();
+        std::uint64_t id = c.offset(is64);
+        bool is_cie = debug_frame ? id == (is64 ? ~0ull : 0xffffffffull) : id == 0;
+        if (!is_cie) {
+            const cie* owner = read_cie(debug_frame ? id : id_pos - id, debug_frame);
+            std::uint64_t begin = 0, range = 0;
+            if (owner != nullptr
+                    && read_encoded(c, owner->fde_encoding, section_addr, 0, begin)
+                    && read_encoded(c, owner->fde_encoding & 0x0f, section_addr, 0, range)
+                    && range != 0) {
+                m_table.push_back({begin, begin + range, offset, debug_frame});
+            }
+        }
+        c.seek(end);
+    }
+}
+
+const call_frame_info::cie* call_frame_info::read_cie(std::uint64_t offset, bool debug_frame) {
+    auto& cies = m_cies[debug_frame];
+    auto it = cies.find(offset);
+    if (it != cies.end()) {
+        return &it->second;
+    }
+    std::string_view section = debug_frame ? m_debug_frame : m_eh_frame;
+    std::uint64_t section_addr = debug_frame ? 0 : m_eh_frame_addr;
+    dwarf_cursor c {section, offset};
+    bool is64 = false;
+    std::uint64_t length = c.initial_length(is64);
+    std::uint64_t end = c.pos() + length;
+    if (length == 0 || end > section.size()) {
+        return nullptr;
+    }
+    c.offset(is64);
+    cie result;
+    std::uint8_t version = c.u8();
+    std::string_view augmentation = c.cstr();
+    if (augmentation.find("eh") != std::string_view::npos) {
+        c.u64();
+    }
+    if (version >= 4) {
+        result.addr_size = c.u8();
+        c.u8();     // segment selector size
+    }
+    result.code_align = c.uleb();
+    result.data_align = c.sleb();
+    result.ra_reg = version == 1 ? c.u8() : c.uleb();
+    if (debug_frame) {
+        result.fde_encoding = result.addr_size == 4 ? DW_EH_PE_udata4 : DW_EH_PE_absptr;
+    }
+    if (!augmentation.empty() && augmentation[0] == 'z') {
+        result.augmented = true;
+        std::uint64_t data_end = c.uleb();
+        data_end += c.pos();
+        for (char a : augmentation.substr(1)) {
+            if (a == 'R') {
+                result.fde_encoding = c.u8();
+            } else if (a == 'L') {
+                c.u8();
+            } else if (a == 'P') {
+                std::uint64_t personality;
+                read_encoded(c, c.u8(), section_addr, 0, personality);
+            } else if (a != 'S' && a != 'B') {
+                break;
+            }
+        }
+        c.seek(data_end);
+    } else if (!augmentation.empty()) {
+        return nullptr;     // an augmentation we don't know how to skip
+    }
+    if (c.error() || c.pos() > end) {
+        return nullptr;
+    }
+    result.initial = section.substr(c.pos(), end - c.pos());
+    return &cies.emplace(offset, result).first->second;
+}
+
+bool call_frame_info::read_fde(const fde_ref& ref, std::uint64_t pc, cfa_row& row) {
+    std::string_view section = ref.debug_frame ? m_debug_frame : m_eh_frame;
+    std::uint64_t section_addr = ref.debug_frame ? 0 : m_eh_frame_addr;
+    dwarf_cursor c {section, ref.offset};
+    bool is64 = false;
+    std::uint64_t length = c.initial_length(is64);
+    std::uint64_t end = c.pos() + length;
+    if (length == 0 || end > section.size()) {
+        return false;
+    }
+    std::uint64_t id_pos = c.pos();
+    std::uint64_t id = c.offset(is64);
+    const cie* owner = read_cie(ref.debug_frame ? id : id_pos - id, ref.debug_frame);
+    std::uint64_t begin = 0, range = 0;
+    if (owner == nullptr
+            || !read_encoded(c, owner->fde_encoding, section_addr, 0, begin)
+            || !read_encoded(c, owner->fde_encoding & 0x0f, section_addr, 0, range)
+            || pc < begin || pc - begin >= range) {
+        return false;
+    }
+    if (owner->augmented) {
+        c.skip(c.uleb());
+    }
+    if (c.error() || c.pos() > end) {
+        return false;
+    }
+
+    cfa_row initial;
+    if (!execute(*owner, owner->initial, 0, ~0ull, initial, initial)) {
+        return false;
+    }
+    row = initial;
+    return execute(*owner, section.substr(c.pos(), end - c.pos()), begin, pc, row, initial);
+}
+
+// runs CFA instructions until the location passes pc. `initial` is the row DW_CFA_restore goes back to
+bool call_frame_info::execute(const cie& owner, std::string_view program, std::uint64_t loc, std::uint64_t pc,
+                              cfa_row& row, const cfa_row& initial) {
+    std::vector<cfa_row> remembered;
+    dwarf_cursor c {program};
+    auto set = [&row](std::uint64_t reg, cfa_row::rule_kind kind, std::int64_t value, std::string_view expr = {}) {
+        if (reg < DW_REG_count) {
+            row.regs[reg] = cfa_row::rule{kind, value, expr};
+        }
+    };
+    while (!c.at_end()) {
+        std::uint8_t op = c.u8();
+        std::uint8_t operand = op & 0x3f;
+        std::uint64_t reg = 0;
+        switch (op & 0xc0) {
+            case DW_CFA_advance_loc:
+                loc += operand * owner.code_align;
+                if (loc > pc) {
+                    return true;
+                }
+                continue;
+            case DW_CFA_offset:
+                set(operand, cfa_row::offset, static_cast<std::int64_t>(c.uleb()) * owner.data_align);
+                continue;
+            case DW_CFA_restore:
+                if (operand < DW_REG_count) {
+                    row.regs[operand] = initial.regs[operand];
+                }
+                continue;
+        }
+        switch (op) {
+            case DW_CFA_nop:
+                break;
+            case DW_CFA_set_loc:
+            case DW_CFA_advance_loc1:
+            case DW_CFA_advance_loc2:
+            case DW_CFA_advance_loc4:
+                if (op == DW_CFA_set_loc) {
+                    if (!read_encoded(c, owner.fde_encoding, 0, 0, loc)) {
+                        return false;
+                    }
+                } else {
+                    loc += c.fixed(op == DW_CFA_advance_loc1 ? 1 : op == DW_CFA_advance_loc2 ? 2 : 4) * owner.code_align;
+                }
+                if (loc > pc) {
+                    return true;
+                }
+                break;
+            case DW_CFA_offset_extended:
+                reg = c.uleb();
+                set(reg, cfa_row::offset, static_cast<std::int64_t>(c.uleb()) * owner.data_align);
+                break;
+            case DW_CFA_offset_extended_sf:
+                reg = c.uleb();
+                set(reg, cfa_row::offset, c.sleb() * owner.data_align);
+                break;
+            case DW_CFA_GNU_negative_offset_extended:
+                reg = c.uleb();
+                set(reg, cfa_row::offset, -static_cast<std::int64_t>(c.uleb()) * owner.data_align);
+                break;
+            case DW_CFA_val_offset:
+                reg = c.uleb();
+                set(reg, cfa_row::val_offset, static_cast<std::int64_t>(c.uleb()) * owner.data_align);
+                break;
+            case DW_CFA_val_offset_sf:
+                reg = c.uleb();
+                set(reg, cfa_row::val_offset, c.sleb() * owner.data_align);
+                break;
+            case DW_CFA_restore_extended:
+                reg = c.uleb();
+                if (reg < DW_REG_count) {
+                    row.regs[reg] = initial.regs[reg];
+                }
+                break;
+            case DW_CFA_undefined:
+                set(c.uleb(), cfa_row::undefined, 0);
+                break;
+            case DW_CFA_same_value:
+                set(c.uleb(), cfa_row::same_value, 0);
+                break;
+            case DW_CFA_register:
+                reg = c.uleb();
+                set(reg, cfa_row::reg, c.uleb());
+                break;
+            case DW_CFA_remember_state:
+                remembered.push_back(row);
+                break;
+            case DW_CFA_restore_state:
+                if (remembered.empty()) {
+                    return false;
+                }
+                row = remembered.back();
+                remembered.pop_back();
+                break;
+            case DW_CFA_def_cfa:
+                row.cfa_reg = c.uleb();
+                row.cfa_offset = c.uleb();
+                row.cfa_expr = {};
+                break;
+            case DW_CFA_def_cfa_sf:
+                row.cfa_reg = c.uleb();
+                row.cfa_offset = c.sleb() * owner.data_align;
+                row.cfa_expr = {};
+                break;
+            case DW_CFA_def_cfa_register:
+                row.cfa_reg = c.uleb();
+                row.cfa_expr = {};
+                break;
+            case DW_CFA_def_cfa_offset:
+                row.cfa_offset = c.uleb();
+                break;
+            case DW_CFA_def_cfa_offset_sf:
+                row.cfa_offset = c.sleb() * owner.data_align;
+                break;
+            case DW_CFA_def_cfa_expression:
+                row.cfa_expr = c.bytes(c.uleb());
+                break;
+            case DW_CFA_expression:
+            case DW_CFA_val_expression:
+                reg = c.uleb();
+                set(reg, op == DW_CFA_expression ? cfa_row::expression : cfa_row::val_expression, 0, c.bytes(c.uleb()));
+                break;
+            case DW_CFA_GNU_args_size:
+                c.uleb();
+                break;
+            default:
+                return false;
+        }
+        if (c.error()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<unwinder::frame> unwinder::backtrace(const user_regs_struct& r, std::size_t max_frames) {
+    std::vector<frame> frames;
+    std::uint64_t regs[DW_REG_count];
+    to_dwarf(r, regs);
+    m_maps_read = false;
+    frames.push_back({regs[DW_REG_ra], regs[DW_REG_rsp]});
+    while (frames.size() < max_frames && step(regs, frames.size() == 1)) {
+        frames.push_back({regs[DW_REG_ra], regs[DW_REG_rsp]});
+    }
+    return frames;
+}
+
+// regs[DW_REG_ra] holds the pc of the frame. on success regs are the caller's, with its pc in DW_REG_ra
+bool unwinder::step(std::uint64_t* regs, bool first) {
+    std::uint64_t pc = regs[DW_REG_ra];
+    // a return address points after the call, which may already be the next function (or outside any)
+    std::uint64_t lookup = first ? pc : pc - 1;
+    std::uint64_t caller[DW_REG_count];
+    std::copy(regs, regs + DW_REG_count, caller);
+
+    module* m = find_module(lookup);
+    cfa_row row;
+    if (m != nullptr && m->cfi->find(lookup - m->bias, row)) {
+        std::uint64_t cfa = 0;
+        if (!row.cfa_expr.empty()) {
+            if (!evaluate(row.cfa_expr, regs, 0, false, cfa)) {
+                return false;
+            }
+        } else if (row.cfa_reg < DW_REG_count) {
+            cfa = regs[row.cfa_reg] + row.cfa_offset;
+        } else {
+            return false;
+        }
+        for (unsigned i = 0; i < DW_REG_count; ++i) {
+            const cfa_row::rule& rule = row.regs[i];
+            std::uint64_t addr = 0;
+            switch (rule.kind) {
+                case cfa_row::undefined:
+                    if (i == DW_REG_ra) {
+                        return false;   // the outermost frame, _start or a thread's start routine
+                    }
+                    break;
+                case cfa_row::same_value:
+                    break;
+                case cfa_row::offset:
+                    if (!read_word(cfa + rule.value, caller[i])) {
+                        return false;
+                    }
+                    break;
+                case cfa_row::val_offset:
+                    caller[i] = cfa + rule.value;
+                    break;
+                case cfa_row::reg:
+                    if (rule.value >= DW_REG_count) {
+                        return false;
+                    }
+                    caller[i] = regs[rule.value];
+                    break;
+                case cfa_row::expression:
+                    if (!evaluate(rule.expr, regs, cfa, true, addr) || !read_word(addr, caller[i])) {
+                        return false;
+                    }
+                    break;
+                case cfa_row::val_expression:
+                    if (!evaluate(rule.expr, regs, cfa, true, caller[i])) {
+                        return false;
+                    }
+                    break;
+            }
+        }
+        caller[DW_REG_rsp] = cfa;
+    } else {
+        // no CFI: assume the standard prologue, push %rbp; mov %rsp,%rbp. in the innermost frame
+        // the pc can still be in front of it, at a breakpoint on the function for instance
+        const elf_file::symbol* sym = first && m != nullptr ? m->elf->find_symbol(pc - m->bias) : nullptr;
+        std::uint64_t into = sym != nullptr ? pc - m->bias - sym->addr : ~0ull;
+        std::uint64_t sp = regs[DW_REG_rsp];
+        std::uint64_t rbp = regs[DW_REG_rbp];
+        if (into == 0) {
+            if (!read_word(sp, caller[DW_REG_ra])) {
+                return false;
+            }
+            caller[DW_REG_rsp] = sp + 8;
+        } else if (into == 1) {
+            if (!read_word(sp, caller[DW_REG_rbp]) || !read_word(sp + 8, caller[DW_REG_ra])) {
+                return false;
+            }
+            caller[DW_REG_rsp] = sp + 16;
+        } else if (rbp == 0 || rbp < sp
+                || !read_word(rbp, caller[DW_REG_rbp]) || !read_word(rbp + 8, caller[DW_REG_ra])) {
+            return false;
+        } else {
+            caller[DW_REG_rsp] = rbp + 16;
+        }
+    }
+    // the stack only grows down; anything else is a corrupt frame and would loop forever
+    if (caller[DW_REG_ra] == 0 || caller[DW_REG_rsp] <= regs[DW_REG_rsp]) {
+        return false;
+    }
+    std::copy(caller, caller + DW_REG_count, regs);
+    return true;
+}
+
+// the register-based subset of DWARF expressions, which covers what compilers put in CFI (PLT entries,
+// realigned stacks, signal frames)
+bool unwinder::evaluate(std::string_view expr, const std::uint64_t* regs, std::uint64_t initial, bool push_initial,
+                        std::uint64_t& result) {
+    std::vector<std::uint64_t> stack;
+    if (push_initial) {
+        stack.push_back(initial);
+    }
+    dwarf_cursor c {expr};
+    while (!c.at_end()) {
+        std::uint8_t op = c.u8();
+        if (op >= DW_OP_lit0 && op <= DW_OP_lit31) {
+            stack.push_back(op - DW_OP_lit0);
+            continue;
+        }
+        if ((op >= DW_OP_breg0 && op <= DW_OP_breg31) || op == DW_OP_bregx) {
+            std::uint64_t reg = op == DW_OP_bregx ? c.uleb() : op - DW_OP_breg0;
+            std::int64_t offset = c.sleb();
+            if (reg >= DW_REG_count) {
+                return false;
+            }
+            stack.push_back(regs[reg] + offset);
+            continue;
+        }
+        switch (op) {
+            case DW_OP_const1u: stack.push_back(c.u8()); continue;
+            case DW_OP_const1s: stack.push_back(c.s8()); continue;
+            case DW_OP_const2u: stack.push_back(c.u16()); continue;
+            case DW_OP_const2s: stack.push_back(static_cast<std::int16_t>(c.u16())); continue;
+            case DW_OP_const4u: stack.push_back(c.u32()); continue;
+            case DW_OP_const4s: stack.push_back(static_cast<std::int32_t>(c.u32())); continue;
+            case DW_OP_const8u: case DW_OP_const8s: stack.push_back(c.u64()); continue;
+            case DW_OP_constu: stack.push_back(c.uleb()); continue;
+            case DW_OP_consts: stack.push_back(c.sleb()); continue;
+            case DW_OP_nop: continue;
+        }
+        if (stack.empty()) {
+            return false;
+        }
+        std::uint64_t top = stack.back();
+        switch (op) {
+            case DW_OP_dup: stack.push_back(top); continue;
+            case DW_OP_drop: stack.pop_back(); continue;
+            case DW_OP_neg: stack.back() = -top; continue;
+            case DW_OP_not: stack.back() = ~top; continue;
+            case DW_OP_plus_uconst: stack.back() = top + c.uleb(); continue;
+            case DW_OP_deref:
+                if (!read_word(top, stack.back())) {
+                    return false;
+                }
+                continue;
+        }
+        // the rest are binary: second op top
+        if (stack.size() < 2) {
+            return false;
+        }
+        std::uint64_t second = stack[stack.size() - 2];
+        switch (op) {
+            case DW_OP_over: stack.push_back(second); continue;
+            case DW_OP_swap: std::swap(stack.back(), stack[stack.size() - 2]); continue;
+        }
+        std::uint64_t value;
+        std::int64_t a = second, b = top;
+        switch (op) {
+            case DW_OP_and: value = second & top; break;
+            case DW_OP_or: value = second | top; break;
+            case DW_OP_xor: value = second ^ top; break;
+            case DW_OP_plus: value = second + top; break;
+            case DW_OP_minus: value = second - top; break;
+            case DW_OP_mul: value = second * top; break;
+            case DW_OP_shl: value = top < 64 ? second << top : 0; break;
+            case DW_OP_shr: value = top < 64 ? second >> top : 0; break;
+            case DW_OP_shra: value = top < 64 ? a >> top : a >> 63; break;
+            case DW_OP_eq: value = a == b; break;
+            case DW_OP_ne: value = a != b; break;
+            case DW_OP_ge: value = a >= b; break;
+            case DW_OP_gt: value = a > b; break;
+            case DW_OP_le: value = a <= b; break;
+            case DW_OP_lt: value = a < b; break;
+            default: return false;
+        }
+        stack.pop_back();
+        stack.back() = value;
+    }
+    if (stack.empty() || c.error()) {
+        return false;
+    }
+    result = stack.back();
+    return true;
+}
+
+bool unwinder::read_word(std::uint64_t addr, std::uint64_t& value) {
+    return m_memory.read(addr, &value, sizeof(value)) == sizeof(value);
+}
+
+const elf_file* unwinder::module_at(std::uint64_t addr, std::uint64_t& bias) {
+    m_maps_read = false;
+    module* m = find_module(addr);
+    if (m == nullptr) {
+        return nullptr;
+    }
+    bias = m->bias;
+    return m->elf.get();
+}
+
+unwinder::module* unwinder::find_module(std::uint64_t addr) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto it = std::upper_bound(m_modules.begin(), m_modules.end(), addr,
+                                   [](std::uint64_t addr, const module& m) { return addr < m.start; });
+        if (it != m_modules.begin() && addr < std::prev(it)->end) {
+            return &*std::prev(it);
+        }
+        // a library loaded since we last looked, or not code at all. /proc/pid/maps is read at most
+        // once per backtrace, so a frame in JIT code doesn't turn every lookup into a file read
+        if (m_maps_read || m_fixed) {
+            return nullptr;
+        }
+        load_maps();
+    }
+    return nullptr;
+}
+
+void unwinder::reset(pid_t pid) {
+    m_pid = pid;
+    load_maps();
+}
+
+void unwinder::use_mappings(const std::vector<mapping>& maps) {
+    m_fixed = true;
+    load_modules(maps);
+}
+
+// 7f1c2a028000-7f1c2a1bd000 r-xp 00028000 08:01 1234 /usr/lib/x86_64-linux-gnu/libc.so.6
+void unwinder::load_maps() {
+    m_maps_read = true;
+    std::ifstream maps {"/proc/" + std::to_string(m_pid) + "/maps"};
+    std::vector<mapping> executable;
+    for (std::string line; std::getline(maps, line); ) {
+        std::istringstream in {line};
+        std::string range, perms, dev, path;
+        std::uint64_t offset = 0, inode = 0;
+        in >> range >> perms >> std::hex >> offset >> dev >> std::dec >> inode;
+        std::getline(in >> std::ws, path);
+        auto dash = range.find('-');
+        if (perms.size() < 3 || perms[2] != 'x' || path.empty() || path[0] != '/' || dash == std::string::npos) {
+            continue;
+        }
+        executable.push_back(mapping{std::stoull(range.substr(0, dash), nullptr, 16),
+                                     std::stoull(range.substr(dash + 1), nullptr, 16), offset, path});
+    }
+    load_modules(executable);
+}
+
+void unwinder::load_modules(const std::vector<mapping>& maps) {
+    std::vector<module> modules;
+    for (const auto& map : maps) {
+        module m;
+        m.start = map.start;
+        m.end = map.end;
+        m.path = map.path;
+        std::uint64_t offset = map.offset;
+
+        // keep what we already have for this mapping: its rows are memoized
+        auto old = std::find_if(m_modules.begin(), m_modules.end(), [&m](const module& o) {
+            return o.start == m.start && o.end == m.end && o.path == m.path && o.elf;
+        });
+        if (old != m_modules.end()) {
+            modules.push_back(std::move(*old));
+            continue;
+        }
+        m.elf = elf_file::open(m.path);
+        if (!m.elf) {
+            continue;
+        }
+        // the load segment this mapping comes from gives the bias
+        bool found = false;
+        for (auto ph = m.elf->segments_begin(); ph != m.elf->segments_end(); ++ph) {
+            if (ph->p_type == PT_LOAD && offset + (m.end - m.start) > ph->p_offset
+                    && offset < ph->p_offset + ph->p_filesz) {
+                m.bias = m.start - (ph->p_vaddr + offset - ph->p_offset);
+                found = true;
+                break;
+            }
+        }
+        if (found) {
+            m.cfi.reset(new call_frame_info{*m.elf});
+            modules.push_back(std::move(m));
+        }
+    }
+    std::sort(modules.begin(), modules.end(), [](const module& a, const module& b) { return a.start < b.start; });
+    m_modules = std::move(modules);
+}
@@ -0,0 +1,143 @@
+#ifndef TDB_UNWIND_HPP
+#define TDB_UNWIND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+#include <sys/user.h>
+#include "elf.hpp"
+#include "memory.hpp"
+
+// registers are numbered the DWARF way: rax rdx rcx rbx rsi rdi rbp rsp r8..r15, then the return address
+enum dwarf_register : unsigned {
+    DW_REG_rbx = 3, DW_REG_rbp = 6, DW_REG_rsp = 7, DW_REG_ra = 16, DW_REG_count = 17,
+};
+
+// how to recover the caller's registers at one pc: the CFA rule plus one rule per register
+struct cfa_row {
+    enum rule_kind : std::uint8_t {
+        undefined,      // not recoverable (for the return address: the outermost frame)
+        same_value,
+        offset,         // saved at CFA + value
+        val_offset,     // is CFA + value
+        reg,            // is in register value
+        expression,     // saved at the address the expression computes
+        val_expression, // is what the expression computes
+    };
+    struct rule {
+        rule_kind kind = same_value;
+        std::int64_t value = 0;
+        std::string_view expr;
+    };
+
+    std::uint16_t cfa_reg = DW_REG_rsp;
+    std::int64_t cfa_offset = 8;
+    std::string_view cfa_expr;      // DW_CFA_def_cfa_expression, used instead of reg + offset when set
+    rule regs[DW_REG_count];
+};
+
+// the call frame information of one ELF file, .eh_frame and .debug_frame.
+// an FDE is found by binary search, either straight over the table in .eh_frame_hdr or over a table
+// sorted once on the first lookup. rows are memoized per pc, so a pc seen before costs one hash lookup
+class call_frame_info {
+    public:
+        explicit call_frame_info(const elf_file& elf);
+
+        // the row for the link-time address pc, false if no FDE covers it
+        bool find(std::uint64_t pc, cfa_row& row);
+
+    private:
+        struct fde_ref {
+            std::uint64_t begin;
+            std::uint64_t end;
+            std::uint64_t offset;   // of the FDE in its section
+            bool debug_frame;
+        };
+        struct cie {
+            std::uint64_t code_align = 1;
+            std::int64_t data_align = 1;
+            std::uint16_t ra_reg = DW_REG_ra;
+            std::uint8_t fde_encoding = 0;
+            std::uint8_t addr_size = 8;
+            bool augmented = false;     // 'z': FDEs have an augmentation data length
+            std::string_view initial;   // initial instructions
+        };
+
+        bool find_fde(std::uint64_t pc, fde_ref& fde);
+        bool search_hdr(std::uint64_t pc, fde_ref& fde);
+        void build_table();
+        void scan(std::string_view section, std::uint64_t section_addr, bool debug_frame);
+        const cie* read_cie(std::uint64_t offset, bool debug_frame);
+        bool read_fde(const fde_ref& ref, std::uint64_t pc, cfa_row& row);
+        bool execute(const cie& c, std::string_view program, std::uint64_t loc, std::uint64_t pc,
+                     cfa_row& row, const cfa_row& initial);
+
+        std::string_view m_eh_frame, m_eh_frame_hdr, m_debug_frame;
+        std::uint64_t m_eh_frame_addr = 0, m_eh_frame_hdr_addr = 0;
+
+        // .eh_frame_hdr's table, when it has the usual 4-byte datarel encoding
+        std::string_view m_hdr_table;
+        std::size_t m_hdr_count = 0;
+
+        bool m_table_built = false;
+        std::vector<fde_ref> m_table;   // sorted by begin; only when the header's table can't be used
+        std::unordered_map<std::uint64_t, cie> m_cies[2];   // by offset, per section
+        std::unordered_map<std::uint64_t, cfa_row> m_rows;   // memoized rows by pc
+};
+
+// walks the stack of a stopped inferior. code of every mapped ELF file (the program, libc, ...)
+// is unwound with that file's CFI, loaded when a pc first lands in it; frame pointers are the
+// fallback where there is no CFI
+class unwinder {
+    public:
+        struct frame {
+            std::uint64_t pc;
+            std::uint64_t sp;       // the stack pointer in that frame
+        };
+        // an executable mapping of a file
+        struct mapping {
+            std::uint64_t start, end;
+            std::uint64_t offset;   // in the file
+            std::string path;
+        };
+
+        unwinder(pid_t pid, memory_cache& memory) : m_pid{pid}, m_memory(memory) {}
+
+        std::vector<frame> backtrace(const user_regs_struct& regs, std::size_t max_frames = 256);
+        // the ELF file mapped at addr and its load bias, nullptr if there is none
+        const elf_file* module_at(std::uint64_t addr, std::uint64_t& bias);
+        // the program was started again as pid: mappings that are still the same keep their memoized rows
+        void reset(pid_t pid);
+        // a core file: these are the mappings for good, /proc isn't looked at
+        void use_mappings(const std::vector<mapping>& maps);
+
+    private:
+        struct module {
+            std::uint64_t start, end;   // the executable mapping
+            std::uint64_t bias;
+            std::string path;
+            std::unique_ptr<elf_file> elf;
+            std::unique_ptr<call_frame_info> cfi;
+        };
+
+        module* find_module(std::uint64_t addr);
+        void load_maps();
+        void load_modules(const std::vector<mapping>& maps);
+        bool step(std::uint64_t* regs, bool first);
+        bool evaluate(std::string_view expr, const std::uint64_t* regs, std::uint64_t initial, bool push_initial,
+                      std::uint64_t& result);
+        bool read_word(std::uint64_t addr, std::uint64_t& value);
+
+        pid_t m_pid;
+        memory_cache& m_memory;
+        std::vector<module> m_modules;  // sorted by start
+        bool m_maps_read = false;       // during this lookup already
+        bool m_fixed = false;           // use_mappings()
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "watchpoint.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include "inject.hpp"
+
+namespace {
+    const std::uint64_t page_size = 4096;
+
+    // DR0-DR7 live at u_debugreg in struct user, as far as PTRACE_PEEKUSER and PTRACE_POKEUSER are concerned
+    void* debugreg(int i) {
+        return reinterpret_cast<void*>(offsetof(struct user, u_debugreg) + i * sizeof(user::u_debugreg[0]));
+    }
+
+    bool set_debugreg(pid_t tid, int i, std::uint64_t value) {
+        return ptrace(PTRACE_POKEUSER, tid, debugreg(i), reinterpret_cast<void*>(value)) == 0;
+    }
+
+    // the protection of the mapping addr is in, from /proc/<tid>/maps; -1 if it is not mapped
+    int mapping_prot(pid_t tid, std::uint64_t addr) {
+        std::ifstream maps {"/proc/" + std::to_string(tid) + "/maps"};
+        for (std::string line; std::getline(maps, line); ) {
+            auto dash = line.find('-');
+            auto space = line.find(' ');
+            if (dash == std::string::npos || space == std::string::npos || line.size() < space + 4) {
+                continue;
+            }
+            std::uint64_t start = std::stoull(line.substr(0, dash), nullptr, 16);
+            std::uint64_t end = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+            if (addr >= start && addr < end) {
+                return (line[space + 1] == 'r' ? PROT_READ : 0) | (line[space + 2] == 'w' ? PROT_WRITE : 0)
+                       | (line[space + 3] == 'x' ? PROT_EXEC : 0);
+            }
+        }
+        return -1;
+    }
+
+    // [addr, addr + len) as the aligned 1, 2, 4 and 8 byte pieces a debug register can watch
+    std::vector<std::pair<std::uint64_t, std::size_t>> split(std::uint64_t addr, std::size_t len) {
+        std::vector<std::pair<std::uint64_t, std::size_t>> pieces;
+        while (len > 0) {
+            std::size_t size = 8;
+            while (size > len || addr % size != 0) {
+                size /= 2;
+            }
+            pieces.emplace_back(addr, size);
+            addr += size;
+            len -= size;
+        }
+        return pieces;
+    }
+}
+
+// DR7: per slot an enable bit (L0 at bit 0, L1 at bit 2, ...), and from bit 16 four bits each:
+// the access (01 write, 11 read or write) and the length (00 1 byte, 01 2, 11 4, 10 8)
+std::uint64_t watchpoint_manager::dr7() const {
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < m_slots.size(); ++i) {
+        const slot& s = m_slots[i];
+        if (s.id == 0) {
+            continue;
+        }
+        std::uint64_t rw = s.what == write ? 1 : 3;
+        std::uint64_t len = s.len == 1 ? 0 : s.len == 2 ? 1 : s.len == 4 ? 3 : 2;
+        value |= std::uint64_t{1} << (2 * i);
+        value |= (rw | len << 2) << (16 + 4 * i);
+    }
+    return value;
+}
+
+// DR7 goes off first, so that the kernel never sees a half-updated combination
+bool watchpoint_manager::program(pid_t tid) {
+    if (!set_debugreg(tid, 7, 0)) {
+        return false;
+    }
+    for (std::size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].id != 0 && !set_debugreg(tid, i, m_slots[i].addr)) {
+            return false;
+        }
+    }
+    return set_debugreg(tid, 7, dr7());
+}
+
+void watchpoint_manager::apply(pid_t tid) {
+    if (dr7() != 0) {
+        program(tid);
+    }
+}
+
+// a page no watchpoint needs any more gets its own protection back
+bool watchpoint_manager::protect(pid_t tid, std::uint64_t page_addr, bool watched) {
+    auto it = m_pages.find(page_addr);
+    if (it == m_pages.end()) {
+        return false;
+    }
+    const page& p = it->second;
+    int prot = p.prot;
+    if (watched) {
+        prot = p.accesses > 0 ? PROT_NONE : p.writes > 0 ? p.prot & ~PROT_WRITE : p.prot;
+    }
+    return remote_syscall(tid, m_memory, SYS_mprotect, {page_addr, page_size, static_cast<std::uint64_t>(prot)}) == 0;
+}
+
+void watchpoint_manager::refresh(watchpoint& w) {
+    w.value.assign(w.len, 0);
+    w.value.resize(m_memory.read(w.addr, w.value.data(), w.len));
+}
+
+int watchpoint_manager::add(std::uint64_t addr, std::size_t len, kind what, const std::vector<pid_t>& tids,
+                            std::string& error) {
+    if (len == 0 || tids.empty()) {
+        error = "nothing to watch";
+        return -1;
+    }
+    watchpoint w {m_next_id, addr, len, what, true, {}};
+    auto pieces = split(addr, len);
+    std::vector<std::size_t> free;
+    for (std::size_t i = 0; i < m_slots.size(); ++i) {
+        if (m_slots[i].id == 0) {
+            free.push_back(i);
+        }
+    }
+
+    if (pieces.size() <= free.size()) {
+        for (std::size_t k = 0; k < pieces.size(); ++k) {
+            m_slots[free[k]] = slot{w.id, pieces[k].first, pieces[k].second, what};
+        }
+        bool ok = true;
+        for (auto tid : tids) {
+            ok = program(tid) && ok;
+        }
+        if (ok) {
+            refresh(w);
+            m_watchpoints.emplace(w.id, w);
+            return m_next_id++;
+        }
+        // e.g. an address the kernel won't watch: take it back, and try the pages instead
+        for (std::size_t k = 0; k < pieces.size(); ++k) {
+            m_slots[free[k]] = slot{};
+        }
+        for (auto tid : tids) {
+            program(tid);
+        }
+    }
+
+    w.hardware = false;
+    std::uint64_t first = addr & ~(page_size - 1), last = (addr + len - 1) & ~(page_size - 1);
+    for (std::uint64_t p = first; p <= last; p += page_size) {
+        if (m_pages.count(p) == 0 && mapping_prot(tids.front(), p) < 0) {
+            error = "the memory is not mapped";
+            return -1;
+        }
+    }
+    for (std::uint64_t p = first; p <= last; p += page_size) {
+        auto it = m_pages.find(p);
+        if (it == m_pages.end()) {
+            it = m_pages.emplace(p, page{mapping_prot(tids.front(), p)}).first;
+        }
+        (what == write ? it->second.writes : it->second.accesses)++;
+        protect(tids.front(), p, true);
+    }
+    refresh(w);
+    m_watchpoints.emplace(w.id, w);
+    return m_next_id++;
+}
+
+bool watchpoint_manager::remove(int id, const std::vector<pid_t>& tids) {
+    auto it = m_watchpoints.find(id);
+    if (it == m_watchpoints.end()) {
+        return false;
+    }
+    const watchpoint& w = it->second;
+    if (w.hardware) {
+        for (auto& s : m_slots) {
+            if (s.id == id) {
+                s = slot{};
+            }
+        }
+        for (auto tid : tids) {
+            program(tid);
+        }
+    } else if (!tids.empty()) {
+        std::uint64_t first = w.addr & ~(page_size - 1), last = (w.addr + w.len - 1) & ~(page_size - 1);
+        for (std::uint64_t p = first; p <= last; p += page_size) {
+            page& pg = m_pages[p];
+            (w.what == write ? pg.writes : pg.accesses)--;
+            bool watched = pg.writes > 0 || pg.accesses > 0;
+            protect(tids.front(), p, watched);
+            if (!watched) {
+                m_pages.erase(p);
+            }
+        }
+    }
+    m_watchpoints.erase(it);
+    return true;
+}
+
+bool watchpoint_manager::hardware_hit(pid_t tid, hit& h) {
+    long dr6 = ptrace(PTRACE_PEEKUSER, tid, debugreg(6), nullptr);
+    set_debugreg(tid, 6, 0);
+    for (std::size_t i = 0; i < m_slots.size(); ++i) {
+        if ((dr6 & (1 << i)) == 0 || m_slots[i].id == 0) {
+            continue;
+        }
+        watchpoint& w = m_watchpoints.at(m_slots[i].id);
+        h.id = w.id;
+        h.old_value = w.value;
+        refresh(w);
+        // x86 has no read-only watch: a read watchpoint watches both, and ignores what turns out to be a write
+        return w.what != read || w.value == h.old_value;
+    }
+    return false;
+}
+
+std::map<std::uint64_t, int> watchpoint_manager::protections() const {
+    std::map<std::uint64_t, int> result;
+    for (const auto& entry : m_pages) {
+        result.emplace_hint(result.end(), entry.first, entry.second.prot);
+    }
+    return result;
+}
+
+bool watchpoint_manager::protected_page(std::uint64_t addr) const {
+    return m_pages.count(addr & ~(page_size - 1)) != 0;
+}
+
+bool watchpoint_manager::lift_page(pid_t tid, std::uint64_t fault) {
+    return protect(tid, fault & ~(page_size - 1), false);
+}
+
+void watchpoint_manager::restore_page(pid_t tid, std::uint64_t fault, hit& h) {
+    protect(tid, fault & ~(page_size - 1), true);
+    h.id = 0;
+    for (auto& entry : m_watchpoints) {
+        watchpoint& w = entry.second;
+        if (w.hardware || fault < w.addr || fault >= w.addr + w.len) {
+            continue;
+        }
+        std::vector<std::uint8_t> old = w.value;
+        refresh(w);
+        // the fault does not say whether it was a read or a write: only a changed value tells
+        bool changed = old != w.value;
+        if ((w.what == write && changed) || (w.what == read && !changed) || w.what == read_write) {
+            h.id = w.id;
+            h.old_value = old;
+            break;
+        }
+    }
+}
+
+void watchpoint_manager::reset() {
+    m_watchpoints.clear();
+    m_slots.fill(slot{});
+    m_pages.clear();
+}
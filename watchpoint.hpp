@@ -0,0 +1,89 @@
+#ifndef TDB_WATCHPOINT_HPP
+#define TDB_WATCHPOINT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "memory.hpp"
+
+// data watchpoints. the four debug address registers DR0-DR3 (with DR7 saying what each one watches)
+// trap right after the access, at full speed; they are per thread, so every thread gets the same
+// programming. a watchpoint that does not fit in the free slots (each covers an aligned 1, 2, 4 or
+// 8 bytes) falls back to page protection: the pages are mprotect'ed in the inferior, and an access
+// faults with SIGSEGV; the faulting instruction is then single-stepped with the page unprotected, and
+// with every other thread stopped so that none of them gets to the page meanwhile
+class watchpoint_manager {
+    public:
+        enum kind : std::uint8_t { read = 1, write = 2, read_write = 3 };
+
+        struct watchpoint {
+            int id;
+            std::uint64_t addr;
+            std::size_t len;
+            kind what;
+            bool hardware;
+            std::vector<std::uint8_t> value;    // as of the last report, to show what changed
+        };
+
+        // a reported hit
+        struct hit {
+            int id = 0;
+            std::vector<std::uint8_t> old_value;
+        };
+
+        explicit watchpoint_manager(memory& mem) : m_memory(mem) {}
+
+        // sets a watchpoint on every thread in tids (all stopped); page protection is changed through
+        // the first of them. its id, or -1 with the reason in `error`
+        int add(std::uint64_t addr, std::size_t len, kind what, const std::vector<pid_t>& tids, std::string& error);
+        bool remove(int id, const std::vector<pid_t>& tids);
+        // gives a thread that just appeared the debug registers the others have
+        void apply(pid_t tid);
+        const std::map<int, watchpoint>& watchpoints() const { return m_watchpoints; }
+        // the protection the program gave each page that is protected for a watchpoint, by page address
+        std::map<std::uint64_t, int> protections() const;
+
+        // the thread stopped with a TRAP_HWBKPT SIGTRAP. true and the watchpoint in `h` if it is to be reported
+        // (a read watchpoint is not when the access changed the value, it was a write)
+        bool hardware_hit(pid_t tid, hit& h);
+        // is `addr` on a page protected for a watchpoint: a fault there is ours, not the program's
+        bool protected_page(std::uint64_t addr) const;
+        // a thread faulted at `fault` on a protected page: the page goes back to its own protection, through
+        // `tid` (stopped), for the access to go through. restore_page protects it again once that is done,
+        // and gives the watchpoint to report in `h`, `h.id` 0 if the access was outside every watched range
+        bool lift_page(pid_t tid, std::uint64_t fault);
+        void restore_page(pid_t tid, std::uint64_t fault, hit& h);
+
+        // the inferior exec'd: its debug registers are clear and its pages are new
+        void reset();
+
+    private:
+        struct slot {
+            int id = 0;         // 0: free
+            std::uint64_t addr = 0;
+            std::size_t len = 0;
+            kind what = read_write;
+        };
+        struct page {
+            int prot;           // of the mapping, to go back to
+            int writes = 0;     // watchpoints on it that only need writes to fault
+            int accesses = 0;   // and the ones that need reads to fault too
+        };
+
+        std::uint64_t dr7() const;
+        bool program(pid_t tid);
+        bool protect(pid_t tid, std::uint64_t page_addr, bool watched);
+        void refresh(watchpoint& w);
+
+        memory& m_memory;
+        std::map<int, watchpoint> m_watchpoints;
+        std::array<slot, 4> m_slots;
+        std::map<std::uint64_t, page> m_pages;  // protected pages by address
+        int m_next_id = 1;
+};
+
+#endif
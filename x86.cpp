@@ -0,0 +1,1123 @@
+#include "x86.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    // per opcode of each map: does a ModRM byte follow, and what immediate comes after it
+    enum imm_kind : std::uint8_t {
+        imm_none,
+        imm_b,          // 1 byte
+        imm_w,          // 2 bytes
+        imm_z,          // 2 bytes with a 66 prefix, else 4
+        imm_v,          // 8 bytes with REX.W, else like imm_z (mov r, imm)
+        imm_w_b,        // enter: 2 + 1
+        imm_moffs,      // 8 bytes, 4 with a 67 prefix (mov al, [moffs])
+        imm_group3,     // test r/m, imm: imm_b (f6) or imm_z (f7) if ModRM.reg is 0 or 1, else none
+    };
+    const std::uint8_t has_modrm = 0x80, invalid = 0x40, imm_mask = 0x0f;
+
+    using opcode_table = std::array<std::uint8_t, 256>;
+
+    constexpr void mark(opcode_table& table, std::initializer_list<int> opcodes, std::uint8_t bits) {
+        for (int op : opcodes) {
+            table[op] |= bits;
+        }
+    }
+
+    constexpr void mark_range(opcode_table& table, int first, int last, std::uint8_t bits) {
+        for (int op = first; op <= last; ++op) {
+            table[op] |= bits;
+        }
+    }
+
+    constexpr opcode_table make_one_byte() {
+        opcode_table t {};
+        // the eight ALU groups: op r/m,r  op r,r/m (4 with ModRM), op al,ib  op eax,iz
+        for (int row = 0; row < 8; ++row) {
+            mark_range(t, row * 8, row * 8 + 3, has_modrm);
+            t[row * 8 + 4] |= imm_b;
+            t[row * 8 + 5] |= imm_z;
+        }
+        mark(t, {0x06, 0x07, 0x0e, 0x16, 0x17, 0x1e, 0x1f, 0x27, 0x2f, 0x37, 0x3f, 0x60, 0x61, 0x82, 0x9a, 0xd4,
+                 0xd5, 0xd6, 0xea}, invalid);
+        mark(t, {0x63, 0x69, 0x6b, 0xc0, 0xc1, 0xc6, 0xc7, 0xf6, 0xf7, 0xfe, 0xff}, has_modrm);
+        mark_range(t, 0x80, 0x8f, has_modrm);
+        mark_range(t, 0xd0, 0xd3, has_modrm);
+        mark_range(t, 0xd8, 0xdf, has_modrm);
+        mark(t, {0x6a, 0x6b, 0x80, 0x83, 0xa8, 0xc0, 0xc1, 0xc6, 0xcd, 0xeb}, imm_b);
+        mark_range(t, 0x70, 0x7f, imm_b);
+        mark_range(t, 0xb0, 0xb7, imm_b);
+        mark_range(t, 0xe0, 0xe7, imm_b);
+        mark(t, {0x68, 0x69, 0x81, 0xa9, 0xc7}, imm_z);
+        mark_range(t, 0xb8, 0xbf, imm_v);
+        mark(t, {0xc2, 0xca}, imm_w);
+        mark(t, {0xc8}, imm_w_b);
+        mark_range(t, 0xa0, 0xa3, imm_moffs);
+        mark(t, {0xf6, 0xf7}, imm_group3);
+        return t;
+    }
+
+    constexpr opcode_table make_two_byte() {
+        opcode_table t {};
+        mark_range(t, 0x00, 0xff, has_modrm);
+        // the ones without: system instructions, jcc rel32, cpuid and friends, bswap
+        for (int op : {0x05, 0x06, 0x07, 0x08, 0x09, 0x0b, 0x0e, 0x77, 0xa0, 0xa1, 0xa2, 0xa8, 0xa9, 0xaa}) {
+            t[op] &= ~has_modrm;
+        }
+        for (int op = 0x30; op <= 0x37; ++op) {
+            t[op] &= ~has_modrm;
+        }
+        for (int op = 0x80; op <= 0x8f; ++op) {
+            t[op] = imm_z;      // always 4 bytes in 64-bit mode, like e8/e9
+        }
+        for (int op = 0xc8; op <= 0xcf; ++op) {
+            t[op] &= ~has_modrm;
+        }
+        mark(t, {0x04, 0x0a, 0x0c, 0x0f, 0x24, 0x25, 0x26, 0x27, 0x36, 0x39, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f, 0x7a,
+                 0x7b, 0xa6, 0xa7}, invalid);
+        mark(t, {0x70, 0x71, 0x72, 0x73, 0xa4, 0xac, 0xba, 0xc2, 0xc4, 0xc5, 0xc6}, imm_b);
+        return t;
+    }
+
+    // built by the compiler: decoding is a table lookup per map, no branching on opcode ranges
+    constexpr opcode_table one_byte = make_one_byte();
+    constexpr opcode_table two_byte = make_two_byte();
+
+    bool is_legacy_prefix(std::uint8_t b) {
+        switch (b) {
+            case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65:
+            case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // the VEX/EVEX maps: 1 is 0f, 2 is 0f 38, 3 is 0f 3a
+    std::uint8_t vex_entry(int map, std::uint8_t op) {
+        if (map == 1) {
+            return op == 0x77 ? imm_none : (two_byte[op] & imm_mask) | has_modrm;
+        }
+        return has_modrm | (map == 3 ? imm_b : imm_none);
+    }
+}
+
+bool x86_decode(const std::uint8_t* code, std::size_t avail, x86_insn& insn) {
+    insn = x86_insn{};
+    std::size_t pos = 0;
+    bool operand_size = false, address_size = false, rex_w = false;
+    while (pos < avail && is_legacy_prefix(code[pos])) {
+        operand_size |= code[pos] == 0x66;
+        address_size |= code[pos] == 0x67;
+        if (++pos > 14) {
+            return false;
+        }
+    }
+    if (pos < avail && (code[pos] & 0xf0) == 0x40) {
+        rex_w = code[pos] & 0x08;
+        ++pos;
+    }
+    if (pos >= avail) {
+        return false;
+    }
+
+    std::uint8_t entry;
+    bool one_byte_map = false;
+    std::uint8_t op = code[pos];
+    if (op == 0xc5 || op == 0xc4 || op == 0x62) {
+        // VEX (2 or 3 bytes) or EVEX (4 bytes); in 64-bit mode c4/c5/62 are never les/lds/bound
+        std::size_t prefix = op == 0xc5 ? 2 : op == 0xc4 ? 3 : 4;
+        if (pos + prefix >= avail) {
+            return false;
+        }
+        int map = op == 0xc5 ? 1 : code[pos + 1] & (op == 0xc4 ? 0x1f : 0x07);
+        if (map < 1 || map > 3) {
+            return false;
+        }
+        if (op != 0xc5) {
+            rex_w = code[pos + 2] & 0x80;
+        }
+        insn.vex = prefix;
+        insn.map = map;
+        pos += prefix;
+        op = code[pos];
+        entry = vex_entry(map, op);
+    } else if (op == 0x0f) {
+        if (++pos >= avail) {
+            return false;
+        }
+        op = code[pos];
+        insn.map = 1;
+        if (op == 0x38 || op == 0x3a) {
+            insn.map = op == 0x38 ? 2 : 3;
+            if (++pos >= avail) {
+                return false;
+            }
+            entry = has_modrm | (op == 0x3a ? imm_b : imm_none);
+            op = code[pos];
+        } else {
+            entry = two_byte[op];
+            if (op >= 0x80 && op <= 0x8f) {
+                insn.branch = x86_insn::rel32;
+            }
+        }
+    } else {
+        entry = one_byte[op];
+        one_byte_map = true;
+        if ((op >= 0x70 && op <= 0x7f) || (op >= 0xe0 && op <= 0xe3) || op == 0xeb) {
+            insn.branch = x86_insn::rel8;
+        } else if (op == 0xe8 || op == 0xe9) {
+            insn.branch = x86_insn::rel32;
+            insn.call = op == 0xe8;
+            entry = imm_none;
+        } else if (op == 0xc2 || op == 0xc3 || op == 0xca || op == 0xcb || op == 0xcf) {
+            insn.indirect = true;   // ret, far ret, iret
+        }
+    }
+    if (entry & invalid) {
+        return false;
+    }
+    insn.opcode_offset = pos;
+    ++pos;
+
+    std::uint8_t reg = 0;
+    if (entry & has_modrm) {
+        if (pos >= avail) {
+            return false;
+        }
+        insn.modrm_offset = pos;
+        std::uint8_t modrm = code[pos++];
+        std::uint8_t mod = modrm >> 6, rm = modrm & 7;
+        reg = (modrm >> 3) & 7;
+        if (one_byte_map && op == 0xff && reg >= 2 && reg <= 5) {
+            insn.indirect = true;   // call/jmp through r/m, near or far
+            insn.call = reg <= 3;
+        }
+        std::size_t disp = 0;
+        if (mod != 3 && rm == 4) {
+            if (pos >= avail) {
+                return false;
+            }
+            std::uint8_t sib = code[pos++];
+            disp = mod == 0 && (sib & 7) == 5 ? 4 : 0;
+        }
+        if (mod == 0 && rm == 5) {
+            insn.disp_offset = pos;
+            disp = 4;
+        } else if (mod == 1) {
+            disp = 1;
+        } else if (mod == 2) {
+            disp = 4;
+        }
+        pos += disp;
+    }
+
+    std::size_t imm = 0;
+    switch (entry & imm_mask) {
+        case imm_b: imm = 1; break;
+        case imm_w: imm = 2; break;
+        case imm_z: imm = operand_size && insn.branch == x86_insn::no_branch ? 2 : 4; break;
+        case imm_v: imm = rex_w ? 8 : operand_size ? 2 : 4; break;
+        case imm_w_b: imm = 3; break;
+        case imm_moffs: imm = address_size ? 4 : 8; break;
+        case imm_group3: imm = reg > 1 ? 0 : op == 0xf6 ? 1 : operand_size ? 2 : 4; break;
+    }
+    if (insn.branch != x86_insn::no_branch) {
+        insn.rel_offset = pos;
+        imm = insn.branch == x86_insn::rel8 ? 1 : 4;
+    } else if (imm != 0) {
+        insn.imm_offset = pos;
+        insn.imm_size = imm;
+    }
+    pos += imm;
+    if (pos > avail || pos > 15) {
+        return false;
+    }
+    insn.length = pos;
+    return true;
+}
+
+bool x86_relocate(const std::uint8_t* code, std::size_t len, std::uint64_t from, std::uint64_t to,
+                  std::vector<std::uint8_t>& out) {
+    std::size_t done = 0;
+    while (done < len) {
+        x86_insn insn;
+        if (!x86_decode(code + done, len - done, insn) || insn.branch == x86_insn::rel8) {
+            return false;
+        }
+        std::size_t start = out.size();
+        out.insert(out.end(), code + done, code + done + insn.length);
+        // both kinds of field are relative to the end of the instruction
+        std::uint64_t old_end = from + done + insn.length, new_end = to + start + insn.length;
+        for (std::size_t field : {std::size_t{insn.disp_offset}, insn.branch == x86_insn::rel32 ? insn.rel_offset : std::size_t{0}}) {
+            if (field == 0) {
+                continue;
+            }
+            std::int32_t disp;
+            std::memcpy(&disp, code + done + field, sizeof(disp));
+            std::int64_t moved = static_cast<std::int64_t>(old_end + disp - new_end);
+            if (moved != static_cast<std::int32_t>(moved)) {
+                return false;
+            }
+            disp = static_cast<std::int32_t>(moved);
+            std::memcpy(out.data() + start + field, &disp, sizeof(disp));
+        }
+        done += insn.length;
+    }
+    return true;
+}
+
+namespace {
+    // operands in the Intel manual's notation. E: ModRM.rm, register or memory; G: ModRM.reg; M: memory only;
+    // I: immediate; J: relative branch target; Z: register in the low opcode bits; O: moffs; X/Y: string source
+    // and destination; V/W/U: xmm in ModRM.reg / ModRM.rm / ModRM.rm register only; H: VEX.vvvv xmm; B: VEX.vvvv
+    // general register. sizes: b byte, w word, d dword, q qword, v 16/32/64 by 66 and REX.W, y 32/64 by REX.W,
+    // z like v but an immediate of at most 4 bytes, s a sign-extended byte
+    enum operand_kind : std::uint8_t {
+        none, Eb, Ew, Ed, Ev, Ey, Gb, Gw, Gd, Gv, Gy, M, Ib, Ibs, Iw, Iz, Iv, Jb, Jz, Zb, Zv, AL, rAX, CL, One, Ob, Ov,
+        Sw, Xb, Xv, Yb, Yv, V, W, U, H, By, ST, STi,
+    };
+    enum : std::uint8_t {
+        op_suffix = 1,      // b/w/l/q on the mnemonic when no register operand gives the size: movl $0x0,(%rax)
+        op_d64 = 2,         // operand size 64 without REX.W: push, pop, call, jmp
+        op_indirect = 4,    // "*" on an E operand: call *%rax
+        op_string = 8,      // takes rep/repz/repnz
+        op_dest_suffix = 16,    // the destination size as a suffix: movzbl
+        op_mmx = 32,        // mmx registers without a 66 prefix
+        op_bnd = 64,        // takes bnd (f2)
+        op_xmm_source = 128,    // a W register is an xmm even with VEX.L: vpbroadcastb %xmm1,%ymm0
+    };
+
+    struct opcode_info {
+        const char* name = nullptr;
+        operand_kind operands[3] = {};  // Intel order, destination first; AT&T prints them the other way round
+        std::uint8_t flags = 0;
+        std::uint8_t group = 0;         // > 0: the name comes from groups[group - 1][ModRM.reg]
+    };
+    using info_table = std::array<opcode_info, 256>;
+
+    // SSE: the mnemonic depends on the mandatory prefix, none, 66, f3, f2
+    struct sse_info {
+        const char* names[4] = {};
+        operand_kind operands[3] = {};
+        std::uint8_t flags = 0;
+    };
+    using sse_table = std::array<sse_info, 256>;
+
+    constexpr const char* groups[][8] = {
+        {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"},                   // 1: 80 81 83
+        {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"},                  // 2: c0 c1 d0-d3
+        {"test", "test", "not", "neg", "mul", "imul", "div", "idiv"},              // 3: f6 f7
+        {"inc", "dec", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},      // 4: fe
+        {"inc", "dec", "call", "lcall", "jmp", "ljmp", "push", nullptr},           // 5: ff
+        {"mov", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},    // 6: c6 c7
+        {"pop", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},    // 7: 8f
+        {nullptr, nullptr, nullptr, nullptr, "bt", "bts", "btr", "btc"},           // 8: 0f ba
+        {"prefetchnta", "prefetcht0", "prefetcht1", "prefetcht2", "nop", "nop", "nop", "nop"},  // 9: 0f 18
+        {"prefetch", "prefetchw", "prefetch", "prefetch", "prefetch", "prefetch", "prefetch", "prefetch"},  // 10: 0f 0d
+    };
+    constexpr const char* jcc[] = {"jo", "jno", "jb", "jae", "je", "jne", "jbe", "ja",
+                                   "js", "jns", "jp", "jnp", "jl", "jge", "jle", "jg"};
+    constexpr const char* setcc[] = {"seto", "setno", "setb", "setae", "sete", "setne", "setbe", "seta",
+                                     "sets", "setns", "setp", "setnp", "setl", "setge", "setle", "setg"};
+    constexpr const char* cmovcc[] = {"cmovo", "cmovno", "cmovb", "cmovae", "cmove", "cmovne", "cmovbe", "cmova",
+                                      "cmovs", "cmovns", "cmovp", "cmovnp", "cmovl", "cmovge", "cmovle", "cmovg"};
+
+    constexpr void op(info_table& t, int code, const char* name, operand_kind a = none, operand_kind b = none,
+                      operand_kind c = none, std::uint8_t flags = 0) {
+        t[code] = opcode_info{name, {a, b, c}, flags, 0};
+    }
+
+    constexpr void group(info_table& t, int code, int number, operand_kind a, operand_kind b = none,
+                         std::uint8_t flags = op_suffix) {
+        t[code] = opcode_info{nullptr, {a, b, none}, flags, static_cast<std::uint8_t>(number)};
+    }
+
+    constexpr info_table make_one_byte_info() {
+        info_table t {};
+        constexpr const char* alu[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+        for (int row = 0; row < 8; ++row) {
+            op(t, row * 8, alu[row], Eb, Gb);
+            op(t, row * 8 + 1, alu[row], Ev, Gv);
+            op(t, row * 8 + 2, alu[row], Gb, Eb);
+            op(t, row * 8 + 3, alu[row], Gv, Ev);
+            op(t, row * 8 + 4, alu[row], AL, Ib);
+            op(t, row * 8 + 5, alu[row], rAX, Iz);
+        }
+        for (int r = 0; r < 8; ++r) {
+            op(t, 0x50 + r, "push", Zv, none, none, op_d64);
+            op(t, 0x58 + r, "pop", Zv, none, none, op_d64);
+            op(t, 0x90 + r, "xchg", Zv, rAX);
+            op(t, 0xb0 + r, "mov", Zb, Ib);
+            op(t, 0xb8 + r, "mov", Zv, Iv);
+        }
+        for (int cc = 0; cc < 16; ++cc) {
+            op(t, 0x70 + cc, jcc[cc], Jb, none, none, op_bnd);
+        }
+        op(t, 0x63, "movsl", Gv, Ed, none, op_dest_suffix);
+        op(t, 0x68, "push", Iz, none, none, op_d64);
+        op(t, 0x69, "imul", Gv, Ev, Iz);
+        op(t, 0x6a, "push", Ibs, none, none, op_d64);
+        op(t, 0x6b, "imul", Gv, Ev, Ibs);
+        group(t, 0x80, 1, Eb, Ib);
+        group(t, 0x81, 1, Ev, Iz);
+        group(t, 0x83, 1, Ev, Ibs);
+        op(t, 0x84, "test", Eb, Gb);
+        op(t, 0x85, "test", Ev, Gv);
+        op(t, 0x86, "xchg", Eb, Gb);
+        op(t, 0x87, "xchg", Ev, Gv);
+        op(t, 0x88, "mov", Eb, Gb);
+        op(t, 0x89, "mov", Ev, Gv);
+        op(t, 0x8a, "mov", Gb, Eb);
+        op(t, 0x8b, "mov", Gv, Ev);
+        op(t, 0x8c, "mov", Ev, Sw);
+        op(t, 0x8d, "lea", Gv, M);
+        op(t, 0x8e, "mov", Sw, Ew);
+        group(t, 0x8f, 7, Ev, none, op_d64);
+        op(t, 0x90, "nop");
+        op(t, 0x9c, "pushf", none, none, none, op_d64);
+        op(t, 0x9d, "popf", none, none, none, op_d64);
+        op(t, 0x9e, "sahf");
+        op(t, 0x9b, "fwait");
+        op(t, 0x9f, "lahf");
+        op(t, 0xa0, "movabs", AL, Ob);
+        op(t, 0xa1, "movabs", rAX, Ov);
+        op(t, 0xa2, "movabs", Ob, AL);
+        op(t, 0xa3, "movabs", Ov, rAX);
+        op(t, 0xa4, "movsb", Yb, Xb, none, op_string);
+        op(t, 0xa5, "movs", Yv, Xv, none, op_string | op_suffix);
+        op(t, 0xa6, "cmpsb", Xb, Yb, none, op_string);
+        op(t, 0xa7, "cmps", Xv, Yv, none, op_string | op_suffix);
+        op(t, 0xa8, "test", AL, Ib);
+        op(t, 0xa9, "test", rAX, Iz);
+        op(t, 0xaa, "stos", Yb, AL, none, op_string);
+        op(t, 0xab, "stos", Yv, rAX, none, op_string);
+        op(t, 0xac, "lods", AL, Xb, none, op_string);
+        op(t, 0xad, "lods", rAX, Xv, none, op_string);
+        op(t, 0xae, "scas", AL, Yb, none, op_string);
+        op(t, 0xaf, "scas", rAX, Yv, none, op_string);
+        group(t, 0xc0, 2, Eb, Ib);
+        group(t, 0xc1, 2, Ev, Ib);
+        op(t, 0xc2, "ret", Iw, none, none, op_bnd);
+        op(t, 0xc3, "ret", none, none, none, op_bnd);
+        group(t, 0xc6, 6, Eb, Ib);
+        group(t, 0xc7, 6, Ev, Iz);
+        op(t, 0xc8, "enter", Iw, Ib);
+        op(t, 0xc9, "leave");
+        op(t, 0xca, "lret", Iw);
+        op(t, 0xcb, "lret");
+        op(t, 0xcc, "int3");
+        op(t, 0xcd, "int", Ib);
+        op(t, 0xcf, "iret");
+        group(t, 0xd0, 2, Eb, One);
+        group(t, 0xd1, 2, Ev, One);
+        group(t, 0xd2, 2, Eb, CL);
+        group(t, 0xd3, 2, Ev, CL);
+        op(t, 0xe0, "loopne", Jb);
+        op(t, 0xe1, "loope", Jb);
+        op(t, 0xe2, "loop", Jb);
+        op(t, 0xe3, "jrcxz", Jb);
+        op(t, 0xe8, "call", Jz, none, none, op_bnd);
+        op(t, 0xe9, "jmp", Jz, none, none, op_bnd);
+        op(t, 0xeb, "jmp", Jb, none, none, op_bnd);
+        op(t, 0xf1, "int1");
+        op(t, 0xf4, "hlt");
+        op(t, 0xf5, "cmc");
+        group(t, 0xf6, 3, Eb, Ib);
+        group(t, 0xf7, 3, Ev, Iz);
+        op(t, 0xf8, "clc");
+        op(t, 0xf9, "stc");
+        op(t, 0xfa, "cli");
+        op(t, 0xfb, "sti");
+        op(t, 0xfc, "cld");
+        op(t, 0xfd, "std");
+        group(t, 0xfe, 4, Eb);
+        group(t, 0xff, 5, Ev);
+        return t;
+    }
+
+    constexpr info_table make_two_byte_info() {
+        info_table t {};
+        op(t, 0x05, "syscall");
+        op(t, 0x0b, "ud2");
+        group(t, 0x0d, 10, M, none, 0);
+        group(t, 0x18, 9, M, none, 0);
+        op(t, 0x1e, "nop", Ev, none, none, op_suffix);
+        op(t, 0x1f, "nop", Ev, none, none, op_suffix);
+        op(t, 0x31, "rdtsc");
+        for (int cc = 0; cc < 16; ++cc) {
+            op(t, 0x40 + cc, cmovcc[cc], Gv, Ev);
+            op(t, 0x80 + cc, jcc[cc], Jz, none, none, op_bnd);
+            op(t, 0x90 + cc, setcc[cc], Eb);
+        }
+        op(t, 0xa2, "cpuid");
+        op(t, 0xa3, "bt", Ev, Gv);
+        op(t, 0xa4, "shld", Ev, Gv, Ib);
+        op(t, 0xa5, "shld", Ev, Gv, CL);
+        op(t, 0xab, "bts", Ev, Gv);
+        op(t, 0xac, "shrd", Ev, Gv, Ib);
+        op(t, 0xad, "shrd", Ev, Gv, CL);
+        op(t, 0xaf, "imul", Gv, Ev);
+        op(t, 0xb0, "cmpxchg", Eb, Gb);
+        op(t, 0xb1, "cmpxchg", Ev, Gv);
+        op(t, 0xb3, "btr", Ev, Gv);
+        op(t, 0xb6, "movzb", Gv, Eb, none, op_dest_suffix);
+        op(t, 0xb7, "movzw", Gv, Ew, none, op_dest_suffix);
+        group(t, 0xba, 8, Ev, Ib);
+        op(t, 0xbb, "btc", Ev, Gv);
+        op(t, 0xbc, "bsf", Gv, Ev);
+        op(t, 0xbd, "bsr", Gv, Ev);
+        op(t, 0xbe, "movsb", Gv, Eb, none, op_dest_suffix);
+        op(t, 0xbf, "movsw", Gv, Ew, none, op_dest_suffix);
+        op(t, 0xc0, "xadd", Eb, Gb);
+        op(t, 0xc1, "xadd", Ev, Gv);
+        for (int r = 0; r < 8; ++r) {
+            op(t, 0xc8 + r, "bswap", Zv);
+        }
+        return t;
+    }
+
+    constexpr void sse(sse_table& t, int code, std::initializer_list<const char*> names, operand_kind a,
+                       operand_kind b, operand_kind c = none, std::uint8_t flags = 0) {
+        int i = 0;
+        for (const char* n : names) {
+            t[code].names[i++] = n;
+        }
+        t[code].operands[0] = a;
+        t[code].operands[1] = b;
+        t[code].operands[2] = c;
+        t[code].flags = flags;
+    }
+
+    // the mmx/sse integer ops that exist without a prefix (mmx) and with 66 (xmm) under the same name
+    constexpr void packed(sse_table& t, int code, const char* name) {
+        sse(t, code, {name, name}, V, H, W, op_mmx);
+    }
+
+    constexpr sse_table make_sse() {
+        sse_table t {};
+        sse(t, 0x10, {"movups", "movupd", "movss", "movsd"}, V, W);
+        sse(t, 0x11, {"movups", "movupd", "movss", "movsd"}, W, V);
+        sse(t, 0x12, {"movlps", "movlpd", "movsldup", "movddup"}, V, W);
+        sse(t, 0x13, {"movlps", "movlpd"}, M, V);
+        sse(t, 0x14, {"unpcklps", "unpcklpd"}, V, H, W);
+        sse(t, 0x15, {"unpckhps", "unpckhpd"}, V, H, W);
+        sse(t, 0x16, {"movhps", "movhpd", "movshdup"}, V, W);
+        sse(t, 0x17, {"movhps", "movhpd"}, M, V);
+        sse(t, 0x28, {"movaps", "movapd"}, V, W);
+        sse(t, 0x29, {"movaps", "movapd"}, W, V);
+        sse(t, 0x2a, {nullptr, nullptr, "cvtsi2ss", "cvtsi2sd"}, V, H, Ey, op_suffix);
+        sse(t, 0x2b, {"movntps", "movntpd"}, M, V);
+        sse(t, 0x2c, {nullptr, nullptr, "cvttss2si", "cvttsd2si"}, Gy, W);
+        sse(t, 0x2d, {nullptr, nullptr, "cvtss2si", "cvtsd2si"}, Gy, W);
+        sse(t, 0x2e, {"ucomiss", "ucomisd"}, V, W);
+        sse(t, 0x2f, {"comiss", "comisd"}, V, W);
+        sse(t, 0x50, {"movmskps", "movmskpd"}, Gd, U);
+        sse(t, 0x51, {"sqrtps", "sqrtpd", "sqrtss", "sqrtsd"}, V, H, W);
+        sse(t, 0x54, {"andps", "andpd"}, V, H, W);
+        sse(t, 0x55, {"andnps", "andnpd"}, V, H, W);
+        sse(t, 0x56, {"orps", "orpd"}, V, H, W);
+        sse(t, 0x57, {"xorps", "xorpd"}, V, H, W);
+        sse(t, 0x58, {"addps", "addpd", "addss", "addsd"}, V, H, W);
+        sse(t, 0x59, {"mulps", "mulpd", "mulss", "mulsd"}, V, H, W);
+        sse(t, 0x5a, {"cvtps2pd", "cvtpd2ps", "cvtss2sd", "cvtsd2ss"}, V, H, W);
+        sse(t, 0x5b, {"cvtdq2ps", "cvtps2dq", "cvttps2dq"}, V, W);
+        sse(t, 0x5c, {"subps", "subpd", "subss", "subsd"}, V, H, W);
+        sse(t, 0x5d, {"minps", "minpd", "minss", "minsd"}, V, H, W);
+        sse(t, 0x5e, {"divps", "divpd", "divss", "divsd"}, V, H, W);
+        sse(t, 0x5f, {"maxps", "maxpd", "maxss", "maxsd"}, V, H, W);
+        constexpr const char* unpack[] = {"punpcklbw", "punpcklwd", "punpckldq", "packsswb", "pcmpgtb", "pcmpgtw",
+                                          "pcmpgtd", "packuswb", "punpckhbw", "punpckhwd", "punpckhdq", "packssdw"};
+        for (int i = 0; i < 12; ++i) {
+            packed(t, 0x60 + i, unpack[i]);
+        }
+        sse(t, 0x6c, {nullptr, "punpcklqdq"}, V, H, W);
+        sse(t, 0x6d, {nullptr, "punpckhqdq"}, V, H, W);
+        sse(t, 0x6e, {"movd", "movd"}, V, Ey, none, op_mmx);
+        sse(t, 0x6f, {"movq", "movdqa", "movdqu"}, V, W, none, op_mmx);
+        sse(t, 0x70, {"pshufw", "pshufd", "pshufhw", "pshuflw"}, V, W, none, op_mmx);
+        packed(t, 0x74, "pcmpeqb");
+        packed(t, 0x75, "pcmpeqw");
+        packed(t, 0x76, "pcmpeqd");
+        sse(t, 0x77, {"emms"}, none, none);
+        sse(t, 0x7e, {"movd", "movd", "movq"}, Ey, V, none, op_mmx);
+        sse(t, 0x7f, {"movq", "movdqa", "movdqu"}, W, V, none, op_mmx);
+        sse(t, 0xc2, {"cmpps", "cmppd", "cmpss", "cmpsd"}, V, H, W);   // the predicate is the immediate
+        sse(t, 0xc4, {"pinsrw", "pinsrw"}, V, H, Ed, op_mmx);
+        sse(t, 0xc5, {"pextrw", "pextrw"}, Gd, U, none, op_mmx);
+        sse(t, 0xc6, {"shufps", "shufpd"}, V, H, W);
+        sse(t, 0xd6, {nullptr, "movq"}, W, V);
+        sse(t, 0xd7, {"pmovmskb", "pmovmskb"}, Gd, U, none, op_mmx);
+        sse(t, 0xe6, {nullptr, "cvttpd2dq", "cvtdq2pd", "cvtpd2dq"}, V, W);
+        sse(t, 0xe7, {"movntq", "movntdq"}, M, V, none, op_mmx);
+        sse(t, 0xf7, {"maskmovq", "maskmovdqu"}, V, U, none, op_mmx);
+        constexpr std::pair<int, const char*> arith[] = {
+            {0xd1, "psrlw"}, {0xd2, "psrld"}, {0xd3, "psrlq"}, {0xd4, "paddq"}, {0xd5, "pmullw"}, {0xd8, "psubusb"},
+            {0xd9, "psubusw"}, {0xda, "pminub"}, {0xdb, "pand"}, {0xdc, "paddusb"}, {0xdd, "paddusw"}, {0xde, "pmaxub"},
+            {0xdf, "pandn"}, {0xe0, "pavgb"}, {0xe1, "psraw"}, {0xe2, "psrad"}, {0xe3, "pavgw"}, {0xe4, "pmulhuw"},
+            {0xe5, "pmulhw"}, {0xe8, "psubsb"}, {0xe9, "psubsw"}, {0xea, "pminsw"}, {0xeb, "por"}, {0xec, "paddsb"},
+            {0xed, "paddsw"}, {0xee, "pmaxsw"}, {0xef, "pxor"}, {0xf1, "psllw"}, {0xf2, "pslld"}, {0xf3, "psllq"},
+            {0xf4, "pmuludq"}, {0xf5, "pmaddwd"}, {0xf6, "psadbw"}, {0xf8, "psubb"}, {0xf9, "psubw"}, {0xfa, "psubd"},
+            {0xfb, "psubq"}, {0xfc, "paddb"}, {0xfd, "paddw"}, {0xfe, "paddd"},
+        };
+        for (auto& a : arith) {
+            packed(t, a.first, a.second);
+        }
+        return t;
+    }
+
+    // 0f 38 and 0f 3a, all with a 66 prefix: the names go in the 66 column
+    constexpr sse_table make_sse38() {
+        sse_table t {};
+        constexpr std::pair<int, const char*> ops[] = {
+            {0x00, "pshufb"}, {0x04, "pmaddubsw"}, {0x0b, "pmulhrsw"}, {0x1c, "pabsb"}, {0x1d, "pabsw"}, {0x1e, "pabsd"},
+            {0x29, "pcmpeqq"}, {0x2b, "packusdw"}, {0x37, "pcmpgtq"}, {0x38, "pminsb"}, {0x39, "pminsd"},
+            {0x3a, "pminuw"}, {0x3b, "pminud"}, {0x3c, "pmaxsb"}, {0x3d, "pmaxsd"}, {0x3e, "pmaxuw"}, {0x3f, "pmaxud"},
+            {0x40, "pmulld"},
+        };
+        for (auto& o : ops) {
+            sse(t, o.first, {nullptr, o.second}, V, H, W);
+        }
+        sse(t, 0x17, {nullptr, "ptest"}, V, W);
+        sse(t, 0x18, {nullptr, "vbroadcastss"}, V, W, none, op_xmm_source);
+        sse(t, 0x58, {nullptr, "vpbroadcastd"}, V, W, none, op_xmm_source);
+        sse(t, 0x59, {nullptr, "vpbroadcastq"}, V, W, none, op_xmm_source);
+        sse(t, 0x78, {nullptr, "vpbroadcastb"}, V, W, none, op_xmm_source);
+        sse(t, 0x79, {nullptr, "vpbroadcastw"}, V, W, none, op_xmm_source);
+        // BMI, VEX only, on general registers
+        sse(t, 0xf2, {"andn"}, Gy, By, Ey);
+        sse(t, 0xf5, {"bzhi", nullptr, "pext", "pdep"}, Gy, Ey, By);
+        sse(t, 0xf7, {"bextr", "shlx", "sarx", "shrx"}, Gy, Ey, By);
+        return t;
+    }
+
+    constexpr sse_table make_sse3a() {
+        sse_table t {};
+        sse(t, 0x0f, {nullptr, "palignr"}, V, H, W);
+        sse(t, 0x14, {nullptr, "pextrb"}, Ed, V);
+        sse(t, 0x16, {nullptr, "pextrd"}, Ey, V);
+        sse(t, 0x20, {nullptr, "pinsrb"}, V, H, Ed);
+        sse(t, 0x22, {nullptr, "pinsrd"}, V, H, Ey);
+        sse(t, 0x60, {nullptr, "pcmpestrm"}, V, W);
+        sse(t, 0x61, {nullptr, "pcmpestri"}, V, W);
+        sse(t, 0x62, {nullptr, "pcmpistrm"}, V, W);
+        sse(t, 0x63, {nullptr, "pcmpistri"}, V, W);
+        sse(t, 0xf0, {nullptr, nullptr, nullptr, "rorx"}, Gy, Ey);
+        return t;
+    }
+
+    // x87, d8-df: the memory forms by ModRM.reg, with the operand size in the name the way AT&T has it
+    constexpr const char* x87_memory[8][8] = {
+        {"fadds", "fmuls", "fcoms", "fcomps", "fsubs", "fsubrs", "fdivs", "fdivrs"},
+        {"flds", nullptr, "fsts", "fstps", "fldenv", "fldcw", "fnstenv", "fnstcw"},
+        {"fiaddl", "fimull", "ficoml", "ficompl", "fisubl", "fisubrl", "fidivl", "fidivrl"},
+        {"fildl", "fisttpl", "fistl", "fistpl", nullptr, "fldt", nullptr, "fstpt"},
+        {"faddl", "fmull", "fcoml", "fcompl", "fsubl", "fsubrl", "fdivl", "fdivrl"},
+        {"fldl", "fisttpll", "fstl", "fstpl", "frstor", nullptr, "fnsave", "fnstsw"},
+        {"fiadds", "fimuls", "ficoms", "ficomps", "fisubs", "fisubrs", "fidivs", "fidivrs"},
+        {"filds", "fisttps", "fists", "fistps", "fbld", "fildll", "fbstp", "fistpll"},
+    };
+    // and on the stack registers; nullptr where ModRM.rm picks one of the ones without operands
+    constexpr const char* x87_register[8][8] = {
+        {"fadd", "fmul", "fcom", "fcomp", "fsub", "fsubr", "fdiv", "fdivr"},
+        {"fld", "fxch", nullptr, nullptr, nullptr, nullptr, nullptr, nullptr},
+        {"fcmovb", "fcmove", "fcmovbe", "fcmovu", nullptr, nullptr, nullptr, nullptr},
+        {"fcmovnb", "fcmovne", "fcmovnbe", "fcmovnu", nullptr, "fucomi", "fcomi", nullptr},
+        {"fadd", "fmul", nullptr, nullptr, "fsub", "fsubr", "fdiv", "fdivr"},
+        {"ffree", nullptr, "fst", "fstp", "fucom", "fucomp", nullptr, nullptr},
+        {"faddp", "fmulp", nullptr, nullptr, "fsubp", "fsubrp", "fdivp", "fdivrp"},
+        {"ffreep", nullptr, nullptr, nullptr, nullptr, "fucomip", "fcomip", nullptr},
+    };
+    // d9 e0-ff
+    constexpr const char* x87_d9[32] = {
+        "fchs", "fabs", nullptr, nullptr, "ftst", "fxam", nullptr, nullptr,
+        "fld1", "fldl2t", "fldl2e", "fldpi", "fldlg2", "fldln2", "fldz", nullptr,
+        "f2xm1", "fyl2x", "fptan", "fpatan", "fxtract", "fprem1", "fdecstp", "fincstp",
+        "fprem", "fyl2xp1", "fsqrt", "fsincos", "frndint", "fscale", "fsin", "fcos",
+    };
+
+    opcode_info x87(std::uint8_t opcode, std::uint8_t modrm) {
+        int row = opcode - 0xd8, reg = (modrm >> 3) & 7;
+        if (modrm < 0xc0) {
+            return opcode_info{x87_memory[row][reg], {M, none, none}, 0, 0};
+        }
+        if (const char* name = x87_register[row][reg]) {
+            // %st(i),%st for the d8 group and the compares into flags, %st,%st(i) for dc and de
+            bool single = (row == 0 && (reg == 2 || reg == 3)) || row == 1 || row == 5 || (row == 7 && reg == 0);
+            if (single) {
+                return opcode_info{name, {STi, none, none}, 0, 0};
+            }
+            return row == 4 || row == 6 ? opcode_info{name, {STi, ST, none}, 0, 0} : opcode_info{name, {ST, STi, none}, 0, 0};
+        }
+        switch (opcode << 8 | modrm) {
+            case 0xd9d0: return opcode_info{"fnop", {}, 0, 0};
+            case 0xdae9: return opcode_info{"fucompp", {}, 0, 0};
+            case 0xdbe2: return opcode_info{"fnclex", {}, 0, 0};
+            case 0xdbe3: return opcode_info{"fninit", {}, 0, 0};
+            case 0xded9: return opcode_info{"fcompp", {}, 0, 0};
+            case 0xdfe0: return opcode_info{"fnstsw", {rAX, none, none}, 0, 0};
+        }
+        return opcode_info{opcode == 0xd9 && modrm >= 0xe0 ? x87_d9[modrm - 0xe0] : nullptr, {}, 0, 0};
+    }
+
+    constexpr info_table one_byte_info = make_one_byte_info();
+    constexpr info_table two_byte_info = make_two_byte_info();
+    constexpr sse_table sse_ops = make_sse();
+    constexpr sse_table sse38_ops = make_sse38();
+    constexpr sse_table sse3a_ops = make_sse3a();
+
+    const char* const gpr64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                                 "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+    const char* const gpr32[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+                                 "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+    const char* const gpr16[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+                                 "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+    const char* const gpr8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                                "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+    const char* const gpr8_legacy[] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
+    const char* const segments[] = {"es", "cs", "ss", "ds", "fs", "gs", "?", "?"};
+
+    std::string hex(std::uint64_t value) {
+        char buf[24];
+        std::snprintf(buf, sizeof(buf), "0x%llx", static_cast<unsigned long long>(value));
+        return buf;
+    }
+
+    std::string signed_hex(std::int64_t value) {
+        return value < 0 ? "-" + hex(-static_cast<std::uint64_t>(value)) : hex(value);
+    }
+
+    std::int64_t read_signed(const std::uint8_t* p, std::size_t size) {
+        switch (size) {
+            case 1: return static_cast<std::int8_t>(p[0]);
+            case 2: { std::int16_t v; std::memcpy(&v, p, 2); return v; }
+            case 4: { std::int32_t v; std::memcpy(&v, p, 4); return v; }
+            default: { std::int64_t v; std::memcpy(&v, p, 8); return v; }
+        }
+    }
+
+    // what the disassembly of one instruction works from
+    struct decoded {
+        const std::uint8_t* code;
+        std::uint64_t addr;
+        const x86_insn& insn;
+        std::uint8_t rex = 0;
+        bool rex_w = false, rex_r = false, rex_x = false, rex_b = false;
+        bool opsize = false, addrsize = false;
+        std::uint8_t rep = 0;           // f2 or f3, the last one
+        bool lock = false;
+        std::uint8_t segment = 0;       // 64 or 65: fs or gs
+        bool notrack = false;           // 3e
+        bool cs = false;                // 2e, only a branch hint in 64-bit mode
+        int data16 = 0;                 // repeated 66s, padding in multi-byte nops
+        int vvvv = 0;
+        bool vex_l = false;
+        int size = 32;                  // of the v operands
+        bool mmx = false;
+        bool reg_operand = false;       // some operand is a general register, it gives the size
+        std::string comment;            // the target of a rip-relative operand
+    };
+
+    std::string gpr(const decoded& d, int size, int n) {
+        const char* name = size == 64 ? gpr64[n] : size == 32 ? gpr32[n] : size == 16 ? gpr16[n]
+                           : d.rex != 0 ? gpr8[n] : n < 8 ? gpr8_legacy[n] : gpr8[n];
+        return std::string("%") + name;
+    }
+
+    std::string vector_reg(const decoded& d, int n) {
+        if (d.mmx) {
+            return "%mm" + std::to_string(n & 7);
+        }
+        return (d.vex_l ? "%ymm" : "%xmm") + std::to_string(n);
+    }
+
+    // the r/m operand as memory: "-0x8(%rbp)", "0x2ee5(%rip)", "%fs:0x28", "0x0(,%rax,8)"
+    std::string memory_operand(decoded& d, const x86_symbolizer& symbolize) {
+        const std::uint8_t* p = d.code + d.insn.modrm_offset;
+        std::uint8_t mod = p[0] >> 6, rm = p[0] & 7;
+        const char* const* regs = d.addrsize ? gpr32 : gpr64;
+        std::string out = d.segment != 0 ? std::string("%") + segments[d.segment - 0x60] + ":" : "";
+        std::size_t pos = 1;
+        int base = -1, index = -1, scale = 1;
+        if (rm == 4) {
+            std::uint8_t sib = p[pos++];
+            scale = 1 << (sib >> 6);
+            index = ((sib >> 3) & 7) | (d.rex_x ? 8 : 0);
+            if (index == 4) {
+                index = -1;
+            }
+            base = (sib & 7) | (d.rex_b ? 8 : 0);
+            if (mod == 0 && (sib & 7) == 5) {
+                base = -1;
+            }
+        } else if (!(mod == 0 && rm == 5)) {
+            base = rm | (d.rex_b ? 8 : 0);
+        }
+        std::int64_t disp = 0;
+        std::size_t disp_size = mod == 1 ? 1 : mod == 2 || (mod == 0 && (rm == 5 || base < 0)) ? 4 : 0;
+        if (disp_size != 0) {
+            disp = read_signed(p + pos, disp_size);
+        }
+
+        if (mod == 0 && rm == 5) {
+            std::uint64_t target = d.addr + d.insn.length + disp;
+            d.comment = hex(target) + (symbolize ? symbolize(target) : "");
+            return out + signed_hex(disp) + "(%rip)";
+        }
+        if (disp_size != 0) {
+            out += base < 0 && index < 0 ? hex(static_cast<std::uint32_t>(disp)) : signed_hex(disp);
+        }
+        if (base < 0 && index < 0) {
+            return out;
+        }
+        out += "(";
+        if (base >= 0) {
+            out += std::string("%") + regs[base];
+        }
+        if (index >= 0) {
+            out += std::string(",%") + regs[index] + "," + std::to_string(scale);
+        }
+        return out + ")";
+    }
+
+    std::string operand(decoded& d, operand_kind kind, std::uint8_t flags, const x86_symbolizer& symbolize) {
+        const std::uint8_t* modrm = d.insn.modrm_offset != 0 ? d.code + d.insn.modrm_offset : nullptr;
+        bool reg_form = modrm != nullptr && modrm[0] >> 6 == 3;
+        int reg = modrm != nullptr ? ((modrm[0] >> 3) & 7) | (d.rex_r ? 8 : 0) : 0;
+        int rm = modrm != nullptr ? (modrm[0] & 7) | (d.rex_b ? 8 : 0) : 0;
+        int low = (d.code[d.insn.opcode_offset] & 7) | (d.rex_b ? 8 : 0);
+        int y = d.rex_w ? 64 : 32;
+        auto general = [&](int size, int n) {
+            d.reg_operand = true;
+            return gpr(d, size, n);
+        };
+        auto rm_operand = [&](int size) {
+            if (reg_form) {
+                return (flags & op_indirect ? "*" : "") + general(size, rm);
+            }
+            return (flags & op_indirect ? "*" : "") + memory_operand(d, symbolize);
+        };
+        auto immediate = [&](int size) {
+            std::uint64_t value = read_signed(d.code + d.insn.imm_offset, d.insn.imm_size);
+            return "$" + hex(size == 64 ? value : value & ((std::uint64_t{1} << size) - 1));
+        };
+        switch (kind) {
+            case none: return "";
+            case Eb: return rm_operand(8);
+            case Ew: return rm_operand(16);
+            case Ed: return rm_operand(32);
+            case Ev: return rm_operand(d.size);
+            case Ey: return rm_operand(y);
+            case M: return memory_operand(d, symbolize);
+            case Gb: return general(8, reg);
+            case Gw: return general(16, reg);
+            case Gd: return general(32, reg);
+            case Gv: return general(d.size, reg);
+            case Gy: return general(y, reg);
+            case Zb: return general(8, low);
+            case Zv: return general(d.size, low);
+            case AL: return general(8, 0);
+            case rAX: return general(d.size, 0);
+            case CL: return general(8, 1);
+            case By: return general(y, d.vvvv);
+            case One: return "";
+            case Sw: return std::string("%") + segments[(modrm[0] >> 3) & 7];
+            case Ib: return "$" + hex(d.code[d.insn.imm_offset + (d.insn.imm_size == 3 ? 2 : 0)]);
+            case Ibs: return immediate(d.size);
+            case Iw: return "$" + hex(d.code[d.insn.imm_offset] | d.code[d.insn.imm_offset + 1] << 8);
+            case Iz: case Iv: return immediate(d.size);
+            case Jb: case Jz: {
+                std::uint64_t target = d.addr + d.insn.length + read_signed(d.code + d.insn.rel_offset,
+                                                                            kind == Jb ? 1 : 4);
+                return hex(target) + (symbolize ? symbolize(target) : "");
+            }
+            case Ob: case Ov: {
+                std::uint64_t addr = static_cast<std::uint64_t>(read_signed(d.code + d.insn.imm_offset, d.insn.imm_size));
+                return (d.segment != 0 ? std::string("%") + segments[d.segment - 0x60] + ":" : "") + hex(addr);
+            }
+            case Xb: case Xv: return d.addrsize ? "%ds:(%esi)" : "%ds:(%rsi)";
+            case Yb: case Yv: return d.addrsize ? "%es:(%edi)" : "%es:(%rdi)";
+            case V: return vector_reg(d, reg);
+            case U: return vector_reg(d, rm);
+            case W:
+                if (reg_form && (flags & op_xmm_source)) {
+                    return "%xmm" + std::to_string(rm);
+                }
+                return reg_form ? vector_reg(d, rm) : memory_operand(d, symbolize);
+            case ST: return "%st";
+            case STi: return "%st(" + std::to_string(modrm[0] & 7) + ")";
+            case H: return d.insn.vex != 0 ? vector_reg(d, d.vvvv) : "";
+        }
+        return "";
+    }
+
+    char suffix(int size) {
+        return size == 8 ? 'b' : size == 16 ? 'w' : size == 32 ? 'l' : 'q';
+    }
+}
+
+bool x86_disassemble(const std::uint8_t* code, std::size_t avail, std::uint64_t addr, x86_insn& insn, std::string& text,
+                     const x86_symbolizer& symbolize) {
+    if (!x86_decode(code, avail, insn)) {
+        return false;
+    }
+    decoded d {code, addr, insn};
+    std::size_t pos = 0;
+    for (; is_legacy_prefix(code[pos]); ++pos) {
+        switch (code[pos]) {
+            case 0x66: d.data16 += d.opsize; d.opsize = true; break;
+            case 0x2e: d.cs = true; break;
+            case 0x67: d.addrsize = true; break;
+            case 0xf0: d.lock = true; break;
+            case 0xf2: case 0xf3: d.rep = code[pos]; break;
+            case 0x64: case 0x65: d.segment = code[pos]; break;
+            case 0x3e: d.notrack = true; break;
+        }
+    }
+    if ((code[pos] & 0xf0) == 0x40) {
+        d.rex = code[pos];
+    }
+    d.rex_w = d.rex & 8;
+    d.rex_r = d.rex & 4;
+    d.rex_x = d.rex & 2;
+    d.rex_b = d.rex & 1;
+    std::uint8_t opcode = code[insn.opcode_offset];
+    std::uint8_t reg = insn.modrm_offset != 0 ? (code[insn.modrm_offset] >> 3) & 7 : 0;
+    bool reg_form = insn.modrm_offset != 0 && code[insn.modrm_offset] >> 6 == 3;
+
+    if (insn.vex == 4) {
+        text = "(evex)";
+        return true;
+    }
+    int pp = d.opsize ? 1 : d.rep == 0xf3 ? 2 : d.rep == 0xf2 ? 3 : 0;
+    if (insn.vex != 0) {
+        const std::uint8_t* v = code + insn.opcode_offset - insn.vex;
+        std::uint8_t last = v[insn.vex - 1];    // W vvvv L pp
+        d.rex_r = !(v[1] & 0x80);
+        if (insn.vex == 3) {
+            d.rex_x = !(v[1] & 0x40);
+            d.rex_b = !(v[1] & 0x20);
+            d.rex_w = last & 0x80;
+        }
+        d.vvvv = (~last >> 3) & 15;
+        d.vex_l = last & 4;
+        pp = last & 3;
+    }
+    d.size = d.rex_w ? 64 : d.opsize ? 16 : 32;
+
+    // the mnemonic and its operands, from the tables and the few opcodes that are special
+    opcode_info info;
+    std::string name;
+    bool imm8 = false;          // an SSE op with an immediate after its table operands
+    if (insn.map == 0 && insn.vex == 0) {
+        info = one_byte_info[opcode];
+        if (opcode >= 0xd8 && opcode <= 0xdf) {
+            info = x87(opcode, code[insn.modrm_offset]);
+            if (opcode == 0xdf && code[insn.modrm_offset] == 0xe0) {
+                d.size = 16;
+            }
+        } else if (opcode == 0x90 && d.rep == 0xf3) {
+            info.name = "pause";
+        } else if (opcode == 0x90 && (d.rex_b || d.opsize)) {
+            info = opcode_info{"xchg", {Zv, rAX, none}, 0, 0};    // 90 alone is nop, not xchg %eax,%eax
+        } else if (opcode == 0x98 || opcode == 0x99) {
+            static const char* const names[2][3] = {{"cbtw", "cwtl", "cltq"}, {"cwtd", "cltd", "cqto"}};
+            info.name = names[opcode - 0x98][d.size == 16 ? 0 : d.size == 32 ? 1 : 2];
+        } else if (opcode == 0x63 && !d.rex_w) {
+            info = opcode_info{"movsxd", {Gv, Ed, none}, 0, 0};
+        } else if (opcode >= 0xb8 && opcode <= 0xbf && d.rex_w) {
+            info.name = "movabs";
+        } else if (opcode == 0xff && (reg == 2 || reg == 4)) {
+            info.flags = op_d64 | op_indirect | op_bnd;
+        } else if (opcode == 0xff && reg == 6) {
+            info.flags = op_d64;
+        } else if (opcode == 0xe3 && d.addrsize) {
+            info.name = "jecxz";
+        }
+        if (opcode == 0xf6 || opcode == 0xf7) {
+            if (reg > 1) {
+                info.operands[1] = none;
+            }
+        }
+    } else if (insn.map == 1 && insn.vex == 0) {
+        info = two_byte_info[opcode];
+        if (opcode == 0x1e && d.rep == 0xf3 && reg_form && (code[insn.modrm_offset] == 0xfa || code[insn.modrm_offset] == 0xfb)) {
+            info = opcode_info{code[insn.modrm_offset] == 0xfa ? "endbr64" : "endbr32", {}, 0, 0};
+        } else if ((opcode == 0xb8 || opcode == 0xbc || opcode == 0xbd) && d.rep == 0xf3) {
+            info = opcode_info{opcode == 0xb8 ? "popcnt" : opcode == 0xbc ? "tzcnt" : "lzcnt", {Gv, Ev, none}, 0, 0};
+        } else if (opcode == 0x01 && reg_form) {
+            switch (code[insn.modrm_offset]) {
+                case 0xd0: info.name = "xgetbv"; break;
+                case 0xd1: info.name = "xsetbv"; break;
+                case 0xd5: info.name = "xend"; break;
+                case 0xd6: info.name = "xtest"; break;
+                case 0xf8: info.name = "swapgs"; break;
+                case 0xf9: info.name = "rdtscp"; break;
+            }
+        } else if (opcode == 0xae) {
+            static const char* const memory_forms[] = {"fxsave", "fxrstor", "ldmxcsr", "stmxcsr",
+                                                       "xsave", "xrstor", "xsaveopt", "clflush"};
+            static const char* const register_forms[] = {nullptr, nullptr, nullptr, nullptr,
+                                                         nullptr, "lfence", "mfence", "sfence"};
+            info = reg_form ? opcode_info{register_forms[reg], {}, 0, 0}
+                            : opcode_info{memory_forms[reg], {M, none, none}, 0, 0};
+            if (!reg_form && d.rex_w && reg <= 1) {
+                info.name = reg == 0 ? "fxsave64" : "fxrstor64";
+            }
+        } else if (opcode == 0xc7) {
+            if (reg_form && (reg == 6 || reg == 7)) {
+                info = opcode_info{reg == 6 ? "rdrand" : "rdseed", {Ev, none, none}, 0, 0};
+            } else if (!reg_form && reg == 1) {
+                info = opcode_info{d.rex_w ? "cmpxchg16b" : "cmpxchg8b", {M, none, none}, 0, 0};
+            }
+        }
+    }
+    if (info.group != 0) {
+        info.name = groups[info.group - 1][reg];
+    }
+
+    if (info.name == nullptr && insn.map != 0) {
+        // the prefix-selected tables: legacy SSE, or the VEX forms with a "v" in front
+        const sse_table& table = insn.map == 1 ? sse_ops : insn.map == 2 ? sse38_ops : sse3a_ops;
+        const sse_info& s = table[opcode];
+        const char* n = s.names[pp];
+        bool bmi = insn.map != 1 && (opcode & 0xf0) == 0xf0;
+        if (insn.vex == 0 && insn.map == 2 && (opcode == 0xf0 || opcode == 0xf1) && pp != 2) {
+            // not BMI without VEX: movbe, and crc32 with f2
+            bmi = false;
+            if (pp == 3) {
+                n = opcode == 0xf0 ? "crc32b" : "crc32";
+                info = opcode_info{n, {opcode == 0xf0 ? Gd : Gy, opcode == 0xf0 ? Eb : Ev, none},
+                                   static_cast<std::uint8_t>(opcode == 0xf0 ? 0 : op_dest_suffix), 0};
+            } else {
+                n = "movbe";
+                info = opcode_info{n, {opcode == 0xf0 ? Gv : M, opcode == 0xf0 ? M : Gv, none}, 0, 0};
+            }
+        } else if (insn.vex != 0 && insn.map == 1 && opcode == 0x77) {
+            n = d.vex_l ? "vzeroall" : "vzeroupper";
+        } else if (insn.vex != 0 && insn.map == 2 && opcode == 0xf3 && reg >= 1 && reg <= 3) {
+            static const char* const bmi1[] = {nullptr, "blsr", "blsmsk", "blsi"};
+            info = opcode_info{bmi1[reg], {By, Ey, none}, 0, 0};
+            n = info.name;
+        } else if (insn.map == 1 && insn.vex == 0 && (opcode == 0x12 || opcode == 0x16) && pp == 0 && reg_form) {
+            n = opcode == 0x12 ? "movhlps" : "movlhps";
+            info = opcode_info{n, {V, W, none}, 0, 0};
+        } else if (insn.map == 1 && opcode == 0x7e && pp == 2) {
+            n = "movq";
+            info = opcode_info{n, {V, W, none}, 0, 0};
+        } else if (insn.map == 1 && (opcode >= 0x71 && opcode <= 0x73) && reg_form) {
+            static const char* const shifts[3][8] = {
+                {nullptr, nullptr, "psrlw", nullptr, "psraw", nullptr, "psllw", nullptr},
+                {nullptr, nullptr, "psrld", nullptr, "psrad", nullptr, "pslld", nullptr},
+                {nullptr, nullptr, "psrlq", "psrldq", nullptr, nullptr, "psllq", "pslldq"},
+            };
+            n = pp <= 1 ? shifts[opcode - 0x71][reg] : nullptr;
+            info = opcode_info{n, {H, U, none}, op_mmx, 0};
+            imm8 = true;
+        } else {
+            info = opcode_info{n, {s.operands[0], s.operands[1], s.operands[2]}, s.flags, 0};
+            imm8 = (insn.map == 3 && opcode != 0xf0)
+                   || (insn.map == 1 && (opcode == 0x70 || opcode == 0xc2 || (opcode >= 0xc4 && opcode <= 0xc6)));
+            if (insn.map == 3 && opcode == 0xf0) {
+                info.operands[2] = Ib;
+            }
+        }
+        if (n == nullptr || (insn.vex == 0 && bmi) || (insn.vex == 0 && (insn.map != 1 && n[0] == 'v'))) {
+            text = "(bad)";
+            return true;
+        }
+        d.mmx = (info.flags & op_mmx) && pp == 0 && insn.vex == 0;
+        if ((opcode == 0x6e || opcode == 0x7e) && insn.map == 1 && d.rex_w && pp < 2) {
+            n = "movq";
+        }
+        if (insn.map == 3 && (opcode == 0x16 || opcode == 0x22) && d.rex_w) {
+            n = opcode == 0x16 ? "pextrq" : "pinsrq";
+        }
+        name = insn.vex != 0 && !bmi && n[0] != 'v' ? std::string("v") + n : n;
+        if (insn.map == 1 && opcode == 0xc2 && code[insn.imm_offset] < 8) {
+            // the predicate goes in the name: cmpltsd
+            static const char* const predicates[] = {"eq", "lt", "le", "unord", "neq", "nlt", "nle", "ord"};
+            name.insert(name.size() - 2, predicates[code[insn.imm_offset]]);
+            imm8 = false;
+        }
+        if (insn.vex == 0) {
+            // H only exists with VEX: without, the destination doubles as the first source
+            auto end = std::remove(std::begin(info.operands), std::end(info.operands), H);
+            std::fill(end, std::end(info.operands), none);
+        }
+    } else if (info.name == nullptr) {
+        text = "(bad)";
+        return true;
+    } else {
+        name = info.name;
+        if (d.opsize && d.rex_w) {
+            ++d.data16;     // REX.W wins, the 66 is for nothing
+        }
+    }
+
+    if (info.flags & op_d64) {
+        d.size = d.opsize ? 16 : 64;
+    }
+
+    // operands, destination first; VEX with an immediate can have four
+    operand_kind kinds[4] = {info.operands[0], info.operands[1], info.operands[2], none};
+    if (imm8) {
+        *std::find(std::begin(kinds), std::end(kinds), none) = Ib;
+    }
+    std::string operands[4];
+    for (int i = 0; i < 4; ++i) {
+        operands[i] = operand(d, kinds[i], info.flags, symbolize);
+    }
+    int memory_size = 0;
+    for (auto kind : info.operands) {
+        if (((kind == Eb || kind == Ew || kind == Ed || kind == Ev || kind == Ey) && !reg_form) || kind == Xv || kind == Yv) {
+            memory_size = kind == Eb ? 8 : kind == Ew ? 16 : kind == Ed ? 32 : kind == Ey ? (d.rex_w ? 64 : 32) : d.size;
+        }
+    }
+    if ((info.flags & op_suffix) && !d.reg_operand && memory_size != 0) {
+        name += suffix(memory_size);
+    }
+    if (info.flags & op_dest_suffix) {
+        name += suffix(d.size);
+    }
+
+    std::string prefix;
+    for (int i = 0; i < d.data16; ++i) {
+        prefix += "data16 ";
+    }
+    if (d.cs && (info.flags & op_bnd) == 0) {
+        prefix += "cs ";
+    }
+    if (d.lock) {
+        prefix += "lock ";
+    }
+    if ((info.flags & op_string) && d.rep != 0) {
+        prefix += d.rep == 0xf2 ? "repnz " : opcode == 0xa6 || opcode == 0xa7 || opcode >= 0xae ? "repz " : "rep ";
+    } else if ((info.flags & op_bnd) && d.rep == 0xf2) {
+        prefix += "bnd ";
+    } else if (opcode == 0xc3 && insn.map == 0 && d.rep == 0xf3) {
+        prefix += "repz ";
+    }
+    if (d.notrack && (info.flags & op_indirect)) {
+        prefix = "notrack " + prefix;
+    }
+
+    text = prefix + name;
+    std::string list;
+    for (int i = 3; i >= 0; --i) {
+        if (!operands[i].empty()) {
+            list += (list.empty() ? "" : ",") + operands[i];
+        }
+    }
+    if (!list.empty()) {
+        text.append(text.size() < 6 ? 6 - text.size() : 0, ' ');
+        text += " " + list;
+    }
+    if (!d.comment.empty()) {
+        text += "        # " + d.comment;
+    }
+    return true;
+}
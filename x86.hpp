@@ -0,0 +1,51 @@
+#ifndef TDB_X86_HPP
+#define TDB_X86_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// what the debugger needs to know about one x86-64 instruction to move it somewhere else or to follow
+// where it goes: its length, where the fields relative to its own address are, and whether it branches
+struct x86_insn {
+    enum branch_kind : std::uint8_t {
+        no_branch,
+        rel8,       // jmp/jcc/loop with an 8-bit displacement
+        rel32,      // jmp/jcc/call with a 32-bit displacement
+    };
+
+    std::uint8_t length = 0;
+    std::uint8_t opcode_offset = 0;     // of the opcode byte, after prefixes, REX and VEX/EVEX
+    std::uint8_t disp_offset = 0;       // of the disp32 of a rip-relative operand, 0 if there is none
+    branch_kind branch = no_branch;
+    std::uint8_t rel_offset = 0;        // of the branch displacement
+    bool call = false;
+    bool indirect = false;              // ret, or jmp/call through a register or memory: the target is only known when it runs
+    std::uint8_t map = 0;               // 0 for the one-byte opcodes, 1 for 0f, 2 for 0f 38, 3 for 0f 3a
+    std::uint8_t vex = 0;               // the size of a VEX (2, 3) or EVEX (4) prefix, 0 without
+    std::uint8_t modrm_offset = 0;      // 0 if there is no ModRM byte
+    std::uint8_t imm_offset = 0;        // of the immediate operand (not a branch displacement)
+    std::uint8_t imm_size = 0;
+};
+
+// decodes the instruction at code (at most `avail` bytes). false if it is invalid in 64-bit mode or cut off
+bool x86_decode(const std::uint8_t* code, std::size_t avail, x86_insn& insn);
+
+// names an address for the disassembly, " <main+4>"; empty if there is nothing to say
+using x86_symbolizer = std::function<std::string(std::uint64_t addr)>;
+
+// decodes the instruction at code, which is at `addr` in the inferior, and writes it out in AT&T syntax the way
+// objdump does: "mov    0x2ee5(%rip),%eax        # 0x404010 <counter>". false if it doesn't decode.
+// opcodes without a mnemonic here (x87, EVEX, rare system instructions) still get their length right
+bool x86_disassemble(const std::uint8_t* code, std::size_t avail, std::uint64_t addr, x86_insn& insn, std::string& text,
+                     const x86_symbolizer& symbolize = nullptr);
+
+// appends whole instructions of code (len bytes, taken from address `from`) to out, whose first byte
+// will be at address `to` in the inferior, with rip-relative operands and rel32 branches adjusted.
+// false if one of them can't be moved: an 8-bit branch, or a displacement that no longer fits in 32 bits
+bool x86_relocate(const std::uint8_t* code, std::size_t len, std::uint64_t from, std::uint64_t to,
+                  std::vector<std::uint8_t>& out);
+
+#endif